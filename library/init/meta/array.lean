@@ -0,0 +1,30 @@
+/-
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+Authors: Leonardo de Moura
+-/
+prelude
+import init.list init.nat
+
+/- Arrays implemented by the VM. The operations write, push_back and pop_back
+   update the array in place when it is not shared. -/
+meta_constant {u} array : Type u → Type (max u 1)
+
+namespace array
+meta_constant mk_empty (A : Type) : array A
+meta_constant mk {A : Type} : nat → A → array A
+meta_constant size {A : Type} : array A → nat
+meta_constant read {A : Type} : array A → nat → A
+meta_constant write {A : Type} : array A → nat → A → array A
+meta_constant push_back {A : Type} : array A → A → array A
+meta_constant pop_back {A : Type} : array A → array A
+meta_constant to_list {A : Type} : array A → list A
+
+open list
+meta_definition of_list_aux {A : Type} : list A → array A → array A
+| []      a := a
+| (v::vs) a := of_list_aux vs (push_back a v)
+
+meta_definition of_list {A : Type} (l : list A) : array A :=
+of_list_aux l (mk_empty A)
+end array
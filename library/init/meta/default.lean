@@ -4,7 +4,7 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Authors: Leonardo de Moura
 -/
 prelude
-import init.meta.name init.meta.options init.meta.format init.meta.rb_map
+import init.meta.name init.meta.options init.meta.format init.meta.rb_map init.meta.array
 import init.meta.level init.meta.expr init.meta.environment init.meta.attribute
 import init.meta.tactic init.meta.contradiction_tactic init.meta.constructor_tactic
 import init.meta.injection_tactic init.meta.relation_tactics init.meta.fun_info
@@ -7,3 +7,7 @@ import init.string
 /- This function has a native implementation that tracks time. -/
 definition timeit {A : Type} (s : string) (f : unit → A) : A :=
 f ()
+
+/- This function has a native implementation that returns the statistics collected by the VM profiler
+   (see `lean --profile-vm`), or the empty string if the VM profiler is disabled. -/
+meta_constant vm_profile_report : unit → string
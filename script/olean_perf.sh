@@ -0,0 +1,35 @@
+#!/usr/bin/env bash
+# Script for measuring the .olean round-trip of the standard library:
+# it (re)generates every .olean file, reports their total size, and then
+# imports all of them into a single environment N times (default 5).
+# The "check" timings import with trust level 0, which decodes and
+# type checks every declaration value instead of decoding them lazily.
+# It assumes the lean binary is at the bin directory
+# It assumes the program realpath is available
+REALPATH=realpath
+N=${1:-5}
+
+MY_PATH="`dirname \"$0\"`"
+LEAN=`$REALPATH $MY_PATH/../bin/lean`
+LIB=`$REALPATH $MY_PATH/../library`
+
+find $LIB -name '*.olean' -delete
+TIMEFORMAT="write %R"
+time $LEAN --make `find $LIB -name '*.lean'` > /dev/null
+echo "size `find $LIB -name '*.olean' | xargs cat | wc -c`"
+
+ALL=`mktemp -d`/all.lean
+for f in `find $LIB -name '*.olean' | sort`; do
+  m=${f#$LIB/}
+  m=${m%.olean}
+  echo "import ${m//\//.}" >> $ALL
+done
+TIMEFORMAT="read %R"
+for i in `seq 1 $N`; do
+  time $LEAN $ALL > /dev/null
+done
+TIMEFORMAT="check %R"
+for i in `seq 1 $N`; do
+  time $LEAN -t0 $ALL > /dev/null
+done
+rm -rf `dirname $ALL`
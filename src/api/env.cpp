@@ -96,7 +96,7 @@ lean_bool lean_env_forget(lean_env e, lean_env * r, lean_exception * ex) {
 lean_bool lean_env_for_each_decl(lean_env e, void (*f)(lean_decl), lean_exception * ex) {
     LEAN_TRY;
     check_nonnull(e);
-    to_env_ref(e).for_each_declaration([&](declaration const & d) {
+    to_env_ref(e).for_each_declaration_by_name([&](declaration const & d) {
             f(of_decl(new declaration(d)));
         });
     return lean_true;
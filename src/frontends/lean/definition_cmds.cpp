@@ -4,10 +4,15 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
+#include <string>
+#include <vector>
 #include "util/timeit.h"
+#include "util/profiler.h"
 #include "kernel/type_checker.h"
 #include "kernel/declaration.h"
 #include "kernel/replace_fn.h"
+#include "kernel/instantiate.h"
+#include "kernel/abstract.h"
 #include "library/trace.h"
 #include "library/explicit.h"
 #include "library/typed_expr.h"
@@ -212,6 +217,7 @@ static void display_pos(std::ostream & out, parser const & p, pos_info const & p
 }
 
 static expr_pair elaborate_definition(parser & p, elaborator & elab, def_cmd_kind kind, expr const & fn, expr const & val, pos_info const & pos) {
+    profile_scope scope("elaboration");
     if (p.profiling()) {
         std::ostringstream msg;
         display_pos(msg, p, pos);
@@ -304,6 +310,27 @@ static expr fix_rec_fn_name(expr const & e, name const & c_name, name const & c_
         });
 }
 
+static environment add_definition(parser & p, environment const & env, certified_declaration const & cdef,
+                                  def_cmd_kind kind, name const & c_name, bool is_private, bool is_protected,
+                                  bool is_noncomputable, decl_attributes attrs, pos_info const & pos) {
+    name c_real_name    = cdef.get_declaration().get_name();
+    environment new_env = module::add(env, cdef);
+
+    check_noncomputable(p, new_env, c_name, c_real_name, is_noncomputable);
+
+    if (is_protected)
+        new_env = add_protected(new_env, c_real_name);
+
+    new_env = add_alias(new_env, is_protected, c_name, c_real_name);
+
+    if (!is_private) {
+        new_env = ensure_decl_namespaces(new_env, c_real_name);
+    }
+
+    new_env = attrs.apply(new_env, p.ios(), c_real_name);
+    return compile_decl(p, new_env, kind, is_noncomputable, c_name, c_real_name, pos);
+}
+
 static pair<environment, name>
 declare_definition(parser & p, environment const & env, def_cmd_kind kind, buffer<name> const & lp_names,
                    name const & c_name, expr const & type, expr const & _val,
@@ -321,21 +348,8 @@ declare_definition(parser & p, environment const & env, def_cmd_kind kind, buffe
         mk_theorem(c_real_name, to_list(lp_names), type, val) :
         mk_definition(new_env, c_real_name, to_list(lp_names), type, val, use_conv_opt, is_trusted);
     auto cdef         = check(p, new_env, c_name, def, pos);
-    new_env           = module::add(new_env, cdef);
-
-    check_noncomputable(p, new_env, c_name, c_real_name, is_noncomputable);
-
-    if (is_protected)
-        new_env = add_protected(new_env, c_real_name);
-
-    new_env = add_alias(new_env, is_protected, c_name, c_real_name);
-
-    if (!is_private) {
-        new_env = ensure_decl_namespaces(new_env, c_real_name);
-    }
-
-    new_env = attrs.apply(new_env, p.ios(), c_real_name);
-    new_env = compile_decl(p, new_env, kind, is_noncomputable, c_name, c_real_name, pos);
+    new_env           = add_definition(p, new_env, cdef, kind, c_name, is_private, is_protected, is_noncomputable,
+                                       attrs, pos);
     return mk_pair(new_env, c_real_name);
 }
 
@@ -370,6 +384,166 @@ static expr fix_rec_fn_macro_args(elaborator & elab, name const & fn, buffer<exp
     return fix_rec_fn_macro_args_fn(params, fns)(val);
 }
 
+/* Auxiliary functional object for replacing references to the declarations \c aux_decls
+   with their values. The theorems elaborated by the theorem_queue are type checked
+   with respect to the environment available when the task was created. So, any
+   auxiliary declaration created when elaborating the proof (e.g., by tactics) must be unfolded. */
+class unfold_aux_decls_fn {
+    environment const & m_env;
+    name_set            m_aux_decls;
+    name_map<expr>      m_values;
+
+    expr get_value(name const & n) {
+        if (auto v = m_values.find(n))
+            return *v;
+        declaration d = m_env.get(n);
+        if (!d.is_definition())
+            throw exception(sstream() << "failed to elaborate theorem in parallel, auxiliary declaration '" << n
+                            << "' is not a definition");
+        expr v = visit(d.get_value());
+        m_values.insert(n, v);
+        return v;
+    }
+
+    expr visit(expr const & e) {
+        return replace(e, [&](expr const & c, unsigned) {
+                if (is_constant(c) && m_aux_decls.contains(const_name(c))) {
+                    declaration d = m_env.get(const_name(c));
+                    return some_expr(instantiate_univ_params(get_value(const_name(c)), d.get_univ_params(),
+                                                             const_levels(c)));
+                }
+                return none_expr();
+            });
+    }
+
+public:
+    /* \pre \c env is a descendant of \c old_env */
+    unfold_aux_decls_fn(environment const & env, environment const & old_env):m_env(env) {
+        list<name> const & old_decls = get_curr_module_decl_names(old_env);
+        list<name> decls = get_curr_module_decl_names(env);
+        while (!is_eqp(decls, old_decls) && !is_nil(decls)) {
+            m_aux_decls.insert(head(decls));
+            decls = tail(decls);
+        }
+    }
+
+    expr operator()(expr const & e) {
+        if (m_aux_decls.empty())
+            return e;
+        return visit(e);
+    }
+};
+
+/* Elaborate theorem in the theorem_queue. Its statement is elaborated by the main thread, and the theorem is
+   added to the environment as an axiom. The proof is elaborated and type checked by an auxiliary thread,
+   using the statement and parameters elaborated by the main thread.
+   The parser replaces the axiom with the actual theorem when the task is finished (see parser::process_finished_theorems). */
+static environment theorem_cmd_async(parser & p, bool is_private, bool is_protected, decl_attributes const & attrs,
+                                     buffer<name> const & lp_names, buffer<expr> const & params,
+                                     expr const & fn, expr const & val, pos_info const & header_pos) {
+    environment env = p.env();
+    options opts    = p.get_options();
+    /* Elaborate statement */
+    elaborator elab(env, opts, metavar_context(), local_context());
+    buffer<expr> new_params;
+    elaborate_params(elab, params, new_params);
+    elab.set_instance_fingerprint();
+    expr new_fn = fn;
+    expr new_val = val;
+    replace_params(params, new_params, new_fn, new_val);
+    buffer<expr> type_buffer;
+    type_buffer.push_back(elab.mk_pi(new_params, elab.elaborate_type(mlocal_type(new_fn))));
+    buffer<name> all_lp_names;
+    all_lp_names.append(lp_names);
+    buffer<name> implicit_lp_names;
+    elab.finalize(type_buffer, implicit_lp_names, true, false);
+    all_lp_names.append(implicit_lp_names);
+    expr type   = type_buffer[0];
+    name c_name = mlocal_name(fn);
+    auto env_n  = mk_real_name(elab.env(), c_name, is_private, header_pos);
+    environment thm_env  = env_n.first;
+    name c_real_name     = env_n.second;
+    level_param_names ls = to_list(all_lp_names);
+    auto cax = check(p, thm_env, c_name, mk_axiom(c_real_name, ls, type), header_pos);
+    environment new_env = add_definition(p, thm_env, cax, Theorem, c_name, is_private, is_protected, false,
+                                         attrs, header_pos);
+
+    /* Elaborate proof */
+    bool profiling = p.profiling();
+    parser_pos_provider pos_provider = p.get_parser_pos_provider(header_pos);
+    std::vector<expr> pre_params(params.begin(), params.end());
+    profile_context pctx = get_profile_context();
+    p.get_theorem_queue()->add(c_name, header_pos, [=](io_state const & ios, theorem_queue_entry & e) {
+            profile_context_scope scope0(pctx);
+            scoped_expr_caching disable(false);
+            parser_pos_provider pp = pos_provider;
+            scope_pos_info_provider scope1(pp);
+            scope_global_ios scope2(ios);
+            type_context tc(env, opts);
+            scope_trace_env scope3(env, opts, tc);
+            declaration_info_scope scope4(env, is_private, false, Theorem);
+            elaborator thm_elab(env, opts, metavar_context(), local_context());
+            /* The parameters are not elaborated again, we create local constants for them using
+               the binders of the elaborated statement. */
+            buffer<expr> thm_params, thm_new_params;
+            thm_params.append(pre_params.size(), pre_params.data());
+            expr thm_type = type;
+            for (unsigned i = 0; i < thm_params.size(); i++) {
+                lean_assert(is_pi(thm_type));
+                expr new_param = thm_elab.push_local(binding_name(thm_type), binding_domain(thm_type),
+                                                     binding_info(thm_type));
+                thm_new_params.push_back(new_param);
+                thm_type = instantiate(binding_body(thm_type), new_param);
+            }
+            thm_elab.set_instance_fingerprint();
+            expr thm_fn  = fn;
+            expr thm_val = val;
+            replace_params(thm_params, thm_new_params, thm_fn, thm_val);
+            expr thm_new_fn = update_mlocal(thm_fn, thm_type);
+            thm_val = replace_local(thm_val, thm_fn, thm_new_fn);
+            {
+                profile_scope scope5("elaboration");
+                if (profiling) {
+                    std::ostringstream msg;
+                    display_pos(msg, pp.get_file_name(), header_pos.first, header_pos.second);
+                    msg << " elaboration time for " << c_name;
+                    timeit timer(ios.get_diagnostic_stream(), msg.str().c_str(), LEAN_PROFILE_THRESHOLD);
+                    thm_val = thm_elab.elaborate_with_type(thm_val, mk_as_is(thm_type)).first;
+                } else {
+                    thm_val = thm_elab.elaborate_with_type(thm_val, mk_as_is(thm_type)).first;
+                }
+            }
+            buffer<expr> val_buffer;
+            val_buffer.push_back(thm_elab.mk_lambda(thm_new_params, thm_val));
+            buffer<name> new_lp_names;
+            thm_elab.finalize(val_buffer, new_lp_names, true, false);
+            if (!new_lp_names.empty())
+                throw exception(sstream() << "failed to elaborate theorem '" << c_name << "' in parallel, "
+                                << "the proof contains universe levels that do not occur in its statement");
+            thm_val = unfold_aux_decls_fn(thm_elab.env(), env)(val_buffer[0]);
+            declaration thm = mk_theorem(c_real_name, ls, type, thm_val);
+            if (profiling) {
+                std::ostringstream msg;
+                display_pos(msg, pp.get_file_name(), header_pos.first, header_pos.second);
+                msg << " type checking time for " << c_name;
+                timeit timer(ios.get_diagnostic_stream(), msg.str().c_str(), LEAN_PROFILE_THRESHOLD);
+                e.m_thm = ::lean::check(thm_env, thm);
+            } else {
+                e.m_thm = ::lean::check(thm_env, thm);
+            }
+        });
+    return add_local_ref(p, new_env, c_name, c_real_name, all_lp_names, params);
+}
+
+/* Return the pre-elaboration type and value of a definition as closed terms. They are the key used to
+   retrieve the elaborated definition from the definition cache. */
+static expr_pair mk_cache_key(buffer<expr> const & params, expr const & fn, expr const & val) {
+    buffer<expr> locals;
+    locals.append(params);
+    locals.push_back(fn);
+    return mk_pair(Pi(params, mlocal_type(fn)), Fun(locals, val));
+}
+
 environment definition_cmd_core(parser & p, def_cmd_kind kind, bool is_private, bool is_protected, bool is_noncomputable,
                                 decl_attributes attrs) {
     buffer<name> lp_names;
@@ -379,12 +553,31 @@ environment definition_cmd_core(parser & p, def_cmd_kind kind, bool is_private,
     declaration_info_scope scope(p.env(), is_private, is_noncomputable, kind);
     std::tie(fn, val) = parse_definition(p, lp_names, params, kind == def_cmd_kind::Example);
     if (p.used_sorry()) p.declare_sorry();
+    profile_scope scope2("declaration", get_namespace(p.env()) + mlocal_name(fn));
+    if (kind == Theorem && p.get_theorem_queue() && !is_equations(val))
+        return theorem_cmd_async(p, is_private, is_protected, attrs, lp_names, params, fn, val, header_pos);
+    name c_name     = mlocal_name(fn);
+    bool is_meta    = (kind == def_cmd_kind::MetaDefinition);
+    bool is_trusted = !is_meta;
+    expr pre_type, pre_value;
+    if (p.has_cache()) {
+        std::tie(pre_type, pre_value) = mk_cache_key(params, fn, val);
+        if (auto r = p.find_cached_definition(c_name, pre_type, pre_value, is_trusted)) {
+            if (kind == Example) return p.env();
+            level_param_names ls; expr type;
+            std::tie(ls, type, val) = *r;
+            lp_names.clear();
+            to_buffer(ls, lp_names);
+            auto env_n  = declare_definition(p, p.env(), kind, lp_names, c_name, type, val,
+                                             is_meta, is_private, is_protected, is_noncomputable, attrs, header_pos);
+            return add_local_ref(p, env_n.first, c_name, env_n.second, lp_names, params);
+        }
+    }
     elaborator elab(p.env(), p.get_options(), metavar_context(), local_context());
     buffer<expr> new_params;
     elaborate_params(elab, params, new_params);
     elab.set_instance_fingerprint();
     replace_params(params, new_params, fn, val);
-    bool is_meta = (kind == def_cmd_kind::MetaDefinition);
     expr type;
     std::tie(val, type) = elaborate_definition(p, elab, kind, fn, val, header_pos);
     if (is_meta) {
@@ -397,8 +590,11 @@ environment definition_cmd_core(parser & p, def_cmd_kind kind, bool is_private,
         val = get_equations_result(val, 0);
     }
     finalize_definition(elab, new_params, type, val, lp_names);
+    /* We only cache definitions that did not create auxiliary declarations (e.g., equation compiler
+       auxiliary definitions), since they would be missing when the cached value is reused. */
+    if (p.has_cache() && is_eqp(elab.env(), p.env()))
+        p.cache_definition(c_name, pre_type, pre_value, to_list(lp_names), type, val, is_trusted);
     if (kind == Example) return p.env();
-    name c_name = mlocal_name(fn);
     auto env_n  = declare_definition(p, elab.env(), kind, lp_names, c_name, type, val,
                                      is_meta, is_private, is_protected, is_noncomputable, attrs, header_pos);
     environment new_env = env_n.first;
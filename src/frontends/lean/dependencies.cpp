@@ -7,6 +7,7 @@ Author: Leonardo de Moura
 #include <utility>
 #include <fstream>
 #include <string>
+#include <vector>
 #include "util/sstream.h"
 #include "util/lean_path.h"
 #include "frontends/lean/scanner.h"
@@ -14,7 +15,7 @@ Author: Leonardo de Moura
 namespace lean {
 
 
-bool display_deps(environment const & env, std::ostream & out, std::ostream & err, char const * fname) {
+bool get_deps(environment const & env, std::ostream & err, char const * fname, std::vector<std::string> & deps) {
     name import("import");
     name prelude("prelude");
     name period(".");
@@ -30,18 +31,11 @@ bool display_deps(environment const & env, std::ostream & out, std::ostream & er
     bool import_args   = false;
     bool ok            = true;
     bool is_prelude    = false;
-    auto display_dep = [&](optional<unsigned> const & k, name const & f) {
+    auto add_dep = [&](optional<unsigned> const & k, name const & f) {
         import_args = true;
         try {
-            std::string m_name = find_file(base, k, name_to_file(f), {".lean", ".hlean", ".olean", ".lua"});
-            int last_idx = m_name.find_last_of(".");
-            std::string rawname = m_name.substr(0, last_idx);
-            std::string ext = m_name.substr(last_idx);
-            if (ext == ".lean" || ext == ".hlean")
-                m_name = rawname + ".olean";
-            display_path(out, m_name);
+            deps.push_back(find_file(base, k, name_to_file(f), {".lean", ".hlean", ".olean", ".lua"}));
             import_prefix = true;
-            out << "\n";
         } catch (exception & new_ex) {
             err << "error: file '" << name_to_file(s.get_name_val()) << "' not found in the LEAN_PATH" << std::endl;
             ok  = false;
@@ -57,7 +51,7 @@ bool display_deps(environment const & env, std::ostream & out, std::ostream & er
         }
         if (t == scanner::token_kind::Eof) {
             if (!is_prelude)
-                display_dep(optional<unsigned>(), name("init"));
+                add_dep(optional<unsigned>(), name("init"));
             return ok;
         } else if (t == scanner::token_kind::CommandKeyword && s.get_token_info().value() == prelude) {
             is_prelude = true;
@@ -70,7 +64,7 @@ bool display_deps(environment const & env, std::ostream & out, std::ostream & er
             else
                 k = *k + 1;
         } else if ((import_prefix || import_args) && t == scanner::token_kind::Identifier) {
-            display_dep(k, s.get_name_val());
+            add_dep(k, s.get_name_val());
             k = optional<unsigned>();
         } else {
             import_args   = false;
@@ -78,4 +72,19 @@ bool display_deps(environment const & env, std::ostream & out, std::ostream & er
         }
     }
 }
+
+bool display_deps(environment const & env, std::ostream & out, std::ostream & err, char const * fname) {
+    std::vector<std::string> deps;
+    bool ok = get_deps(env, err, fname, deps);
+    for (std::string m_name : deps) {
+        int last_idx = m_name.find_last_of(".");
+        std::string rawname = m_name.substr(0, last_idx);
+        std::string ext = m_name.substr(last_idx);
+        if (ext == ".lean" || ext == ".hlean")
+            m_name = rawname + ".olean";
+        display_path(out, m_name);
+        out << "\n";
+    }
+    return ok;
+}
 }
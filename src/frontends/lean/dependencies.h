@@ -5,9 +5,16 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Author: Leonardo de Moura
 */
 #include <fstream>
+#include <string>
+#include <vector>
 #include "kernel/environment.h"
 
 namespace lean {
+/** \brief Store in \c deps the files imported by the .lean file \c fname. Source files (.lean and .hlean) are
+    preferred over .olean files. Return false if \c fname cannot be read or an import cannot be found,
+    the problems are reported in \c err. */
+bool get_deps(environment const & env, std::ostream & err, char const * fname, std::vector<std::string> & deps);
+
 /** \brief Display in \c out all files the .lean file \c fname depends on */
 bool display_deps(environment const & env, std::ostream & out, std::ostream & err, char const * fname);
 }
@@ -6,6 +6,7 @@ Author: Leonardo de Moura
 */
 #include <string>
 #include "util/flet.h"
+#include "util/profiler.h"
 #include "kernel/find_fn.h"
 #include "kernel/for_each_fn.h"
 #include "kernel/replace_fn.h"
@@ -1921,6 +1922,7 @@ tactic_state elaborator::mk_tactic_state_for(expr const & mvar) {
 }
 
 void elaborator::invoke_tactic(expr const & mvar, expr const & tactic) {
+    profile_scope scope("tactic execution");
     expr const & ref = mvar;
     /* Build initial state */
     trace_elab(tout() << "executing tactic at " << pos_string_for(ref) << "\n";);
@@ -0,0 +1,286 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#include <string>
+#include <vector>
+#include <fstream>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "util/sstream.h"
+#include "util/thread.h"
+#include "util/interrupt.h"
+#include "util/lean_path.h"
+#include "util/realpath.h"
+#include "library/module.h"
+#include "library/type_context.h"
+#include "library/error_handling.h"
+#include "frontends/lean/dependencies.h"
+#include "frontends/lean/make.h"
+
+namespace lean {
+/* Modification time as (seconds, nanoseconds), ordered lexicographically. */
+typedef std::pair<time_t, long> file_mtime;
+
+/* Return the modification time of the given file, or none if it does not exist.
+   The nanosecond part is zero on platforms where it is not available. */
+static optional<file_mtime> get_mtime(std::string const & fname) {
+    struct stat st;
+    if (stat(fname.c_str(), &st) != 0)
+        return optional<file_mtime>();
+#if defined(__APPLE__)
+    return optional<file_mtime>(st.st_mtimespec.tv_sec, st.st_mtimespec.tv_nsec);
+#elif defined(LEAN_WINDOWS) && !defined(LEAN_CYGWIN)
+    return optional<file_mtime>(st.st_mtime, 0);
+#else
+    return optional<file_mtime>(st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+#endif
+}
+
+static bool is_source_file(std::string const & fname) {
+    return is_lean_file(fname) || is_hlean_file(fname);
+}
+
+static std::string get_olean_file(std::string const & fname) {
+    return fname.substr(0, fname.find_last_of(".")) + ".olean";
+}
+
+class make_fn {
+    struct module {
+        std::string           m_fname;
+        std::string           m_olean;
+        std::vector<unsigned> m_dependents;
+        bool                  m_needs_build;
+        bool                  m_failed;
+        /* Number of imports that still need to be built. */
+        unsigned              m_num_pending;
+        module(std::string const & fname):
+            m_fname(fname), m_olean(get_olean_file(fname)), m_needs_build(false), m_failed(false),
+            m_num_pending(0) {}
+    };
+
+    environment                               m_env;
+    io_state                                  m_ios;
+    unsigned                                  m_num_threads;
+    definition_cache *                        m_cache;
+    keep_theorem_mode                         m_tmode;
+    import_cache                              m_import_cache;
+    std::vector<module>                       m_modules;
+    std::unordered_map<std::string, unsigned> m_module_idx;
+    std::vector<bool>                         m_visiting;
+    bool                                      m_ok;
+    mutex                                     m_mutex;
+    condition_variable                        m_cv;
+    std::vector<unsigned>                     m_ready;         // modules whose imports have been built
+    unsigned                                  m_num_remaining; // modules that still need to be processed
+    bool                                      m_stop;
+    mutex                                     m_output_mutex;
+
+    /* Add the module \c fname and its imports to the import graph, and decide whether it needs to be built. */
+    unsigned visit(std::string const & fname) {
+        auto it = m_module_idx.find(fname);
+        if (it != m_module_idx.end()) {
+            if (m_visiting[it->second])
+                throw exception(sstream() << "circular dependency detected at '" << fname << "'");
+            return it->second;
+        }
+        unsigned idx = m_modules.size();
+        m_modules.push_back(module(fname));
+        m_visiting.push_back(true);
+        m_module_idx.insert(mk_pair(fname, idx));
+        std::vector<std::string> deps;
+        std::ostream & err = m_ios.get_regular_stream();
+        optional<file_mtime> src_mtime   = get_mtime(fname);
+        optional<file_mtime> olean_mtime = get_mtime(m_modules[idx].m_olean);
+        /* The .olean is stale unless it is strictly newer than the source; equal times may hide an edit
+           made within the timestamp resolution. */
+        bool needs_build = !olean_mtime || !src_mtime || *src_mtime >= *olean_mtime;
+        if (!src_mtime) {
+            err << "failed to open file '" << fname << "'" << std::endl;
+            m_ok        = false;
+            m_modules[idx].m_failed = true;
+        } else if (!get_deps(m_env, err, fname.c_str(), deps)) {
+            /* The module and the modules that depend on it are not processed. */
+            m_ok        = false;
+            needs_build = true;
+            m_modules[idx].m_failed = true;
+        }
+        for (std::string const & dep : deps) {
+            std::string dep_olean = dep;
+            if (is_source_file(dep)) {
+                unsigned dep_idx = visit(dep);
+                module & d = m_modules[dep_idx];
+                if (d.m_needs_build) {
+                    needs_build = true;
+                    m_modules[idx].m_num_pending++;
+                    d.m_dependents.push_back(idx);
+                }
+                dep_olean = d.m_olean;
+            }
+            optional<file_mtime> dep_mtime = get_mtime(dep_olean);
+            if (!dep_mtime || (olean_mtime && *dep_mtime >= *olean_mtime))
+                needs_build = true;
+        }
+        m_modules[idx].m_needs_build = needs_build;
+        m_visiting[idx] = false;
+        return idx;
+    }
+
+    /* Mark the modules that depend on \c idx as failed.
+       \pre m_mutex is locked */
+    void skip_dependents(unsigned idx) {
+        for (unsigned d : m_modules[idx].m_dependents) {
+            if (!m_modules[d].m_failed) {
+                m_modules[d].m_failed = true;
+                m_num_remaining--;
+                skip_dependents(d);
+            }
+        }
+    }
+
+    /* Process the module \c idx, and produce its .olean file. Return true if no error was found. */
+    bool build(unsigned idx) {
+        module const & m = m_modules[idx];
+        auto out = std::make_shared<string_output_channel>();
+        io_state ios(m_ios, out, out);
+        environment env = m_env;
+        bool ok = false;
+        try {
+            std::ifstream in(m.m_fname);
+            if (in.bad() || in.fail())
+                throw exception(sstream() << "failed to open file '" << m.m_fname << "'");
+            parser p(env, ios, in, m.m_fname.c_str(), optional<std::string>(), false, 1, nullptr, nullptr, m_tmode);
+            p.set_cache(m_cache);
+            p.set_import_cache(&m_import_cache);
+            ok = p();
+            env = p.env();
+            if (ok)
+                export_module(m.m_olean, env);
+        } catch (throwable & ex) {
+            ok = false;
+            type_context tc(env, ios.get_options());
+            display_error(diagnostic(env, ios, tc), nullptr, ex);
+        }
+        std::string msgs = out->str();
+        if (!msgs.empty()) {
+            lock_guard<mutex> lk(m_output_mutex);
+            m_ios.get_regular_stream() << msgs << std::flush;
+        }
+        return ok;
+    }
+
+    /* Return the next module to be processed, or none if there is nothing else to do. */
+    optional<unsigned> next_module() {
+        unique_lock<mutex> lk(m_mutex);
+        while (true) {
+            check_interrupted();
+            if (m_stop || m_num_remaining == 0) {
+                return optional<unsigned>();
+            } else if (!m_ready.empty()) {
+                /* Process the modules in the order they were found, the output is deterministic when
+                   a single thread is used. */
+                std::pop_heap(m_ready.begin(), m_ready.end(), std::greater<unsigned>());
+                unsigned idx = m_ready.back();
+                m_ready.pop_back();
+                return optional<unsigned>(idx);
+            } else {
+                m_cv.wait(lk);
+            }
+        }
+    }
+
+    void worker() {
+        while (optional<unsigned> idx = next_module()) {
+            bool ok = build(*idx);
+            {
+                lock_guard<mutex> lk(m_mutex);
+                m_num_remaining--;
+                if (ok) {
+                    for (unsigned d : m_modules[*idx].m_dependents) {
+                        if (--m_modules[d].m_num_pending == 0 && !m_modules[d].m_failed) {
+                            m_ready.push_back(d);
+                            std::push_heap(m_ready.begin(), m_ready.end(), std::greater<unsigned>());
+                        }
+                    }
+                } else {
+                    m_ok = false;
+                    skip_dependents(*idx);
+                }
+            }
+            m_cv.notify_all();
+        }
+    }
+
+public:
+    make_fn(environment const & env, io_state const & ios, unsigned num_threads, definition_cache * cache,
+            keep_theorem_mode tmode):
+        m_env(env), m_ios(ios), m_num_threads(std::max(num_threads, 1u)), m_cache(cache), m_tmode(tmode),
+        m_ok(true), m_num_remaining(0), m_stop(false) {
+#if !defined(LEAN_MULTI_THREAD)
+        m_num_threads = 1;
+#endif
+    }
+
+    bool operator()(unsigned num_files, char const * const * files) {
+        for (unsigned i = 0; i < num_files; i++) {
+            if (!get_mtime(files[i])) {
+                m_ios.get_regular_stream() << "failed to open file '" << files[i] << "'" << std::endl;
+                m_ok = false;
+            } else {
+                visit(lrealpath(files[i]));
+            }
+        }
+        for (module const & m : m_modules) {
+            if (m.m_needs_build && !m.m_failed)
+                m_num_remaining++;
+        }
+        for (unsigned idx = 0; idx < m_modules.size(); idx++) {
+            if (m_modules[idx].m_failed)
+                skip_dependents(idx);
+        }
+        for (unsigned idx = 0; idx < m_modules.size(); idx++) {
+            module const & m = m_modules[idx];
+            if (m.m_needs_build && !m.m_failed && m.m_num_pending == 0)
+                m_ready.push_back(idx);
+        }
+        std::make_heap(m_ready.begin(), m_ready.end(), std::greater<unsigned>());
+        std::vector<std::unique_ptr<interruptible_thread>> threads;
+        for (unsigned i = 0; i < m_num_threads - 1; i++)
+            threads.push_back(std::unique_ptr<interruptible_thread>(new interruptible_thread([=]() {
+                            try {
+                                worker();
+                            } catch (interrupted &) {
+                            }
+                        })));
+        try {
+            worker();
+        } catch (...) {
+            {
+                lock_guard<mutex> lk(m_mutex);
+                m_stop = true;
+            }
+            m_cv.notify_all();
+            for (auto & th : threads)
+                th->request_interrupt();
+            for (auto & th : threads)
+                th->join();
+            throw;
+        }
+        for (auto & th : threads)
+            th->join();
+        return m_ok;
+    }
+};
+
+bool make(environment const & env, io_state const & ios, unsigned num_files, char const * const * files,
+          unsigned num_threads, definition_cache * cache, keep_theorem_mode tmode) {
+    return make_fn(env, ios, num_threads, cache, tmode)(num_files, files);
+}
+}
@@ -0,0 +1,27 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#pragma once
+#include "kernel/environment.h"
+#include "library/io_state.h"
+#include "library/definition_cache.h"
+#include "frontends/lean/parser.h"
+
+namespace lean {
+/** \brief Build driver (lean --make).
+
+    It computes the import graph of the given .lean files and of the .lean files they import (directly or
+    indirectly), and produces the .olean file of each module that is out of date, i.e., its .olean file
+    is missing, or is older than its source or the .olean file of one of its imports.
+
+    Modules are processed in parallel by \c num_threads threads as soon as all their imports have been built.
+    Imported modules are loaded into memory once, and shared by all modules processed by this call
+    (see \c import_cache). If a module fails, the modules that depend on it are not processed.
+
+    Return true iff all modules were successfully built. */
+bool make(environment const & env, io_state const & ios, unsigned num_files, char const * const * files,
+          unsigned num_threads, definition_cache * cache, keep_theorem_mode tmode);
+}
@@ -14,6 +14,7 @@ Author: Leonardo de Moura
 #include "util/sstream.h"
 #include "util/flet.h"
 #include "util/lean_path.h"
+#include "util/profiler.h"
 #include "util/sexpr/option_declarations.h"
 #include "kernel/for_each_fn.h"
 #include "kernel/replace_fn.h"
@@ -48,6 +49,7 @@ Author: Leonardo de Moura
 #include "library/type_context.h"
 #include "library/equations_compiler/equations.h"
 #include "library/pattern_attribute.h"
+#include "library/vm/vm.h"
 #include "frontends/lean/tokens.h"
 #include "frontends/lean/builtin_exprs.h"
 #include "frontends/lean/parser.h"
@@ -67,7 +69,7 @@ Author: Leonardo de Moura
 #endif
 
 #ifndef LEAN_DEFAULT_PARSER_PARALLEL_IMPORT
-#define LEAN_DEFAULT_PARSER_PARALLEL_IMPORT false
+#define LEAN_DEFAULT_PARSER_PARALLEL_IMPORT true
 #endif
 
 namespace lean {
@@ -177,12 +179,14 @@ parser::parser(environment const & env, io_state const & ios,
     m_verbose(true), m_use_exceptions(use_exceptions),
     m_scanner(strm, strm_name, s ? s->m_line : 1),
     m_base_dir(base_dir),
-    m_snapshot_vector(sv), m_cache(nullptr) {
+    m_snapshot_vector(sv), m_from_snapshot(s != nullptr), m_cache(nullptr),
+    m_import_cache(nullptr) {
     m_ignore_noncomputable = false;
     m_profile     = ios.get_options().get_bool("profile", false);
     init_stop_at(ios.get_options());
-    if (num_threads > 1 && m_profile)
-        throw exception("option --profile cannot be used when theorems are compiled in parallel");
+    // Remark: theorems are elaborated by the main thread when we are looking for information at a given position
+    if (num_threads > 1 && !m_stop_at)
+        m_theorem_queue.reset(new theorem_queue(num_threads, ios));
     m_in_quote = false;
     m_in_pattern = false;
     m_has_params = false;
@@ -208,6 +212,12 @@ parser::parser(environment const & env, io_state const & ios,
 }
 
 parser::~parser() {
+    if (m_theorem_queue && !m_theorem_queue->done()) {
+        try {
+            m_theorem_queue->interrupt();
+            m_theorem_queue->join();
+        } catch (...) {}
+    }
 }
 
 void parser::scan() {
@@ -259,13 +269,13 @@ void parser::scan() {
 void parser::cache_definition(name const & n, expr const & pre_type, expr const & pre_value,
                               level_param_names const & ls, expr const & type, expr const & value, bool is_trusted) {
     if (m_cache)
-        m_cache->add(m_env, n, pre_type, pre_value, ls, type, value, is_trusted);
+        m_cache->add(m_env, get_options(), n, pre_type, pre_value, ls, type, value, is_trusted);
 }
 
 auto parser::find_cached_definition(name const & n, expr const & pre_type, expr const & pre_value, bool is_trusted)
 -> optional<std::tuple<level_param_names, expr, expr>> {
     if (m_cache)
-        return m_cache->find(m_env, n, pre_type, pre_value, is_trusted);
+        return m_cache->find(m_env, get_options(), n, pre_type, pre_value, is_trusted);
     else
         return optional<std::tuple<level_param_names, expr, expr>>();
 }
@@ -2070,6 +2080,7 @@ void parser::parse_command() {
     name cmd_name = get_token_info().value();
     m_cmd_token = get_token_info().token();
     if (auto it = cmds().find(cmd_name)) {
+        profile_scope scope0("parsing", cmd_name);
         lazy_type_context tc(m_env, get_options());
         scope_global_ios scope1(m_ios);
         scope_trace_env  scope2(m_env, m_ios.get_options(), tc);
@@ -2162,13 +2173,17 @@ void parser::parse_imports() {
     if (get_parser_parallel_import(m_ios.get_options()))
         num_threads = m_num_threads;
     bool keep_imported_thms = (m_keep_theorem_mode == keep_theorem_mode::All);
-    m_env = import_modules(m_env, base, olean_files.size(), olean_files.data(), num_threads,
-                           keep_imported_thms, m_ios);
+    profile_scope scope("importing");
+    if (m_import_cache)
+        m_env = m_import_cache->import_modules(m_env, base, olean_files.size(), olean_files.data(), num_threads,
+                                               keep_imported_thms, m_ios);
+    else
+        m_env = import_modules(m_env, base, olean_files.size(), olean_files.data(), num_threads,
+                               keep_imported_thms, m_ios);
+    m_env = install_vm_natives(m_env);
     m_env = update_fingerprint(m_env, fingerprint);
     m_env = activate_export_decls(m_env, {}); // explicitly activate exports in root namespace
     m_env = replay_export_decls_core(m_env, m_ios);
-    if (imported)
-        save_snapshot();
 }
 
 bool parser::parse_commands() {
@@ -2176,21 +2191,25 @@ bool parser::parse_commands() {
     scoped_expr_caching disable(false);
     scoped_set_distinguishing_pp_options set(get_distinguishing_pp_options());
     scope_pos_info_provider scope1(*this);
+    profile_scope scope2("file", name(get_stream_name().c_str()));
     try {
         bool done = false;
-        protected_call([&]() {
-                parse_imports();
-            },
-            [&]() { sync_command(); });
-        if (has_sorry(m_env)) {
+        if (!m_from_snapshot) {
+            protected_call([&]() {
+                    parse_imports();
+                },
+                [&]() { sync_command(); });
+            if (has_sorry(m_env)) {
 #ifndef LEAN_IGNORE_SORRY
-            // TODO(Leo): remove the #ifdef.
-            // The compilation option LEAN_IGNORE_SORRY is a temporary hack for the nightly builds
-            // We use it to avoid a buch of warnings on cdash.
-            flycheck_warning wrn(ios());
-            display_warning_pos(pos());
-            ios().get_regular_stream() << " imported file uses 'sorry'" << std::endl;
+                // TODO(Leo): remove the #ifdef.
+                // The compilation option LEAN_IGNORE_SORRY is a temporary hack for the nightly builds
+                // We use it to avoid a buch of warnings on cdash.
+                flycheck_warning wrn(ios());
+                display_warning_pos(pos());
+                ios().get_regular_stream() << " imported file uses 'sorry'" << std::endl;
 #endif
+            }
+            save_snapshot();
         }
         while (!done) {
             if (m_stop_at && pos().first > m_stop_at_line) {
@@ -2203,6 +2222,7 @@ bool parser::parse_commands() {
                         if (curr_is_token(get_end_tk()))
                             save_snapshot();
                         parse_command();
+                        process_finished_theorems();
                         save_snapshot();
                         break;
                     case scanner::token_kind::Eof:
@@ -2219,6 +2239,7 @@ bool parser::parse_commands() {
                 },
                 [&]() { sync_command(); });
         }
+        join_theorem_queue();
         if (has_open_scopes(m_env)) {
             m_found_errors = true;
             if (!m_use_exceptions && m_show_errors)
@@ -2227,11 +2248,10 @@ bool parser::parse_commands() {
                 throw_parser_exception("invalid end of module, expecting 'end'", pos());
         }
     } catch (interrupt_parser) {
-        save_snapshot();
+        // Remark: we do not save a snapshot here since the remaining commands were not processed.
         while (has_open_scopes(m_env))
             m_env = pop_scope_core(m_env, m_ios);
     }
-    save_snapshot();
     return !m_found_errors;
 }
 
@@ -2257,7 +2277,35 @@ void parser::replace_theorem(certified_declaration const & thm) {
     }
 }
 
+void parser::process_theorem_queue_entries(std::vector<theorem_queue_entry> const & entries) {
+    for (theorem_queue_entry const & e : entries) {
+        m_ios.get_regular_stream() << e.m_regular;
+        m_ios.get_diagnostic_stream() << e.m_diagnostic;
+        flet<pos_info> set_pos(m_last_cmd_pos, e.m_pos);
+        protected_call([&]() {
+                if (e.m_ex)
+                    e.m_ex->rethrow();
+                replace_theorem(*e.m_thm);
+            },
+            []() {});
+    }
+}
+
+void parser::process_finished_theorems() {
+    if (!m_theorem_queue || m_theorem_queue->empty())
+        return;
+    process_theorem_queue_entries(m_theorem_queue->finished());
+}
+
+void parser::join_theorem_queue() {
+    if (!m_theorem_queue || m_theorem_queue->empty())
+        return;
+    process_theorem_queue_entries(m_theorem_queue->join());
+    m_theorem_queue.reset(new theorem_queue(m_num_threads, m_ios));
+}
+
 environment parser::reveal_theorems_core(buffer<name> const & /* ds */, bool /* all */) {
+    join_theorem_queue();
     return m_env;
 }
 
@@ -2269,13 +2317,18 @@ environment parser::reveal_all_theorems() {
     return reveal_theorems_core(buffer<name>(), true);
 }
 
+/* Save the state before the command at the current position. */
 void parser::save_snapshot() {
     if (!m_snapshot_vector)
         return;
-    if (m_snapshot_vector->empty() || static_cast<int>(m_snapshot_vector->back().m_line) != m_scanner.get_line())
+    pos_info p = pos();
+    if (m_snapshot_vector->empty() || m_snapshot_vector->back().m_line != p.first) {
+        std::streamoff out_pos = m_ios.get_regular_stream().tellp();
         m_snapshot_vector->push_back(snapshot(m_env, m_local_level_decls, m_local_decls,
                                               m_level_variables, m_variables, m_include_vars,
-                                              m_ios.get_options(), m_parser_scope_stack, m_scanner.get_line()));
+                                              m_ios.get_options(), m_parser_scope_stack,
+                                              p.first, p.second, out_pos));
+    }
 }
 
 optional<pos_info> parser::get_pos_info(expr const & e) const {
@@ -17,11 +17,14 @@ Author: Leonardo de Moura
 #include "library/io_state.h"
 #include "library/io_state_stream.h"
 #include "library/definition_cache.h"
+#include "library/module.h"
 #include "frontends/lean/scanner.h"
 #include "frontends/lean/local_decls.h"
 #include "frontends/lean/local_level_decls.h"
 #include "frontends/lean/parser_config.h"
 #include "frontends/lean/local_context_adapter.h"
+#include "frontends/lean/parser_pos_provider.h"
+#include "frontends/lean/theorem_queue.h"
 
 namespace lean {
 struct interrupt_parser {};
@@ -49,7 +52,9 @@ struct parser_scope {
 };
 typedef list<parser_scope> parser_scope_stack;
 
-/** \brief Snapshot of the state of the Lean parser */
+/** \brief Snapshot of the state of the Lean parser.
+    Snapshots are taken before each command, and they can be used to resume parsing at
+    position (m_line, m_col) (see parser constructor). */
 struct snapshot {
     environment        m_env;
     local_level_decls  m_lds;
@@ -60,13 +65,18 @@ struct snapshot {
     options            m_options;
     parser_scope_stack m_parser_scope_stack;
     unsigned           m_line;
-    snapshot():m_line(0) {}
-    snapshot(environment const & env, options const & o):m_env(env), m_options(o), m_line(1) {}
+    unsigned           m_col;
+    /* Position of the regular output stream when the snapshot was taken (if the stream supports tellp).
+       It is used to discard the messages produced after the snapshot. */
+    std::streamoff     m_out_pos;
+    snapshot():m_line(0), m_col(0), m_out_pos(0) {}
+    snapshot(environment const & env, options const & o):m_env(env), m_options(o), m_line(1), m_col(0), m_out_pos(0) {}
     snapshot(environment const & env, local_level_decls const & lds,
              local_expr_decls const & eds, name_set const & lvars, name_set const & vars,
-             name_set const & includes, options const & opts, parser_scope_stack const & pss, unsigned line):
+             name_set const & includes, options const & opts, parser_scope_stack const & pss,
+             unsigned line, unsigned col, std::streamoff out_pos):
         m_env(env), m_lds(lds), m_eds(eds), m_lvars(lvars), m_vars(vars), m_include_vars(includes),
-        m_options(opts), m_parser_scope_stack(pss), m_line(line) {}
+        m_options(opts), m_parser_scope_stack(pss), m_line(line), m_col(col), m_out_pos(out_pos) {}
 };
 
 typedef std::vector<snapshot> snapshot_vector;
@@ -112,9 +122,12 @@ class parser : public abstract_parser {
 
     // info support
     snapshot_vector *       m_snapshot_vector;
+    // true if the parser was created using a snapshot, then imports have already been processed
+    bool                    m_from_snapshot;
 
     // cache support
     definition_cache *     m_cache;
+    import_cache *         m_import_cache;
 
     keep_theorem_mode      m_keep_theorem_mode;
 
@@ -126,6 +139,9 @@ class parser : public abstract_parser {
     // profiling
     bool                   m_profile;
 
+    // theorems being elaborated in parallel, it is nullptr if m_num_threads <= 1
+    std::unique_ptr<theorem_queue> m_theorem_queue;
+
     // stop/info at line/col
     bool                   m_stop_at; // if true, then parser stops execution after the given line and column is reached
     unsigned               m_stop_at_line;
@@ -210,6 +226,10 @@ class parser : public abstract_parser {
     void init_stop_at(options const & opts);
 
     void replace_theorem(certified_declaration const & thm);
+    void process_theorem_queue_entries(std::vector<theorem_queue_entry> const & entries);
+    /* Replace the axioms of the theorems whose tasks have already been completed, and report their errors. */
+    void process_finished_theorems();
+    void join_theorem_queue();
     environment reveal_theorems_core(buffer<name> const & ds, bool all);
 public:
     parser(environment const & env, io_state const & ios,
@@ -232,6 +252,8 @@ public:
     cmd_table const & cmds() const { return get_cmd_table(env()); }
 
     void set_cache(definition_cache * c) { m_cache = c; }
+    bool has_cache() const { return m_cache != nullptr; }
+    void set_import_cache(import_cache * c) { m_import_cache = c; }
     void cache_definition(name const & n, expr const & pre_type, expr const & pre_value,
                           level_param_names const & ls, expr const & type, expr const & value, bool is_trusted);
     /** \brief Try to find an elaborated definition for (n, pre_type, pre_value) in the cache */
@@ -269,6 +291,13 @@ public:
     expr mk_app(std::initializer_list<expr> const & args, pos_info const & p);
 
     unsigned num_threads() const { return m_num_threads; }
+    /** \brief Return the queue for elaborating theorems in parallel, or nullptr if theorems
+        must be elaborated by the main thread. */
+    theorem_queue * get_theorem_queue() { return m_theorem_queue.get(); }
+    /** \brief Return a position provider that can be safely used by other threads. */
+    parser_pos_provider get_parser_pos_provider(pos_info const & some_pos) const {
+        return parser_pos_provider(m_pos_table, get_stream_name(), some_pos);
+    }
     void add_delayed_theorem(environment const & env, name const & n, level_param_names const & ls,
                              expr const & t, expr const & v);
     void add_delayed_theorem(certified_declaration const & cd);
@@ -81,18 +81,22 @@ static environment print_axioms(parser & p) {
         print_axioms_deps(p.env(), out)(c);
         return new_env;
     } else {
-        bool has_axioms = false;
         environment const & env = p.env();
         type_context tc(env, p.get_options());
         auto out = regular(env, p.ios(), tc);
+        /* The declarations are not visited in any particular order, so we sort the axioms by name. */
+        buffer<declaration> axioms;
         env.for_each_declaration([&](declaration const & d) {
                 name const & n = d.get_name();
-                if (!d.is_definition() && !env.is_builtin(n) && d.is_trusted()) {
-                    out << n << " : " << d.get_type() << endl;
-                    has_axioms = true;
-                }
+                if (!d.is_definition() && !env.is_builtin(n) && d.is_trusted())
+                    axioms.push_back(d);
+            });
+        std::sort(axioms.begin(), axioms.end(), [](declaration const & d1, declaration const & d2) {
+                return d1.get_name() < d2.get_name();
             });
-        if (!has_axioms)
+        for (declaration const & d : axioms)
+            out << d.get_name() << " : " << d.get_type() << endl;
+        if (axioms.empty())
             out << "no axioms" << endl;
         return p.env();
     }
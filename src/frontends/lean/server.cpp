@@ -0,0 +1,220 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include "util/sstream.h"
+#include "util/utf8.h"
+#include "util/exception.h"
+#include "frontends/lean/opt_cmd.h"
+#include "frontends/lean/server.h"
+
+namespace lean {
+server::server(environment const & env, io_state const & ios, optional<std::string> const & base_dir):
+    m_env(env), m_ios(ios), m_base_dir(base_dir), m_curr(nullptr) {}
+
+server::file & server::get_curr() {
+    if (!m_curr)
+        throw exception("no file has been visited, use VISIT [file-name]");
+    return *m_curr;
+}
+
+static unsigned parse_unsigned(std::string const & s) {
+    std::istringstream in(s);
+    unsigned r;
+    if (!(in >> r))
+        throw exception(sstream() << "invalid server command, numeral expected at '" << s << "'");
+    return r;
+}
+
+static void check_line(unsigned line, unsigned max_line) {
+    if (line == 0 || line > max_line)
+        throw exception(sstream() << "invalid line number " << line << ", the current file has "
+                        << max_line << " line(s)");
+}
+
+static std::string read_line(std::istream & in) {
+    std::string r;
+    if (!std::getline(in, r))
+        throw exception("invalid server command, unexpected end of input");
+    if (!r.empty() && r.back() == '\r')
+        r.pop_back();
+    return r;
+}
+
+/* Discard the snapshots that may be affected by a modification at the given line. */
+void server::invalidate(file & f, unsigned line) {
+    while (!f.m_snapshots.empty() && f.m_snapshots.back().m_line >= line)
+        f.m_snapshots.pop_back();
+    f.m_processed = false;
+}
+
+/* Return the contents of \c f starting at the position of the snapshot \c s.
+   The text before the position in its line is replaced with spaces to make sure the scanner
+   produces the same columns. */
+std::string server::get_contents(file const & f, snapshot const * s) const {
+    std::string r;
+    unsigned first = s ? s->m_line - 1 : 0;
+    for (unsigned i = first; i < f.m_lines.size(); i++) {
+        std::string const & l = f.m_lines[i];
+        if (s && i == first) {
+            unsigned j = 0;
+            for (unsigned k = 0; k < s->m_col && j < l.size(); k++) {
+                j += get_utf8_size(l[j]);
+                r += ' ';
+            }
+            if (j < l.size())
+                r.append(l, j, std::string::npos);
+        } else {
+            r += l;
+        }
+        r += '\n';
+    }
+    return r;
+}
+
+void server::process(file & f) {
+    if (f.m_processed)
+        return;
+    optional<snapshot> s;
+    if (!f.m_snapshots.empty())
+        s = f.m_snapshots.back();
+    std::streamoff base_pos = s ? s->m_out_pos : 0;
+    f.m_messages.resize(base_pos);
+    unsigned old_sz = f.m_snapshots.size();
+    auto out = std::make_shared<string_output_channel>();
+    io_state ios(m_ios, out, out);
+    if (s)
+        ios.set_options(s->m_options);
+    std::istringstream in(get_contents(f, s ? &*s : nullptr));
+    parser p(s ? s->m_env : m_env, ios, in, f.m_name.c_str(), m_base_dir, false, 1,
+             s ? &*s : nullptr, &f.m_snapshots);
+    p();
+    /* The new snapshots store positions relative to the messages produced in this run. */
+    for (unsigned i = old_sz; i < f.m_snapshots.size(); i++)
+        f.m_snapshots[i].m_out_pos += base_pos;
+    f.m_messages += out->str();
+    f.m_processed = true;
+}
+
+void server::query(file & f, std::string const & kind, unsigned line, unsigned col, std::ostream & out) {
+    process(f);
+    optional<snapshot> s;
+    for (snapshot const & it : f.m_snapshots) {
+        if (it.m_line < line || (it.m_line == line && it.m_col <= col))
+            s = it;
+        else
+            break;
+    }
+    options opts = s ? s->m_options : m_ios.get_options();
+    if (kind == "INFO")
+        opts = set_show_info(opts, line, col);
+    else if (kind == "GOAL")
+        opts = set_show_goal(opts, line, col);
+    else
+        opts = set_show_hole(opts, line, col);
+    auto ch = std::make_shared<string_output_channel>();
+    io_state ios(m_ios, ch, ch);
+    ios.set_options(opts);
+    std::istringstream in(get_contents(f, s ? &*s : nullptr));
+    parser p(s ? s->m_env : m_env, ios, in, f.m_name.c_str(), m_base_dir, false, 1, s ? &*s : nullptr, nullptr);
+    p();
+    out << ch->str();
+}
+
+void server::execute(std::string const & cmd, std::string const & args, std::istream & in, std::ostream & out) {
+    if (cmd == "VISIT") {
+        auto it = m_files.find(args);
+        if (it == m_files.end()) {
+            std::ifstream fin(args);
+            if (!fin)
+                throw exception(sstream() << "failed to open file '" << args << "'");
+            file f(args);
+            std::string l;
+            while (std::getline(fin, l))
+                f.m_lines.push_back(l);
+            it = m_files.insert(mk_pair(args, f)).first;
+        }
+        m_curr = &it->second;
+    } else if (cmd == "SYNC") {
+        file & f = get_curr();
+        unsigned n = parse_unsigned(args);
+        std::vector<std::string> lines;
+        for (unsigned i = 0; i < n; i++)
+            lines.push_back(read_line(in));
+        unsigned i = 0;
+        while (i < lines.size() && i < f.m_lines.size() && lines[i] == f.m_lines[i])
+            i++;
+        if (i < lines.size() || i < f.m_lines.size()) {
+            invalidate(f, i + 1);
+            f.m_lines = lines;
+        }
+    } else if (cmd == "REPLACE") {
+        file & f = get_curr();
+        unsigned line = parse_unsigned(args);
+        std::string l = read_line(in);
+        check_line(line, f.m_lines.size());
+        f.m_lines[line - 1] = l;
+        invalidate(f, line);
+    } else if (cmd == "INSERT") {
+        file & f = get_curr();
+        unsigned line = parse_unsigned(args);
+        std::string l = read_line(in);
+        check_line(line, f.m_lines.size() + 1);
+        f.m_lines.insert(f.m_lines.begin() + (line - 1), l);
+        invalidate(f, line);
+    } else if (cmd == "REMOVE") {
+        file & f = get_curr();
+        unsigned line = parse_unsigned(args);
+        check_line(line, f.m_lines.size());
+        f.m_lines.erase(f.m_lines.begin() + (line - 1));
+        invalidate(f, line);
+    } else if (cmd == "CHECK") {
+        file & f = get_curr();
+        process(f);
+        out << f.m_messages;
+    } else if (cmd == "INFO" || cmd == "GOAL" || cmd == "HOLE") {
+        file & f = get_curr();
+        std::istringstream args_in(args);
+        std::string line_str, col_str;
+        args_in >> line_str >> col_str;
+        unsigned line = parse_unsigned(line_str);
+        unsigned col  = parse_unsigned(col_str);
+        query(f, cmd, line, col, out);
+    } else if (cmd == "CLEAR_CACHE") {
+        for (auto & p : m_files) {
+            p.second.m_snapshots.clear();
+            p.second.m_messages.clear();
+            p.second.m_processed = false;
+        }
+    } else {
+        throw exception(sstream() << "unknown server command '" << cmd << "'");
+    }
+}
+
+void server::operator()(std::istream & in) {
+    std::ostream & out = m_ios.get_regular_stream();
+    std::string l;
+    while (std::getline(in, l)) {
+        if (!l.empty() && l.back() == '\r')
+            l.pop_back();
+        auto p = l.find(' ');
+        std::string cmd  = l.substr(0, p);
+        std::string args = p == std::string::npos ? std::string() : l.substr(p + 1);
+        if (cmd.empty())
+            continue;
+        try {
+            execute(cmd, args, in, out);
+        } catch (throwable & ex) {
+            out << "-- ERROR " << ex.what() << "\n";
+        }
+        out << "-- END" << std::endl;
+    }
+}
+}
@@ -0,0 +1,63 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "frontends/lean/parser.h"
+
+namespace lean {
+/** \brief Long-running server for editors (lean --server).
+
+    It reads commands from an input stream (one command per line), and writes the results to the
+    regular stream of the given io_state. The response for each command is terminated by the line
+    <tt>-- END</tt>. If a command fails, the line <tt>-- ERROR [message]</tt> is produced before it.
+
+    Commands:
+       VISIT [file-name]     make [file-name] the current file (its contents are read from disk the first time)
+       SYNC [n]              replace the contents of the current file with the next [n] lines
+       REPLACE [line]        replace line [line] of the current file with the next line
+       INSERT [line]         insert the next line before line [line] of the current file
+       REMOVE [line]         remove line [line] of the current file
+       CHECK                 display the messages (e.g., errors) produced when processing the current file
+       INFO [line] [col]     display information about the identifier or token at the given position
+       GOAL [line] [col]     display the goal at the given position
+       HOLE [line] [col]     display the type of the "hole" at the given position
+       CLEAR_CACHE           discard all snapshots, the files will be processed again from scratch
+
+    The server keeps the parser snapshots produced when a file is processed. When the file is edited, it
+    only discards the snapshots after the first modified line, and resumes parsing from the last remaining one.
+    In particular, imported modules are not reloaded unless the import commands are modified. */
+class server {
+    struct file {
+        std::string              m_name;
+        std::vector<std::string> m_lines;
+        /* Snapshots taken while processing the current contents (or a prefix of them). */
+        snapshot_vector          m_snapshots;
+        /* Messages produced while processing the current contents. */
+        std::string              m_messages;
+        bool                     m_processed;
+        file(std::string const & n):m_name(n), m_processed(false) {}
+    };
+    environment                            m_env;
+    io_state                               m_ios;
+    optional<std::string>                  m_base_dir;
+    std::unordered_map<std::string, file>  m_files;
+    file *                                 m_curr;
+
+    file & get_curr();
+    void invalidate(file & f, unsigned line);
+    std::string get_contents(file const & f, snapshot const * s) const;
+    void process(file & f);
+    void query(file & f, std::string const & kind, unsigned line, unsigned col, std::ostream & out);
+    void execute(std::string const & cmd, std::string const & args, std::istream & in, std::ostream & out);
+public:
+    server(environment const & env, io_state const & ios, optional<std::string> const & base_dir);
+    /** \brief Process commands from \c in until end of file. */
+    void operator()(std::istream & in);
+};
+}
@@ -0,0 +1,75 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include "frontends/lean/theorem_queue.h"
+
+namespace lean {
+theorem_queue::theorem_queue(unsigned num_threads, io_state const & ios):
+    m_queue(num_threads > 1 ? num_threads - 1 : 0), m_ios(ios), m_next_idx(0), m_next_finished(0) {}
+
+void theorem_queue::add(name const & n, pos_info const & pos, task const & t) {
+    unsigned idx = m_next_idx;
+    m_next_idx++;
+    io_state ios = m_ios;
+    m_queue.add([=]() {
+            theorem_queue_entry e;
+            e.m_idx  = idx;
+            e.m_name = n;
+            e.m_pos  = pos;
+            auto regular    = std::make_shared<string_output_channel>();
+            auto diagnostic = std::make_shared<string_output_channel>();
+            io_state task_ios(ios, regular, diagnostic);
+            try {
+                t(task_ios, e);
+            } catch (interrupted &) {
+                throw;
+            } catch (throwable & ex) {
+                e.m_ex.reset(ex.clone());
+            }
+            e.m_regular    = regular->str();
+            e.m_diagnostic = diagnostic->str();
+            {
+                lock_guard<mutex> lock(m_finished_mutex);
+                m_finished.insert(mk_pair(idx, e));
+            }
+            return e;
+        });
+}
+
+std::vector<theorem_queue_entry> theorem_queue::finished() {
+    std::vector<theorem_queue_entry> r;
+    lock_guard<mutex> lock(m_finished_mutex);
+    while (true) {
+        auto it = m_finished.find(m_next_finished);
+        if (it == m_finished.end())
+            return r;
+        r.push_back(it->second);
+        m_finished.erase(it);
+        m_next_finished++;
+    }
+}
+
+std::vector<theorem_queue_entry> const & theorem_queue::join() {
+    if (!m_queue.done()) {
+        unsigned next = m_next_finished;
+        for (theorem_queue_entry const & e : m_queue.join()) {
+            if (e.m_idx >= next)
+                m_result.push_back(e);
+        }
+        std::sort(m_result.begin(), m_result.end(),
+                  [](theorem_queue_entry const & e1, theorem_queue_entry const & e2) {
+                      return e1.m_idx < e2.m_idx;
+                  });
+        lock_guard<mutex> lock(m_finished_mutex);
+        m_finished.clear();
+        m_next_finished = m_next_idx;
+    }
+    return m_result;
+}
+}
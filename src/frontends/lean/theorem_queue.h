@@ -0,0 +1,64 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#pragma once
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <functional>
+#include "util/worker_queue.h"
+#include "kernel/environment.h"
+#include "kernel/pos_info_provider.h"
+#include "library/io_state.h"
+
+namespace lean {
+/** \brief Result of elaborating and type checking a theorem asynchronously. */
+struct theorem_queue_entry {
+    unsigned                        m_idx;        // position in the queue, results are processed in this order
+    name                            m_name;       // name of the theorem (the axiom in the main environment)
+    pos_info                        m_pos;
+    optional<certified_declaration> m_thm;        // certified theorem, it is none if an exception was thrown
+    std::shared_ptr<throwable>      m_ex;
+    std::string                     m_regular;    // output produced by the task
+    std::string                     m_diagnostic;
+    theorem_queue_entry():m_idx(0) {}
+};
+
+/** \brief Queue of theorems that are elaborated and type checked in parallel.
+    The parser adds the theorem to the environment as an axiom, and creates a task
+    for elaborating its proof. The axiom is replaced with the actual theorem when
+    the task is finished (see #finished), or when the queue is joined. */
+class theorem_queue {
+public:
+    /* Task for elaborating a theorem. It should store the result at the given entry,
+       and produce output only using the given io_state. */
+    typedef std::function<void(io_state const &, theorem_queue_entry &)> task;
+private:
+    worker_queue<theorem_queue_entry> m_queue;
+    io_state                          m_ios;
+    unsigned                          m_next_idx;
+    std::vector<theorem_queue_entry>  m_result;
+    mutex                             m_finished_mutex;
+    std::map<unsigned, theorem_queue_entry> m_finished; // protected by m_finished_mutex
+    unsigned                          m_next_finished;  // index of the next result to be returned by #finished
+public:
+    /** \brief Create a queue where the tasks are executed by num_threads - 1 auxiliary threads. */
+    theorem_queue(unsigned num_threads, io_state const & ios);
+
+    void add(name const & n, pos_info const & pos, task const & t);
+    /** \brief Return the results of the tasks that have already been completed, and have not been returned yet.
+        Results are returned in the order the tasks were added, so a result is only returned after the
+        results of all previous tasks. */
+    std::vector<theorem_queue_entry> finished();
+    /** \brief Wait for all tasks to complete, and return the results that have not been returned by #finished.
+        The result is sorted using the order the tasks were added. */
+    std::vector<theorem_queue_entry> const & join();
+    void interrupt() { m_queue.interrupt(); }
+    bool done() const { return m_queue.done(); }
+    bool empty() const { return m_next_idx == 0; }
+};
+}
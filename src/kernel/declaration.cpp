@@ -4,6 +4,8 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
+#include <memory>
+#include "util/thread.h"
 #include "kernel/declaration.h"
 #include "kernel/environment.h"
 #include "kernel/for_each_fn.h"
@@ -38,12 +40,35 @@ int compare(reducibility_hints const & h1, reducibility_hints const & h2) {
 }
 
 struct declaration::cell {
+    /* Type or value of a declaration created using mk_lazy_* that has not been produced yet. */
+    struct lazy_expr {
+        mutex               m_mutex;
+        atomic<bool>        m_ready;
+        declaration_expr_fn m_fn;
+        expr                m_expr;
+        lazy_expr(declaration_expr_fn const & fn):m_ready(false), m_fn(fn) {}
+        expr const & get() {
+            if (!m_ready.load(memory_order_acquire)) {
+                lock_guard<mutex> lock(m_mutex);
+                if (!m_ready.load(memory_order_relaxed)) {
+                    m_expr = m_fn();
+                    /* release resources captured by the closure */
+                    m_fn = declaration_expr_fn();
+                    m_ready.store(true, memory_order_release);
+                }
+            }
+            return m_expr;
+        }
+    };
     MK_LEAN_RC();
     name               m_name;
     level_param_names  m_params;
-    expr               m_type;
+    expr               m_type;         // not used if m_lazy_type != nullptr
     bool               m_theorem;
-    optional<expr>     m_value;        // if none, then declaration is actually a postulate
+    bool               m_definition;
+    optional<expr>     m_value;        // not used if m_lazy_value != nullptr
+    std::unique_ptr<lazy_expr> m_lazy_type;
+    std::unique_ptr<lazy_expr> m_lazy_value;
     reducibility_hints m_hints;
     /* Definitions are trusted by default, and nested macros are expanded when kernel is instantiated with
        trust level 0. When this flag is false, then we do not expand nested macros. We say the
@@ -53,12 +78,22 @@ struct declaration::cell {
     void dealloc() { delete this; }
 
     cell(name const & n, level_param_names const & params, expr const & t, bool is_axiom, bool trusted):
-        m_rc(1), m_name(n), m_params(params), m_type(t), m_theorem(is_axiom),
+        m_rc(1), m_name(n), m_params(params), m_type(t), m_theorem(is_axiom), m_definition(false),
         m_hints(reducibility_hints::mk_opaque()), m_trusted(trusted) {}
     cell(name const & n, level_param_names const & params, expr const & t, bool is_thm, expr const & v,
          reducibility_hints const & h, bool trusted):
-        m_rc(1), m_name(n), m_params(params), m_type(t), m_theorem(is_thm),
+        m_rc(1), m_name(n), m_params(params), m_type(t), m_theorem(is_thm), m_definition(true),
         m_value(v), m_hints(h), m_trusted(trusted) {}
+    cell(name const & n, level_param_names const & params, declaration_expr_fn const & t, bool is_axiom, bool trusted):
+        m_rc(1), m_name(n), m_params(params), m_theorem(is_axiom), m_definition(false),
+        m_lazy_type(new lazy_expr(t)), m_hints(reducibility_hints::mk_opaque()), m_trusted(trusted) {}
+    cell(name const & n, level_param_names const & params, declaration_expr_fn const & t, bool is_thm,
+         declaration_expr_fn const & v, reducibility_hints const & h, bool trusted):
+        m_rc(1), m_name(n), m_params(params), m_theorem(is_thm), m_definition(true),
+        m_lazy_type(new lazy_expr(t)), m_lazy_value(new lazy_expr(v)), m_hints(h), m_trusted(trusted) {}
+
+    expr const & get_type() { return m_lazy_type ? m_lazy_type->get() : m_type; }
+    expr const & get_value() { return m_lazy_value ? m_lazy_value->get() : *m_value; }
 };
 
 static declaration * g_dummy = nullptr;
@@ -72,7 +107,7 @@ declaration::~declaration() { if (m_ptr) m_ptr->dec_ref(); }
 declaration & declaration::operator=(declaration const & s) { LEAN_COPY_REF(s); }
 declaration & declaration::operator=(declaration && s) { LEAN_MOVE_REF(s); }
 
-bool declaration::is_definition() const    { return static_cast<bool>(m_ptr->m_value); }
+bool declaration::is_definition() const    { return m_ptr->m_definition; }
 bool declaration::is_constant_assumption() const { return !is_definition(); }
 bool declaration::is_axiom() const         { return is_constant_assumption() && m_ptr->m_theorem; }
 bool declaration::is_theorem() const       { return is_definition() && m_ptr->m_theorem; }
@@ -81,9 +116,9 @@ bool declaration::is_trusted() const       { return m_ptr->m_trusted; }
 name const & declaration::get_name() const { return m_ptr->m_name; }
 level_param_names const & declaration::get_univ_params() const { return m_ptr->m_params; }
 unsigned declaration::get_num_univ_params() const { return length(get_univ_params()); }
-expr const & declaration::get_type() const { return m_ptr->m_type; }
+expr const & declaration::get_type() const { return m_ptr->get_type(); }
 
-expr const & declaration::get_value() const { lean_assert(is_definition()); return *(m_ptr->m_value); }
+expr const & declaration::get_value() const { lean_assert(is_definition()); return m_ptr->get_value(); }
 reducibility_hints const & declaration::get_hints() const { return m_ptr->m_hints; }
 
 declaration mk_definition(name const & n, level_param_names const & params, expr const & t, expr const & v,
@@ -111,6 +146,21 @@ declaration mk_definition(environment const & env, name const & n, level_param_n
 declaration mk_theorem(name const & n, level_param_names const & params, expr const & t, expr const & v) {
     return declaration(new declaration::cell(n, params, t, true, v, reducibility_hints::mk_opaque(), true));
 }
+declaration mk_lazy_definition(name const & n, level_param_names const & params, declaration_expr_fn const & t,
+                               declaration_expr_fn const & v, reducibility_hints const & h, bool trusted) {
+    return declaration(new declaration::cell(n, params, t, false, v, h, trusted));
+}
+declaration mk_lazy_theorem(name const & n, level_param_names const & params, declaration_expr_fn const & t,
+                            declaration_expr_fn const & v) {
+    return declaration(new declaration::cell(n, params, t, true, v, reducibility_hints::mk_opaque(), true));
+}
+declaration mk_lazy_axiom(name const & n, level_param_names const & params, declaration_expr_fn const & t) {
+    return declaration(new declaration::cell(n, params, t, true, true));
+}
+declaration mk_lazy_constant_assumption(name const & n, level_param_names const & params,
+                                        declaration_expr_fn const & t, bool trusted) {
+    return declaration(new declaration::cell(n, params, t, false, trusted));
+}
 declaration mk_axiom(name const & n, level_param_names const & params, expr const & t) {
     return declaration(new declaration::cell(n, params, t, true, true));
 }
@@ -8,6 +8,7 @@ Author: Leonardo de Moura
 #include <algorithm>
 #include <string>
 #include <limits>
+#include <functional>
 #include "util/rc.h"
 #include "kernel/expr.h"
 
@@ -66,6 +67,9 @@ public:
 
 int compare(reducibility_hints const & h1, reducibility_hints const & h2);
 
+/** \brief Procedure for producing the type or value of a declaration on demand (see #mk_lazy_definition). */
+typedef std::function<expr()> declaration_expr_fn;
+
 /** \brief Environment definitions, theorems, axioms and variable declarations. */
 class declaration {
     struct cell;
@@ -114,6 +118,13 @@ public:
     friend declaration mk_definition(environment const & env, name const & n, level_param_names const & params, expr const & t,
                                      expr const & v, bool use_conv_opt, bool trusted);
     friend declaration mk_theorem(name const &, level_param_names const &, expr const &, expr const &);
+    friend declaration mk_lazy_definition(name const & n, level_param_names const & params, declaration_expr_fn const & t,
+                                          declaration_expr_fn const & v, reducibility_hints const & hints, bool trusted);
+    friend declaration mk_lazy_theorem(name const & n, level_param_names const & params, declaration_expr_fn const & t,
+                                       declaration_expr_fn const & v);
+    friend declaration mk_lazy_axiom(name const & n, level_param_names const & params, declaration_expr_fn const & t);
+    friend declaration mk_lazy_constant_assumption(name const & n, level_param_names const & params,
+                                                   declaration_expr_fn const & t, bool trusted);
     friend declaration mk_axiom(name const & n, level_param_names const & params, expr const & t);
     friend declaration mk_constant_assumption(name const & n, level_param_names const & params, expr const & t, bool trusted);
 };
@@ -127,6 +138,18 @@ declaration mk_definition(name const & n, level_param_names const & params, expr
 declaration mk_definition(environment const & env, name const & n, level_param_names const & params, expr const & t, expr const & v,
                           bool use_conv_opt = true, bool trusted = true);
 declaration mk_theorem(name const & n, level_param_names const & params, expr const & t, expr const & v);
+/** \brief Similar to mk_definition, but the type (value) is only produced using \c t (\c v) the first time it is needed.
+    \c t and \c v are invoked at most once, and they may be invoked by any thread. */
+declaration mk_lazy_definition(name const & n, level_param_names const & params, declaration_expr_fn const & t,
+                               declaration_expr_fn const & v, reducibility_hints const & hints, bool trusted = true);
+/** \brief Similar to mk_theorem, but the type and value are only produced the first time they are needed. */
+declaration mk_lazy_theorem(name const & n, level_param_names const & params, declaration_expr_fn const & t,
+                            declaration_expr_fn const & v);
+/** \brief Similar to mk_axiom, but the type is only produced the first time it is needed. */
+declaration mk_lazy_axiom(name const & n, level_param_names const & params, declaration_expr_fn const & t);
+/** \brief Similar to mk_constant_assumption, but the type is only produced the first time it is needed. */
+declaration mk_lazy_constant_assumption(name const & n, level_param_names const & params,
+                                        declaration_expr_fn const & t, bool trusted = true);
 declaration mk_axiom(name const & n, level_param_names const & params, expr const & t);
 declaration mk_constant_assumption(name const & n, level_param_names const & params, expr const & t, bool trusted = true);
 
@@ -7,7 +7,9 @@ Author: Leonardo de Moura
 #include <utility>
 #include <vector>
 #include <limits>
+#include <algorithm>
 #include "util/thread.h"
+#include "util/buffer.h"
 #include "kernel/environment.h"
 #include "kernel/kernel_exception.h"
 
@@ -218,6 +220,16 @@ void environment::for_each_declaration(std::function<void(declaration const & d)
     m_declarations.for_each([&](name const &, declaration const & d) { return f(d); });
 }
 
+void environment::for_each_declaration_by_name(std::function<void(declaration const & d)> const & f) const {
+    buffer<declaration const *> ds;
+    m_declarations.for_each([&](name const &, declaration const & d) { ds.push_back(&d); });
+    std::sort(ds.begin(), ds.end(), [](declaration const * d1, declaration const * d2) {
+            return d1->get_name() < d2->get_name();
+        });
+    for (declaration const * d : ds)
+        f(*d);
+}
+
 void environment::for_each_universe(std::function<void(name const & n)> const & f) const {
     m_global_levels.for_each([&](name const & n) { return f(n); });
 }
@@ -104,7 +104,7 @@ public:
 */
 class environment {
     typedef std::shared_ptr<environment_header const>     header;
-    typedef name_map<declaration>                         declarations;
+    typedef name_hamt_map<declaration>                    declarations;
     typedef std::shared_ptr<environment_extensions const> extensions;
 
     header         m_header;
@@ -218,9 +218,13 @@ public:
     */
     environment forget() const;
 
-    /** \brief Apply the function \c f to each declaration */
+    /** \brief Apply the function \c f to each declaration. The order is not specified. */
     void for_each_declaration(std::function<void(declaration const & d)> const & f) const;
 
+    /** \brief Apply the function \c f to each declaration in the order of their names.
+        It should be used when the order is observable (e.g., it affects the output). */
+    void for_each_declaration_by_name(std::function<void(declaration const & d)> const & f) const;
+
     /** \brief Apply the function \c f to each universe */
     void for_each_universe(std::function<void(name const & u)> const & f) const;
 
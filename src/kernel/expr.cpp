@@ -10,6 +10,7 @@ Author: Leonardo de Moura
 #include <string>
 #include <algorithm>
 #include <limits>
+#include <unordered_set>
 #include "util/list_fn.h"
 #include "util/hash.h"
 #include "util/buffer.h"
@@ -28,6 +29,14 @@ Author: Leonardo de Moura
 #define LEAN_INITIAL_EXPR_CACHE_CAPACITY 1024*16
 #endif
 
+#ifndef LEAN_EXPR_CACHE_NUM_SHARDS
+#define LEAN_EXPR_CACHE_NUM_SHARDS 64
+#endif
+
+#ifndef LEAN_EXPR_LOCAL_CACHE_SIZE
+#define LEAN_EXPR_LOCAL_CACHE_SIZE 1024
+#endif
+
 namespace lean {
 unsigned add_weight(unsigned w1, unsigned w2) {
     unsigned r = w1 + w2;
@@ -108,6 +117,15 @@ void expr_cell::set_tag(tag t) {
     m_tag = t;
 }
 
+bool expr_cell::try_inc_ref() {
+    unsigned rc = get_rc();
+    while (rc > 0) {
+        if (m_rc.compare_exchange_weak(rc, rc + 1, memory_order_relaxed))
+            return true;
+    }
+    return false;
+}
+
 bool is_meta(expr const & e) {
     return is_metavar(get_app_fn(e));
 }
@@ -327,40 +345,190 @@ expr_macro::~expr_macro() {
     delete[] m_args;
 }
 
+// =======================================
+// Hash-consing
+
+/* Direct-mapped cache of the expressions recently hash-consed by the current thread.
+   It is checked before the shared table, so creating again an expression that was recently created
+   does not acquire a shard lock. It contains strong references, so entries cannot be deleted by other threads. */
+typedef std::vector<optional<expr>> expr_local_cache;
+MK_THREAD_LOCAL_GET_DEF(expr_local_cache, get_expr_local_cache);
+
+/** \brief Hash-consing table shared by all threads.
+
+    The table contains weak references: it does not increment the reference counter of the
+    expressions stored in it, and expr_cell::dealloc removes deleted expressions from it.
+    To reduce contention, the table is split into shards, each one protected by its own mutex.
+
+    Two expressions are considered equal if they have the same kind, data (names, levels, binder information)
+    and pointer equal children. That is, the table assumes the children have already been hash-consed.
+    This test is cheap, and it does not need to access expressions that are being deleted. */
+class expr_hash_cons_table {
+    struct cell_hash {
+        unsigned operator()(expr_cell * c) const { return c->hash(); }
+    };
+
+    struct cell_eq {
+        bool operator()(expr_cell * c1, expr_cell * c2) const {
+            if (c1 == c2)                       return true;
+            if (c1->hash() != c2->hash())       return false;
+            if (c1->kind() != c2->kind())       return false;
+            switch (c1->kind()) {
+            case expr_kind::Var:
+                return to_var(c1)->get_vidx() == to_var(c2)->get_vidx();
+            case expr_kind::Sort:
+                return to_sort(c1)->get_level() == to_sort(c2)->get_level();
+            case expr_kind::Constant:
+                return
+                    to_constant(c1)->get_name() == to_constant(c2)->get_name() &&
+                    to_constant(c1)->get_levels() == to_constant(c2)->get_levels();
+            case expr_kind::Meta:
+                return
+                    to_mlocal(c1)->get_name() == to_mlocal(c2)->get_name() &&
+                    is_eqp(to_mlocal(c1)->get_type(), to_mlocal(c2)->get_type());
+            case expr_kind::Local:
+                return
+                    to_local(c1)->get_name() == to_local(c2)->get_name() &&
+                    is_eqp(to_local(c1)->get_type(), to_local(c2)->get_type()) &&
+                    to_local(c1)->get_pp_name() == to_local(c2)->get_pp_name() &&
+                    to_local(c1)->get_info() == to_local(c2)->get_info();
+            case expr_kind::App:
+                return
+                    is_eqp(to_app(c1)->get_fn(), to_app(c2)->get_fn()) &&
+                    is_eqp(to_app(c1)->get_arg(), to_app(c2)->get_arg());
+            case expr_kind::Lambda: case expr_kind::Pi:
+                return
+                    is_eqp(to_binding(c1)->get_domain(), to_binding(c2)->get_domain()) &&
+                    is_eqp(to_binding(c1)->get_body(), to_binding(c2)->get_body()) &&
+                    to_binding(c1)->get_name() == to_binding(c2)->get_name() &&
+                    to_binding(c1)->get_info() == to_binding(c2)->get_info();
+            case expr_kind::Let:
+                return
+                    is_eqp(to_let(c1)->get_type(), to_let(c2)->get_type()) &&
+                    is_eqp(to_let(c1)->get_value(), to_let(c2)->get_value()) &&
+                    is_eqp(to_let(c1)->get_body(), to_let(c2)->get_body()) &&
+                    to_let(c1)->get_name() == to_let(c2)->get_name();
+            case expr_kind::Macro:
+                if (to_macro(c1)->get_num_args() != to_macro(c2)->get_num_args() ||
+                    to_macro(c1)->get_def() != to_macro(c2)->get_def())
+                    return false;
+                for (unsigned i = 0; i < to_macro(c1)->get_num_args(); i++) {
+                    if (!is_eqp(to_macro(c1)->get_arg(i), to_macro(c2)->get_arg(i)))
+                        return false;
+                }
+                return true;
+            }
+            lean_unreachable(); // LCOV_EXCL_LINE
+        }
+    };
+
+    struct shard {
+        mutex                                                  m_mutex;
+        std::unordered_set<expr_cell *, cell_hash, cell_eq>    m_table;
+    };
+
+    shard m_shards[LEAN_EXPR_CACHE_NUM_SHARDS];
+
+    shard & get_shard(expr_cell * c) { return m_shards[c->hash() % LEAN_EXPR_CACHE_NUM_SHARDS]; }
+
+public:
+    expr_hash_cons_table() {
+        for (shard & s : m_shards)
+            s.m_table.reserve(LEAN_INITIAL_EXPR_CACHE_CAPACITY / LEAN_EXPR_CACHE_NUM_SHARDS);
+    }
+
+    /** \brief Return an expression in the table equal to \c e. If there is none, \c e is inserted. */
+    expr insert(expr const & e) {
+        expr_cell * c = e.raw();
+        if (c->is_hash_consed())
+            return e;
+        expr_local_cache & local = get_expr_local_cache();
+        if (local.empty())
+            local.resize(LEAN_EXPR_LOCAL_CACHE_SIZE);
+        optional<expr> & slot = local[c->hash() % LEAN_EXPR_LOCAL_CACHE_SIZE];
+        if (slot && cell_eq()(slot->raw(), c))
+            return *slot;
+        expr r = insert_core(e);
+        slot = r;
+        return r;
+    }
+
+private:
+    expr insert_core(expr const & e) {
+        expr_cell * c = e.raw();
+        shard & s = get_shard(c);
+        lock_guard<mutex> lock(s.m_mutex);
+        auto it = s.m_table.find(c);
+        if (it != s.m_table.end()) {
+            expr_cell * old = *it;
+            if (old->try_inc_ref()) {
+                expr r(old);
+                /* r holds a reference, so the following dec_ref does not delete \c old */
+                old->dec_ref();
+                return r;
+            }
+            /* \c old is being deleted by another thread, we replace it with \c c */
+            s.m_table.erase(it);
+        }
+        c->set_hash_consed();
+        s.m_table.insert(c);
+        return e;
+    }
+
+public:
+    /** \brief Remove \c c from the table. This method is invoked when the reference counter of \c c reaches 0. */
+    void erase(expr_cell * c) {
+        shard & s = get_shard(c);
+        lock_guard<mutex> lock(s.m_mutex);
+        auto it = s.m_table.find(c);
+        /* Remark: the entry may have been replaced by an equal expression (see insert). */
+        if (it != s.m_table.end() && *it == c)
+            s.m_table.erase(it);
+    }
+
+    bool contains(expr_cell * c) {
+        shard & s = get_shard(c);
+        lock_guard<mutex> lock(s.m_mutex);
+        return s.m_table.find(c) != s.m_table.end();
+    }
+
+    unsigned size() {
+        unsigned r = 0;
+        for (shard & s : m_shards) {
+            lock_guard<mutex> lock(s.m_mutex);
+            r += s.m_table.size();
+        }
+        return r;
+    }
+};
+
+static expr_hash_cons_table * g_hash_cons_table = nullptr;
+
 // =======================================
 // Constructors
 LEAN_THREAD_VALUE(bool, g_expr_cache_enabled, true);
-typedef typename std::unordered_set<expr, expr_hash, is_bi_equal_proc> expr_cache;
-MK_THREAD_LOCAL_GET_DEF(expr_cache, get_expr_cache);
 inline expr cache(expr const & e) {
-    if (g_expr_cache_enabled) {
-        expr_cache & cache = get_expr_cache();
-        auto it = cache.find(e);
-        if (it != cache.end()) {
-            return *it;
-        } else {
-            cache.insert(e);
-        }
-    }
+    if (g_expr_cache_enabled && g_hash_cons_table)
+        return g_hash_cons_table->insert(e);
     return e;
 }
 bool enable_expr_caching(bool f) {
     DEBUG_CODE(bool r1 =) enable_level_caching(f);
     bool r2 = g_expr_cache_enabled;
     lean_assert(r1 == r2);
-    expr_cache new_cache;
-    get_expr_cache().swap(new_cache);
+    get_expr_local_cache().clear();
     if (f) {
         clear_abstract_cache();
         clear_instantiate_cache();
-        cache(mk_Prop());
-        cache(mk_Type());
     }
     g_expr_cache_enabled = f;
     return r2;
 }
 bool is_cached(expr const & e) {
-    return get_expr_cache().find(e) != get_expr_cache().end();
+    return g_hash_cons_table && g_hash_cons_table->contains(e.raw());
+}
+unsigned get_hash_cons_table_size() {
+    return g_hash_cons_table ? g_hash_cons_table->size() : 0;
 }
 
 expr mk_var(unsigned idx, tag g) {
@@ -401,6 +569,8 @@ void expr_cell::dealloc() {
             expr_cell * it = todo.back();
             todo.pop_back();
             lean_assert(it->get_rc() == 0);
+            if (it->is_hash_consed() && g_hash_cons_table)
+                g_hash_cons_table->erase(it);
             switch (it->kind()) {
             case expr_kind::Var:        static_cast<expr_var*>(it)->dealloc(); break;
             case expr_kind::Macro:      static_cast<expr_macro*>(it)->dealloc(todo); break;
@@ -731,6 +901,7 @@ std::ostream & operator<<(std::ostream & out, expr_kind const & k) {
 }
 
 void initialize_expr() {
+    g_hash_cons_table = new expr_hash_cons_table();
     g_dummy        = new expr(mk_constant("__expr_for_default_constructor__"));
     g_default_name = new name("a");
     g_Type1        = new expr(mk_sort(mk_level_one()));
@@ -743,5 +914,7 @@ void finalize_expr() {
     delete g_Type1;
     delete g_dummy;
     delete g_default_name;
+    delete g_hash_cons_table;
+    g_hash_cons_table = nullptr;
 }
 }
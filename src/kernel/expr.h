@@ -50,6 +50,7 @@ class expr_cell {
 protected:
     // The bits of the following field mean:
     //    0-1  - term is an arrow (0 - not initialized, 1 - is arrow, 2 - is not arrow)
+    //    2    - term was inserted in the hash-consing table
     // Remark: we use atomic_uchar because these flags are computed lazily (i.e., after the expression is created)
     atomic_uchar       m_flags;
     unsigned           m_kind:8;
@@ -67,6 +68,12 @@ protected:
     void set_is_arrow(bool flag);
     friend bool is_arrow(expr const & e);
 
+    bool is_hash_consed() const { return (m_flags & 4) != 0; }
+    void set_hash_consed() { m_flags |= 4; }
+    /* Increment the reference counter if it is not zero. Return false if the cell is being deleted. */
+    bool try_inc_ref();
+    friend class expr_hash_cons_table;
+
      static void dec_ref(expr & c, buffer<expr_cell*> & todelete);
 public:
     expr_cell(expr_kind k, unsigned h, bool has_expr_mv, bool has_univ_mv, bool has_local, bool has_param_univ, tag g);
@@ -94,6 +101,7 @@ private:
     expr_cell * m_ptr;
     explicit expr(expr_cell * ptr):m_ptr(ptr) { if (m_ptr) m_ptr->inc_ref(); }
     friend class expr_cell;
+    friend class expr_hash_cons_table;
     expr_cell * steal_ptr() { expr_cell * r = m_ptr; m_ptr = nullptr; return r; }
     friend class optional<expr>;
 public:
@@ -493,7 +501,11 @@ inline expr mk_app(expr const & e1, expr const & e2, expr const & e3, expr const
 /** \brief Return application (...((f x_{n-1}) x_{n-2}) ... x_0) */
 expr mk_app_vars(expr const & f, unsigned n, tag g = nulltag);
 
-/** \brief Enable hash-consing (caching) for expressions (and universe levels) */
+/** \brief Enable hash-consing (caching) for expressions (and universe levels) created by the current thread.
+
+    Expressions are hash-consed using a table shared by all threads. The table only contains weak references,
+    i.e., an expression is removed from the table when its last (strong) reference is deleted.
+    Each thread also keeps the last expressions it hash-consed in a small cache, which is cleared by this function. */
 bool enable_expr_caching(bool f);
 /** \brief Helper class for temporarily enabling/disabling expression caching */
 struct scoped_expr_caching {
@@ -501,8 +513,10 @@ struct scoped_expr_caching {
     scoped_expr_caching(bool f) { m_old = enable_expr_caching(f); }
     ~scoped_expr_caching() { enable_expr_caching(m_old); }
 };
-/** \brief Return true iff \c e is in the cache */
+/** \brief Return true iff \c e is in the hash-consing table */
 bool is_cached(expr const & e);
+/** \brief Return the number of expressions in the hash-consing table */
+unsigned get_hash_cons_table_size();
 // =======================================
 
 // =======================================
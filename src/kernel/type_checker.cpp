@@ -12,6 +12,7 @@ Author: Leonardo de Moura
 #include "util/sstream.h"
 #include "util/scoped_map.h"
 #include "util/fresh_name.h"
+#include "util/profiler.h"
 #include "kernel/type_checker.h"
 #include "kernel/expr_maps.h"
 #include "kernel/instantiate.h"
@@ -742,6 +743,7 @@ static void check_duplicated_params(environment const & env, declaration const &
 }
 
 certified_declaration check(environment const & env, declaration const & d) {
+    profile_scope scope("type checking");
     if (d.is_definition())
         check_no_mlocal(env, d.get_name(), d.get_value(), false);
     check_no_mlocal(env, d.get_name(), d.get_type(), true);
@@ -170,7 +170,7 @@ bool is_exception(name const & n, name const & prefix, unsigned num_exceptions,
 environment add_aliases(environment const & env, name const & prefix, name const & new_prefix,
                         unsigned num_exceptions, name const * exceptions, bool overwrite) {
     aliases_ext ext = get_extension(env);
-    env.for_each_declaration([&](declaration const & d) {
+    env.for_each_declaration_by_name([&](declaration const & d) {
             if (is_prefix_of(prefix, d.get_name()) && !is_exception(d.get_name(), prefix, num_exceptions, exceptions)) {
                 name a        = d.get_name().replace_prefix(prefix, new_prefix);
                 if (!(is_protected(env, d.get_name()) && a.is_atomic()) &&
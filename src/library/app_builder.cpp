@@ -117,11 +117,12 @@ public:
     }
 
     environment const & env() const { return m_env; }
+    void set_env(environment const & env) { m_env = env; }
 };
 
 typedef cache_compatibility_helper<app_builder_cache> app_builder_cache_helper;
 
-MK_THREAD_LOCAL_GET_DEF(app_builder_cache_helper, get_abch);
+MK_THREAD_LOCAL_GET(app_builder_cache_helper, get_abch, "app_builder");
 
 /** Return an app_builder_cache for the transparency_mode in ctx, and compatible with the environment. */
 app_builder_cache & get_app_builder_cache_for(type_context const & ctx) {
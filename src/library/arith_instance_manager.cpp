@@ -32,12 +32,13 @@ private:
     expr_struct_map<arith_instance_info_cache_entry> m_cache;
 public:
     environment const & env() const { return m_env; }
+    void set_env(environment const & env) { m_env = env; }
     expr_struct_map<arith_instance_info_cache_entry> & get_cache() { return m_cache; }
     arith_instance_info_cache(environment const & env): m_env(env) {}
 };
 
 typedef transparencyless_cache_compatibility_helper<arith_instance_info_cache> arith_instance_info_cache_helper;
-MK_THREAD_LOCAL_GET_DEF(arith_instance_info_cache_helper, get_aiich);
+MK_THREAD_LOCAL_GET(arith_instance_info_cache_helper, get_aiich, "arith_instance_info");
 
 static expr_struct_map<arith_instance_info_cache_entry> & get_arith_instance_info_cache_for(type_context const & tctx) {
     return get_aiich().get_cache_for(tctx).get_cache();
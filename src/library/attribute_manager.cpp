@@ -15,7 +15,7 @@ Author: Leonardo de Moura
 
 namespace lean {
 static name_map<attribute_ptr> * g_system_attributes;
-static std::unique_ptr<user_attribute_ext> g_user_attribute_ext;
+static user_attribute_ext * g_user_attribute_ext = nullptr;
 
 static attr_data_ptr * g_default_attr_data_ptr = nullptr;
 
@@ -27,7 +27,8 @@ name_map<attribute_ptr> user_attribute_ext::get_attributes(environment const &)
     return {};
 }
 void set_user_attribute_ext(std::unique_ptr<user_attribute_ext> ext) {
-    g_user_attribute_ext = std::move(ext);
+    delete g_user_attribute_ext;
+    g_user_attribute_ext = ext.release();
 }
 
 static std::vector<pair<name, name>> * g_incomp = nullptr;
@@ -101,7 +102,18 @@ struct attr_entry {
 };
 
 typedef priority_queue<attr_record, attr_record_cmp> attr_records;
-typedef name_map<pair<attr_records, unsigned>> attr_state;
+
+struct attr_records_info {
+    attr_records m_records;
+    unsigned     m_fingerprint;
+    /* Declarations of the entries added so far, the most recent one first. The lists of a descendant
+       state share their tail with the list of the ancestor state, see attribute::get_updated_since. */
+    list<name>   m_updated;
+    unsigned     m_num_updated;
+    attr_records_info():m_fingerprint(0), m_num_updated(0) {}
+};
+
+typedef name_map<attr_records_info> attr_state;
 
 struct attr_config {
     typedef attr_state state;
@@ -112,15 +124,14 @@ struct attr_config {
     }
 
     static void add_entry(environment const &, io_state const &, state & s, entry const & e) {
-        attr_records m;
-        unsigned h = 0;
-        if (auto q = s.find(e.m_attr)) {
-            m = q->first;
-            h = q->second;
-        }
-        m.insert(e.m_record, e.m_prio);
-        h = hash(h, get_entry_hash(e));
-        s.insert(e.m_attr, mk_pair(m, h));
+        attr_records_info info;
+        if (auto q = s.find(e.m_attr))
+            info = *q;
+        info.m_records.insert(e.m_record, e.m_prio);
+        info.m_fingerprint = hash(info.m_fingerprint, get_entry_hash(e));
+        info.m_updated     = cons(e.m_record.m_decl, info.m_updated);
+        info.m_num_updated++;
+        s.insert(e.m_attr, info);
     }
 
     static std::string const & get_serialization_key() {
@@ -179,7 +190,7 @@ environment attribute::unset(environment env, io_state const & ios, name const &
 
 attr_data_ptr attribute::get_untyped(environment const & env, name const & n) const {
     if (auto p = attribute_ext::get_state(env).find(m_id)) {
-        attr_records const & records = p->first;
+        attr_records const & records = p->m_records;
         if (auto record = records.get_key({n, {}}))
             return record->m_data;
     }
@@ -188,7 +199,7 @@ attr_data_ptr attribute::get_untyped(environment const & env, name const & n) co
 
 unsigned attribute::get_prio(environment const & env, name const & n) const {
     if (auto p = attribute_ext::get_state(env).find(get_name())) {
-        attr_records const & records = p->first;
+        attr_records const & records = p->m_records;
         if (auto prio = records.get_prio({n, {}}))
             return prio.value();
     }
@@ -197,7 +208,7 @@ unsigned attribute::get_prio(environment const & env, name const & n) const {
 
 void attribute::get_instances(environment const & env, buffer<name> & r) const {
     if (auto p = attribute_ext::get_state(env).find(m_id)) {
-        attr_records const & records = p->first;
+        attr_records const & records = p->m_records;
         records.for_each([&](attr_record const & rec) {
                 if (!rec.deleted())
                     r.push_back(rec.m_decl);
@@ -207,11 +218,28 @@ void attribute::get_instances(environment const & env, buffer<name> & r) const {
 
 unsigned attribute::get_fingerprint(environment const & env) const {
     if (auto p = attribute_ext::get_state(env).find(m_id)) {
-        return p->second;
+        return p->m_fingerprint;
     }
     return 0;
 }
 
+bool attribute::get_updated_since(environment const & old_env, environment const & new_env, buffer<name> & r) const {
+    attr_records_info old_info, new_info;
+    if (auto p = attribute_ext::get_state(old_env).find(m_id))
+        old_info = *p;
+    if (auto p = attribute_ext::get_state(new_env).find(m_id))
+        new_info = *p;
+    if (new_info.m_num_updated < old_info.m_num_updated)
+        return false;
+    list<name> it = new_info.m_updated;
+    for (unsigned i = old_info.m_num_updated; i < new_info.m_num_updated; i++) {
+        r.push_back(head(it));
+        it = tail(it);
+    }
+    /* the entries of old_env may have been removed when a scope was closed */
+    return is_eqp(it, old_info.m_updated);
+}
+
 priority_queue<name, name_quick_cmp> attribute::get_instances_by_prio(environment const & env) const {
     priority_queue<name, name_quick_cmp> q;
     buffer<name> b;
@@ -275,7 +303,7 @@ unsigned get_attribute_fingerprint(environment const & env, name const & attr) {
 void initialize_attribute_manager() {
     g_default_attr_data_ptr = new attr_data_ptr(new attr_data);
     g_system_attributes  = new name_map<attribute_ptr>();
-    g_user_attribute_ext.reset(new user_attribute_ext());
+    g_user_attribute_ext = new user_attribute_ext();
     g_incomp             = new std::vector<pair<name, name>>();
     g_key                = new std::string("ATTR");
     attribute_ext::initialize();
@@ -285,7 +313,8 @@ void finalize_attribute_manager() {
     attribute_ext::finalize();
     delete g_key;
     delete g_incomp;
-    g_user_attribute_ext.reset();
+    delete g_user_attribute_ext;
+    g_user_attribute_ext = nullptr;
     delete g_system_attributes;
     delete g_default_attr_data_ptr;
 }
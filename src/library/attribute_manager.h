@@ -69,6 +69,10 @@ public:
 
     virtual environment unset(environment env, io_state const & ios, name const & n, bool persistent) const;
     virtual unsigned get_fingerprint(environment const & env) const;
+    /** \brief Store in \c r the declarations whose attribute was set or removed in \c new_env after \c old_env,
+        and return true. The cost is proportional to the number of these updates.
+        Return false if \c new_env does not extend the attribute entries of \c old_env (e.g., a scope was closed). */
+    bool get_updated_since(environment const & old_env, environment const & new_env, buffer<name> & r) const;
 };
 
 typedef std::shared_ptr<attribute const> attribute_ptr;
@@ -216,6 +220,7 @@ typedef typed_attribute<indices_attribute_data> indices_attribute;
 
 class user_attribute_ext {
 public:
+    virtual ~user_attribute_ext() {}
     virtual name_map<attribute_ptr> get_attributes(environment const & env);
     virtual void write_entry(serializer &, attr_data const &) {}
     virtual attr_data_ptr read_entry(deserializer &) {
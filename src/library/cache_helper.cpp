@@ -0,0 +1,75 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#include <map>
+#include <string>
+#include <vector>
+#include <iterator>
+#include <iomanip>
+#include "util/hash.h"
+#include "library/attribute_manager.h"
+#include "library/cache_helper.h"
+
+namespace lean {
+typedef std::map<std::string, std::unique_ptr<cache_stats>> cache_stats_map;
+static mutex *           g_cache_stats_mutex = nullptr;
+static cache_stats_map * g_cache_stats       = nullptr;
+
+cache_stats & get_cache_stats(char const * n) {
+    lock_guard<mutex> lock(*g_cache_stats_mutex);
+    std::unique_ptr<cache_stats> & r = (*g_cache_stats)[n];
+    if (!r)
+        r.reset(new cache_stats());
+    return *r;
+}
+
+void display_cache_stats(std::ostream & out) {
+    lock_guard<mutex> lock(*g_cache_stats_mutex);
+    for (auto const & p : *g_cache_stats) {
+        cache_stats const & s = *p.second;
+        unsigned hits   = s.m_hits;
+        unsigned reuses = s.m_reuses;
+        unsigned misses = s.m_misses;
+        unsigned total  = hits + reuses + misses;
+        if (total == 0)
+            continue;
+        out << std::left << std::setw(20) << p.first << std::right
+            << " hits: " << hits << ", reuses: " << reuses << ", misses: " << misses
+            << ", reuse rate: " << (100 * (hits + reuses)) / total << "%\n";
+    }
+}
+
+/* Attributes that may affect the information stored in the caches. */
+static char const * g_cache_attribute_names[] = {"reducibility", "class", "instance", "unify",
+                                                 "refl", "symm", "trans", "subst"};
+static std::vector<name> * g_cache_attributes = nullptr;
+
+unsigned get_cache_attributes_fingerprint(environment const & env) {
+    unsigned r = 31;
+    for (name const & attr : *g_cache_attributes)
+        r = hash(r, get_attribute_fingerprint(env, attr));
+    return r;
+}
+
+bool is_cache_reusable(environment const & cached_env, unsigned fingerprint, environment const & env) {
+    return
+        env.is_descendant(cached_env) &&
+        get_cache_attributes_fingerprint(env) == fingerprint;
+}
+
+void initialize_cache_helper() {
+    g_cache_stats_mutex = new mutex();
+    g_cache_stats       = new cache_stats_map();
+    g_cache_attributes  = new std::vector<name>(std::begin(g_cache_attribute_names),
+                                                std::end(g_cache_attribute_names));
+}
+
+void finalize_cache_helper() {
+    delete g_cache_attributes;
+    delete g_cache_stats;
+    delete g_cache_stats_mutex;
+}
+}
@@ -6,19 +6,85 @@ Author: Leonardo de Moura
 */
 #pragma once
 #include <memory>
+#include <iostream>
+#include <type_traits>
+#include "util/thread.h"
+#include "util/profiler.h"
 #include "library/type_context.h"
 
 namespace lean {
-/** \brief Helper class for making sure we have a cache that is compatible
-    with a given environment and transparency mode. */
+/** \brief Statistics for a family of caches (e.g., all fun_info caches).
+    - hits:   the cache was created for the given environment.
+    - reuses: the cache was created for an ancestor of the given environment, and it was kept.
+    - misses: a new cache had to be created.
+
+    The counters are shared by all threads, so they are only updated when the profiler is enabled. */
+struct cache_stats {
+    atomic<unsigned> m_hits;
+    atomic<unsigned> m_reuses;
+    atomic<unsigned> m_misses;
+    cache_stats():m_hits(0), m_reuses(0), m_misses(0) {}
+    void hit() { if (is_profiler_enabled()) m_hits++; }
+    void reuse() { if (is_profiler_enabled()) m_reuses++; }
+    void miss() { if (is_profiler_enabled()) m_misses++; }
+};
+
+/** \brief Return the statistics object for the caches named \c n. */
+cache_stats & get_cache_stats(char const * n);
+/** \brief Display the statistics of all caches. */
+void display_cache_stats(std::ostream & out);
+
+/** \brief Fingerprint for the attributes that may affect the information stored in the caches
+    managed by the helper classes below: reducibility, type classes and instances, and relation attributes. */
+unsigned get_cache_attributes_fingerprint(environment const & env);
+
+/** \brief Return true if a cache created for \c cached_env can be used with \c env.
+    \c fingerprint is the value of get_cache_attributes_fingerprint for \c cached_env.
+
+    Caches store information derived from the declarations in the environment. Declarations are never
+    modified, so the information is still valid in descendant environments unless one of the attributes above
+    has been modified. */
+bool is_cache_reusable(environment const & cached_env, unsigned fingerprint, environment const & env);
+
+/** \brief Try to reuse the cache \c c for \c env. See cache_compatibility_helper. */
 template<typename Cache>
+bool try_reuse_cache(Cache & c, unsigned fingerprint, environment const & env, std::true_type) {
+    if (!is_cache_reusable(c.env(), fingerprint, env))
+        return false;
+    c.set_env(env);
+    return true;
+}
+
+template<typename Cache>
+bool try_reuse_cache(Cache &, unsigned, environment const &, std::false_type) {
+    return false;
+}
+
+/** \brief Helper class for making sure we have a cache that is compatible
+    with a given environment and transparency mode.
+
+    If \c Reuse is true, a cache is kept when we move to a descendant environment, and
+    the \c Cache class must provide the method <tt>void set_env(environment const & env)</tt>. */
+template<typename Cache, bool Reuse = true>
 class cache_compatibility_helper {
     std::unique_ptr<Cache> m_cache_ptr[4];
+    unsigned               m_fingerprint[4];
+    cache_stats &          m_stats;
 public:
+    cache_compatibility_helper(char const * n):m_stats(get_cache_stats(n)) {}
+
     Cache & get_cache_for(environment const & env, transparency_mode m) {
         unsigned midx = static_cast<unsigned>(m);
-        if (!m_cache_ptr[midx] || !is_eqp(env, m_cache_ptr[midx]->env())) {
+        if (m_cache_ptr[midx] && is_eqp(env, m_cache_ptr[midx]->env())) {
+            m_stats.hit();
+        } else if (m_cache_ptr[midx] &&
+                   try_reuse_cache(*m_cache_ptr[midx], m_fingerprint[midx], env, std::integral_constant<bool, Reuse>())) {
+            m_stats.reuse();
+        } else {
+            m_stats.miss();
             m_cache_ptr[midx].reset(new Cache(env));
+            if (Reuse)
+                m_fingerprint[midx] = get_cache_attributes_fingerprint(env);
         }
         return *m_cache_ptr[midx].get();
     }
@@ -33,14 +99,26 @@ public:
 };
 
 /** \brief Helper class for making sure we have a cache that is compatible
-    with a given environment. */
-template<typename Cache>
+    with a given environment. See cache_compatibility_helper. */
+template<typename Cache, bool Reuse = true>
 class transparencyless_cache_compatibility_helper {
     std::unique_ptr<Cache> m_cache_ptr;
+    unsigned               m_fingerprint;
+    cache_stats &          m_stats;
 public:
+    transparencyless_cache_compatibility_helper(char const * n):m_stats(get_cache_stats(n)) {}
+
     Cache & get_cache_for(environment const & env) {
-        if (!m_cache_ptr || !is_eqp(env, m_cache_ptr->env())) {
+        if (m_cache_ptr && is_eqp(env, m_cache_ptr->env())) {
+            m_stats.hit();
+        } else if (m_cache_ptr &&
+                   try_reuse_cache(*m_cache_ptr, m_fingerprint, env, std::integral_constant<bool, Reuse>())) {
+            m_stats.reuse();
+        } else {
+            m_stats.miss();
             m_cache_ptr.reset(new Cache(env));
+            if (Reuse)
+                m_fingerprint = get_cache_attributes_fingerprint(env);
         }
         return *m_cache_ptr.get();
     }
@@ -53,4 +131,7 @@ public:
         m_cache_ptr.reset();
     }
 };
+
+void initialize_cache_helper();
+void finalize_cache_helper();
 }
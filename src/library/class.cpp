@@ -8,6 +8,7 @@ Author: Leonardo de Moura
 #include "util/lbool.h"
 #include "util/sstream.h"
 #include "util/fresh_name.h"
+#include "util/name_set.h"
 #include "kernel/instantiate.h"
 #include "library/scoped_ext.h"
 #include "library/kernel_serializer.h"
@@ -15,6 +16,9 @@ Author: Leonardo de Moura
 #include "library/aliases.h"
 #include "library/protected.h"
 #include "library/type_context.h"
+#include "library/trace.h"
+#include "library/discr_tree.h"
+#include "library/unification_hint.h"
 #include "library/class.h"
 #include "library/attribute_manager.h"
 
@@ -25,17 +29,20 @@ struct class_entry {
     name             m_class;
     name             m_instance; // only relevant if m_kind == Instance
     unsigned         m_priority; // only relevant if m_kind == Instance
+    discr_tree_keys  m_keys;     // only relevant if m_kind == Instance, keys for the resulting type of the instance
     class_entry():m_kind(class_entry_kind::Class), m_priority(0) {}
     explicit class_entry(name const & c):m_kind(class_entry_kind::Class), m_class(c), m_priority(0) {}
-    class_entry(class_entry_kind k, name const & c, name const & i, unsigned p):
-        m_kind(k), m_class(c), m_instance(i), m_priority(p) {}
+    class_entry(class_entry_kind k, name const & c, name const & i, unsigned p, discr_tree_keys const & keys):
+        m_kind(k), m_class(c), m_instance(i), m_priority(p), m_keys(keys) {}
 };
 
 struct class_state {
-    typedef name_map<list<name>> class_instances;
-    typedef name_map<unsigned>   instance_priorities;
+    typedef name_hamt_map<list<name>> class_instances;
+    typedef name_hamt_map<unsigned>   instance_priorities;
     class_instances       m_instances;
     instance_priorities   m_priorities;
+    /* Index for retrieving the instances that may be used to solve a given class-instance problem. */
+    discr_tree<name>      m_instance_tree;
 
     unsigned get_priority(name const & i) const {
         if (auto it = m_priorities.find(i))
@@ -63,7 +70,7 @@ struct class_state {
             m_instances.insert(c, list<name>());
     }
 
-    void add_instance(name const & c, name const & i, unsigned p) {
+    void add_instance(name const & c, name const & i, unsigned p, discr_tree_keys const & keys) {
         auto it = m_instances.find(c);
         if (!it) {
             m_instances.insert(c, to_list(i));
@@ -72,6 +79,9 @@ struct class_state {
             m_instances.insert(c, insert(i, p, lst));
         }
         m_priorities.insert(i, p);
+        buffer<discr_tree_key> key_buffer;
+        to_buffer(keys, key_buffer);
+        m_instance_tree.insert(key_buffer, i);
     }
 };
 
@@ -87,7 +97,7 @@ struct class_config {
             s.add_class(e.m_class);
             break;
         case class_entry_kind::Instance:
-            s.add_instance(e.m_class, e.m_instance, e.m_priority);
+            s.add_instance(e.m_class, e.m_instance, e.m_priority, e.m_keys);
             break;
         }
     }
@@ -105,6 +115,7 @@ struct class_config {
             break;
         case class_entry_kind::Instance:
             s << e.m_class << e.m_instance << e.m_priority;
+            write_list(s, e.m_keys);
             break;
         }
     }
@@ -118,6 +129,7 @@ struct class_config {
             break;
         case class_entry_kind::Instance:
             d >> e.m_class >> e.m_instance >> e.m_priority;
+            e.m_keys = read_list<discr_tree_key>(d);
             break;
         }
         return e;
@@ -179,22 +191,50 @@ static environment set_reducible_if_def(environment const & env, name const & n,
         return env;
 }
 
+/* Return the discrimination tree keys for the class-instance problem \c type, where \c type is of the form
+   (c a_1 ... a_n). The arguments are indexed using the transparency mode of \c ctx. */
+static discr_tree_keys get_class_instance_keys(type_context & ctx, name const & c, expr const & type) {
+    buffer<expr> args;
+    get_app_args(type, args);
+    buffer<discr_tree_key> keys;
+    keys.push_back(discr_tree_key(discr_tree_key_kind::Constant, c, args.size()));
+    for (expr const & arg : args) {
+        buffer<discr_tree_key> arg_keys;
+        try {
+            get_discr_tree_keys(ctx, arg, arg_keys);
+            keys.append(arg_keys);
+        } catch (exception &) {
+            keys.push_back(discr_tree_key());
+        }
+    }
+    return to_list(keys);
+}
+
+/* Put \c type in the form used to register instances, i.e., unfold definitions until we find a class. */
+static expr whnf_class(type_context & ctx, class_state const & S, expr const & type) {
+    type_context::transparency_scope scope(ctx, transparency_mode::All);
+    return ctx.whnf_pred(type, [&](expr const & e) { return !is_constant(e) || !S.m_instances.contains(const_name(e)); });
+}
+
 environment add_instance(environment const & env, name const & n, unsigned priority, bool persistent) {
     declaration d = env.get(n);
     expr type = d.get_type();
-    type_context ctx(env, transparency_mode::All);
+    type_context ctx(env, transparency_mode::Reducible);
+    type_context::tmp_mode_scope tmp_scope(ctx);
     class_state S = class_ext::get_state(env);
-    type_context::tmp_locals locals(ctx);
     while (true) {
-        type = ctx.whnf_pred(type, [&](expr const & e) { return !is_constant(e) || !S.m_instances.contains(const_name(e)); });
+        type = whnf_class(ctx, S, type);
         if (!is_pi(type))
             break;
-        expr x = locals.push_local_from_binding(type);
-        type = instantiate(binding_body(type), x);
+        expr m = ctx.mk_tmp_mvar(binding_domain(type));
+        type = instantiate(binding_body(type), m);
     }
     name c = get_class_name(env, get_app_fn(type));
     check_is_class(env, c);
-    environment new_env = class_ext::add_entry(env, get_dummy_ios(), class_entry(class_entry_kind::Instance, c, n, priority),
+    /* Remark: the instance synthesizer unifies the resulting type using reducible transparency */
+    discr_tree_keys keys = get_class_instance_keys(ctx, c, type);
+    environment new_env = class_ext::add_entry(env, get_dummy_ios(),
+                                               class_entry(class_entry_kind::Instance, c, n, priority, keys),
                                                persistent);
     return set_reducible_if_def(new_env, n, persistent);
 }
@@ -229,10 +269,49 @@ list<name> get_class_instances(environment const & env, name const & c) {
     return ptr_to_list(s.m_instances.find(c));
 }
 
+bool get_updated_classes(environment const & old_env, environment const & new_env, name_set & r) {
+    class_state const & old_s = class_ext::get_state(old_env);
+    class_state const & new_s = class_ext::get_state(new_env);
+    bool same_classes = old_s.m_instances.size() == new_s.m_instances.size();
+    /* Remark: the list of instances of a class is only copied when the class is updated. */
+    new_s.m_instances.for_each([&](name const & c, list<name> const & insts) {
+            if (auto old_insts = old_s.m_instances.find(c)) {
+                if (!is_eqp(*old_insts, insts))
+                    r.insert(c);
+            } else {
+                same_classes = false;
+            }
+        });
+    return same_classes;
+}
+
+list<name> get_class_instances(type_context & ctx, name const & c, expr const & type) {
+    class_state const & s = class_ext::get_state(ctx.env());
+    list<name> insts = ptr_to_list(s.m_instances.find(c));
+    if (!insts || !tail(insts))
+        return insts;
+    /* Unification hints may solve constraints that have different head symbols */
+    if (!get_unification_hints(ctx.env()).empty())
+        return insts;
+    expr it = whnf_class(ctx, s, ctx.instantiate_mvars(type));
+    if (!is_constant(get_app_fn(it)) || const_name(get_app_fn(it)) != c)
+        return insts;
+    buffer<discr_tree_key> keys;
+    to_buffer(get_class_instance_keys(ctx, c, it), keys);
+    name_set candidates;
+    s.m_instance_tree.find(keys, [&](name const & i) { candidates.insert(i); });
+    list<name> r = filter(insts, [&](name const & i) { return candidates.contains(i); });
+    lean_trace(name({"class_instances", "discr_tree"}),
+               unsigned n = length(insts);
+               tout() << "pruned " << n - length(r) << " of " << n << " instances of '" << c << "' for " << type << "\n";);
+    return r;
+}
+
 void initialize_class() {
     g_class_name = new name("class");
     g_key = new std::string("class");
     class_ext::initialize();
+    register_trace_class(name({"class_instances", "discr_tree"}));
 
     register_system_attribute(basic_attribute("class", "type class",
                                               [](environment const & env, io_state const &, name const & d, unsigned,
@@ -5,6 +5,7 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Author: Leonardo de Moura
 */
 #pragma once
+#include "util/name_set.h"
 #include "library/util.h"
 namespace lean {
 /** \brief Add a new 'class' to the environment (if it is not already declared) */
@@ -21,6 +22,16 @@ name_predicate mk_class_pred(environment const & env);
 name_predicate mk_instance_pred(environment const & env);
 /** \brief Return the instances of the given class. */
 list<name> get_class_instances(environment const & env, name const & c);
+/** \brief Store in \c r the classes whose instances in \c new_env are not the ones in \c old_env.
+    Return false if \c old_env and \c new_env do not have the same classes. */
+bool get_updated_classes(environment const & old_env, environment const & new_env, name_set & r);
+class type_context;
+/** \brief Return the instances of the class \c c that may be used to solve the class-instance problem \c type.
+    The result is a subset of get_class_instances(ctx.env(), c) retrieved using a discrimination tree,
+    and it is sorted by priority. The instances that are not in the result cannot be unified
+    with \c type using reducible transparency.
+    \pre ctx.is_class(type) == c */
+list<name> get_class_instances(type_context & ctx, name const & c, expr const & type);
 /** \brief Return the classes in the given environment. */
 void get_classes(environment const & env, buffer<name> & classes);
 name get_class_name(environment const & env, expr const & e);
@@ -0,0 +1,506 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#if !defined(LEAN_WINDOWS) && !defined(LEAN_EMSCRIPTEN)
+#include <dlfcn.h>
+#endif
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <sstream>
+#include "util/sstream.h"
+#include "util/name_set.h"
+#include "library/module.h"
+#include "library/vm/vm.h"
+#include "library/compiler/cpp_compiler.h"
+
+namespace lean {
+/* Auxiliary definitions used by the generated code. The stack of each generated function
+   has the same layout of the VM stack, i.e., the arguments are stored in reverse order
+   at the bottom of the stack.
+
+   Generated functions take their arguments by value, and callers move them off their stacks.
+   So, a function holds the only reference to an argument that is not shared, and the VM builtins
+   may update it in place (e.g., array.write). */
+static char const * g_cpp_prelude =
+    "#include <utility>\n"
+    "#include \"util/interrupt.h\"\n"
+    "#include \"util/stackinfo.h\"\n"
+    "#include \"library/vm/vm.h\"\n"
+    "\n"
+    "namespace {\n"
+    "using namespace lean; // NOLINT\n"
+    "typedef buffer<vm_obj> stack;\n"
+    "\n"
+    "inline vm_obj pop(stack & s) { vm_obj r = s.back(); s.pop_back(); return r; }\n"
+    "inline void push_arg(stack & s, vm_obj && v) { s.push_back(mk_vm_simple(0)); s.back() = std::move(v); }\n"
+    "inline void push(stack & s, unsigned i) { vm_obj v = s[i]; s.push_back(v); }\n"
+    "inline void move(stack & s, unsigned i) { vm_obj v = s[i]; s[i] = mk_vm_simple(0); s.push_back(v); }\n"
+    "inline void drop(stack & s, unsigned n) {\n"
+    "    unsigned sz = s.size(); swap(s[sz - n - 1], s[sz - 1]); s.shrink(sz - n);\n"
+    "}\n"
+    "inline void result(stack & s, unsigned n, vm_obj const & r) { s.shrink(s.size() - n); s.push_back(r); }\n"
+    "inline void cnstr(stack & s, unsigned cidx, unsigned n) {\n"
+    "    unsigned sz = s.size(); result(s, n, mk_vm_constructor(cidx, n, s.data() + sz - n));\n"
+    "}\n"
+    "inline void closure(stack & s, unsigned fn_idx, unsigned n) {\n"
+    "    unsigned sz = s.size(); result(s, n, mk_vm_closure(fn_idx, n, s.data() + sz - n));\n"
+    "}\n"
+    "inline void global(stack & s, unsigned fn_idx, unsigned n) {\n"
+    "    unsigned sz = s.size(); result(s, n, invoke_global(fn_idx, n, s.data() + sz - n));\n"
+    "}\n"
+    "inline void proj(stack & s, unsigned i) { vm_obj v = cfield(s.back(), i); s.back() = v; }\n"
+    "inline void apply(stack & s) { vm_obj c = pop(s); vm_obj a = pop(s); s.push_back(invoke(c, a)); }\n"
+    "inline void push_fields(stack & s, vm_obj const & o) {\n"
+    "    if (is_constructor(o)) { for (unsigned i = 0; i < csize(o); i++) s.push_back(cfield(o, i)); }\n"
+    "}\n"
+    "inline unsigned cases(stack & s) { vm_obj o = pop(s); push_fields(s, o); return cidx(o); }\n"
+    "inline unsigned cases(stack & s, vm_cases_function fn) {\n"
+    "    vm_obj o = pop(s); buffer<vm_obj> data; unsigned r = fn(o, data); s.append(data); return r;\n"
+    "}\n"
+    "/* Return false and pop the top of the stack if it is zero, and replace it with its predecessor otherwise. */\n"
+    "inline bool nat_cases(stack & s) {\n"
+    "    vm_obj & top = s.back();\n"
+    "    if (is_simple(top)) {\n"
+    "        unsigned v = cidx(top);\n"
+    "        if (v == 0) { s.pop_back(); return false; }\n"
+    "        top = mk_vm_simple(v - 1); return true;\n"
+    "    } else {\n"
+    "        if (to_mpz(top) == 0) { s.pop_back(); return false; }\n"
+    "        vm_obj v = mk_vm_mpz(to_mpz(top) - 1); top = v; return true;\n"
+    "    }\n"
+    "}\n";
+
+static void display_cpp_string(std::ostream & out, char const * str) {
+    out << "\"";
+    for (char const * it = str; *it; it++) {
+        unsigned char c = *it;
+        if (c == '\"' || c == '\\' || c == '?') {
+            out << "\\" << c;
+        } else if (c >= 32 && c < 127) {
+            out << c;
+        } else {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\%03o", c);
+            out << buf;
+        }
+    }
+    out << "\"";
+}
+
+static void display_cpp_name(std::ostream & out, name const & n) {
+    if (n.is_anonymous()) {
+        out << "name()";
+    } else {
+        out << "name(";
+        display_cpp_name(out, n.get_prefix());
+        out << ", ";
+        if (n.is_string())
+            display_cpp_string(out, n.get_string());
+        else
+            out << n.get_numeral() << "u";
+        out << ")";
+    }
+}
+
+class cpp_compiler_fn {
+    environment        m_env;
+    std::ostream &     m_out;
+    /* functions being compiled, and their position in m_fns */
+    buffer<vm_decl>    m_fns;
+    name_map<unsigned> m_fn2id;
+    /* VM functions, builtin C functions, builtin cases and numerals used by the generated code. */
+    buffer<name>       m_fn_refs;
+    name_map<unsigned> m_fn_ref2id;
+    buffer<name>       m_cfuns;
+    name_map<unsigned> m_cfun2id;
+    buffer<name>       m_cases;
+    name_map<unsigned> m_cases2id;
+    buffer<mpz>        m_nums;
+    /* true if the function being emitted references VM functions by index */
+    bool               m_uses_fn_refs;
+
+    static unsigned get_id(name const & n, buffer<name> & ns, name_map<unsigned> & n2id) {
+        if (auto id = n2id.find(n))
+            return *id;
+        unsigned id = ns.size();
+        ns.push_back(n);
+        n2id.insert(n, id);
+        return id;
+    }
+
+    unsigned get_fn_ref_id(name const & n) {
+        m_uses_fn_refs = true;
+        return get_id(n, m_fn_refs, m_fn_ref2id);
+    }
+
+    static bool is_supported(vm_decl const & d) {
+        for (unsigned i = 0; i < d.get_code_size(); i++) {
+            if (d.get_code()[i].op() == opcode::Pexpr)
+                return false;
+        }
+        return true;
+    }
+
+    /* Emit the parameters of a generated function. If \c cfun is true, we use the calling convention
+       of vm_cfunction, i.e., the arguments are passed by const reference. */
+    static void emit_params(std::ostream & out, unsigned arity, bool cfun) {
+        if (arity > 8) {
+            out << (cfun ? "unsigned n, vm_obj const * as" : "unsigned, vm_obj * as");
+        } else {
+            for (unsigned i = 1; i <= arity; i++) {
+                if (i > 1) out << ", ";
+                out << (cfun ? "vm_obj const & a_" : "vm_obj a_") << i;
+            }
+        }
+    }
+
+    static void emit_signature(std::ostream & out, unsigned id, unsigned arity) {
+        out << "vm_obj fn_" << id << "(";
+        emit_params(out, arity, false);
+        out << ")";
+    }
+
+    /* Emit the function registered in the VM for fn_<id>. The VM invokes native functions as
+       vm_cfunction objects, and keeps a reference to their arguments. */
+    static void emit_cfun_wrapper(std::ostream & out, unsigned id, unsigned arity) {
+        out << "vm_obj fn_" << id << "_cfun(";
+        emit_params(out, arity, true);
+        out << ") {";
+        if (arity > 8) {
+            out << " buffer<vm_obj> args; args.append(n, as); return fn_" << id << "(n, args.data()); }\n";
+        } else {
+            out << " return fn_" << id << "(";
+            for (unsigned i = 1; i <= arity; i++) {
+                if (i > 1) out << ", ";
+                out << "a_" << i;
+            }
+            out << "); }\n";
+        }
+    }
+
+    static char const * cfun_type(unsigned arity) {
+        static char const * types[] = {
+            "vm_cfunction_0", "vm_cfunction_1", "vm_cfunction_2", "vm_cfunction_3", "vm_cfunction_4",
+            "vm_cfunction_5", "vm_cfunction_6", "vm_cfunction_7", "vm_cfunction_8"};
+        return arity > 8 ? "vm_cfunction_N" : types[arity];
+    }
+
+    /* Emit the invocation of the C++ function \c fn with the \c arity arguments on the top of the stack.
+       If \c move is true, the arguments are moved off the stack, see g_cpp_prelude. The builtin C functions
+       take their arguments by const reference, and the stack holds the only reference to them. */
+    static void emit_cpp_call(std::ostream & out, std::string const & fn, unsigned arity, bool move) {
+        if (arity == 0) {
+            out << "s.push_back(" << fn << "());";
+            return;
+        }
+        out << "{ unsigned sz = s.size(); ";
+        if (arity > 8) {
+            out << "vm_obj as[" << arity << "] = {";
+            for (unsigned i = 1; i <= arity; i++) {
+                if (i > 1) out << ", ";
+                out << "std::move(s[sz - " << i << "])";
+            }
+            out << "}; result(s, " << arity << ", " << fn << "(" << arity << ", as)); }";
+        } else {
+            out << "result(s, " << arity << ", " << fn << "(";
+            for (unsigned i = 1; i <= arity; i++) {
+                if (i > 1) out << ", ";
+                if (move)
+                    out << "std::move(s[sz - " << i << "])";
+                else
+                    out << "s[sz - " << i << "]";
+            }
+            out << ")); }";
+        }
+    }
+
+    void emit_invoke(std::ostream & out, vm_decl const & d, vm_instr const & instr) {
+        name fn_name     = get_vm_decl_name(m_env, instr.get_fn_idx());
+        vm_decl fn       = *get_vm_decl(m_env, fn_name);
+        unsigned arity   = fn.get_arity();
+        if (auto id = m_fn2id.find(fn_name)) {
+            if (instr.op() == opcode::TailInvokeGlobal && fn_name == d.get_name()) {
+                /* self tail call */
+                out << "{ unsigned sz = s.size(); ";
+                out << "for (unsigned i = 0; i < " << arity << "; i++) s[i] = s[sz - " << arity << " + i]; ";
+                out << "s.shrink(" << arity << "); } check_interrupted(); goto pc_0;";
+            } else {
+                emit_cpp_call(out, (sstream() << "fn_" << *id).str(), arity, true);
+            }
+        } else if (fn.is_cfun() && is_vm_builtin_function(fn_name) &&
+                   get_vm_builtin_kind(fn_name) == vm_builtin_kind::CFun) {
+            unsigned id = get_id(fn_name, m_cfuns, m_cfun2id);
+            std::string cfn = (sstream() << "reinterpret_cast<" << cfun_type(arity) << ">(g_cfuns[" << id << "])").str();
+            emit_cpp_call(out, cfn, arity, false);
+        } else {
+            out << "global(s, fn_idxs[" << get_fn_ref_id(fn_name) << "], " << arity << ");";
+        }
+    }
+
+    void emit_instr(std::ostream & out, vm_decl const & d, vm_instr const & instr) {
+        switch (instr.op()) {
+        case opcode::Push:
+            out << "push(s, " << instr.get_idx() << ");";
+            break;
+        case opcode::Move:
+            out << "move(s, " << instr.get_idx() << ");";
+            break;
+        case opcode::Drop:
+            out << "drop(s, " << instr.get_num() << ");";
+            break;
+        case opcode::Goto:
+            out << "goto pc_" << instr.get_goto_pc() << ";";
+            break;
+        case opcode::SConstructor:
+            out << "s.push_back(mk_vm_simple(" << instr.get_cidx() << "));";
+            break;
+        case opcode::Constructor:
+            out << "cnstr(s, " << instr.get_cidx() << ", " << instr.get_nfields() << ");";
+            break;
+        case opcode::Closure: {
+            name fn_name = get_vm_decl_name(m_env, instr.get_fn_idx());
+            out << "closure(s, fn_idxs[" << get_fn_ref_id(fn_name) << "], " << instr.get_nargs() << ");";
+            break;
+        }
+        case opcode::Num:
+            out << "s.push_back(mk_vm_mpz(*g_nums[" << m_nums.size() << "]));";
+            m_nums.push_back(instr.get_mpz());
+            break;
+        case opcode::Destruct:
+            out << "cases(s);";
+            break;
+        case opcode::Cases2:
+            out << "if (cases(s) == 0) goto pc_" << instr.get_cases2_pc(0) << "; else goto pc_" << instr.get_cases2_pc(1) << ";";
+            break;
+        case opcode::NatCases:
+            out << "if (nat_cases(s)) goto pc_" << instr.get_cases2_pc(1) << ";";
+            break;
+        case opcode::CasesN: case opcode::BuiltinCases: {
+            if (instr.op() == opcode::CasesN) {
+                out << "switch (cases(s)) {";
+            } else {
+                name cases_name = get_vm_builtin_cases_name(m_env, instr.get_cases_idx());
+                out << "switch (cases(s, g_cases[" << get_id(cases_name, m_cases, m_cases2id) << "])) {";
+            }
+            unsigned n = instr.get_casesn_size();
+            for (unsigned i = 0; i < n; i++) {
+                if (i + 1 < n)
+                    out << " case " << i << ": ";
+                else
+                    out << " default: ";
+                out << "goto pc_" << instr.get_casesn_pc(i) << ";";
+            }
+            out << " }";
+            break;
+        }
+        case opcode::Proj:
+            out << "proj(s, " << instr.get_idx() << ");";
+            break;
+        case opcode::Apply:
+            out << "apply(s);";
+            break;
+        case opcode::InvokeGlobal: case opcode::TailInvokeGlobal:
+        case opcode::InvokeBuiltin: case opcode::InvokeCFun:
+            emit_invoke(out, d, instr);
+            break;
+        case opcode::Unreachable:
+            out << "throw exception(\"VM unreachable instruction has been reached\");";
+            break;
+        case opcode::Ret:
+            out << "return s.back();";
+            break;
+        case opcode::Pexpr:
+            lean_unreachable();
+        }
+    }
+
+    void emit_fn(std::ostream & out, unsigned id) {
+        vm_decl const & d     = m_fns[id];
+        unsigned arity        = d.get_arity();
+        vm_instr const * code = d.get_code();
+        unsigned code_sz      = d.get_code_size();
+        /* Collect jump targets */
+        std::vector<bool> target(code_sz, false);
+        for (unsigned i = 0; i < code_sz; i++) {
+            vm_instr const & instr = code[i];
+            if (instr.op() == opcode::TailInvokeGlobal &&
+                get_vm_decl_name(m_env, instr.get_fn_idx()) == d.get_name()) {
+                target[0] = true;
+            } else if (instr.op() == opcode::NatCases) {
+                /* the zero case is the next instruction, see emit_instr */
+                target[instr.get_pc(1)] = true;
+            } else {
+                for (unsigned j = 0; j < instr.get_num_pcs(); j++)
+                    target[instr.get_pc(j)] = true;
+            }
+        }
+        std::ostringstream code_out;
+        m_uses_fn_refs = false;
+        for (unsigned pc = 0; pc < code_sz; pc++) {
+            if (target[pc])
+                code_out << "  pc_" << pc << ":\n";
+            code_out << "    ";
+            emit_instr(code_out, d, code[pc]);
+            code_out << "\n";
+        }
+        out << "/* " << d.get_name() << " */\n";
+        emit_signature(out, id, arity);
+        out << " {\n";
+        out << "    check_interrupted();\n";
+        out << "    check_stack(";
+        display_cpp_string(out, d.get_name().to_string().c_str());
+        out << ");\n";
+        /* The function indices depend on the environment being executed, see install_vm_natives. */
+        if (m_uses_fn_refs)
+            out << "    unsigned const * fn_idxs = get_vm_native_fn_idxs(g_lib);\n";
+        out << "    stack s;\n";
+        unsigned i = arity;
+        while (i > 0) {
+            if (arity > 8)
+                out << "    push_arg(s, std::move(as[" << i - 1 << "]));\n";
+            else
+                out << "    push_arg(s, std::move(a_" << i << "));\n";
+            --i;
+        }
+        out << code_out.str();
+        out << "}\n\n";
+    }
+
+public:
+    cpp_compiler_fn(environment const & env, std::ostream & out):
+        m_env(env), m_out(out), m_uses_fn_refs(false) {}
+
+    void add_fn(name const & n) {
+        optional<vm_decl> d = get_vm_decl(m_env, n);
+        if (d && d->is_bytecode() && is_supported(*d) && !m_fn2id.contains(n)) {
+            m_fn2id.insert(n, m_fns.size());
+            m_fns.push_back(*d);
+        }
+    }
+
+    /* Add the bytecode functions invoked by the functions being compiled. Then, these invocations are
+       direct C++ calls instead of (nested) executions of the VM interpreter. */
+    void add_callees() {
+        for (unsigned id = 0; id < m_fns.size(); id++) {
+            vm_decl d = m_fns[id];
+            for (unsigned i = 0; i < d.get_code_size(); i++) {
+                vm_instr const & instr = d.get_code()[i];
+                if (instr.op() == opcode::InvokeGlobal || instr.op() == opcode::TailInvokeGlobal)
+                    add_fn(get_vm_decl_name(m_env, instr.get_fn_idx()));
+            }
+        }
+    }
+
+    void operator()(buffer<name> const & fns) {
+        for (name const & n : fns)
+            add_fn(n);
+        unsigned num_registered = m_fns.size();
+        add_callees();
+        std::ostringstream body;
+        for (unsigned id = 0; id < m_fns.size(); id++)
+            emit_fn(body, id);
+
+        m_out << "// Generated by the Lean C++ code generator\n";
+        m_out << g_cpp_prelude << "\n";
+        m_out << "unsigned g_lib;\n";
+        if (!m_cfuns.empty())
+            m_out << "vm_cfunction g_cfuns[" << m_cfuns.size() << "];\n";
+        if (!m_cases.empty())
+            m_out << "vm_cases_function g_cases[" << m_cases.size() << "];\n";
+        if (!m_nums.empty())
+            m_out << "mpz * g_nums[" << m_nums.size() << "];\n";
+        m_out << "\n";
+        for (unsigned id = 0; id < m_fns.size(); id++) {
+            emit_signature(m_out, id, m_fns[id].get_arity());
+            m_out << ";\n";
+        }
+        m_out << "\n" << body.str();
+        for (unsigned id = 0; id < num_registered; id++)
+            emit_cfun_wrapper(m_out, id, m_fns[id].get_arity());
+        m_out << "}\n\n";
+
+        /* The objects allocated by the registration function are never deleted
+           since the native code is used until the end of the execution. */
+        m_out << "extern \"C\" void " << LEAN_NATIVE_REGISTER_FN << "() {\n";
+        m_out << "    buffer<name> fn_refs;\n";
+        for (unsigned i = 0; i < m_fn_refs.size(); i++) {
+            m_out << "    fn_refs.push_back(";
+            display_cpp_name(m_out, m_fn_refs[i]);
+            m_out << ");\n";
+        }
+        m_out << "    g_lib = register_vm_native_library(fn_refs);\n";
+        for (unsigned i = 0; i < m_cfuns.size(); i++) {
+            m_out << "    g_cfuns[" << i << "] = get_vm_builtin_cfun(";
+            display_cpp_name(m_out, m_cfuns[i]);
+            m_out << ");\n";
+        }
+        for (unsigned i = 0; i < m_cases.size(); i++) {
+            m_out << "    g_cases[" << i << "] = get_vm_builtin_cases(";
+            display_cpp_name(m_out, m_cases[i]);
+            m_out << ");\n";
+        }
+        for (unsigned i = 0; i < m_nums.size(); i++) {
+            m_out << "    g_nums[" << i << "] = new mpz(\"" << m_nums[i] << "\");\n";
+        }
+        /* Callees are registered without an implementation, install_vm_natives only checks their code hash. */
+        for (unsigned id = 0; id < m_fns.size(); id++) {
+            vm_decl const & d = m_fns[id];
+            m_out << "    register_vm_native(g_lib, ";
+            display_cpp_name(m_out, d.get_name());
+            m_out << ", " << d.get_arity() << ", " << get_vm_code_hash(m_env, d) << "u, ";
+            if (id < num_registered)
+                m_out << "reinterpret_cast<vm_cfunction>(fn_" << id << "_cfun));\n";
+            else
+                m_out << "nullptr);\n";
+        }
+        m_out << "}\n";
+    }
+};
+
+void emit_cpp(std::ostream & out, environment const & env, buffer<name> const & fns) {
+    cpp_compiler_fn(env, out)(fns);
+}
+
+void emit_cpp_module(std::ostream & out, environment const & env) {
+    /* The VM functions of a declaration \c d are \c d and auxiliary functions such as d._lambda_1 */
+    name_set decls;
+    for (name const & n : get_curr_module_decl_names(env))
+        decls.insert(n);
+    buffer<name> fns;
+    for_each_vm_decl(env, [&](vm_decl const & d) {
+            if (!d.is_bytecode())
+                return;
+            name n = d.get_name();
+            while (!n.is_anonymous()) {
+                if (decls.contains(n)) {
+                    fns.push_back(d.get_name());
+                    return;
+                }
+                n = n.get_prefix();
+            }
+        });
+    emit_cpp(out, env, fns);
+}
+
+#if !defined(LEAN_WINDOWS) && !defined(LEAN_EMSCRIPTEN)
+void load_native_library(std::string const & fname) {
+    void * handle = dlopen(fname.c_str(), RTLD_NOW | RTLD_GLOBAL);
+    if (!handle)
+        throw exception(sstream() << "failed to load native library '" << fname << "', " << dlerror());
+    void * fn = dlsym(handle, LEAN_NATIVE_REGISTER_FN);
+    if (!fn)
+        throw exception(sstream() << "invalid native library '" << fname << "', function '"
+                        << LEAN_NATIVE_REGISTER_FN << "' is missing");
+    reinterpret_cast<void (*)()>(fn)();
+}
+#else
+void load_native_library(std::string const & fname) {
+    throw exception(sstream() << "failed to load native library '" << fname << "', "
+                    << "native libraries are not supported on this platform");
+}
+#endif
+}
@@ -0,0 +1,37 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#pragma once
+#include <iostream>
+#include <string>
+#include "kernel/environment.h"
+
+/* Name of the function defined by the code produced by emit_cpp. */
+#define LEAN_NATIVE_REGISTER_FN "lean_register_natives"
+
+namespace lean {
+/** \brief Generate C++ code for the bytecode of the VM functions \c fns.
+
+    Each function is translated into a C++ function that has the same semantics of the VM
+    interpreter, but without the dispatch overhead. Calls to functions in \c fns are direct C++ calls,
+    and self tail calls are jumps. The generated code defines the function
+
+         extern "C" void lean_register_natives();
+
+    which registers the generated functions, together with the code hash of their bytecode, using
+    register_vm_native. The generated code should be compiled as a shared object, and loaded using
+    load_native_library.
+
+    \remark Functions containing quoted expressions are skipped, and are still executed by the VM. */
+void emit_cpp(std::ostream & out, environment const & env, buffer<name> const & fns);
+
+/** \brief Similar to emit_cpp, but generate code for all VM functions defined in the current module. */
+void emit_cpp_module(std::ostream & out, environment const & env);
+
+/** \brief Load a shared object produced from the code generated by emit_cpp, and register its functions.
+    The native code is installed after modules are imported (see install_vm_natives). */
+void load_native_library(std::string const & fname);
+}
@@ -4,9 +4,13 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
+#include <algorithm>
+#include "util/flet.h"
 #include "util/fresh_name.h"
 #include "util/sstream.h"
+#include "util/profiler.h"
 #include "kernel/instantiate.h"
+#include "kernel/for_each_fn.h"
 #include "kernel/inductive/inductive.h"
 #include "library/constants.h"
 #include "library/trace.h"
@@ -24,6 +28,15 @@ namespace lean {
 class vm_compiler_fn {
     environment        m_env;
     buffer<vm_instr> & m_code;
+    /* The value of an expression compiled at bpz is stored at the stack slot bpz, and the
+       stack slots used to compute it are above bpz. So, the maximum bpz + 1 is the number of
+       stack slots used by the code. */
+    unsigned           m_stack_size;
+    /* Local constants used by the code executed after the expression being compiled.
+       The last use of a local is compiled into a move instruction instead of a push one.
+       Then, the VM stack does not keep a reference to its value, and builtins such as
+       array.write can update it in place. */
+    name_set           m_live;
 
     void emit(vm_instr const & i) {
         m_code.push_back(i);
@@ -37,24 +50,57 @@ class vm_compiler_fn {
         return ::lean::mk_local(n, mk_neutral_expr());
     }
 
+    static void collect_used_locals(expr const & e, name_set & s) {
+        for_each(e, [&](expr const & x, unsigned) {
+                if (!has_local(x)) return false;
+                if (is_local(x)) s.insert(mlocal_name(x));
+                return true;
+            });
+    }
+
+    /* Return the locals used by \c e or by the code executed after it. */
+    name_set live_before(expr const & e) const {
+        name_set r = m_live;
+        collect_used_locals(e, r);
+        return r;
+    }
+
+    /* Store in live[i] the locals used after es[i] when es[0], ..., es[n-1] are compiled in this order. */
+    void mk_live_sets(unsigned n, expr const * es, buffer<name_set> & live) const {
+        live.resize(n);
+        name_set s = m_live;
+        unsigned i = n;
+        while (i > 0) {
+            --i;
+            live[i] = s;
+            collect_used_locals(es[i], s);
+        }
+    }
+
     void compile_args(unsigned nargs, expr const * args, unsigned bpz, name_map<unsigned> const & m) {
+        buffer<name_set> live;
+        mk_live_sets(nargs, args, live);
         for (unsigned i = 0; i < nargs; i++, bpz++) {
+            flet<name_set> set(m_live, live[i]);
             compile(args[i], bpz, m);
         }
     }
 
     void compile_rev_args(unsigned nargs, expr const * args, unsigned bpz, name_map<unsigned> const & m) {
+        buffer<expr> rev_args;
         unsigned i = nargs;
         while (i > 0) {
             --i;
-            compile(args[i], bpz, m);
-            bpz++;
+            rev_args.push_back(args[i]);
         }
+        compile_args(rev_args.size(), rev_args.data(), bpz, m);
     }
 
     void compile_global(vm_decl const & decl, unsigned nargs, expr const * args, unsigned bpz, name_map<unsigned> const & m) {
         compile_rev_args(nargs, args, bpz, m);
         if (decl.get_arity() <= nargs) {
+            /* the result is stored above the remaining arguments */
+            m_stack_size = std::max(m_stack_size, bpz + nargs - decl.get_arity() + 1);
             if (decl.is_builtin())
                 emit(mk_invoke_builtin_instr(decl.get_idx()));
             else if (decl.is_cfun())
@@ -96,7 +142,10 @@ class vm_compiler_fn {
 
     void compile_local(expr const & e, name_map<unsigned> const & m) {
         unsigned idx = *m.find(mlocal_name(e));
-        emit(mk_push_instr(idx));
+        if (m_live.contains(mlocal_name(e)))
+            emit(mk_push_instr(idx));
+        else
+            emit(mk_move_instr(idx));
     }
 
     void compile_cases_on(expr const & e, unsigned bpz, name_map<unsigned> const & m) {
@@ -121,7 +170,13 @@ class vm_compiler_fn {
         lean_assert(args.size() == num + 1);
         lean_assert(num >= 1);
         /** compile major premise */
-        compile(args[0], bpz, m);
+        {
+            name_set live = m_live;
+            for (unsigned i = 1; i < args.size(); i++)
+                collect_used_locals(args[i], live);
+            flet<name_set> set(m_live, live);
+            compile(args[0], bpz, m);
+        }
         unsigned cases_pos = next_pc();
         buffer<unsigned> cases_args;
         buffer<unsigned> goto_pcs;
@@ -190,7 +245,10 @@ class vm_compiler_fn {
         lean_assert(is_internal_proj(fn));
         unsigned idx = *is_internal_proj(fn);
         lean_assert(args.size() >= 1);
-        compile_rev_args(args.size() - 1, args.data() + 1, bpz, m);
+        {
+            flet<name_set> set(m_live, live_before(args[0]));
+            compile_rev_args(args.size() - 1, args.data() + 1, bpz, m);
+        }
         bpz += args.size() - 1;
         compile(args[0], bpz, m);
         emit(mk_proj_instr(idx));
@@ -201,7 +259,10 @@ class vm_compiler_fn {
         buffer<expr> args;
         expr fn = get_app_args(e, args);
         if (!is_constant(fn)) {
-            compile_rev_args(args.size(), args.data(), bpz+1, m);
+            {
+                flet<name_set> set(m_live, live_before(fn));
+                compile_rev_args(args.size(), args.data(), bpz+1, m);
+            }
             compile(fn, bpz, m);
             emit_apply_instr(args.size());
             return;
@@ -236,21 +297,26 @@ class vm_compiler_fn {
     }
 
     void compile_let(expr e, unsigned bpz, name_map<unsigned> const & m) {
-        unsigned counter = 0;
         buffer<expr> locals;
-        name_map<unsigned> new_m = m;
+        /* values of the let-declarations followed by the body */
+        buffer<expr> es;
         while (is_let(e)) {
-            counter++;
-            compile(instantiate_rev(let_value(e), locals.size(), locals.data()), bpz, new_m);
-            name n = mk_fresh_name();
-            new_m.insert(n, bpz);
-            locals.push_back(mk_local(n));
-            bpz++;
+            es.push_back(instantiate_rev(let_value(e), locals.size(), locals.data()));
+            locals.push_back(mk_local(mk_fresh_name()));
             e = let_body(e);
         }
-        lean_assert(counter > 0);
-        compile(instantiate_rev(e, locals.size(), locals.data()), bpz, new_m);
-        emit(mk_drop_instr(counter));
+        lean_assert(!locals.empty());
+        es.push_back(instantiate_rev(e, locals.size(), locals.data()));
+        buffer<name_set> live;
+        mk_live_sets(es.size(), es.data(), live);
+        name_map<unsigned> new_m = m;
+        for (unsigned i = 0; i < es.size(); i++) {
+            flet<name_set> set(m_live, live[i]);
+            compile(es[i], bpz + i, new_m);
+            if (i < locals.size())
+                new_m.insert(mlocal_name(locals[i]), bpz + i);
+        }
+        emit(mk_drop_instr(locals.size()));
     }
 
     void compile_macro(expr const & e, unsigned bpz, name_map<unsigned> const & m) {
@@ -267,6 +333,7 @@ class vm_compiler_fn {
     }
 
     void compile(expr const & e, unsigned bpz, name_map<unsigned> const & m) {
+        m_stack_size = std::max(m_stack_size, bpz + 1);
         switch (e.kind()) {
         case expr_kind::Var:      lean_unreachable();
         case expr_kind::Sort:     lean_unreachable();
@@ -292,7 +359,9 @@ class vm_compiler_fn {
 
 public:
     vm_compiler_fn(environment const & env, buffer<vm_instr> & code):
-        m_env(env), m_code(code) {}
+        m_env(env), m_code(code), m_stack_size(0) {}
+
+    unsigned get_stack_size() const { return m_stack_size; }
 
     unsigned operator()(expr e) {
         buffer<expr> locals;
@@ -329,12 +398,13 @@ environment vm_compile(environment const & env, buffer<pair<name, expr>> const &
         optimize(new_env, code);
         lean_trace(name({"compiler", "optimize_bytecode"}), tout() << " " << p.first << " " << arity << "\n";
                    display_vm_code(tout().get_stream(), new_env, code.size(), code.data()););
-        new_env = update_vm_code(new_env, p.first, code.size(), code.data());
+        new_env = update_vm_code(new_env, p.first, code.size(), code.data(), gen.get_stack_size());
     }
     return new_env;
 }
 
 environment vm_compile(environment const & env, declaration const & d) {
+    profile_scope scope("compilation");
     buffer<pair<name, expr>> procs;
     preprocess(env, d, procs);
     return vm_compile(env, procs);
@@ -37,11 +37,12 @@ struct congr_lemma_cache {
         m_env(env),
         m_relation_info_getter(mk_relation_info_getter(env)) {}
     environment const & env() const { return m_env; }
+    void set_env(environment const & env) { m_env = env; }
 };
 
 typedef cache_compatibility_helper<congr_lemma_cache> congr_lemma_cache_helper;
 
-MK_THREAD_LOCAL_GET_DEF(congr_lemma_cache_helper, get_clch);
+MK_THREAD_LOCAL_GET(congr_lemma_cache_helper, get_clch, "congr_lemma");
 
 congr_lemma_cache & get_congr_lemma_cache_for(type_context const & ctx) {
     return get_clch().get_cache_for(ctx);
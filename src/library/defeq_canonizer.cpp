@@ -23,11 +23,13 @@ struct defeq_canonize_cache {
     environment const & env() const { return m_env; }
 };
 
-/* The defeq_canonize_cache does not depend on the transparency mode */
-typedef transparencyless_cache_compatibility_helper<defeq_canonize_cache>
+/* The defeq_canonize_cache does not depend on the transparency mode.
+   It is not reused in descendant environments since the canonical mappings are
+   only relevant for the terms being processed (e.g., the current proof), and m_M would keep growing. */
+typedef transparencyless_cache_compatibility_helper<defeq_canonize_cache, false>
 defeq_canonize_cache_helper;
 
-MK_THREAD_LOCAL_GET_DEF(defeq_canonize_cache_helper, get_dcch);
+MK_THREAD_LOCAL_GET(defeq_canonize_cache_helper, get_dcch, "defeq_canonize");
 
 defeq_canonize_cache & get_defeq_canonize_cache_for(type_context const & ctx) {
     return get_dcch().get_cache_for(ctx);
@@ -4,12 +4,22 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
 #include "util/interrupt.h"
+#include "util/sstream.h"
+#include "util/hash.h"
+#include "util/file_lock.h"
+#include "util/lean_path.h"
 #include "kernel/for_each_fn.h"
 #include "library/placeholder.h"
 #include "library/kernel_serializer.h"
 #include "library/definition_cache.h"
-#include "library/fingerprint.h"
+#include "library/attribute_manager.h"
+#include "version.h"
 
 namespace lean {
 /** \brief Similar to expr_eq_fn, but allows different placeholders
@@ -87,8 +97,10 @@ class expr_eq_modulo_placeholders_fn {
                 compare(mlocal_name(a), mlocal_name(b), placeholders) &&
                 compare(mlocal_type(a), mlocal_type(b));
         case expr_kind::Local:
+            /* The names of local constants are produced by fresh name generators, and they are
+               not stable across different lean processes. So, we compare them modulo renaming. */
             return
-                compare(mlocal_name(a), mlocal_name(b), placeholders) &&
+                compare(mlocal_name(a), mlocal_name(b), true) &&
                 compare(mlocal_type(a), mlocal_type(b)) &&
                 local_pp_name(a) == local_pp_name(b) &&
                 local_info(a) == local_info(b);
@@ -125,37 +137,251 @@ public:
     bool operator()(expr const & a, expr const & b) { return compare(a, b); }
 };
 
-definition_cache::entry::entry(expr const & pre_t, expr const & pre_v,
+/** \brief Hash code compatible with expr_eq_modulo_placeholders_fn, i.e., the names of
+    placeholders and local constants are ignored. The result does not depend on memory addresses,
+    and can be used to identify expressions in different lean processes. */
+class hash_modulo_placeholders_fn {
+    std::unordered_map<expr_cell const *, uint64> m_cache;
+
+    static uint64 mk(uint64 h1, uint64 h2) { return ::lean::hash(h1, h2); }
+    static uint64 mk(uint64 h1, name const & n) { return mk(h1, static_cast<uint64>(n.hash())); }
+
+    uint64 hash(level const & l) {
+        if (is_placeholder(l))
+            return 3;
+        uint64 k = static_cast<uint64>(kind(l)) + 5;
+        switch (kind(l)) {
+        case level_kind::Zero:   return k;
+        case level_kind::Param:  return mk(k, param_id(l));
+        case level_kind::Global: return mk(k, global_id(l));
+        case level_kind::Meta:   return mk(k, meta_id(l));
+        case level_kind::Succ:   return mk(k, hash(succ_of(l)));
+        case level_kind::Max:    return mk(mk(k, hash(max_lhs(l))), hash(max_rhs(l)));
+        case level_kind::IMax:   return mk(mk(k, hash(imax_lhs(l))), hash(imax_rhs(l)));
+        }
+        lean_unreachable(); // LCOV_EXCL_LINE
+    }
+
+    uint64 hash(levels const & ls) {
+        uint64 r = 17;
+        for (level const & l : ls)
+            r = mk(r, hash(l));
+        return r;
+    }
+
+    uint64 hash_core(expr const & e) {
+        check_system("hash modulo placeholders");
+        if (is_placeholder(e))
+            return is_local(e) ? mk(7, hash(mlocal_type(e))) : 7;
+        uint64 k = static_cast<uint64>(e.kind()) + 11;
+        switch (e.kind()) {
+        case expr_kind::Var:
+            return mk(k, static_cast<uint64>(var_idx(e)));
+        case expr_kind::Constant:
+            return mk(mk(k, const_name(e)), hash(const_levels(e)));
+        case expr_kind::Meta:
+            return mk(k, hash(mlocal_type(e)));
+        case expr_kind::Local:
+            return mk(mk(k, local_pp_name(e)), hash(mlocal_type(e)));
+        case expr_kind::App:
+            return mk(mk(k, hash(app_fn(e))), hash(app_arg(e)));
+        case expr_kind::Lambda: case expr_kind::Pi:
+            return mk(mk(k, hash(binding_domain(e))), hash(binding_body(e)));
+        case expr_kind::Let:
+            return mk(mk(mk(k, hash(let_type(e))), hash(let_value(e))), hash(let_body(e)));
+        case expr_kind::Sort:
+            return mk(k, hash(sort_level(e)));
+        case expr_kind::Macro: {
+            uint64 r = mk(k, static_cast<uint64>(macro_def(e).hash()));
+            for (unsigned i = 0; i < macro_num_args(e); i++)
+                r = mk(r, hash(macro_arg(e, i)));
+            return r;
+        }}
+        lean_unreachable(); // LCOV_EXCL_LINE
+    }
+
+    uint64 hash(expr const & e) {
+        if (!is_shared(e))
+            return hash_core(e);
+        auto it = m_cache.find(e.raw());
+        if (it != m_cache.end())
+            return it->second;
+        uint64 r = hash_core(e);
+        m_cache.insert(mk_pair(e.raw(), r));
+        return r;
+    }
+
+public:
+    uint64 operator()(expr const & e) { return hash(e); }
+};
+
+static char const * g_cache_header  = "leancache";
+static char const * g_index_file    = "index";
+static char const * g_entry_ext     = ".def";
+
+/* Attributes that may affect the result of elaborating a definition. */
+static char const * g_key_attributes[] = {"reducibility", "class", "instance", "simp", "congr", "refl",
+                                          "elab_as_eliminator", "elab_simple", "elab_with_expected_type"};
+
+/* Fingerprint of the options and the attributes in g_key_attributes. Unlike get_fingerprint, it does not
+   depend on the imports and open namespaces of the file being processed. So, entries can be reused by
+   different files that have the same options, instances, reducibility annotations and simplification lemmas.
+   Remark: the options are included because some of them affect elaboration (e.g., class.instance_max_depth). */
+static uint64 get_cache_fingerprint(environment const & env, options const & opts) {
+    uint64 r = hash(31, static_cast<uint64>(opts.hash()));
+    for (char const * attr : g_key_attributes) {
+        if (is_attribute(env, attr))
+            r = hash(r, static_cast<uint64>(get_attribute_fingerprint(env, attr)));
+    }
+    return r;
+}
+
+/* Hash code for the types of the constants occurring in \c e, they are the dependencies of the pre-terms. */
+static uint64 hash_pre_dependencies(environment const & env, expr const & e, uint64 r) {
+    name_set visited;
+    for_each(e, [&](expr const & e, unsigned) {
+            if (!is_constant(e))
+                return true;
+            name const & n = const_name(e);
+            if (visited.contains(n))
+                return true;
+            visited.insert(n);
+            if (auto d = env.find(n))
+                r = hash(hash(r, static_cast<uint64>(n.hash())), static_cast<uint64>(hash_bi(d->get_type())));
+            return true;
+        });
+    return r;
+}
+
+/* Remark: the declaration name is not part of the key, an entry can be used for a definition with a
+   different name as long as the elaborated terms do not refer to auxiliary declarations of the
+   original one (see refers_to_aux_decls). */
+static uint64 get_key(environment const & env, expr const & pre_type, expr const & pre_value, uint64 fingerprint,
+                      bool is_trusted) {
+    hash_modulo_placeholders_fn h;
+    uint64 r = fingerprint;
+    r = hash(r, h(pre_type));
+    r = hash(r, h(pre_value));
+    r = hash_pre_dependencies(env, pre_type, r);
+    r = hash_pre_dependencies(env, pre_value, r);
+    return hash(r, static_cast<uint64>(is_trusted));
+}
+
+/* Return true iff \c e contains a constant whose name is prefixed by \c n, e.g., \c n._main. */
+static bool refers_to_aux_decls(expr const & e, name const & n) {
+    bool found = false;
+    for_each(e, [&](expr const & e, unsigned) {
+            if (found)
+                return false;
+            if (is_constant(e) && is_prefix_of(n, const_name(e)))
+                found = true;
+            return true;
+        });
+    return found;
+}
+
+static void write_header(serializer & s) {
+    s << g_cache_header << LEAN_VERSION_MAJOR << LEAN_VERSION_MINOR << LEAN_VERSION_PATCH;
+}
+
+static bool check_header(deserializer & d) {
+    std::string header;
+    unsigned major, minor, patch;
+    d >> header;
+    if (header != g_cache_header)
+        return false;
+    d >> major >> minor >> patch;
+    return major == LEAN_VERSION_MAJOR && minor == LEAN_VERSION_MINOR && patch == LEAN_VERSION_PATCH;
+}
+
+/* Move \c tmp_fname to \c fname. Remark: std::rename does not overwrite existing files on Windows. */
+static void rename_file(std::string const & tmp_fname, std::string const & fname) {
+    if (std::rename(tmp_fname.c_str(), fname.c_str()) != 0) {
+        std::remove(fname.c_str());
+        if (std::rename(tmp_fname.c_str(), fname.c_str()) != 0) {
+            std::remove(tmp_fname.c_str());
+            throw exception(sstream() << "failed to write '" << fname << "'");
+        }
+    }
+}
+
+
+definition_cache::entry::entry(name const & n, expr const & pre_t, expr const & pre_v,
                                level_param_names const & ps, expr const & t, expr const & v,
                                dependencies const & deps, uint64 fingerprint, bool is_trusted):
-    m_pre_type(pre_t), m_pre_value(pre_v), m_params(ps),
+    m_name(n), m_pre_type(pre_t), m_pre_value(pre_v), m_params(ps),
     m_type(t), m_value(v), m_dependencies(deps), m_fingerprint(fingerprint), m_is_trusted(is_trusted) {}
 
-definition_cache::definition_cache() {}
+definition_cache::definition_cache(std::string const & dir, unsigned capacity):
+    m_dir(dir), m_capacity(capacity) {
+    if (!create_directory(m_dir.c_str()))
+        throw exception(sstream() << "failed to create cache directory '" << m_dir << "'");
+}
 
-void definition_cache::load(std::istream & in) {
-    lock_guard<mutex> lc(m_mutex);
-    deserializer d(in);
-    unsigned num;
-    d >> num;
-    for (unsigned i = 0; i < num; i++) {
-        name n;
-        level_param_names ls;
-        expr pre_type, pre_value, type, value;
-        d >> n >> pre_type >> pre_value >> ls >> type >> value;
-        dependencies deps;
-        unsigned num;
-        d >> num;
-        for (unsigned i = 0; i < num; i++) {
-            name n; unsigned h;
-            d >> n >> h;
-            deps.insert(n, h);
+std::string definition_cache::get_entry_file(uint64 key) const {
+    char buffer[20];
+    std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(key));
+    return path_append(m_dir.c_str(), (std::string(buffer) + g_entry_ext).c_str());
+}
+
+std::string definition_cache::get_index_file() const {
+    return path_append(m_dir.c_str(), g_index_file);
+}
+
+/* Return the entry associated with the given key, it is read from the cache directory
+   if it has not been loaded yet.
+   \pre m_mutex is locked */
+auto definition_cache::load_entry(uint64 key) -> entry const * {
+    auto it = m_entries.find(key);
+    if (it != m_entries.end())
+        return &it->second;
+    if (m_missing.count(key))
+        return nullptr;
+    std::ifstream in(get_entry_file(key), std::ifstream::binary);
+    if (!in.bad() && !in.fail()) {
+        try {
+            deserializer d(in);
+            if (check_header(d)) {
+                entry e;
+                d >> e.m_name >> e.m_pre_type >> e.m_pre_value >> e.m_params >> e.m_type >> e.m_value;
+                unsigned num;
+                d >> num;
+                for (unsigned i = 0; i < num; i++) {
+                    name n; unsigned h;
+                    d >> n >> h;
+                    e.m_dependencies.insert(n, h);
+                }
+                d >> e.m_fingerprint >> e.m_is_trusted;
+                return &m_entries.insert(mk_pair(key, e)).first->second;
+            }
+        } catch (throwable &) {
+            // entry was produced by a different version, or it uses unknown macros
         }
-        uint64 fingerprint;
-        bool is_trusted;
-        d >> fingerprint >> is_trusted;
-        add_core(n, pre_type, pre_value, ls, type, value, deps, fingerprint, is_trusted);
     }
+    m_missing.insert(key);
+    return nullptr;
+}
+
+/* Remark: entries are content addressed, so if two processes save the same key, the last one wins.
+   \pre the index file is locked */
+void definition_cache::save_entry(uint64 key, entry const & e) {
+    std::string fname = get_entry_file(key);
+    std::string tmp_fname = fname + ".tmp";
+    try {
+        std::ofstream out(tmp_fname, std::ofstream::binary);
+        serializer s(out);
+        write_header(s);
+        s << e.m_name << e.m_pre_type << e.m_pre_value << e.m_params << e.m_type << e.m_value;
+        s << static_cast<unsigned>(e.m_dependencies.size());
+        e.m_dependencies.for_each([&](name const & n, unsigned h) {
+                s << n << h;
+            });
+        s << e.m_fingerprint << e.m_is_trusted;
+    } catch (...) {
+        std::remove(tmp_fname.c_str());
+        throw;
+    }
+    rename_file(tmp_fname, fname);
 }
 
 void definition_cache::collect_dependencies(environment const & env, expr const & e, dependencies & deps) {
@@ -173,30 +399,32 @@ void definition_cache::collect_dependencies(environment const & env, expr const
         });
 }
 
-void definition_cache::add_core(name const & n, expr const & pre_type, expr const & pre_value,
-                                level_param_names const & ls, expr const & type, expr const & value,
-                                dependencies const & deps, uint64 fingerprint, bool is_trusted) {
-    m_definitions.insert(n, entry(pre_type, pre_value, ls, type, value, deps, fingerprint, is_trusted));
-}
-
-void definition_cache::add(environment const & env, name const & n, expr const & pre_type, expr const & pre_value,
-                           level_param_names const & ls, expr const & type, expr const & value, bool is_trusted) {
+void definition_cache::add(environment const & env, options const & opts, name const & n, expr const & pre_type,
+                           expr const & pre_value, level_param_names const & ls, expr const & type, expr const & value,
+                           bool is_trusted) {
     dependencies deps;
     collect_dependencies(env, type, deps);
     collect_dependencies(env, value, deps);
-    uint64 fingerprint = get_fingerprint(env);
+    uint64 fingerprint = get_cache_fingerprint(env, opts);
+    uint64 key         = get_key(env, pre_type, pre_value, fingerprint, is_trusted);
     lock_guard<mutex> lc(m_mutex);
-    add_core(n, pre_type, pre_value, ls, type, value, deps, fingerprint, is_trusted);
+    m_entries[key] = entry(n, pre_type, pre_value, ls, type, value, deps, fingerprint, is_trusted);
+    m_missing.erase(key);
+    m_new.insert(key);
+    m_used.insert(key);
 }
 
 void definition_cache::erase(name const & n) {
     lock_guard<mutex> lc(m_mutex);
-    m_definitions.erase(n);
+    m_erased.insert(n);
 }
 
 void definition_cache::clear() {
     lock_guard<mutex> lc(m_mutex);
-    m_definitions.clear();
+    m_entries.clear();
+    m_missing.clear();
+    m_new.clear();
+    m_used.clear();
 }
 
 /** \brief Return true iff the type of all declarations in deps still have the same hashcode
@@ -217,40 +445,97 @@ bool definition_cache::check_dependencies(environment const & env, dependencies
 }
 
 optional<std::tuple<level_param_names, expr, expr>>
-definition_cache::find(environment const & env, name const & n, expr const & pre_type, expr const & pre_value, bool is_trusted) {
+definition_cache::find(environment const & env, options const & opts, name const & n, expr const & pre_type,
+                       expr const & pre_value, bool is_trusted) {
+    uint64 fingerprint = get_cache_fingerprint(env, opts);
+    uint64 key         = get_key(env, pre_type, pre_value, fingerprint, is_trusted);
     entry e;
     {
         lock_guard<mutex> lc(m_mutex);
-        if (auto it = m_definitions.find(n)) {
+        if (m_erased.contains(n))
+            return optional<std::tuple<level_param_names, expr, expr>>();
+        if (auto it = load_entry(key)) {
             e = *it;
         } else {
             return optional<std::tuple<level_param_names, expr, expr>>();
         }
     }
-    level_param_names ls;
-    if (e.m_is_trusted == is_trusted &&
+    if ((e.m_name == n || (!refers_to_aux_decls(e.m_type, e.m_name) && !refers_to_aux_decls(e.m_value, e.m_name))) &&
+        e.m_is_trusted == is_trusted &&
+        e.m_fingerprint == fingerprint &&
         expr_eq_modulo_placeholders_fn()(e.m_pre_type, pre_type) &&
         expr_eq_modulo_placeholders_fn()(e.m_pre_value, pre_value) &&
-        get_fingerprint(env) == e.m_fingerprint &&
         check_dependencies(env, e.m_dependencies)) {
+        lock_guard<mutex> lc(m_mutex);
+        m_used.insert(key);
         return some(std::make_tuple(e.m_params, e.m_type, e.m_value));
     } else {
         return optional<std::tuple<level_param_names, expr, expr>>();
     }
 }
 
-void definition_cache::save(std::ostream & out) {
+void definition_cache::save() {
     lock_guard<mutex> lc(m_mutex);
-    serializer s(out);
-    s << m_definitions.size();
-    m_definitions.for_each([&](name const & n, entry const & e) {
-            s << n << e.m_pre_type << e.m_pre_value << e.m_params
-              << e.m_type << e.m_value;
-            s << static_cast<unsigned>(e.m_dependencies.size());
-            e.m_dependencies.for_each([&](name const & n, unsigned h) {
-                    s << n << h;
-                });
-            s << e.m_fingerprint << e.m_is_trusted;
-        });
+    /* The index lock is also used to make sure only one process writes entries at a time. */
+    std::string index = get_index_file();
+    exclusive_file_lock index_lock(index);
+    for (uint64 key : m_new) {
+        try {
+            save_entry(key, m_entries[key]);
+        } catch (throwable &) {
+            // pre-elaboration terms may contain auxiliary macros that cannot be serialized
+            m_used.erase(key);
+        }
+    }
+    m_new.clear();
+    /* The index maps each key to the last time (a counter incremented by each save) it was used. */
+    std::unordered_map<uint64, unsigned> last_used;
+    unsigned time = 0;
+    {
+        std::ifstream in(index, std::ifstream::binary);
+        if (!in.bad() && !in.fail()) {
+            try {
+                deserializer d(in);
+                if (check_header(d)) {
+                    unsigned num;
+                    d >> time >> num;
+                    for (unsigned i = 0; i < num; i++) {
+                        uint64 key; unsigned t;
+                        d >> key >> t;
+                        last_used[key] = t;
+                    }
+                }
+            } catch (throwable &) {
+                // index is rebuilt
+                last_used.clear();
+            }
+        }
+    }
+    time++;
+    for (uint64 key : m_used)
+        last_used[key] = time;
+    m_used.clear();
+    if (last_used.size() > m_capacity) {
+        std::vector<pair<unsigned, uint64>> to_sort;
+        for (auto const & p : last_used)
+            to_sort.emplace_back(p.second, p.first);
+        std::sort(to_sort.begin(), to_sort.end());
+        for (unsigned i = 0; i < to_sort.size() - m_capacity; i++) {
+            uint64 key = to_sort[i].second;
+            std::remove(get_entry_file(key).c_str());
+            last_used.erase(key);
+            m_entries.erase(key);
+        }
+    }
+    std::string tmp_index = index + ".tmp";
+    {
+        std::ofstream out(tmp_index, std::ofstream::binary);
+        serializer s(out);
+        write_header(s);
+        s << time << static_cast<unsigned>(last_used.size());
+        for (auto const & p : last_used)
+            s << p.first << p.second;
+    }
+    rename_file(tmp_index, index);
 }
 }
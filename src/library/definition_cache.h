@@ -5,19 +5,43 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Author: Leonardo de Moura
 */
 #pragma once
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include "util/int64.h"
 #include "util/thread.h"
 #include "util/name_map.h"
+#include "util/name_set.h"
 #include "util/optional.h"
+#include "util/sexpr/options.h"
 #include "kernel/expr.h"
 
+#ifndef LEAN_DEFAULT_DEFINITION_CACHE_CAPACITY
+#define LEAN_DEFAULT_DEFINITION_CACHE_CAPACITY 65536
+#endif
+
 namespace lean {
-/** \brief Cache for mapping definitions (type, value) before elaboration to (level_names, type, value)
+/** \brief Persistent cache for mapping definitions (type, value) before elaboration to (level_names, type, value)
     after elaboration.
+
+    The cache is a directory shared by different files and different lean processes.
+    Each entry is stored in its own file, and the name of the file is a hash code of the key:
+    pre_type and pre_value modulo placeholder names, the hash codes of the types of the constants
+    occurring in them, and a fingerprint of the options and of the instance, reducibility, simp and
+    elaboration attributes. The key does not depend on the declaration name, nor on the imports and
+    open namespaces of the file. Thus, an entry can be reused after a definition is moved to a different file.
+    Entries are loaded on demand, and they are validated using the hash codes of the types of
+    the constants the elaborated terms depend on.
+
+    New entries are written by \c save using a temporary file and a rename. So, concurrent readers never
+    observe partially written entries, and do not need locks. Writers hold the lock of the file <tt>index</tt>
+    in the cache directory. The index records when each entry was last used, and the least recently used
+    entries are removed when the cache has more than \c capacity entries.
 */
 class definition_cache {
     typedef name_map<unsigned> dependencies; // store the hash code for the type of used constants
     struct entry {
+        name              m_name;
         expr              m_pre_type;
         expr              m_pre_value;
         level_param_names m_params;
@@ -27,34 +51,49 @@ class definition_cache {
         uint64            m_fingerprint;
         bool              m_is_trusted;
         entry() {}
-        entry(expr const & pre_t, expr const & pre_v, level_param_names const & ps, expr const & t, expr const & v,
-              dependencies const & deps, uint64 fingerprint, bool is_trusted);
+        entry(name const & n, expr const & pre_t, expr const & pre_v, level_param_names const & ps,
+              expr const & t, expr const & v, dependencies const & deps, uint64 fingerprint, bool is_trusted);
     };
-    mutex           m_mutex;
-    name_map<entry> m_definitions;
+    typedef std::unordered_map<uint64, entry> entries;
+    typedef std::unordered_set<uint64>        keys;
+    std::string m_dir;
+    unsigned    m_capacity;
+    mutex       m_mutex;
+    entries     m_entries; // entries loaded or created by this process
+    keys        m_missing; // keys that are not in the cache directory
+    keys        m_new;     // entries created by this process that have not been saved yet
+    keys        m_used;    // entries used or created by this process
+    name_set    m_erased;
+    std::string get_entry_file(uint64 key) const;
+    std::string get_index_file() const;
+    entry const * load_entry(uint64 key);
+    void save_entry(uint64 key, entry const & e);
     void collect_dependencies(environment const & env, expr const & e, dependencies & deps);
     bool check_dependencies(environment const & env, dependencies const & deps);
-    void add_core(name const & n, expr const & pre_type, expr const & pre_value, level_param_names const & ls,
-                  expr const & type, expr const & value, dependencies const & deps, uint64 fingerprint, bool is_trusted);
 public:
-    definition_cache();
-    /** \brief Add the cache entry (n, pre_type, pre_value) -> (ls, type, value) */
-    void add(environment const & env, name const & n, expr const & pre_type, expr const & pre_value,
-             level_param_names const & ls, expr const & type, expr const & value, bool is_trusted);
+    /** \brief Create a cache stored in the directory \c dir. The directory is created if it does not exist. */
+    definition_cache(std::string const & dir, unsigned capacity = LEAN_DEFAULT_DEFINITION_CACHE_CAPACITY);
+    /** \brief Add the cache entry (n, pre_type, pre_value) -> (ls, type, value), where \c opts are the
+        options used to elaborate the definition. */
+    void add(environment const & env, options const & opts, name const & n, expr const & pre_type,
+             expr const & pre_value, level_param_names const & ls, expr const & type, expr const & value,
+             bool is_trusted);
     /** \brief Return (if available) elaborated (level_names, type, value) for (n, pre_type, pre_value).
+        An entry created for a different declaration is only used if the elaborated terms do not refer to
+        its auxiliary declarations (e.g., n._main).
         The pre_type and pre_value are compared modulo placeholders names if the cached values.
         In principle, we could have compared only the name and pre_type, but we only want to use cached values if the
         user intent (captured by pre_value) did not change.
     */
     optional<std::tuple<level_param_names, expr, expr>>
-    find(environment const & env, name const & n, expr const & pre_type, expr const & pre_value, bool is_trusted);
-    /** \brief Store the cache content into the given stream */
-    void save(std::ostream & out);
-    /** \brief Load the cache content from the given stream */
-    void load(std::istream & in);
-    /** \brief Remove the entry named \c n from the cache. */
+    find(environment const & env, options const & opts, name const & n, expr const & pre_type, expr const & pre_value,
+         bool is_trusted);
+    /** \brief Store the new entries in the cache directory, update the index, and evict the least recently used
+        entries. */
+    void save();
+    /** \brief Do not use cached values for the declaration named \c n. */
     void erase(name const & n);
-    /** \brief Clear the whole cache */
+    /** \brief Forget the entries loaded by this process */
     void clear();
 };
 }
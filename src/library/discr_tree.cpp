@@ -0,0 +1,83 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#include "library/discr_tree.h"
+
+namespace lean {
+int discr_tree_key::cmp::operator()(discr_tree_key const & k1, discr_tree_key const & k2) const {
+    if (k1.m_kind != k2.m_kind)
+        return static_cast<int>(k1.m_kind) - static_cast<int>(k2.m_kind);
+    if (k1.m_arity != k2.m_arity)
+        return k1.m_arity < k2.m_arity ? -1 : 1;
+    return quick_cmp(k1.m_name, k2.m_name);
+}
+
+std::ostream & operator<<(std::ostream & out, discr_tree_key const & k) {
+    switch (k.m_kind) {
+    case discr_tree_key_kind::Star:     out << "*"; break;
+    case discr_tree_key_kind::Sort:     out << "Sort"; break;
+    case discr_tree_key_kind::Constant: out << k.m_name; break;
+    case discr_tree_key_kind::Local:    out << "@" << k.m_name; break;
+    }
+    if (k.m_arity > 0)
+        out << "/" << k.m_arity;
+    return out;
+}
+
+serializer & operator<<(serializer & s, discr_tree_key const & k) {
+    s << static_cast<char>(k.m_kind) << k.m_name << k.m_arity;
+    return s;
+}
+
+deserializer & operator>>(deserializer & d, discr_tree_key & k) {
+    char kind;
+    d >> kind >> k.m_name >> k.m_arity;
+    k.m_kind = static_cast<discr_tree_key_kind>(kind);
+    return d;
+}
+
+static void get_keys(type_context & ctx, expr const & e, buffer<discr_tree_key> & keys) {
+    expr it = ctx.whnf(e);
+    if (is_sort(it)) {
+        keys.push_back(discr_tree_key(discr_tree_key_kind::Sort, name(), 0));
+        return;
+    }
+    expr const & fn = get_app_fn(it);
+    /* Remark: stuck terms (e.g., projections and recursors applied to metavariables)
+       may be reduced by is_def_eq after metavariables are assigned. */
+    if ((!is_constant(fn) && !is_local(fn)) || ctx.is_stuck(it)) {
+        keys.push_back(discr_tree_key());
+        return;
+    }
+    /* Remark: definitions that were not unfolded may be unfolded after their reducibility status changes
+       (e.g., attribute [reducible] or local attribute [irreducible]). So, they are mapped to Star, and
+       the keys do not depend on the reducibility status of definitions. */
+    if (is_constant(fn)) {
+        optional<declaration> d = ctx.env().find(const_name(fn));
+        if (!d || d->is_definition()) {
+            keys.push_back(discr_tree_key());
+            return;
+        }
+    }
+    buffer<expr> args;
+    get_app_args(it, args);
+    if (is_constant(fn))
+        keys.push_back(discr_tree_key(discr_tree_key_kind::Constant, const_name(fn), args.size()));
+    else
+        keys.push_back(discr_tree_key(discr_tree_key_kind::Local, mlocal_name(fn), args.size()));
+    for (expr const & arg : args) {
+        /* Proofs are definitionally equal by proof irrelevance */
+        if (ctx.is_proof(arg))
+            keys.push_back(discr_tree_key());
+        else
+            get_keys(ctx, arg, keys);
+    }
+}
+
+void get_discr_tree_keys(type_context & ctx, expr const & e, buffer<discr_tree_key> & keys) {
+    get_keys(ctx, ctx.instantiate_mvars(e), keys);
+}
+}
@@ -0,0 +1,244 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#pragma once
+#include <algorithm>
+#include "util/rb_map.h"
+#include "util/list.h"
+#include "util/serializer.h"
+#include "kernel/expr.h"
+#include "library/type_context.h"
+
+namespace lean {
+enum class discr_tree_key_kind { Star, Constant, Local, Sort };
+
+/** \brief Key used in discrimination trees. An expression is represented by the sequence of keys
+    produced by a preorder traversal. Applications (f a_1 ... a_n) are represented by a key for \c f
+    storing the number of arguments n, followed by the keys of a_1 ... a_n.
+    The key Star is a wildcard that matches any subterm. */
+struct discr_tree_key {
+    discr_tree_key_kind m_kind;
+    name                m_name;
+    unsigned            m_arity;
+    discr_tree_key():m_kind(discr_tree_key_kind::Star), m_arity(0) {}
+    discr_tree_key(discr_tree_key_kind k, name const & n, unsigned arity):m_kind(k), m_name(n), m_arity(arity) {}
+    discr_tree_key_kind kind() const { return m_kind; }
+    name const & get_name() const { return m_name; }
+    unsigned get_arity() const { return m_arity; }
+    bool is_star() const { return m_kind == discr_tree_key_kind::Star; }
+
+    struct cmp {
+        int operator()(discr_tree_key const & k1, discr_tree_key const & k2) const;
+    };
+
+    friend bool operator==(discr_tree_key const & k1, discr_tree_key const & k2) {
+        return k1.m_kind == k2.m_kind && k1.m_arity == k2.m_arity && k1.m_name == k2.m_name;
+    }
+    friend std::ostream & operator<<(std::ostream & out, discr_tree_key const & k);
+};
+
+typedef list<discr_tree_key> discr_tree_keys;
+
+serializer & operator<<(serializer & s, discr_tree_key const & k);
+deserializer & operator>>(deserializer & d, discr_tree_key & k);
+
+/** \brief Store in \c keys the discrimination tree keys for \c e.
+
+    Subterms are put in weak head normal form using \c ctx before they are indexed, and the transparency
+    mode of \c ctx should be the one used to unify the indexed terms. Metavariables, proofs, binders,
+    stuck terms (e.g., projections of metavariables), applications of definitions that were not unfolded,
+    and subterms that is_def_eq may solve using other means (e.g., eta) are mapped to Star.
+    Thus, keys are only produced for heads that are not affected by reducibility annotations, and keys
+    stored in .olean files remain valid when the reducibility status of a definition changes.
+
+    The same procedure is used for the indexed terms (patterns) and for queries. So, if
+    \c ctx.is_def_eq(p, q) succeeds, then the keys of \c q match the keys of \c p. */
+void get_discr_tree_keys(type_context & ctx, expr const & e, buffer<discr_tree_key> & keys);
+
+/** \brief Default order of the values associated with the same keys: the most recent value comes first. */
+struct discr_tree_recent_first {
+    template<typename V> bool operator()(V const &, V const &) const { return false; }
+};
+
+/** \brief Discrimination tree: indexing data-structure that maps expressions to a list of values.
+    It is used to retrieve the values associated with expressions that may be unified with a given query.
+    The tree is a persistent data-structure, i.e., copying is a constant time operation.
+
+    The values associated with the same keys are kept sorted using \c Lt. A new value is inserted
+    before the values that are not smaller than it. */
+template<typename V, typename Lt = discr_tree_recent_first>
+class discr_tree {
+    struct node {
+        rb_map<discr_tree_key, node, discr_tree_key::cmp> m_children;
+        list<V>                                           m_values;
+    };
+    node     m_root;
+    unsigned m_size;
+
+    static list<V> insert_sorted(list<V> const & vs, V const & v) {
+        if (!vs || !Lt()(head(vs), v))
+            return cons(v, vs);
+        else
+            return cons(head(vs), insert_sorted(tail(vs), v));
+    }
+
+    static bool insert(node & n, discr_tree_key const * it, discr_tree_key const * end, V const & v) {
+        if (it == end) {
+            if (std::find(n.m_values.begin(), n.m_values.end(), v) != n.m_values.end())
+                return false;
+            n.m_values = insert_sorted(n.m_values, v);
+            return true;
+        } else {
+            node child;
+            if (auto c = n.m_children.find(*it))
+                child = *c;
+            if (!insert(child, it+1, end, v))
+                return false;
+            n.m_children.insert(*it, child);
+            return true;
+        }
+    }
+
+    static bool erase(node & n, discr_tree_key const * it, discr_tree_key const * end, V const & v) {
+        if (it == end) {
+            auto new_values = filter(n.m_values, [&](V const & v2) { return v != v2; });
+            bool r = length(new_values) != length(n.m_values);
+            n.m_values = new_values;
+            return r;
+        } else if (auto c = n.m_children.find(*it)) {
+            node child = *c;
+            if (!erase(child, it+1, end, v))
+                return false;
+            if (child.m_children.empty() && !child.m_values)
+                n.m_children.erase(*it);
+            else
+                n.m_children.insert(*it, child);
+            return true;
+        } else {
+            return false;
+        }
+    }
+
+    /* Invoke fn for each node reached after skipping \c n subterms starting at \c nd. */
+    template<typename F> static void skip(node const & nd, unsigned n, F && fn) {
+        if (n == 0) {
+            fn(nd);
+        } else {
+            nd.m_children.for_each([&](discr_tree_key const & k, node const & child) {
+                    skip(child, n - 1 + k.get_arity(), fn);
+                });
+        }
+    }
+
+    /* Invoke \c fn for each leaf (i.e., the values stored in it) matching keys[i], ..., keys[sz-1].
+       \c next[i] is the position of the first key after the subterm starting at position \c i. */
+    template<typename F> static void find(node const & nd, discr_tree_key const * keys, unsigned const * next,
+                                          unsigned i, unsigned sz, F && fn) {
+        if (i == sz) {
+            if (nd.m_values)
+                fn(nd.m_values);
+            return;
+        }
+        discr_tree_key const & k = keys[i];
+        if (k.is_star()) {
+            nd.m_children.for_each([&](discr_tree_key const & ck, node const & child) {
+                    skip(child, ck.get_arity(), [&](node const & c) { find(c, keys, next, i+1, sz, fn); });
+                });
+        } else {
+            if (auto star = nd.m_children.find(discr_tree_key()))
+                find(*star, keys, next, next[i], sz, fn);
+            if (auto child = nd.m_children.find(k))
+                find(*child, keys, next, i+1, sz, fn);
+        }
+    }
+
+    template<typename F> static void for_each(node const & nd, F && fn) {
+        for (V const & v : nd.m_values)
+            fn(v);
+        nd.m_children.for_each([&](discr_tree_key const &, node const & child) { for_each(child, fn); });
+    }
+
+    /* Invoke \c fn for the list of values of each leaf matching the given query keys. */
+    template<typename F> void find_leaves(unsigned num_keys, discr_tree_key const * keys, F && fn) const {
+        buffer<unsigned> next;
+        next.resize(num_keys, 0);
+        /* compute the end of each subterm, \c todo contains the subterms being processed, and
+           \c remaining the number of arguments that still need to be processed. */
+        buffer<unsigned> todo;
+        buffer<unsigned> remaining;
+        for (unsigned i = 0; i < num_keys; i++) {
+            todo.push_back(i);
+            remaining.push_back(keys[i].get_arity());
+            while (!todo.empty() && remaining.back() == 0) {
+                next[todo.back()] = i + 1;
+                todo.pop_back();
+                remaining.pop_back();
+                if (!remaining.empty())
+                    remaining.back()--;
+            }
+        }
+        find(m_root, keys, next.data(), 0, num_keys, fn);
+    }
+
+public:
+    discr_tree():m_size(0) {}
+    bool empty() const { return m_size == 0; }
+    /** \brief Number of (keys, value) pairs stored in the tree. */
+    unsigned size() const { return m_size; }
+
+    void insert(unsigned num_keys, discr_tree_key const * keys, V const & v) {
+        if (insert(m_root, keys, keys + num_keys, v))
+            m_size++;
+    }
+    void insert(buffer<discr_tree_key> const & keys, V const & v) { insert(keys.size(), keys.data(), v); }
+
+    void erase(unsigned num_keys, discr_tree_key const * keys, V const & v) {
+        if (erase(m_root, keys, keys + num_keys, v))
+            m_size--;
+    }
+    void erase(buffer<discr_tree_key> const & keys, V const & v) { erase(keys.size(), keys.data(), v); }
+
+    /** \brief Invoke \c fn for each value associated with keys that match the given query keys.
+        \remark \c fn may be invoked more than once for the same value. */
+    template<typename F> void find(unsigned num_keys, discr_tree_key const * keys, F && fn) const {
+        find_leaves(num_keys, keys, [&](list<V> const & vs) {
+                for (V const & v : vs)
+                    fn(v);
+            });
+    }
+    template<typename F> void find(buffer<discr_tree_key> const & keys, F && fn) const {
+        find(keys.size(), keys.data(), fn);
+    }
+
+    /** \brief Similar to \c find, but \c fn is invoked following the order \c Lt.
+        The values of each matching leaf are already sorted, so they only need to be merged. */
+    template<typename F> void find_sorted(unsigned num_keys, discr_tree_key const * keys, F && fn) const {
+        buffer<list<V>> leaves;
+        find_leaves(num_keys, keys, [&](list<V> const & vs) { leaves.push_back(vs); });
+        if (leaves.size() == 1) {
+            for (V const & v : leaves[0])
+                fn(v);
+            return;
+        }
+        while (true) {
+            unsigned best = leaves.size();
+            for (unsigned i = 0; i < leaves.size(); i++) {
+                if (leaves[i] && (best == leaves.size() || Lt()(head(leaves[i]), head(leaves[best]))))
+                    best = i;
+            }
+            if (best == leaves.size())
+                return;
+            fn(head(leaves[best]));
+            leaves[best] = tail(leaves[best]);
+        }
+    }
+    template<typename F> void find_sorted(buffer<discr_tree_key> const & keys, F && fn) const {
+        find_sorted(keys.size(), keys.data(), fn);
+    }
+
+    template<typename F> void for_each(F && fn) const { for_each(m_root, fn); }
+};
+}
@@ -283,7 +283,7 @@ class exporter {
 
     void export_declarations() {
         if (m_all) {
-            m_env.for_each_declaration([&](declaration const & d) {
+            m_env.for_each_declaration_by_name([&](declaration const & d) {
                     export_declaration(d.get_name());
                 });
         } else {
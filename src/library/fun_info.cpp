@@ -47,11 +47,12 @@ struct fun_info_cache {
     prefix_cache  m_cache_prefix;
     fun_info_cache(environment const & env):m_env(env) {}
     environment const & env() const { return m_env; }
+    void set_env(environment const & env) { m_env = env; }
 };
 
 typedef cache_compatibility_helper<fun_info_cache> fun_info_cache_helper;
 
-MK_THREAD_LOCAL_GET_DEF(fun_info_cache_helper, get_fich);
+MK_THREAD_LOCAL_GET(fun_info_cache_helper, get_fich, "fun_info");
 
 fun_info_cache & get_fun_info_cache_for(type_context const & ctx) {
     return get_fich().get_cache_for(ctx);
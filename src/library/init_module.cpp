@@ -48,6 +48,7 @@ Author: Leonardo de Moura
 #include "library/inverse.h"
 #include "library/rfl_lemmas.h"
 #include "library/pattern_attribute.h"
+#include "library/cache_helper.h"
 
 namespace lean {
 void initialize_library_core_module() {
@@ -56,9 +57,11 @@ void initialize_library_core_module() {
     initialize_module();
     initialize_scoped_ext();
     initialize_attribute_manager();
+    initialize_cache_helper();
 }
 
 void finalize_library_core_module() {
+    finalize_cache_helper();
     finalize_attribute_manager();
     finalize_scoped_ext();
     finalize_module();
@@ -63,7 +63,7 @@ public:
     formatted_exception(expr const & e, format const & fmt):m_expr(e), m_fmt(fmt) {}
     virtual ~formatted_exception() noexcept {}
     virtual char const * what() const noexcept;
-    virtual throwable * clone() const { return new formatted_exception(m_fmt); }
+    virtual throwable * clone() const { return new formatted_exception(*this); }
     virtual void rethrow() const { throw *this; }
     optional<expr> get_main_expr() const { return m_expr; }
     format pp() const { return m_fmt; }
@@ -5,6 +5,10 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Author: Leonardo de Moura
 */
 #include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
 #include "util/object_serializer.h"
 #include "kernel/expr.h"
 #include "kernel/declaration.h"
@@ -126,7 +130,7 @@ serializer & operator<<(serializer & s, binder_info const & i) {
     return s;
 }
 
-static binder_info read_binder_info(deserializer & d) {
+static binder_info read_binder_info(deserializer_core & d) {
     unsigned w = d.read_char();
     bool rec   = (w & 8) != 0;
     bool imp   = (w & 4)  != 0;
@@ -349,6 +353,496 @@ declaration read_declaration(deserializer & d) {
     }
 }
 
+// Declaration tables
+/* The declarations written using write_lazy_declaration are stored in a table shared by all of them
+   (see write_declaration_table). Names and universe levels are stored only once in the table, and
+   each expression node is stored only once as a record whose children are references to previous
+   records. Thus, the type and value of each declaration can be decoded independently of the
+   other declarations, and the decoded expressions preserve the sharing between declarations.
+
+   No expression is decoded when the table is read. The position of each record is only computed
+   the first time an expression of the table is needed. */
+
+class declaration_table_serializer : public serializer::extension {
+    typedef std::unordered_map<name, unsigned, name_hash> name2idx;
+    typedef std::unordered_map<level, unsigned, level_hash> level2idx;
+    typedef std::unordered_map<expr, unsigned, expr_hash_alloc, expr_eqp> expr2idx;
+    std::vector<name>        m_names;
+    name2idx                 m_name2idx;
+    std::vector<level>       m_levels;
+    level2idx                m_level2idx;
+    expr2idx                 m_expr2idx;
+    max_sharing_fn           m_max_sharing_fn;
+    unsigned                 m_next_id;
+    serializer               m_nodes;
+    unsigned                 m_num_nodes;
+    std::vector<declaration> m_decls;
+    std::vector<unsigned>    m_types;
+    std::vector<unsigned>    m_values;
+
+    unsigned name_idx(name const & n) {
+        auto it = m_name2idx.find(n);
+        if (it != m_name2idx.end())
+            return it->second;
+        unsigned r = m_names.size();
+        m_names.push_back(n);
+        m_name2idx.insert(mk_pair(n, r));
+        return r;
+    }
+
+    unsigned level_idx(level const & l) {
+        auto it = m_level2idx.find(l);
+        if (it != m_level2idx.end())
+            return it->second;
+        unsigned r = m_levels.size();
+        m_levels.push_back(l);
+        m_level2idx.insert(mk_pair(l, r));
+        return r;
+    }
+
+    unsigned binder_name_idx(name const & a) {
+        // make sure binding names are atomic string
+        if (!a.is_atomic() || a.is_numeral()) {
+            name r = g_binder_name->append_after(m_next_id);
+            m_next_id++;
+            return name_idx(r);
+        } else {
+            return name_idx(a);
+        }
+    }
+
+    unsigned write_expr_core(expr const & a) {
+        auto it = m_expr2idx.find(a);
+        if (it != m_expr2idx.end())
+            return it->second;
+        buffer<unsigned> args;
+        switch (a.kind()) {
+        case expr_kind::Var: case expr_kind::Constant: case expr_kind::Sort:
+            break;
+        case expr_kind::Macro:
+            for (unsigned i = 0; i < macro_num_args(a); i++)
+                args.push_back(write_expr_core(macro_arg(a, i)));
+            break;
+        case expr_kind::App:
+            args.push_back(write_expr_core(app_fn(a)));
+            args.push_back(write_expr_core(app_arg(a)));
+            break;
+        case expr_kind::Lambda: case expr_kind::Pi:
+            args.push_back(write_expr_core(binding_domain(a)));
+            args.push_back(write_expr_core(binding_body(a)));
+            break;
+        case expr_kind::Let:
+            args.push_back(write_expr_core(let_type(a)));
+            args.push_back(write_expr_core(let_value(a)));
+            args.push_back(write_expr_core(let_body(a)));
+            break;
+        case expr_kind::Meta: case expr_kind::Local:
+            args.push_back(write_expr_core(mlocal_type(a)));
+            break;
+        }
+        serializer & s = m_nodes;
+        s << static_cast<char>(a.kind());
+        switch (a.kind()) {
+        case expr_kind::Var:
+            s << var_idx(a);
+            break;
+        case expr_kind::Constant:
+            s << name_idx(const_name(a)) << length(const_levels(a));
+            for (level const & l : const_levels(a))
+                s << level_idx(l);
+            break;
+        case expr_kind::Sort:
+            s << level_idx(sort_level(a));
+            break;
+        case expr_kind::Macro: {
+            s << static_cast<unsigned>(args.size());
+            for (unsigned arg : args)
+                s << arg;
+            serializer ms;
+            macro_def(a).write(ms);
+            s.write_unsigned(ms.size());
+            s.write(ms.data(), ms.size());
+            break;
+        }
+        case expr_kind::App:
+            s << args[0] << args[1];
+            break;
+        case expr_kind::Lambda: case expr_kind::Pi:
+            lean_assert(!binding_name(a).is_anonymous());
+            s << binder_name_idx(binding_name(a)) << binding_info(a) << args[0] << args[1];
+            break;
+        case expr_kind::Let:
+            s << name_idx(let_name(a)) << args[0] << args[1] << args[2];
+            break;
+        case expr_kind::Meta:
+            s << name_idx(mlocal_name(a)) << args[0];
+            break;
+        case expr_kind::Local:
+            s << name_idx(mlocal_name(a)) << name_idx(local_pp_name(a)) << local_info(a) << args[0];
+            break;
+        }
+        unsigned r = m_num_nodes;
+        m_num_nodes++;
+        m_expr2idx.insert(mk_pair(a, r));
+        return r;
+    }
+
+    unsigned write_expr(expr const & a) {
+        return write_expr_core(m_max_sharing_fn(a));
+    }
+
+public:
+    declaration_table_serializer():m_next_id(0), m_num_nodes(0) {}
+
+    void add(declaration const & d) {
+        m_decls.push_back(d);
+        m_types.push_back(write_expr(d.get_type()));
+        m_values.push_back(d.is_definition() ? write_expr(d.get_value()) : 0);
+    }
+
+    void write(serializer & s) {
+        buffer<unsigned> entries;
+        for (unsigned i = 0; i < m_decls.size(); i++)
+            entries.push_back(i);
+        /* entries are sorted by name to allow binary search (see declaration_table::find) */
+        std::sort(entries.begin(), entries.end(), [&](unsigned i1, unsigned i2) {
+                return cmp(m_decls[i1].get_name(), m_decls[i2].get_name()) < 0;
+            });
+        serializer es;
+        for (unsigned i : entries) {
+            declaration const & d = m_decls[i];
+            char k = 0;
+            if (d.is_definition())
+                k |= 1;
+            if (d.is_theorem() || d.is_axiom())
+                k |= 2;
+            if (d.is_trusted())
+                k |= 4;
+            es << name_idx(d.get_name()) << k << length(d.get_univ_params());
+            for (name const & p : d.get_univ_params())
+                es << name_idx(p);
+            es << m_types[i];
+            if (d.is_definition()) {
+                es << m_values[i];
+                if (!d.is_theorem())
+                    es << d.get_hints();
+            }
+        }
+        /* Remark: names and levels are written using the sharing provided by \c s, they must be
+           written before the entries, since entries may add new names. */
+        s << static_cast<unsigned>(m_names.size());
+        for (name const & n : m_names)
+            s << n;
+        s << static_cast<unsigned>(m_levels.size());
+        for (level const & l : m_levels)
+            s << l;
+        s << static_cast<unsigned>(m_decls.size());
+        s.write(es.data(), es.size());
+        s << m_num_nodes;
+        s.write_unsigned(m_nodes.size());
+        s.write(m_nodes.data(), m_nodes.size());
+    }
+};
+
+struct declaration_table_sd {
+    unsigned m_s_extid;
+    declaration_table_sd() {
+        m_s_extid = serializer::register_extension([](){
+                return std::unique_ptr<serializer::extension>(new declaration_table_serializer());
+            });
+    }
+};
+static declaration_table_sd * g_declaration_table_sd = nullptr;
+
+void write_lazy_declaration(serializer & s, declaration const & d) {
+    s.get_extension<declaration_table_serializer>(g_declaration_table_sd->m_s_extid).add(d);
+    s << d.get_name();
+}
+
+void write_declaration_table(serializer & s, serializer & src) {
+    serializer ts;
+    src.get_extension<declaration_table_serializer>(g_declaration_table_sd->m_s_extid).write(ts);
+    s.write_unsigned(ts.size());
+    s.write(ts.data(), ts.size());
+}
+
+class declaration_table : public std::enable_shared_from_this<declaration_table> {
+    struct entry {
+        name                         m_name;
+        char                         m_kind;
+        level_param_names            m_params;
+        unsigned                     m_type;
+        unsigned                     m_value;
+        optional<reducibility_hints> m_hints;
+    };
+    std::shared_ptr<mapped_file> m_file;
+    std::vector<name>            m_names;
+    std::vector<level>           m_levels;
+    std::vector<entry>           m_entries;
+    unsigned                     m_num_nodes;
+    char const *                 m_nodes;
+    unsigned                     m_nodes_size;
+    mutex                        m_mutex;
+    std::vector<unsigned>        m_offsets; // protected by m_mutex
+    std::vector<optional<expr>>  m_cache;   // protected by m_mutex
+
+    name const & get_name(unsigned i) const {
+        if (i >= m_names.size())
+            throw corrupted_stream_exception();
+        return m_names[i];
+    }
+
+    level const & get_level(unsigned i) const {
+        if (i >= m_levels.size())
+            throw corrupted_stream_exception();
+        return m_levels[i];
+    }
+
+    deserializer_core get_node(unsigned i) const {
+        unsigned o = m_offsets[i];
+        return deserializer_core(m_nodes + o, m_nodes_size - o);
+    }
+
+    /* Read the record at \c d, and store at \c r the records it references. */
+    static void read_children(deserializer_core & d, buffer<unsigned> & r) {
+        auto k = static_cast<expr_kind>(d.read_char());
+        unsigned n = 0;
+        switch (k) {
+        case expr_kind::Var: case expr_kind::Sort:
+            d.read_unsigned();
+            return;
+        case expr_kind::Constant:
+            d.read_unsigned();
+            n = d.read_unsigned();
+            for (unsigned j = 0; j < n; j++)
+                d.read_unsigned();
+            return;
+        case expr_kind::Macro:
+            n = d.read_unsigned();
+            for (unsigned j = 0; j < n; j++)
+                r.push_back(d.read_unsigned());
+            d.read_block(d.read_unsigned());
+            return;
+        case expr_kind::App:
+            n = 2;
+            break;
+        case expr_kind::Lambda: case expr_kind::Pi:
+            d.read_unsigned(); d.read_char();
+            n = 2;
+            break;
+        case expr_kind::Let:
+            d.read_unsigned();
+            n = 3;
+            break;
+        case expr_kind::Meta:
+            d.read_unsigned();
+            n = 1;
+            break;
+        case expr_kind::Local:
+            d.read_unsigned(); d.read_unsigned(); d.read_char();
+            n = 1;
+            break;
+        default:
+            throw corrupted_stream_exception();
+        }
+        for (unsigned j = 0; j < n; j++)
+            r.push_back(d.read_unsigned());
+    }
+
+    /* Store at \c r the records referenced by the record \c i. */
+    void get_children(unsigned i, buffer<unsigned> & r) const {
+        deserializer_core d = get_node(i);
+        read_children(d, r);
+        for (unsigned c : r) {
+            /* records only reference previous records */
+            if (c >= i)
+                throw corrupted_stream_exception();
+        }
+    }
+
+    void init_offsets() {
+        deserializer_core d(m_nodes, m_nodes_size);
+        buffer<unsigned> children;
+        m_offsets.reserve(m_num_nodes);
+        for (unsigned i = 0; i < m_num_nodes; i++) {
+            m_offsets.push_back(d.pos());
+            children.clear();
+            read_children(d, children);
+        }
+        m_cache.resize(m_num_nodes);
+    }
+
+    /* Decode the record \c i. \pre The records referenced by \c i have already been decoded. */
+    expr decode(unsigned i) const {
+        deserializer_core d = get_node(i);
+        auto arg = [&]() { return *m_cache[d.read_unsigned()]; };
+        auto k = static_cast<expr_kind>(d.read_char());
+        switch (k) {
+        case expr_kind::Var:
+            return mk_var(d.read_unsigned());
+        case expr_kind::Constant: {
+            name const & n = get_name(d.read_unsigned());
+            unsigned num   = d.read_unsigned();
+            buffer<level> ls;
+            for (unsigned j = 0; j < num; j++)
+                ls.push_back(get_level(d.read_unsigned()));
+            return mk_constant(n, to_list(ls.begin(), ls.end()));
+        }
+        case expr_kind::Sort:
+            return mk_sort(get_level(d.read_unsigned()));
+        case expr_kind::Macro: {
+            unsigned num = d.read_unsigned();
+            buffer<expr> args;
+            for (unsigned j = 0; j < num; j++)
+                args.push_back(arg());
+            unsigned sz      = d.read_unsigned();
+            char const * def = d.read_block(sz);
+            deserializer md(def, sz);
+            return read_macro_definition(md, args.size(), args.data());
+        }
+        case expr_kind::App: {
+            expr f = arg();
+            return mk_app(f, arg());
+        }
+        case expr_kind::Lambda: case expr_kind::Pi: {
+            name const & n = get_name(d.read_unsigned());
+            binder_info bi = read_binder_info(d);
+            expr t         = arg();
+            return mk_binding(k, n, t, arg(), bi);
+        }
+        case expr_kind::Let: {
+            name const & n = get_name(d.read_unsigned());
+            expr t = arg();
+            expr v = arg();
+            return mk_let(n, t, v, arg());
+        }
+        case expr_kind::Meta: {
+            name const & n = get_name(d.read_unsigned());
+            return mk_metavar(n, arg());
+        }
+        case expr_kind::Local: {
+            name const & n    = get_name(d.read_unsigned());
+            name const & pp_n = get_name(d.read_unsigned());
+            binder_info bi    = read_binder_info(d);
+            return mk_local(n, pp_n, arg(), bi);
+        }}
+        throw corrupted_stream_exception(); // LCOV_EXCL_LINE
+    }
+
+public:
+    declaration_table(deserializer & d, std::shared_ptr<mapped_file> const & file):m_file(file) {
+        unsigned num_names = d.read_unsigned();
+        for (unsigned i = 0; i < num_names; i++)
+            m_names.push_back(read_name(d));
+        unsigned num_levels = d.read_unsigned();
+        for (unsigned i = 0; i < num_levels; i++)
+            m_levels.push_back(read_level(d));
+        unsigned num_entries = d.read_unsigned();
+        for (unsigned i = 0; i < num_entries; i++) {
+            entry e;
+            e.m_name       = get_name(d.read_unsigned());
+            e.m_kind       = d.read_char();
+            unsigned num_ps = d.read_unsigned();
+            buffer<name> ps;
+            for (unsigned j = 0; j < num_ps; j++)
+                ps.push_back(get_name(d.read_unsigned()));
+            e.m_params     = to_list(ps.begin(), ps.end());
+            e.m_type       = d.read_unsigned();
+            e.m_value      = 0;
+            if (e.m_kind & 1) {
+                e.m_value  = d.read_unsigned();
+                if (!(e.m_kind & 2))
+                    e.m_hints = read_hints(d);
+            }
+            m_entries.push_back(e);
+        }
+        m_num_nodes  = d.read_unsigned();
+        m_nodes_size = d.read_unsigned();
+        m_nodes      = d.read_block(m_nodes_size);
+        for (entry const & e : m_entries) {
+            if (e.m_type >= m_num_nodes || ((e.m_kind & 1) && e.m_value >= m_num_nodes))
+                throw corrupted_stream_exception();
+        }
+    }
+
+    expr get_expr(unsigned i) {
+        lock_guard<mutex> lock(m_mutex);
+        if (m_offsets.empty())
+            init_offsets();
+        /* Remark: we use an explicit stack since expressions may be very deep. */
+        buffer<unsigned> todo;
+        buffer<unsigned> children;
+        todo.push_back(i);
+        while (!todo.empty()) {
+            unsigned j = todo.back();
+            if (m_cache[j]) {
+                todo.pop_back();
+                continue;
+            }
+            children.clear();
+            get_children(j, children);
+            bool ready = true;
+            for (unsigned c : children) {
+                if (!m_cache[c]) {
+                    todo.push_back(c);
+                    ready = false;
+                }
+            }
+            if (ready) {
+                m_cache[j] = decode(j);
+                todo.pop_back();
+            }
+        }
+        return *m_cache[i];
+    }
+
+    optional<declaration> find(name const & n) {
+        auto it = std::lower_bound(m_entries.begin(), m_entries.end(), n, [](entry const & e, name const & n) {
+                return cmp(e.m_name, n) < 0;
+            });
+        if (it == m_entries.end() || it->m_name != n)
+            return none_declaration();
+        entry const & e = *it;
+        bool has_value  = (e.m_kind & 1) != 0;
+        bool is_th_ax   = (e.m_kind & 2) != 0;
+        bool is_trusted = (e.m_kind & 4) != 0;
+        std::shared_ptr<declaration_table> self = shared_from_this();
+        unsigned t_idx = e.m_type;
+        unsigned v_idx = e.m_value;
+        declaration_expr_fn t = [=]() { return self->get_expr(t_idx); };
+        if (has_value) {
+            declaration_expr_fn v = [=]() { return self->get_expr(v_idx); };
+            if (is_th_ax)
+                return some_declaration(mk_lazy_theorem(n, e.m_params, t, v));
+            else
+                return some_declaration(mk_lazy_definition(n, e.m_params, t, v, *e.m_hints, is_trusted));
+        } else {
+            if (is_th_ax)
+                return some_declaration(mk_lazy_axiom(n, e.m_params, t));
+            else
+                return some_declaration(mk_lazy_constant_assumption(n, e.m_params, t, is_trusted));
+        }
+    }
+};
+
+declaration_table_ptr read_declaration_table(deserializer & d, std::shared_ptr<mapped_file> const & file) {
+    unsigned sz       = d.read_unsigned();
+    char const * data = d.read_block(sz);
+    deserializer td(data, sz);
+    return std::make_shared<declaration_table>(td, file);
+}
+
+optional<declaration> find_declaration(declaration_table_ptr const & t, name const & n) {
+    return t->find(n);
+}
+
+declaration read_lazy_declaration(deserializer & d, declaration_table_ptr const & t) {
+    name n = read_name(d);
+    if (auto r = find_declaration(t, n))
+        return *r;
+    throw corrupted_stream_exception();
+}
+
 using inductive::certified_inductive_decl;
 using inductive::inductive_decl;
 using inductive::intro_rule;
@@ -422,9 +916,11 @@ void initialize_kernel_serializer() {
     g_macro_readers = new macro_readers();
     g_binder_name   = new name("a");
     g_expr_sd       = new expr_sd();
+    g_declaration_table_sd = new declaration_table_sd();
 }
 
 void finalize_kernel_serializer() {
+    delete g_declaration_table_sd;
     delete g_expr_sd;
     delete g_binder_name;
     delete g_macro_readers;
@@ -6,7 +6,9 @@ Author: Leonardo de Moura
 */
 #pragma once
 #include <string>
+#include <memory>
 #include "util/serializer.h"
+#include "util/mapped_file.h"
 #include "kernel/declaration.h"
 #include "kernel/inductive/inductive.h"
 
@@ -29,6 +31,24 @@ inline deserializer & operator>>(deserializer & d, expr & e) { e = read_expr(d);
 serializer & operator<<(serializer & s, declaration const & d);
 declaration read_declaration(deserializer & d);
 
+/** \brief Similar to <tt>s << d</tt>, but \c d is stored in a declaration table associated with \c s,
+    and only its name is written to \c s. The table is shared by all declarations written to \c s, and
+    it must be written using #write_declaration_table. */
+void write_lazy_declaration(serializer & s, declaration const & d);
+/** \brief Write to \c s the declaration table of all declarations written to \c src using #write_lazy_declaration. */
+void write_declaration_table(serializer & s, serializer & src);
+
+class declaration_table;
+typedef std::shared_ptr<declaration_table> declaration_table_ptr;
+/** \brief Read a table written using #write_declaration_table. No type or value is decoded at this point.
+    \pre \c d reads from the memory of \c file, and \c file keeps the memory alive. */
+declaration_table_ptr read_declaration_table(deserializer & d, std::shared_ptr<mapped_file> const & file);
+/** \brief Return the declaration named \c n in the given table. The type and value of the result are only
+    decoded the first time they are needed (see mk_lazy_definition). */
+optional<declaration> find_declaration(declaration_table_ptr const & t, name const & n);
+/** \brief Read a declaration written using #write_lazy_declaration, \c t is the table of the stream. */
+declaration read_lazy_declaration(deserializer & d, declaration_table_ptr const & t);
+
 serializer & operator<<(serializer & s, inductive::certified_inductive_decl const & d);
 inductive::certified_inductive_decl read_certified_inductive_decl(deserializer & d);
 
@@ -26,9 +26,9 @@ name get_metavar_decl_ref_suffix(level const & l);
 name get_metavar_decl_ref_suffix(expr const & e);
 
 class metavar_context {
-    name_map<metavar_decl> m_decls;
-    name_map<level>        m_uassignment;
-    name_map<expr>         m_eassignment;
+    name_hamt_map<metavar_decl> m_decls;
+    name_hamt_map<level>        m_uassignment;
+    name_hamt_map<expr>         m_eassignment;
     struct interface_impl;
     friend struct interface_impl;
 public:
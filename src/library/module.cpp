@@ -6,10 +6,12 @@ Author: Leonardo de Moura
 */
 #include <unordered_map>
 #include <vector>
+#include <deque>
 #include <utility>
 #include <string>
 #include <sstream>
 #include <fstream>
+#include <cstdio>
 #include <algorithm>
 #include <sys/stat.h>
 #include "util/hash.h"
@@ -20,6 +22,7 @@ Author: Leonardo de Moura
 #include "util/interrupt.h"
 #include "util/name_map.h"
 #include "util/file_lock.h"
+#include "util/mapped_file.h"
 #include "kernel/type_checker.h"
 #include "kernel/quotient/quotient.h"
 #include "kernel/hits/hits.h"
@@ -32,7 +35,7 @@ Author: Leonardo de Moura
 #include "version.h"
 
 #ifndef LEAN_ASYNCH_IMPORT_THEOREM
-#define LEAN_ASYNCH_IMPORT_THEOREM false
+#define LEAN_ASYNCH_IMPORT_THEOREM true
 #endif
 
 namespace lean {
@@ -111,7 +114,9 @@ bool direct_imports_have_changed(environment const & env) {
 }
 
 static char const * g_olean_end_file = "EndFile";
-static char const * g_olean_header   = "oleanfile";
+/* The version suffix must be bumped whenever the object encoding changes: the checksum is only
+   validated at low trust levels, so it cannot be relied on to reject stale files. */
+static char const * g_olean_header   = "oleanfile.v4";
 
 serializer & operator<<(serializer & s, module_name const & n) {
     if (n.is_relative())
@@ -143,8 +148,7 @@ void export_module(std::ostream & out, environment const & env) {
         writers.push_back(&w);
     std::reverse(writers.begin(), writers.end());
 
-    std::ostringstream out1(std::ios_base::binary);
-    serializer s1(out1);
+    serializer s1;
 
     // store objects
     for (auto p : writers) {
@@ -153,9 +157,15 @@ void export_module(std::ostream & out, environment const & env) {
     }
     s1 << g_olean_end_file;
 
+    /* The declaration table of the objects is stored before them */
+    serializer s0;
+    write_declaration_table(s0, s1);
+    s0.write(s1.data(), s1.size());
+
     serializer s2(out);
-    std::string r = out1.str();
-    unsigned h    = hash(r.size(), [&](unsigned i) { return r[i]; });
+    char const * r = s0.data();
+    unsigned r_sz  = s0.size();
+    unsigned h     = hash(r_sz, [&](unsigned i) { return r[i]; });
     s2 << g_olean_header << LEAN_VERSION_MAJOR << LEAN_VERSION_MINOR << LEAN_VERSION_PATCH;
     s2 << h;
     // store imported files
@@ -163,9 +173,8 @@ void export_module(std::ostream & out, environment const & env) {
     for (auto m : imports)
         s2 << m;
     // store object code
-    s2.write_unsigned(r.size());
-    for (unsigned i = 0; i < r.size(); i++)
-        s2.write_char(r[i]);
+    s2.write_unsigned(r_sz);
+    s2.write(r, r_sz);
 }
 
 typedef std::unordered_map<std::string, module_object_reader> object_readers;
@@ -215,7 +224,7 @@ environment update_module_defs(environment const & env, declaration const & d) {
 static environment export_decl(environment const & env, declaration const & d) {
     name n = d.get_name();
     return add(env, *g_decl_key, [=](environment const & env, serializer & s) {
-            s << env.get(n);
+            write_lazy_declaration(s, env.get(n));
         });
 }
 
@@ -240,7 +249,7 @@ environment declare_quotient(environment const & env) {
 static void quotient_reader(deserializer &, shared_environment & senv,
                             std::function<void(asynch_update_fn const &)>  &,
                             std::function<void(delayed_update_fn const &)> &) {
-    senv.update([&](environment const & env) {
+    senv.update([](environment const & env) {
             return ::lean::declare_quotient(env);
         });
 }
@@ -253,7 +262,7 @@ environment declare_hits(environment const & env) {
 static void hits_reader(deserializer &, shared_environment & senv,
                         std::function<void(asynch_update_fn const &)>  &,
                         std::function<void(delayed_update_fn const &)> &) {
-    senv.update([&](environment const & env) {
+    senv.update([](environment const & env) {
             return ::lean::declare_hits(env);
         });
 }
@@ -277,7 +286,7 @@ static void inductive_reader(deserializer & d, shared_environment & senv,
                              std::function<void(asynch_update_fn const &)>  &,
                              std::function<void(delayed_update_fn const &)> &) {
     certified_inductive_decl cdecl = read_certified_inductive_decl(d);
-    senv.update([&](environment const & env) {
+    senv.update([=](environment const & env) {
             return cdecl.add(env);
         });
 }
@@ -289,8 +298,46 @@ environment add_inductive(environment const & env, name const & ind_name, level_
 }
 } // end of namespace module
 
+struct import_modules_fn;
+
+/* The objects of a module decoded from its .olean file. Decoding does not depend on the environment
+   the module is imported into, so decoded modules are shared by the imports performed using the same
+   import_cache (e.g., the jobs of lean --make), and each .olean file is only read once. */
+struct decoded_module {
+    typedef std::function<void(import_modules_fn &)> update_fn;
+    std::string                                        m_fname;
+    dev_t                                              m_dev;
+    ino_t                                              m_ino;
+    time_t                                             m_mod_time;
+    off_t                                              m_size;
+    bool                                               m_checked; // true if the checksum has been checked
+    std::vector<module_name>                           m_imports;
+    /* Updates to be applied to the environment being constructed, in order. */
+    std::vector<update_fn>                             m_updates;
+    /* Delayed updates, and the position of the object that produced them. */
+    std::vector<std::pair<unsigned, delayed_update_fn>> m_delayed_updates;
+    decoded_module():m_dev(0), m_ino(0), m_mod_time(0), m_size(0), m_checked(false) {}
+};
+
+std::shared_ptr<decoded_module const> import_cache::find_module(std::string const & fname, struct stat const & st) {
+    lock_guard<mutex> lk(m_mutex);
+    auto it = m_modules.find(fname);
+    /* Remark: .olean files are replaced by renaming a new file (see export_module), and decoded modules
+       keep their file mapped. So, a file that has been rewritten has a different inode. */
+    if (it != m_modules.end() && it->second->m_dev == st.st_dev && it->second->m_ino == st.st_ino &&
+        it->second->m_mod_time == st.st_mtime && it->second->m_size == st.st_size)
+        return it->second;
+    return nullptr;
+}
+
+void import_cache::add_module(std::shared_ptr<decoded_module const> const & m) {
+    lock_guard<mutex> lk(m_mutex);
+    m_modules[m->m_fname] = m;
+}
+
 struct import_modules_fn {
     typedef std::tuple<unsigned, unsigned, delayed_update_fn> delayed_update;
+    environment                    m_initial_env;
     shared_environment             m_senv;
     unsigned                       m_num_threads;
     bool                           m_keep_proofs;
@@ -300,26 +347,50 @@ struct import_modules_fn {
     std::vector<asynch_update_fn>  m_asynch_tasks;
     mutex                          m_delayed_mutex;
     std::vector<delayed_update>    m_delayed_tasks;
-    atomic<unsigned>               m_next_module_idx;
-    atomic<unsigned>               m_import_counter; // number of modules to be processed
-    atomic<bool>                   m_all_modules_imported;
+    unsigned                       m_next_module_idx;
+    mutex                          m_merge_mutex;
+    unsigned                       m_next_merge_idx; // index of the next module to be merged, protected by m_merge_mutex
+    bool                           m_all_modules_imported; // protected by m_asynch_mutex
+    bool                           m_failed; // true if some thread failed, protected by m_asynch_mutex
 
     struct module_info {
         std::string                               m_fname;
-        atomic<unsigned>                          m_counter; // number of dependencies to be processed
         unsigned                                  m_module_idx;
-        std::vector<std::shared_ptr<module_info>> m_dependents;
-        std::vector<char>                         m_obj_code;
-        module_info():m_counter(0), m_module_idx(0) {}
+        /* The .olean file is mapped into memory, and objects are deserialized directly from it.
+           The types and values of imported declarations are only decoded when they are needed,
+           so the mapping is kept alive by the declaration table of the module (see read_declaration_table). */
+        std::shared_ptr<mapped_file>              m_file;
+        char const *                              m_obj_code;
+        unsigned                                  m_obj_code_size;
+        struct stat                               m_stat;
+        std::vector<module_name>                  m_imports;
+        bool                                      m_checked;
+        /* Objects of the module, they are applied to m_senv by #merge_modules. */
+        std::shared_ptr<decoded_module const>     m_module;
+        bool                                      m_decoded; // protected by m_merge_mutex
+        module_info():m_module_idx(0), m_obj_code(nullptr), m_obj_code_size(0), m_checked(false), m_decoded(false) {}
     };
     typedef std::shared_ptr<module_info> module_info_ptr;
+    /* Modules are decoded in parallel, in any order, since decoding does not depend on the environment.
+       The updates produced by each module are then applied following the module index order (see #merge_modules).
+
+       Remark: module indices are assigned in post-order, i.e., a module has a bigger index than all
+       its dependencies. Since updates are applied in this order, the resulting environment does not depend
+       on how threads are scheduled. */
+    std::vector<module_info_ptr> m_modules; // m_modules[i-1] is the module with index i
+    std::deque<module_info_ptr>  m_decode_tasks; // protected by m_asynch_mutex
     name_map<module_info_ptr> m_module_info;
     name_set                  m_visited; // contains visited files in the current call
     name_set                  m_imported; // contains all imported files, even ones from previous calls
 
-    import_modules_fn(environment const & env, unsigned num_threads, bool keep_proofs, io_state const & ios):
-        m_senv(env), m_num_threads(num_threads), m_keep_proofs(keep_proofs), m_ios(ios),
-        m_next_module_idx(1), m_import_counter(0), m_all_modules_imported(false) {
+    /* Decoded modules are shared using m_cache if it is not nullptr. */
+    import_cache *            m_cache;
+
+    import_modules_fn(environment const & env, unsigned num_threads, bool keep_proofs, io_state const & ios,
+                      import_cache * cache = nullptr):
+        m_initial_env(env), m_senv(env), m_num_threads(num_threads), m_keep_proofs(keep_proofs), m_ios(ios),
+        m_next_module_idx(1), m_next_merge_idx(1), m_all_modules_imported(false), m_failed(false),
+        m_cache(cache) {
         module_ext const & ext = get_extension(env);
         m_imported = ext.m_imported;
         if (m_num_threads == 0)
@@ -328,10 +399,6 @@ struct import_modules_fn {
         if (m_num_threads > 1)
             m_num_threads = 1;
 #endif
-        if (env.trust_lvl() > 0) {
-            // it doesn't payoff to use multiple threads if we will not type check anything
-            m_num_threads = 1;
-        }
     }
 
     module_info_ptr load_module_file(std::string const & base, module_name const & mname) {
@@ -345,21 +412,38 @@ struct import_modules_fn {
             throw exception(sstream() << "circular dependency detected at '" << fname << "'");
         m_visited.insert(fname);
         m_imported.insert(fname);
+        struct stat st;
+        if (stat(fname.c_str(), &st) != 0)
+            throw exception(sstream() << "failed to access stats of file '" << fname << "'");
+        bool check_hash = m_senv.env().trust_lvl() <= LEAN_BELIEVER_TRUST_LEVEL;
+        if (m_cache) {
+            std::shared_ptr<decoded_module const> m = m_cache->find_module(fname, st);
+            if (m && (m->m_checked || !check_hash)) {
+                module_info_ptr r = std::make_shared<module_info>();
+                r->m_fname        = fname;
+                r->m_module       = m;
+                std::string new_base = dirname(fname.c_str());
+                for (module_name const & i : m->m_imports)
+                    load_module_file(new_base, i);
+                register_module(r);
+                return r;
+            }
+        }
         try {
             unsigned major, minor, patch, claimed_hash;
             unsigned code_size;
             buffer<module_name> imports;
-            std::vector<char> code;
+            std::shared_ptr<mapped_file> file;
+            char const * code;
             {
                 shared_file_lock fname_lock(fname);
-                std::ifstream in(fname, std::ifstream::binary);
-                if (!in.good())
-                    throw exception(sstream() << "failed to open file '" << fname << "'");
-                deserializer d1(in);
+                file.reset(new mapped_file(fname));
+                deserializer d1(file->data(), file->size());
                 std::string header;
                 d1 >> header;
                 if (header != g_olean_header)
-                    throw exception(sstream() << "file '" << fname << "' does not seem to be a valid object Lean file, invalid header");
+                    throw exception(sstream() << "file '" << fname << "' does not seem to be a valid object Lean file, "
+                                    "invalid header (it may have been produced by an older version of Lean, rebuild it)");
                 d1 >> major >> minor >> patch >> claimed_hash;
                 // Enforce version?
 
@@ -368,11 +452,12 @@ struct import_modules_fn {
                     imports.push_back(read_module_name(d1));
 
                 code_size = d1.read_unsigned();
-                code.resize(code_size);
-                d1.read(code);
+                if (d1.pos() + code_size > file->size())
+                    throw corrupted_stream_exception();
+                code = file->data() + d1.pos();
             }
 
-            if (m_senv.env().trust_lvl() <= LEAN_BELIEVER_TRUST_LEVEL) {
+            if (check_hash) {
                 unsigned computed_hash = hash(code_size, [&](unsigned i) { return code[i]; });
                 if (claimed_hash != computed_hash)
                     throw exception(sstream() << "file '" << fname << "' has been corrupted, checksum mismatch");
@@ -380,30 +465,32 @@ struct import_modules_fn {
 
             module_info_ptr r = std::make_shared<module_info>();
             r->m_fname        = fname;
-            r->m_counter      = 0;
-            r->m_module_idx   = 0;
-            m_import_counter++;
             std::string new_base = dirname(fname.c_str());
-            std::swap(r->m_obj_code, code);
-            bool has_dependency = false;
-            for (auto i : imports) {
-                if (auto d = load_module_file(new_base, i)) {
-                    r->m_counter++;
-                    d->m_dependents.push_back(r);
-                    has_dependency = true;
-                }
-            }
-            m_module_info.insert(fname, r);
-            r->m_module_idx = m_next_module_idx++;
-
-            if (!has_dependency)
-                add_import_module_task(r);
+            r->m_obj_code      = code;
+            r->m_obj_code_size = code_size;
+            r->m_stat          = st;
+            std::swap(r->m_file, file);
+            r->m_imports.assign(imports.begin(), imports.end());
+            r->m_checked       = check_hash;
+            for (auto i : imports)
+                load_module_file(new_base, i);
+            register_module(r);
             return r;
         } catch (corrupted_stream_exception&) {
             throw corrupted_file_exception(fname);
         }
     }
 
+    /* Assign the next module index to \c r, and create the task for decoding it.
+       Remark: modules are registered after their dependencies. */
+    void register_module(module_info_ptr const & r) {
+        m_module_info.insert(r->m_fname, r);
+        r->m_module_idx = m_next_module_idx++;
+        m_modules.push_back(r);
+        lock_guard<mutex> l(m_asynch_mutex);
+        m_decode_tasks.push_back(r);
+    }
+
     void add_asynch_task(asynch_update_fn const & f) {
         {
             lock_guard<mutex> l(m_asynch_mutex);
@@ -412,17 +499,13 @@ struct import_modules_fn {
         m_asynch_cv.notify_one();
     }
 
-    void add_import_module_task(module_info_ptr const & r) {
-        add_asynch_task([=](shared_environment &) { import_module(r); });
-    }
-
     declaration theorem2axiom(declaration const & decl) {
         lean_assert(decl.is_theorem());
-        return mk_axiom(decl.get_name(), decl.get_univ_params(), decl.get_type());
+        /* Remark: the type of imported theorems is decoded on demand */
+        return mk_lazy_axiom(decl.get_name(), decl.get_univ_params(), [=]() { return decl.get_type(); });
     }
 
-    void import_decl(deserializer & d) {
-        declaration decl = read_declaration(d);
+    void import_decl(declaration decl) {
         environment env  = m_senv.env();
         decl = unfold_untrusted_macros(env, decl);
         if (decl.get_name() == get_sorry_name() && has_sorry(env))
@@ -432,7 +515,7 @@ struct import_modules_fn {
                 m_senv.add(theorem2axiom(decl));
             else
                 m_senv.add(decl);
-        } else if (LEAN_ASYNCH_IMPORT_THEOREM && decl.is_theorem()) {
+        } else if (LEAN_ASYNCH_IMPORT_THEOREM && m_num_threads > 1 && decl.is_theorem()) {
             // First, we add the theorem as an axiom, and create an asychronous task for
             // checking the actual theorem, and replace the axiom with the actual theorem.
             certified_declaration tmp_c = check(env, theorem2axiom(decl));
@@ -454,22 +537,46 @@ struct import_modules_fn {
         }
     }
 
-    void import_universe(deserializer & d) {
-        name const l = read_name(d);
-        m_senv.update([=](environment const & env) { return env.add_universe(l); });
+    /* Decode the objects of the given module, and store them at r->m_module.
+       The environment is not modified, object readers are given a shared_environment that only records
+       their updates. If r->m_module is already set, the module was decoded by a previous import using m_cache. */
+    void decode_module(module_info_ptr const & r) {
+        if (!r->m_module) {
+            std::shared_ptr<decoded_module> m = std::make_shared<decoded_module>();
+            m->m_fname    = r->m_fname;
+            m->m_dev      = r->m_stat.st_dev;
+            m->m_ino      = r->m_stat.st_ino;
+            m->m_mod_time = r->m_stat.st_mtime;
+            m->m_size     = r->m_stat.st_size;
+            m->m_checked  = r->m_checked;
+            m->m_imports  = r->m_imports;
+            decode_module_objects(r, *m);
+            r->m_obj_code = nullptr;
+            r->m_file.reset();
+            if (m_cache)
+                m_cache->add_module(m);
+            r->m_module = m;
+        }
+        merge_modules(r);
     }
 
-    void import_module(module_info_ptr const & r) {
-        std::string s(r->m_obj_code.data(), r->m_obj_code.size());
-        std::istringstream in(s, std::ios_base::binary);
-        deserializer d(in);
+    void decode_module_objects(module_info_ptr const & r, decoded_module & m) {
+        deserializer d(r->m_obj_code, r->m_obj_code_size);
+        declaration_table_ptr decls = read_declaration_table(d, r->m_file);
         unsigned obj_counter = 0;
+        std::vector<std::function<environment(environment const &)>> deferred;
+        shared_environment stage(m_initial_env, deferred);
+        auto flush_deferred = [&]() {
+            for (auto const & f : deferred)
+                m.m_updates.push_back([=](import_modules_fn & fn) { fn.m_senv.update(f); });
+            deferred.clear();
+        };
         std::function<void(asynch_update_fn const &)> add_asynch_update([&](asynch_update_fn const & f) {
-                add_asynch_task(f);
+                flush_deferred();
+                m.m_updates.push_back([=](import_modules_fn & fn) { fn.add_asynch_task(f); });
             });
         std::function<void(delayed_update_fn const &)> add_delayed_update([&](delayed_update_fn const & f) {
-                lock_guard<mutex> lk(m_delayed_mutex);
-                m_delayed_tasks.push_back(std::make_tuple(r->m_module_idx, obj_counter, f));
+                m.m_delayed_updates.emplace_back(obj_counter, f);
             });
         while (true) {
             check_interrupted();
@@ -478,42 +585,65 @@ struct import_modules_fn {
             if (k == g_olean_end_file) {
                 break;
             } else if (k == *g_decl_key) {
-                import_decl(d);
+                declaration decl = read_lazy_declaration(d, decls);
+                m.m_updates.push_back([=](import_modules_fn & fn) { fn.import_decl(decl); });
             } else if (k == *g_glvl_key) {
-                import_universe(d);
+                name const l = read_name(d);
+                m.m_updates.push_back([=](import_modules_fn & fn) {
+                        fn.m_senv.update([=](environment const & env) { return env.add_universe(l); });
+                    });
             } else {
                 object_readers & readers = get_object_readers();
                 auto it = readers.find(k);
                 if (it == readers.end())
                     throw exception(sstream() << "file '" << r->m_fname << "' has been corrupted, unknown object");
-                it->second(d, m_senv, add_asynch_update, add_delayed_update);
+                it->second(d, stage, add_asynch_update, add_delayed_update);
+                flush_deferred();
             }
             obj_counter++;
         }
-        if (atomic_fetch_sub_explicit(&m_import_counter, 1u, memory_order_release) == 1u) {
-            atomic_thread_fence(memory_order_acquire);
-            m_all_modules_imported = true;
-            m_asynch_cv.notify_all();
-        }
-        // Module was successfully imported, we should notify descendents.
-        for (module_info_ptr const & d : r->m_dependents) {
-            if (atomic_fetch_sub_explicit(&(d->m_counter), 1u, memory_order_release) == 1u) {
-                atomic_thread_fence(memory_order_acquire);
-                // all d's dependencies have been processed
-                add_import_module_task(d);
+    }
+
+    /* Mark \c r as decoded, and apply the updates of the decoded modules whose predecessors
+       (in module index order) have already been merged. */
+    void merge_modules(module_info_ptr const & r) {
+        bool done;
+        {
+            lock_guard<mutex> l(m_merge_mutex);
+            r->m_decoded = true;
+            while (m_next_merge_idx < m_next_module_idx && m_modules[m_next_merge_idx - 1]->m_decoded) {
+                module_info_ptr m = m_modules[m_next_merge_idx - 1];
+                for (decoded_module::update_fn const & u : m->m_module->m_updates)
+                    u(*this);
+                if (!m->m_module->m_delayed_updates.empty()) {
+                    lock_guard<mutex> lk(m_delayed_mutex);
+                    for (auto const & p : m->m_module->m_delayed_updates)
+                        m_delayed_tasks.push_back(std::make_tuple(m->m_module_idx, p.first, p.second));
+                }
+                m_next_merge_idx++;
             }
+            done = m_next_merge_idx == m_next_module_idx;
+        }
+        if (done) {
+            lock_guard<mutex> l(m_asynch_mutex);
+            m_all_modules_imported = true;
         }
+        m_asynch_cv.notify_all();
     }
 
     optional<asynch_update_fn> next_task() {
         while (true) {
             check_interrupted();
             unique_lock<mutex> lk(m_asynch_mutex);
-            if (!m_asynch_tasks.empty()) {
+            if (!m_decode_tasks.empty()) {
+                module_info_ptr r = m_decode_tasks.front();
+                m_decode_tasks.pop_front();
+                return optional<asynch_update_fn>([=](shared_environment &) { decode_module(r); });
+            } else if (!m_asynch_tasks.empty()) {
                 asynch_update_fn r = m_asynch_tasks.back();
                 m_asynch_tasks.pop_back();
                 return optional<asynch_update_fn>(r);
-            } else if (m_all_modules_imported) {
+            } else if (m_all_modules_imported || m_failed) {
                 return optional<asynch_update_fn>();
             } else {
                 m_asynch_cv.wait(lk);
@@ -521,8 +651,16 @@ struct import_modules_fn {
         }
     }
 
+    void set_failed() {
+        {
+            lock_guard<mutex> l(m_asynch_mutex);
+            m_failed = true;
+        }
+        m_asynch_cv.notify_all();
+    }
+
     void process_asynch_tasks() {
-        if (m_asynch_tasks.empty())
+        if (m_decode_tasks.empty() && m_asynch_tasks.empty())
             return;
         std::vector<std::unique_ptr<interruptible_thread>> extra_threads;
         std::vector<std::unique_ptr<throwable>> thread_exceptions(m_num_threads - 1);
@@ -537,9 +675,11 @@ struct import_modules_fn {
                             } catch (throwable & ex) {
                                 thread_exceptions[i].reset(ex.clone());
                                 failed_thread_idx = i;
+                                set_failed();
                             } catch (...) {
                                 thread_exceptions[i].reset(new exception("module import thread failed for unknown reasons"));
                                 failed_thread_idx = i;
+                                set_failed();
                             }
                         })));
         }
@@ -551,15 +691,19 @@ struct import_modules_fn {
                     thread_exceptions[idx]->rethrow();
             }
             m_asynch_cv.notify_all();
-            for (auto & th : extra_threads)
-                th->join();
         } catch (...) {
+            set_failed();
             for (auto & th : extra_threads)
                 th->request_interrupt();
             for (auto & th : extra_threads)
                 th->join();
             throw;
         }
+        for (auto & th : extra_threads)
+            th->join();
+        int idx = failed_thread_idx;
+        if (idx >= 0)
+            thread_exceptions[idx]->rethrow();
     }
 
     environment process_delayed_tasks() {
@@ -620,6 +764,77 @@ environment import_module(environment const & env, std::string const & base, mod
     return import_modules(env, base, 1, &module, num_threads, keep_proofs, ios);
 }
 
+void export_module(std::string const & fname, environment const & env) {
+    exclusive_file_lock fname_lock(fname);
+    std::string tmp_fname = fname + ".tmp";
+    try {
+        std::ofstream out(tmp_fname, std::ofstream::binary);
+        export_module(out, env);
+        out.close();
+        if (!out)
+            throw exception(sstream() << "failed to write '" << tmp_fname << "'");
+    } catch (...) {
+        std::remove(tmp_fname.c_str());
+        throw;
+    }
+    if (std::rename(tmp_fname.c_str(), fname.c_str()) != 0) {
+        std::remove(fname.c_str());
+        if (std::rename(tmp_fname.c_str(), fname.c_str()) != 0)
+            throw exception(sstream() << "failed to write '" << fname << "'");
+    }
+}
+
+static std::string mk_import_key(std::string const & base, unsigned num_modules, module_name const * modules,
+                                 bool keep_proofs) {
+    std::ostringstream key;
+    key << keep_proofs;
+    for (unsigned i = 0; i < num_modules; i++) {
+        /* The relative imports are resolved and stored using base */
+        if (auto k = modules[i].get_k())
+            key << "|" << base << "|" << *k;
+        key << "|" << modules[i].get_name();
+    }
+    return key.str();
+}
+
+environment import_cache::import_modules(environment const & env, std::string const & base, unsigned num_modules,
+                                         module_name const * modules, unsigned num_threads, bool keep_proofs,
+                                         io_state const & ios) {
+    std::string key = mk_import_key(base, num_modules, modules, keep_proofs);
+    {
+        unique_lock<mutex> lk(m_mutex);
+        while (true) {
+            auto it = m_entries.find(key);
+            if (it != m_entries.end() && is_eqp(it->second.m_initial_env, env) &&
+                !direct_imports_have_changed(it->second.m_env))
+                return it->second.m_env;
+            if (m_pending.find(key) == m_pending.end())
+                break;
+            m_cv.wait(lk);
+        }
+        m_pending.insert(key);
+    }
+    optional<environment> r;
+    try {
+        r = import_modules_fn(env, num_threads, keep_proofs, ios, this)(base, num_modules, modules);
+    } catch (...) {
+        {
+            lock_guard<mutex> lk(m_mutex);
+            m_pending.erase(key);
+        }
+        m_cv.notify_all();
+        throw;
+    }
+    {
+        lock_guard<mutex> lk(m_mutex);
+        m_pending.erase(key);
+        m_entries.erase(key);
+        m_entries.insert(mk_pair(key, entry(env, *r)));
+    }
+    m_cv.notify_all();
+    return *r;
+}
+
 void initialize_module() {
     g_ext            = new module_ext_reg();
     g_object_readers = new object_readers();
@@ -5,8 +5,13 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Author: Leonardo de Moura
 */
 #pragma once
+#include <sys/stat.h>
 #include <string>
 #include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include "util/thread.h"
 #include "util/serializer.h"
 #include "util/optional.h"
 #include "kernel/inductive/inductive.h"
@@ -59,6 +64,42 @@ bool direct_imports_have_changed(environment const & env);
 
 /** \brief Store/Export module using \c env to the output stream \c out. */
 void export_module(std::ostream & out, environment const & env);
+/** \brief Store/Export module using \c env to the file \c fname.
+    Remark: .olean files are memory mapped when imported. So, we do not overwrite them in place,
+    the module is written to a temporary file that is then renamed. */
+void export_module(std::string const & fname, environment const & env);
+
+struct decoded_module;
+
+/** \brief Cache for the environments produced by \c import_modules. It allows different files processed
+    by the same lean process (e.g., lean --make) to share imported modules instead of reloading them.
+
+    An environment is only reused for the same list of imports. We do not split the list to share
+    prefixes, since the order the imported objects are added to the environment would change.
+    However, the objects decoded from each .olean file are shared by all imports, even when the lists
+    of imports are different. So, each .olean file is read only once while it is not modified. */
+class import_cache {
+    struct entry {
+        environment m_initial_env;
+        environment m_env;
+        entry(environment const & env0, environment const & env):m_initial_env(env0), m_env(env) {}
+    };
+    friend struct import_modules_fn;
+    mutex                                  m_mutex;
+    condition_variable                     m_cv;
+    std::unordered_map<std::string, entry> m_entries;
+    std::unordered_set<std::string>        m_pending; // keys being imported by some thread
+    /* Decoded .olean files, indexed by file name */
+    std::unordered_map<std::string, std::shared_ptr<decoded_module const>> m_modules;
+    std::shared_ptr<decoded_module const> find_module(std::string const & fname, struct stat const & st);
+    void add_module(std::shared_ptr<decoded_module const> const & m);
+public:
+    /** \brief Similar to the function \c import_modules, but reuses the environments produced by previous
+        calls that used the same initial environment. */
+    environment import_modules(environment const & env, std::string const & base, unsigned num_modules,
+                               module_name const * modules, unsigned num_threads, bool keep_proofs,
+                               io_state const & ios);
+};
 
 /** \brief An asynchronous update. It goes into a task queue, and can be executed by a different execution thread. */
 typedef std::function<void(shared_environment & env)> asynch_update_fn;
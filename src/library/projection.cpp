@@ -19,7 +19,7 @@ namespace lean {
     defined in an environment object.
 */
 struct projection_ext : public environment_extension {
-    name_map<projection_info> m_info;
+    name_hamt_map<projection_info> m_info;
     projection_ext() {}
 };
 
@@ -59,7 +59,7 @@ projection_info const * get_projection_info(environment const & env, name const
     return ext.m_info.find(p);
 }
 
-name_map<projection_info> const & get_projection_info_map(environment const & env) {
+name_hamt_map<projection_info> const & get_projection_info_map(environment const & env) {
     return get_extension(env).m_info;
 }
 
@@ -48,7 +48,7 @@ inline bool is_projection(environment const & env, name const & n) {
 }
 
 /** \brief Return the mapping from projection name to associated information */
-name_map<projection_info> const & get_projection_info_map(environment const & env);
+name_hamt_map<projection_info> const & get_projection_info_map(environment const & env);
 
 /** \brief Return true iff the type named \c S can be viewed as
     a structure in the given environment.
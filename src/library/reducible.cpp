@@ -88,6 +88,29 @@ reducible_status get_reducible_status(environment const & env, name const & n) {
     return reducible_status::Semireducible;
 }
 
+bool has_same_reducible_status(environment const & old_env, environment const & new_env) {
+    buffer<name> updated;
+    if (get_reducibility_attribute().get_updated_since(old_env, new_env, updated)) {
+        for (name const & n : updated) {
+            if (old_env.find(n) && get_reducible_status(old_env, n) != get_reducible_status(new_env, n))
+                return false;
+        }
+        return true;
+    }
+    buffer<name> old_decls, new_decls;
+    get_reducibility_attribute().get_instances(old_env, old_decls);
+    get_reducibility_attribute().get_instances(new_env, new_decls);
+    for (name const & n : old_decls) {
+        if (get_reducible_status(old_env, n) != get_reducible_status(new_env, n))
+            return false;
+    }
+    for (name const & n : new_decls) {
+        if (old_env.find(n) && get_reducible_status(old_env, n) != get_reducible_status(new_env, n))
+            return false;
+    }
+    return true;
+}
+
 name_predicate mk_not_reducible_pred(environment const & env) {
     return [=](name const & n) { // NOLINT
         return get_reducible_status(env, n) != reducible_status::Reducible;
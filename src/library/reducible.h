@@ -29,6 +29,10 @@ inline bool is_reducible(environment const & env, name const & n) { return get_r
 /* \brief Execute the given function for each declaration explicitly marked with a reducibility annotation */
 void for_each_reducible(environment const & env, std::function<void(name const &, reducible_status)> const & fn);
 
+/** \brief Return true iff the declarations in \c old_env have the same reducibility status in \c new_env.
+    \pre new_env is a descendant of old_env */
+bool has_same_reducible_status(environment const & old_env, environment const & new_env);
+
 /** \brief Create a predicate that returns true for all non reducible constants in \c env */
 name_predicate mk_not_reducible_pred(environment const & env);
 /** \brief Create a predicate that returns true for irreducible constants  in \c env */
@@ -4,11 +4,15 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
+#include <vector>
 #include "library/shared_environment.h"
 
 namespace lean {
-shared_environment::shared_environment() {}
-shared_environment::shared_environment(environment const & env):m_env(env) {}
+shared_environment::shared_environment():m_deferred(nullptr) {}
+shared_environment::shared_environment(environment const & env):m_env(env), m_deferred(nullptr) {}
+shared_environment::shared_environment(environment const & env,
+                                       std::vector<std::function<environment(environment const &)>> & deferred):
+    m_env(env), m_deferred(&deferred) {}
 
 environment shared_environment::get_environment() const {
     lock_guard<mutex> l(m_mutex);
@@ -32,6 +36,9 @@ void shared_environment::replace(certified_declaration const & t) {
 
 void shared_environment::update(std::function<environment(environment const &)> const & f) {
     lock_guard<mutex> l(m_mutex);
-    m_env = f(m_env);
+    if (m_deferred)
+        m_deferred->push_back(f);
+    else
+        m_env = f(m_env);
 }
 }
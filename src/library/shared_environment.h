@@ -6,6 +6,7 @@ Author: Leonardo de Moura
 */
 #pragma once
 #include <functional>
+#include <vector>
 #include "util/shared_mutex.h"
 #include "kernel/environment.h"
 
@@ -15,6 +16,11 @@ class shared_environment {
     friend struct import_modules_fn;
     environment          m_env;
     mutable mutex        m_mutex;
+    /* When m_deferred != nullptr, #update does not modify m_env, the update is appended to m_deferred.
+       The module importer uses this mode to decode modules in parallel, and then apply their updates
+       in a fixed order. */
+    std::vector<std::function<environment(environment const &)>> * m_deferred;
+    shared_environment(environment const & env, std::vector<std::function<environment(environment const &)>> & deferred);
     /**
         \brief Add declaration that was not type checked.
         The method throws an exception if trust_level() == 0
@@ -6,6 +6,7 @@ Author: Daniel Selsam
 */
 #include <string>
 #include <algorithm>
+#include "util/sstream.h"
 #include "util/sexpr/option_declarations.h"
 #include "library/kernel_serializer.h"
 #include "library/constants.h"
@@ -6,6 +6,7 @@ Author: Leonardo de Moura
 */
 #include <vector>
 #include <string>
+#include <algorithm>
 #include <library/constants.h>
 #include "util/priority_queue.h"
 #include "util/sstream.h"
@@ -15,10 +16,13 @@ Author: Leonardo de Moura
 #include "kernel/error_msgs.h"
 #include "kernel/find_fn.h"
 #include "kernel/instantiate.h"
+#include "kernel/inductive/inductive.h"
 #include "library/trace.h"
 #include "library/num.h"
 #include "library/cache_helper.h"
 #include "library/scoped_ext.h"
+#include "library/reducible.h"
+#include "library/projection.h"
 #include "library/attribute_manager.h"
 #include "library/type_context.h"
 #include "library/vm/vm_expr.h"
@@ -31,7 +35,10 @@ namespace lean {
 
 /* Caching */
 struct simp_lemma_cache {
-    typedef name_hash_map<simp_lemmas> cache;
+    /* We also store the fingerprint of the attribute used to build each entry.
+       The cache is reused in descendant environments, and an entry is only
+       rebuilt when the corresponding attribute has been modified. */
+    typedef name_hash_map<pair<simp_lemmas, unsigned>> cache;
 
     environment                        m_env;
     cache                              m_simp_lemma_cache;
@@ -39,6 +46,7 @@ struct simp_lemma_cache {
 
     simp_lemma_cache(environment const & env): m_env(env) {}
     environment const & env() const { return m_env; }
+    void set_env(environment const & env) { m_env = env; }
 
     cache & simp_cache() { return m_simp_lemma_cache; }
     cache & congr_cache() { return m_congr_lemma_cache; }
@@ -46,7 +54,7 @@ struct simp_lemma_cache {
 
 typedef cache_compatibility_helper<simp_lemma_cache> simp_lemma_cache_helper;
 
-MK_THREAD_LOCAL_GET_DEF(simp_lemma_cache_helper, get_slch);
+MK_THREAD_LOCAL_GET(simp_lemma_cache_helper, get_slch, "simp_lemma");
 
 simp_lemma_cache & get_simp_lemma_cache_for(type_context const & ctx) {
     return get_slch().get_cache_for(ctx);
@@ -107,7 +115,7 @@ simp_lemmas add_core(tmp_type_context & tmp_tctx, simp_lemmas const & s,
         }
         expr rel, lhs, rhs;
         if (is_simp_relation(env, rule, rel, lhs, rhs) && is_constant(rel)) {
-            new_s.insert(const_name(rel), simp_lemma(id, univ_metas, reverse_to_list(emetas),
+            new_s.insert(const_name(rel), simp_lemma(env, id, univ_metas, reverse_to_list(emetas),
                                                      reverse_to_list(instances), lhs, rhs, proof, is_perm, priority));
         }
     }
@@ -275,7 +283,7 @@ simp_lemmas add_congr_core(tmp_type_context & tmp_tctx, simp_lemmas const & s, n
         }
     }
     simp_lemmas new_s = s;
-    new_s.insert(const_name(rel), user_congr_lemma(n, ls, reverse_to_list(emetas),
+    new_s.insert(const_name(rel), user_congr_lemma(tmp_tctx.tctx().env(), n, ls, reverse_to_list(emetas),
                                                    reverse_to_list(instances), lhs, rhs, proof, to_list(congr_hyps), prio));
     return new_s;
 }
@@ -293,14 +301,14 @@ simp_lemmas add(type_context & tctx, simp_lemmas const & s, name const & id, exp
 simp_lemmas join(simp_lemmas const & s1, simp_lemmas const & s2) {
     simp_lemmas new_s1 = s1;
 
-    buffer<pair<name const &, simp_lemma const &>> slemmas;
+    buffer<pair<name, simp_lemma>> slemmas;
     s2.for_each_simp([&](name const & eqv, simp_lemma const & r) {
             slemmas.push_back({eqv, r});
         });
     for (unsigned i = slemmas.size() - 1; i + 1 > 0; --i)
         new_s1.insert(slemmas[i].first, slemmas[i].second);
 
-    buffer<pair<name const &, user_congr_lemma const &>> clemmas;
+    buffer<pair<name, user_congr_lemma>> clemmas;
     s2.for_each_congr([&](name const & eqv, user_congr_lemma const & r) {
             clemmas.push_back({eqv, r});
         });
@@ -324,16 +332,64 @@ void validate_congr(type_context & tctx, name const & n) {
     add_congr_core(tmp_tctx, s, n, LEAN_DEFAULT_PRIORITY);
 }
 
-simp_lemma_core::simp_lemma_core(name const & id, levels const & umetas, list<expr> const & emetas,
-                                 list<bool> const & instances, expr const & lhs, expr const & rhs, expr const & proof,
-                                 unsigned priority):
+/* Return true if an application of \c n may not be in weak head normal form using reducible transparency.
+   Remark: projections and recursors are reduced when their major premise is a constructor application.
+   So, a lemma about (point.x (point.mk a b)) also applies to (a). */
+static bool may_reduce(environment const & env, name const & n) {
+    return is_reducible(env, n) || is_projection(env, n) || static_cast<bool>(inductive::is_elim_rule(env, n));
+}
+
+/* Store in \c keys the discrimination tree keys used to index the left-hand-side of simp and congruence lemmas.
+
+   The simplifier unifies terms and left-hand-sides using reducible transparency, but the keys are computed
+   syntactically: metavariables, binders, instance implicit arguments, and subterms that may not be in
+   weak head normal form (see may_reduce) are mapped to Star. As in the head symbol index used before,
+   the head symbol of the whole term is always used. */
+static void get_simp_keys(environment const & env, expr const & e, bool root, buffer<discr_tree_key> & keys) {
+    if (is_sort(e)) {
+        keys.push_back(discr_tree_key(discr_tree_key_kind::Sort, name(), 0));
+        return;
+    }
+    buffer<expr> args;
+    expr const & fn = get_app_args(e, args);
+    expr fn_type;
+    if (is_constant(fn) && (root || !may_reduce(env, const_name(fn)))) {
+        keys.push_back(discr_tree_key(discr_tree_key_kind::Constant, const_name(fn), args.size()));
+        if (auto d = env.find(const_name(fn)))
+            fn_type = d->get_type();
+    } else if (is_local(fn)) {
+        keys.push_back(discr_tree_key(discr_tree_key_kind::Local, mlocal_name(fn), args.size()));
+        fn_type = mlocal_type(fn);
+    } else {
+        keys.push_back(discr_tree_key());
+        return;
+    }
+    for (expr const & arg : args) {
+        if (fn_type && is_pi(fn_type) && binding_info(fn_type).is_inst_implicit())
+            keys.push_back(discr_tree_key());
+        else
+            get_simp_keys(env, arg, false, keys);
+        if (fn_type && is_pi(fn_type))
+            fn_type = binding_body(fn_type);
+    }
+}
+
+static discr_tree_keys get_simp_keys(environment const & env, expr const & e) {
+    buffer<discr_tree_key> keys;
+    get_simp_keys(env, e, true, keys);
+    return to_list(keys);
+}
+
+simp_lemma_core::simp_lemma_core(environment const & env, name const & id, levels const & umetas,
+                                 list<expr> const & emetas, list<bool> const & instances,
+                                 expr const & lhs, expr const & rhs, expr const & proof, unsigned priority):
     m_id(id), m_umetas(umetas), m_emetas(emetas), m_instances(instances),
-    m_lhs(lhs), m_rhs(rhs), m_proof(proof), m_priority(priority) {}
+    m_lhs(lhs), m_rhs(rhs), m_proof(proof), m_priority(priority), m_keys(get_simp_keys(env, lhs)) {}
 
-simp_lemma::simp_lemma(name const & id, levels const & umetas, list<expr> const & emetas,
+simp_lemma::simp_lemma(environment const & env, name const & id, levels const & umetas, list<expr> const & emetas,
                        list<bool> const & instances, expr const & lhs, expr const & rhs, expr const & proof,
                        bool is_perm, unsigned priority):
-    simp_lemma_core(id, umetas, emetas, instances, lhs, rhs, proof, priority),
+    simp_lemma_core(env, id, umetas, emetas, instances, lhs, rhs, proof, priority),
     m_is_permutation(is_perm) {}
 
 bool operator==(simp_lemma const & r1, simp_lemma const & r2) {
@@ -354,10 +410,11 @@ format simp_lemma::pp(formatter const & fmt) const {
     return r;
 }
 
-user_congr_lemma::user_congr_lemma(name const & id, levels const & umetas, list<expr> const & emetas,
-                                   list<bool> const & instances, expr const & lhs, expr const & rhs, expr const & proof,
-                                   list<expr> const & congr_hyps, unsigned priority):
-    simp_lemma_core(id, umetas, emetas, instances, lhs, rhs, proof, priority),
+user_congr_lemma::user_congr_lemma(environment const & env, name const & id, levels const & umetas,
+                                   list<expr> const & emetas, list<bool> const & instances, expr const & lhs,
+                                   expr const & rhs, expr const & proof, list<expr> const & congr_hyps,
+                                   unsigned priority):
+    simp_lemma_core(env, id, umetas, emetas, instances, lhs, rhs, proof, priority),
     m_congr_hyps(congr_hyps) {}
 
 bool operator==(user_congr_lemma const & r1, user_congr_lemma const & r2) {
@@ -385,36 +442,91 @@ format user_congr_lemma::pp(formatter const & fmt) const {
 simp_lemmas_for::simp_lemmas_for(name const & eqv):
     m_eqv(eqv) {}
 
+/* Insert \c r in the discrimination tree \c s. If \c r is already there, it becomes the most recent lemma. */
+template<typename R, typename S>
+static void insert_lemma(S & s, R const & r, unsigned & next_idx) {
+    buffer<discr_tree_key> keys;
+    to_buffer(r.get_keys(), keys);
+    s.erase(keys, simp_lemmas_for::entry<R>(r, 0));
+    s.insert(keys, simp_lemmas_for::entry<R>(r, next_idx));
+    next_idx++;
+}
+
+template<typename R, typename S>
+static void erase_lemma(S & s, R const & r) {
+    buffer<discr_tree_key> keys;
+    to_buffer(r.get_keys(), keys);
+    s.erase(keys, simp_lemmas_for::entry<R>(r, 0));
+}
+
+/* The lemmas of each leaf of the discrimination tree are already sorted, see simp_lemmas_for::entry::lt. */
+template<typename R, typename S>
+static list<R> find_lemmas(S const & s, buffer<discr_tree_key> const & keys) {
+    buffer<R> r;
+    s.find_sorted(keys, [&](simp_lemmas_for::entry<R> const & e) { r.push_back(e.m_lemma); });
+    return to_list(r);
+}
+
+/* Return all lemmas from the highest priority to the lowest one, and the most recent to the oldest one. */
+template<typename R, typename S>
+static list<R> get_lemmas(S const & s) {
+    buffer<simp_lemmas_for::entry<R>> entries;
+    s.for_each([&](simp_lemmas_for::entry<R> const & e) { entries.push_back(e); });
+    std::sort(entries.begin(), entries.end(), typename simp_lemmas_for::entry<R>::lt());
+    buffer<R> r;
+    for (auto const & e : entries)
+        r.push_back(e.m_lemma);
+    return to_list(r);
+}
+
 void simp_lemmas_for::insert(simp_lemma const & r) {
-    m_simp_set.insert(r.get_lhs(), r);
+    insert_lemma(m_simp_set, r, m_next_idx);
 }
 
 void simp_lemmas_for::erase(simp_lemma const & r) {
-    m_simp_set.erase(r.get_lhs(), r);
+    erase_lemma(m_simp_set, r);
 }
 
 void simp_lemmas_for::insert(user_congr_lemma const & r) {
-    m_congr_set.insert(r.get_lhs(), r);
+    insert_lemma(m_congr_set, r, m_next_idx);
 }
 
 void simp_lemmas_for::erase(user_congr_lemma const & r) {
-    m_congr_set.erase(r.get_lhs(), r);
+    erase_lemma(m_congr_set, r);
+}
+
+list<simp_lemma> simp_lemmas_for::find_simp(environment const & env, expr const & e) const {
+    buffer<discr_tree_key> keys;
+    get_simp_keys(env, e, true, keys);
+    return find_lemmas<simp_lemma>(m_simp_set, keys);
 }
 
-list<simp_lemma> const * simp_lemmas_for::find_simp(head_index const & h) const {
-    return m_simp_set.find(h);
+list<simp_lemma> simp_lemmas_for::find_simp_binary_op(environment const & env, expr const & op) const {
+    buffer<discr_tree_key> keys;
+    get_simp_keys(env, op, true, keys);
+    if (keys[0].is_star())
+        return get_lemmas<simp_lemma>(m_simp_set);
+    /* keys for (op ?a ?b) */
+    keys[0].m_arity += 2;
+    keys.push_back(discr_tree_key());
+    keys.push_back(discr_tree_key());
+    return find_lemmas<simp_lemma>(m_simp_set, keys);
 }
 
 void simp_lemmas_for::for_each_simp(std::function<void(simp_lemma const &)> const & fn) const {
-    m_simp_set.for_each_entry([&](head_index const &, simp_lemma const & r) { fn(r); });
+    for (simp_lemma const & r : get_lemmas<simp_lemma>(m_simp_set))
+        fn(r);
 }
 
-list<user_congr_lemma> const * simp_lemmas_for::find_congr(head_index const & h) const {
-    return m_congr_set.find(h);
+list<user_congr_lemma> simp_lemmas_for::find_congr(environment const & env, expr const & e) const {
+    buffer<discr_tree_key> keys;
+    get_simp_keys(env, e, true, keys);
+    return find_lemmas<user_congr_lemma>(m_congr_set, keys);
 }
 
 void simp_lemmas_for::for_each_congr(std::function<void(user_congr_lemma const &)> const & fn) const {
-    m_congr_set.for_each_entry([&](head_index const &, user_congr_lemma const & r) { fn(r); });
+    for (user_congr_lemma const & r : get_lemmas<user_congr_lemma>(m_congr_set))
+        fn(r);
 }
 
 void simp_lemmas_for::erase_simp(name_set const & ids) {
@@ -497,16 +609,16 @@ simp_lemmas_for const * simp_lemmas::find(name const & eqv) const {
     return m_sets.find(eqv);
 }
 
-list<simp_lemma> const * simp_lemmas::find_simp(name const & eqv, head_index const & h) const {
+list<simp_lemma> simp_lemmas::find_simp(environment const & env, name const & eqv, expr const & e) const {
     if (auto const * s = m_sets.find(eqv))
-        return s->find_simp(h);
-    return nullptr;
+        return s->find_simp(env, e);
+    return list<simp_lemma>();
 }
 
-list<user_congr_lemma> const * simp_lemmas::find_congr(name const & eqv, head_index const & h) const {
+list<user_congr_lemma> simp_lemmas::find_congr(environment const & env, name const & eqv, expr const & e) const {
     if (auto const * s = m_sets.find(eqv))
-        return s->find_congr(h);
-    return nullptr;
+        return s->find_congr(env, e);
+    return list<user_congr_lemma>();
 }
 
 void simp_lemmas::for_each_simp(std::function<void(name const &, simp_lemma const &)> const & fn) const {
@@ -570,9 +682,10 @@ format simp_lemmas::pp(formatter const & fmt) const {
 }
 
 simp_lemmas get_simp_lemmas_for_attr(simp_lemma_cache & sl_cache, type_context & tctx, name const & simp_attr) {
+    unsigned fingerprint = get_attribute_fingerprint(tctx.env(), simp_attr);
     auto it = sl_cache.simp_cache().find(simp_attr);
-    if (it != sl_cache.simp_cache().end())
-        return it->second;
+    if (it != sl_cache.simp_cache().end() && it->second.second == fingerprint)
+        return it->second.first;
 
     auto const & attr = get_attribute(tctx.env(), simp_attr);
     simp_lemmas r;
@@ -585,14 +698,15 @@ simp_lemmas get_simp_lemmas_for_attr(simp_lemma_cache & sl_cache, type_context &
         tmp_type_context tmp_tctx(tctx);
         r = add_core(tmp_tctx, r, id, attr.get_prio(tctx.env(), id));
     }
-    sl_cache.simp_cache().insert({simp_attr, r});
+    sl_cache.simp_cache()[simp_attr] = mk_pair(r, fingerprint);
     return r;
 }
 
 simp_lemmas get_congr_lemmas_for_attr(simp_lemma_cache & sl_cache, type_context & tctx, name const & congr_attr) {
+    unsigned fingerprint = get_attribute_fingerprint(tctx.env(), congr_attr);
     auto it = sl_cache.congr_cache().find(congr_attr);
-    if (it != sl_cache.congr_cache().end())
-        return it->second;
+    if (it != sl_cache.congr_cache().end() && it->second.second == fingerprint)
+        return it->second.first;
 
     auto const & attr = get_attribute(tctx.env(), congr_attr);
     simp_lemmas r;
@@ -605,7 +719,7 @@ simp_lemmas get_congr_lemmas_for_attr(simp_lemma_cache & sl_cache, type_context
         tmp_type_context tmp_tctx(tctx);
         r = add_congr_core(tmp_tctx, r, id, attr.get_prio(tctx.env(), id));
     }
-    sl_cache.congr_cache().insert({congr_attr, r});
+    sl_cache.congr_cache()[congr_attr] = mk_pair(r, fingerprint);
     return r;
 }
 
@@ -8,7 +8,7 @@ Author: Leonardo de Moura
 #include "kernel/environment.h"
 #include "library/io_state.h"
 #include "library/type_context.h"
-#include "library/head_map.h"
+#include "library/discr_tree.h"
 #include "library/vm/vm.h"
 
 namespace lean {
@@ -34,7 +34,8 @@ protected:
     expr                m_rhs;
     expr                m_proof;
     unsigned            m_priority;
-    simp_lemma_core(name const & id, levels const & umetas, list<expr> const & emetas,
+    discr_tree_keys     m_keys; // keys for m_lhs, see get_simp_keys
+    simp_lemma_core(environment const & env, name const & id, levels const & umetas, list<expr> const & emetas,
                     list<bool> const & instances, expr const & lhs, expr const & rhs, expr const & proof,
                     unsigned priority);
 public:
@@ -54,11 +55,12 @@ public:
     expr const & get_lhs() const { return m_lhs; }
     expr const & get_rhs() const { return m_rhs; }
     expr const & get_proof() const { return m_proof; }
+    discr_tree_keys const & get_keys() const { return m_keys; }
 };
 
 class simp_lemma : public simp_lemma_core {
     bool           m_is_permutation;
-    simp_lemma(name const & id, levels const & umetas, list<expr> const & emetas,
+    simp_lemma(environment const & env, name const & id, levels const & umetas, list<expr> const & emetas,
                list<bool> const & instances, expr const & lhs, expr const & rhs, expr const & proof,
                bool is_perm, unsigned priority);
 
@@ -76,7 +78,7 @@ inline bool operator!=(simp_lemma const & r1, simp_lemma const & r2) { return !o
 // We use user_congr_lemma to avoid a confusion with ::lemma::congr_lemma
 class user_congr_lemma : public simp_lemma_core {
     list<expr>  m_congr_hyps;
-    user_congr_lemma(name const & id, levels const & umetas, list<expr> const & emetas,
+    user_congr_lemma(environment const & env, name const & id, levels const & umetas, list<expr> const & emetas,
                      list<bool> const & instances, expr const & lhs, expr const & rhs, expr const & proof,
                      list<expr> const & congr_hyps, unsigned priority);
     friend simp_lemmas add_congr_core(tmp_type_context & tctx, simp_lemmas const & s, name const & n, unsigned priority);
@@ -86,16 +88,37 @@ public:
     format pp(formatter const & fmt) const;
 };
 
-struct simp_lemma_core_prio_fn { unsigned operator()(simp_lemma_core const & s) const { return s.get_priority(); } };
-
 bool operator==(user_congr_lemma const & r1, user_congr_lemma const & r2);
 inline bool operator!=(user_congr_lemma const & r1, user_congr_lemma const & r2) { return !operator==(r1, r2); }
 
 /** \brief Simplification and congruence lemmas for a given equivalence relation */
 class simp_lemmas_for {
-    typedef head_map_prio<simp_lemma, simp_lemma_core_prio_fn>  simp_set;
-    typedef head_map_prio<user_congr_lemma, simp_lemma_core_prio_fn> congr_set;
+public:
+    /* Lemmas are indexed using a discrimination tree on their left-hand-side.
+       Lemmas with the same priority are tried from the most recent to the oldest one,
+       so we also store the position of each lemma in the insertion order. */
+    template<typename R> struct entry {
+        R        m_lemma;
+        unsigned m_idx;
+        entry(R const & r, unsigned idx):m_lemma(r), m_idx(idx) {}
+        friend bool operator==(entry const & e1, entry const & e2) { return e1.m_lemma == e2.m_lemma; }
+        friend bool operator!=(entry const & e1, entry const & e2) { return e1.m_lemma != e2.m_lemma; }
+        /* Order in which the lemmas are tried: from the highest priority to the lowest one,
+           and from the most recent to the oldest one. The leaves of the discrimination tree
+           are kept sorted using this order. */
+        struct lt {
+            bool operator()(entry const & e1, entry const & e2) const {
+                if (e1.m_lemma.get_priority() != e2.m_lemma.get_priority())
+                    return e1.m_lemma.get_priority() > e2.m_lemma.get_priority();
+                return e1.m_idx > e2.m_idx;
+            }
+        };
+    };
+private:
+    typedef discr_tree<entry<simp_lemma>, entry<simp_lemma>::lt>             simp_set;
+    typedef discr_tree<entry<user_congr_lemma>, entry<user_congr_lemma>::lt> congr_set;
     name      m_eqv;
+    unsigned  m_next_idx{0};
     simp_set  m_simp_set;
     congr_set m_congr_set;
 public:
@@ -110,9 +133,14 @@ public:
     void erase(user_congr_lemma const & r);
     void erase_simp(name_set const & ids);
     void erase_simp(buffer<name> const & ids);
-    list<simp_lemma> const * find_simp(head_index const & h) const;
+    /** \brief Return the simp lemmas whose left-hand-side may match \c e, sorted by priority. */
+    list<simp_lemma> find_simp(environment const & env, expr const & e) const;
+    /** \brief Return the simp lemmas whose left-hand-side is of the form (op' a b), and \c op' may match \c op. */
+    list<simp_lemma> find_simp_binary_op(environment const & env, expr const & op) const;
+    /** \brief Execute \c fn for each simp lemma, from the highest priority to the lowest one. */
     void for_each_simp(std::function<void(simp_lemma const &)> const & fn) const;
-    list<user_congr_lemma> const * find_congr(head_index const & h) const;
+    /** \brief Return the congruence lemmas whose left-hand-side may match \c e, sorted by priority. */
+    list<user_congr_lemma> find_congr(environment const & env, expr const & e) const;
     void for_each_congr(std::function<void(user_congr_lemma const &)> const & fn) const;
 };
 
@@ -129,8 +157,8 @@ public:
     void erase_simp(buffer<name> const & ids);
     void get_relations(buffer<name> & rs) const;
     simp_lemmas_for const * find(name const & eqv) const;
-    list<simp_lemma> const * find_simp(name const & eqv, head_index const & h) const;
-    list<user_congr_lemma> const * find_congr(name const & eqv, head_index const & h) const;
+    list<simp_lemma> find_simp(environment const & env, name const & eqv, expr const & e) const;
+    list<user_congr_lemma> find_congr(environment const & env, name const & eqv, expr const & e) const;
     void for_each_simp(std::function<void(name const &, simp_lemma const &)> const & fn) const;
     void for_each_congr(std::function<void(name const &, user_congr_lemma const &)> const & fn) const;
     format pp(formatter const & fmt, format const & header, bool simp, bool congr) const;
@@ -188,6 +188,11 @@ class simplifier {
 
     /* Logging */
     unsigned                  m_num_steps{0};
+    /* Number of simp/congruence lemmas retrieved from the index that were tried, and that succeeded */
+    unsigned                  m_num_lemma_attempts{0};
+    unsigned                  m_num_lemma_hits{0};
+    unsigned                  m_num_congr_attempts{0};
+    unsigned                  m_num_congr_hits{0};
 
     bool                      m_need_restart{false};
 
@@ -374,15 +379,17 @@ class simplifier {
         simp_lemmas_for const * sr = slss.find(m_rel);
         if (!sr) return simp_result(e);
 
-        list<simp_lemma> const * srs = sr->find_simp(e);
+        list<simp_lemma> srs = sr->find_simp(env(), e);
         if (!srs) {
             lean_trace_d(name({"debug", "simplifier", "try_rewrite"}), tout() << "no simp lemmas for: " << e << "\n";);
             return simp_result(e);
         }
 
-        for (simp_lemma const & lemma : *srs) {
+        for (simp_lemma const & lemma : srs) {
+            m_num_lemma_attempts++;
             simp_result r = rewrite_binary(e, lemma);
             if (r.has_proof()) {
+                m_num_lemma_hits++;
                 lean_trace_d(name({"simplifier", "rewrite"}), tout() << "[" << lemma.get_id() << "]: " << e << " ==> " << r.get_new() << "\n";);
                 return r;
             }
@@ -556,14 +563,17 @@ class simplifier {
         if (!sr)
             return optional<simp_result>();
 
-        list<simp_lemma> const * srs = sr->find_simp(op);
+        list<simp_lemma> srs = sr->find_simp_binary_op(env(), op);
         if (!srs) {
             return optional<simp_result>();
         }
 
-        for (simp_lemma const & lemma : *srs) {
-            if (optional<simp_result> r = rewrite_nary(assoc, old_e, op, nary_args, lemma))
+        for (simp_lemma const & lemma : srs) {
+            m_num_lemma_attempts++;
+            if (optional<simp_result> r = rewrite_nary(assoc, old_e, op, nary_args, lemma)) {
+                m_num_lemma_hits++;
                 return r;
+            }
         }
         return optional<simp_result>();
     }
@@ -814,10 +824,13 @@ public:
             m_need_restart = false;
             r = join(r, simplify(r.get_new()));
             if (!m_need_restart || !should_defeq_canonize())
-                return r;
+                break;
             m_cache.clear();
         }
-        return simplify(e);
+        lean_trace(name({"simplifier", "stats"}),
+                   tout() << "simp lemmas: " << m_num_lemma_attempts << " attempts, " << m_num_lemma_hits << " hits; "
+                   << "congruence lemmas: " << m_num_congr_attempts << " attempts, " << m_num_congr_hits << " hits\n";);
+        return r;
     }
 };
 
@@ -1035,13 +1048,16 @@ simp_result simplifier::try_congrs(expr const & e) {
     simp_lemmas_for const * sls = m_slss.find(m_rel);
     if (!sls) return simp_result(e);
 
-    list<user_congr_lemma> const * cls = sls->find_congr(e);
+    list<user_congr_lemma> cls = sls->find_congr(env(), e);
     if (!cls) return simp_result(e);
 
-    for (user_congr_lemma const & cl : *cls) {
+    for (user_congr_lemma const & cl : cls) {
+        m_num_congr_attempts++;
         simp_result r = try_congr(e, cl);
-        if (r.get_new() != e)
+        if (r.get_new() != e) {
+            m_num_congr_hits++;
             return r;
+        }
     }
     return simp_result(e);
 }
@@ -1445,6 +1461,7 @@ void initialize_simplifier() {
     register_trace_class(name({"simplifier", "rewrite", "assoc"}));
     register_trace_class(name({"simplifier", "theory"}));
     register_trace_class(name({"simplifier", "subsingleton"}));
+    register_trace_class(name({"simplifier", "stats"}));
     register_trace_class(name({"debug", "simplifier", "try_rewrite"}));
     register_trace_class(name({"debug", "simplifier", "try_rewrite", "assoc"}));
     register_trace_class(name({"debug", "simplifier", "try_congruence"}));
@@ -7,6 +7,8 @@ Author: Leonardo de Moura
 #include <algorithm>
 #include "util/flet.h"
 #include "util/interrupt.h"
+#include "util/profiler.h"
+#include "util/list_fn.h"
 #include "util/sexpr/option_declarations.h"
 #include "kernel/instantiate.h"
 #include "kernel/abstract.h"
@@ -132,6 +134,28 @@ type_context_cache_ptr type_context_cache_manager::release() {
     return c;
 }
 
+/* Copy to \c to the closed class-instance answers in \c from that are not affected by the
+   instances declared in \c new_env after \c old_env. */
+void type_context_cache_manager::import_closed_instance_answers(type_context_cache & to, type_context_cache const & from,
+                                                                environment const & old_env,
+                                                                environment const & new_env) {
+    name_set updated;
+    if (from.m_closed_instance_cache.empty() || !get_updated_classes(old_env, new_env, updated))
+        return;
+    for (auto const & p : from.m_closed_instance_cache) {
+        bool affected = false;
+        p.second.m_classes.for_each([&](name const & c) {
+                if (updated.contains(c))
+                    affected = true;
+            });
+        if (!affected)
+            to.m_closed_instance_cache.insert(p);
+    }
+    lean_trace("type_context_cache",
+               tout() << "reusing " << to.m_closed_instance_cache.size() << " of "
+               << from.m_closed_instance_cache.size() << " closed instance answers\n";);
+}
+
 type_context_cache_ptr type_context_cache_manager::mk(environment const & env, options const & o) {
     if (!m_cache_ptr || get_class_instance_max_depth(o) != m_max_depth) return mk_cache(env, o, m_use_bi);
     if (is_eqp(env, m_env)) {
@@ -146,7 +170,11 @@ type_context_cache_ptr type_context_cache_manager::mk(environment const & env, o
                    bool c2 = (get_attribute_fingerprint(env, *g_instance)     == m_instance_fingerprint);
                    tout() << "creating new cache, is_descendant: " << env.is_descendant(m_env)
                    << ", reducibility compatibility: " << c1 << ", instance compatibility: " << c2 << "\n";);
-        return mk_cache(env, o, m_use_bi);
+        type_context_cache_ptr r = mk_cache(env, o, m_use_bi);
+        /* Remark: instances are usually marked as reducible when they are declared. */
+        if (env.is_descendant(m_env) && has_same_reducible_status(m_env, env))
+            import_closed_instance_answers(*r, *release(), m_env, env);
+        return r;
     }
     m_cache_ptr->m_options = o;
     m_cache_ptr->m_env     = env;
@@ -2604,17 +2632,46 @@ struct instance_synthesizer {
         list<expr>         m_local_instances;
         list<name>         m_instances;
         state              m_state;
+        /* Tabled sub-goals (see process_tabled_mvar): the type of the sub-goal, and the answer that was used
+           before its other answers were retrieved from the answer table. */
+        optional<expr>     m_tabled_type;
+        optional<expr>     m_tabled_answer;
+        /* Answers of the tabled sub-goal that have not been tried yet. */
+        list<expr>         m_answers;
     };
 
+    /* All the answers of tabled sub-goals, see get_answers. */
+    typedef expr_struct_map<list<expr>> answer_table;
+
     type_context &        m_ctx;
+    /* Sub-goals without metavariables are solved by nested synthesizers (see process_tabled_mvar).
+       m_parent is the synthesizer that created this one. */
+    instance_synthesizer * m_parent;
+    /* The answer table is shared by the root synthesizer and its nested synthesizers. */
+    answer_table          m_answer_table;
+    answer_table &        m_answers;
+    unsigned              m_depth;    // depth of the goal being solved
+    unsigned              m_num_parent_choices;
+    expr                  m_goal;
     expr                  m_main_mvar;
     state                 m_state;    // active state
     buffer<choice>        m_choices;
+    /* Classes whose instances were tried, they are used to decide whether a cached answer is
+       affected by new instances. */
+    name_set              m_classes;
+    /* m_incomplete is set to true when a sub-goal was rejected because it was being solved by
+       an ancestor. In this case, a failure is not cached. */
+    bool                  m_incomplete;
     bool                  m_displayed_trace_header;
     transparency_mode     m_old_transparency_mode;
 
-    instance_synthesizer(type_context & ctx):
+    instance_synthesizer(type_context & ctx, instance_synthesizer * parent = nullptr, unsigned depth = 0):
         m_ctx(ctx),
+        m_parent(parent),
+        m_answers(parent ? parent->m_answers : m_answer_table),
+        m_depth(depth),
+        m_num_parent_choices(parent ? parent->m_num_parent_choices + parent->m_choices.size() : 0),
+        m_incomplete(false),
         m_displayed_trace_header(false),
         m_old_transparency_mode(m_ctx.m_transparency_mode) {
         lean_assert(m_ctx.in_tmp_mode());
@@ -2646,7 +2703,7 @@ struct instance_synthesizer {
 
     void trace(unsigned depth, expr const & mvar, expr const & mvar_type, expr const & r) {
         auto out = tout();
-        if (!m_displayed_trace_header && m_choices.size() == 1) {
+        if (!m_displayed_trace_header && !m_parent && m_choices.size() == 1) {
             out << tclass("class_instances");
             if (m_ctx.m_cache->m_pip) {
                 if (auto fname = m_ctx.m_cache->m_pip->get_file_name()) {
@@ -2734,8 +2791,10 @@ struct instance_synthesizer {
 
     bool mk_choice_point(expr const & mvar) {
         lean_assert(is_metavar(mvar));
-        if (m_choices.size() > m_ctx.m_cache->m_ci_max_depth) {
-            throw_class_exception(m_ctx.infer(m_main_mvar),
+        if (m_num_parent_choices + m_choices.size() > m_ctx.m_cache->m_ci_max_depth) {
+            instance_synthesizer * root = this;
+            while (root->m_parent) root = root->m_parent;
+            throw_class_exception(root->m_goal,
                                   "maximum class-instance resolution depth has been reached "
                                   "(the limit can be increased by setting option 'class.instance_max_depth') "
                                   "(the class-instance resolution trace can be visualized "
@@ -2755,8 +2814,9 @@ struct instance_synthesizer {
         auto cname = m_ctx.is_class(mvar_type);
         if (!cname)
             return false;
+        m_classes.insert(*cname);
         r.m_local_instances = get_local_instances(*cname);
-        r.m_instances = get_class_instances(env(), *cname);
+        r.m_instances = get_class_instances(m_ctx, *cname, mvar_type);
         if (empty(r.m_local_instances) && empty(r.m_instances))
             return false;
         r.m_state = m_state;
@@ -2788,6 +2848,18 @@ struct instance_synthesizer {
         lean_assert(m_choices.size() > 0);
         lean_assert(!m_choices.empty());
         buffer<choice> & cs = m_choices;
+        if (optional<expr> type = cs.back().m_tabled_type) {
+            /* We are backtracking to a tabled sub-goal, its alternatives are its other answers */
+            if (optional<expr> a = cs.back().m_tabled_answer) {
+                cs.back().m_tabled_answer = none_expr();
+                cs.back().m_answers = remove(get_answers(*type, e.m_depth), *a);
+            }
+            if (empty(cs.back().m_answers))
+                return false;
+            m_ctx.assign(e.m_mvar, head(cs.back().m_answers));
+            cs.back().m_answers = tail(cs.back().m_answers);
+            return true;
+        }
         list<expr> locals = cs.back().m_local_instances;
         if (process_next_alt_core(e, locals)) {
             cs.back().m_local_instances = locals;
@@ -2803,9 +2875,102 @@ struct instance_synthesizer {
         return false;
     }
 
+    /* Return true iff \c type is the goal of this synthesizer or one of its ancestors.
+       The synthesizers visited before finding \c type are marked as incomplete. */
+    bool is_in_progress(expr const & type) {
+        buffer<instance_synthesizer *> visited;
+        for (instance_synthesizer * it = this; it; it = it->m_parent) {
+            if (it->m_goal == type) {
+                for (instance_synthesizer * s : visited)
+                    s->m_incomplete = true;
+                return true;
+            }
+            visited.push_back(it);
+        }
+        return false;
+    }
+
+    /* Solve the sub-goal \c e of type \c type, where \c type does not contain metavariables.
+
+       We solve it using a nested synthesizer. The first answer (or failure) is stored in the instance cache,
+       and it is reused by other branches of this search and by future queries. A sub-goal that is
+       currently being solved by an ancestor is rejected, since any solution would depend on itself.
+
+       If \c type is a proposition, any answer is as good as any other, and we commit to the first one.
+       Otherwise, the remaining sub-goals may depend on the answer. For example, given
+            [h : has_add A] [bar A h]
+       the instance of bar may only exist for the second instance of has_add. Thus, when we backtrack
+       to the choice point created here, the other answers are retrieved from the answer table
+       (see get_answers), and the sub-goal is not solved again. */
+    bool process_tabled_mvar(stack_entry const & e, expr const & type) {
+        m_choices.push_back(choice());
+        push_scope();
+        m_choices.back().m_state = m_state;
+        if (is_in_progress(type)) {
+            lean_trace("class_instances", tout() << "loop detected for " << type << "\n";);
+            return false;
+        }
+        bool is_prop = m_ctx.is_prop(type);
+        auto it = m_answers.find(type);
+        if (it != m_answers.end()) {
+            list<expr> const & answers = it->second;
+            if (empty(answers))
+                return false;
+            if (!is_prop) {
+                m_choices.back().m_tabled_type = type;
+                m_choices.back().m_answers     = tail(answers);
+            }
+            m_ctx.assign(e.m_mvar, head(answers));
+        } else {
+            optional<expr> r;
+            {
+                instance_synthesizer nested(m_ctx, this, e.m_depth);
+                r = nested(type);
+                nested.m_classes.for_each([&](name const & c) { m_classes.insert(c); });
+            }
+            if (!r)
+                return false;
+            if (!is_prop) {
+                m_choices.back().m_tabled_type   = type;
+                m_choices.back().m_tabled_answer = r;
+            }
+            m_ctx.assign(e.m_mvar, *r);
+        }
+        m_state.m_stack = tail(m_state.m_stack);
+        return true;
+    }
+
+    /* Return all the answers of the tabled sub-goal \c type. They are computed by a nested synthesizer
+       the first time the search backtracks to \c type, and stored in the answer table. Then, other
+       branches of the search reuse them. Remark: the answers of a sub-goal may also contain the answers
+       of its own tabled sub-goals, and the table prevents them from being enumerated again and again. */
+    list<expr> get_answers(expr const & type, unsigned depth) {
+        auto it = m_answers.find(type);
+        if (it != m_answers.end())
+            return it->second;
+        buffer<expr> answers;
+        bool incomplete;
+        {
+            instance_synthesizer nested(m_ctx, this, depth);
+            nested.get_all_solutions(type, answers);
+            nested.m_classes.for_each([&](name const & c) { m_classes.insert(c); });
+            incomplete = nested.m_incomplete;
+        }
+        list<expr> r = to_list(answers);
+        /* Answers found while cutting a cycle are not stored, see is_in_progress. */
+        if (!incomplete)
+            m_answers.insert(mk_pair(type, r));
+        return r;
+    }
+
     bool process_next_mvar() {
         lean_assert(!is_done());
         stack_entry e = head(m_state.m_stack);
+        if (!m_choices.empty()) {
+            expr mvar_type = m_ctx.instantiate_mvars(mlocal_type(e.m_mvar));
+            if (!has_metavar(mvar_type))
+                return process_tabled_mvar(e, mvar_type);
+        }
         if (!mk_choice_point(e.m_mvar))
             return false;
         m_state.m_stack = tail(m_state.m_stack);
@@ -2855,14 +3020,40 @@ struct instance_synthesizer {
             return none_expr();
     }
 
+    bool use_closed_instance_cache(expr const & type) const {
+        return !m_ctx.m_local_instances && !has_local(type) && !has_metavar(type);
+    }
+
     void cache_result(expr const & type, optional<expr> const & inst) {
-        m_ctx.m_cache->m_instance_cache.insert(mk_pair(type, inst));
+        if (use_closed_instance_cache(type)) {
+            m_ctx.m_cache->m_closed_instance_cache.insert(
+                mk_pair(type, type_context_cache::closed_instance_answer(inst, m_classes)));
+        } else {
+            m_ctx.m_cache->m_instance_cache.insert(mk_pair(type, inst));
+        }
+    }
+
+    /* Return some(inst) if the class-instance problem \c type is in the cache. */
+    optional<optional<expr>> find_cached_result(expr const & type) {
+        if (use_closed_instance_cache(type)) {
+            auto it = m_ctx.m_cache->m_closed_instance_cache.find(type);
+            if (it == m_ctx.m_cache->m_closed_instance_cache.end())
+                return optional<optional<expr>>();
+            it->second.m_classes.for_each([&](name const & c) { m_classes.insert(c); });
+            return optional<optional<expr>>(it->second.m_result);
+        } else {
+            auto it = m_ctx.m_cache->m_instance_cache.find(type);
+            if (it == m_ctx.m_cache->m_instance_cache.end())
+                return optional<optional<expr>>();
+            return optional<optional<expr>>(it->second);
+        }
     }
 
     optional<expr> ensure_no_meta(optional<expr> r) {
         while (true) {
             if (!r) {
-                cache_result(m_ctx.infer(m_main_mvar), r);
+                if (!m_incomplete)
+                    cache_result(m_ctx.infer(m_main_mvar), r);
                 return none_expr();
             }
             if (!has_expr_metavar(*r)) {
@@ -2881,21 +3072,36 @@ struct instance_synthesizer {
         }
     }
 
+    void init_search(expr const & type) {
+        m_goal           = type;
+        m_state          = state();
+        m_main_mvar      = m_ctx.mk_tmp_mvar(type);
+        m_state.m_stack  = to_list(stack_entry(m_main_mvar, m_depth));
+    }
+
+    /* Store in \c r all the solutions for \c type that do not contain metavariables. */
+    void get_all_solutions(expr const & type, buffer<expr> & r) {
+        init_search(type);
+        optional<expr> s = search();
+        while (s) {
+            if (!has_metavar(*s))
+                r.push_back(*s);
+            s = next_solution();
+        }
+    }
+
     optional<expr> mk_class_instance_core(expr const & type) {
         /* We do not cache results when multiple instances have to be generated. */
-        auto it = m_ctx.m_cache->m_instance_cache.find(type);
-        if (it != m_ctx.m_cache->m_instance_cache.end()) {
+        if (auto it = find_cached_result(type)) {
             /* instance/failure is already cached */
             lean_trace("class_instances",
-                       if (it->second)
-                           tout() << "cached instance for " << type << "\n" << *(it->second) << "\n";
+                       if (*it)
+                           tout() << "cached instance for " << type << "\n" << **it << "\n";
                        else
                            tout() << "cached failure for " << type << "\n";);
-            return it->second;
+            return *it;
         }
-        m_state          = state();
-        m_main_mvar      = m_ctx.mk_tmp_mvar(type);
-        m_state.m_stack  = to_list(stack_entry(m_main_mvar, 0));
+        init_search(type);
         auto r = search();
         return ensure_no_meta(r);
     }
@@ -2915,6 +3121,7 @@ struct instance_synthesizer {
 };
 
 optional<expr> type_context::mk_class_instance(expr const & type) {
+    profile_scope scope("type class resolution");
     if (in_tmp_mode()) {
         return instance_synthesizer(*this)(type);
     } else {
@@ -9,6 +9,7 @@ Author: Leonardo de Moura
 #include <unordered_map>
 #include "util/flet.h"
 #include "util/lbool.h"
+#include "util/name_set.h"
 #include "kernel/environment.h"
 #include "kernel/abstract_type_context.h"
 #include "kernel/expr_maps.h"
@@ -42,9 +43,15 @@ class type_context_cache {
     typedef expr_struct_map<expr> whnf_cache;
     typedef expr_struct_map<optional<expr>> instance_cache;
     typedef expr_struct_map<optional<expr>> subsingleton_cache;
-    environment                   m_env;
-    options                       m_options;
-    name_map<projection_info>     m_proj_info;
+    struct closed_instance_answer {
+        optional<expr> m_result;
+        name_set       m_classes; // classes whose instances were tried to produce m_result
+        closed_instance_answer(optional<expr> const & r, name_set const & cs):m_result(r), m_classes(cs) {}
+    };
+    typedef expr_struct_map<closed_instance_answer> closed_instance_cache;
+    environment                    m_env;
+    options                        m_options;
+    name_hamt_map<projection_info> m_proj_info;
 
     /* We only cache inferred types if the metavariable assignment was not accessed.
        This restriction is sufficient to make sure the cached information can be reused
@@ -99,11 +106,18 @@ class type_context_cache {
           whenever new local instances are pushed into the local context.
 
           m_instance_cache and m_subsingleton_cache are flushed before the cache is returned to the
-          cache manager. */
+          cache manager.
+
+       Class-instance problems that do not contain local constants nor metavariables, and are solved
+       when there are no local instances, are cached at m_closed_instance_cache instead. These answers
+       depend only on the environment, and they are not flushed when the local instances change.
+       Moreover, the cache manager preserves them when new instances are declared for classes
+       that were not tried when producing them. */
     optional<unsigned>            m_instance_fingerprint;
     list<pair<name, expr>>        m_local_instances;
     instance_cache                m_instance_cache;
     subsingleton_cache            m_subsingleton_cache;
+    closed_instance_cache         m_closed_instance_cache;
 
     pos_info_provider const *     m_pip{nullptr};
     optional<pos_info>            m_ci_pos;
@@ -152,6 +166,8 @@ class type_context_cache_manager {
     unsigned               m_max_depth;
     bool                   m_use_bi;
     type_context_cache_ptr release();
+    static void import_closed_instance_answers(type_context_cache & to, type_context_cache const & from,
+                                               environment const & old_env, environment const & new_env);
 public:
     type_context_cache_manager(bool use_bi = false):m_use_bi(use_bi) {}
     type_context_cache_ptr mk(environment const & env, options const & o);
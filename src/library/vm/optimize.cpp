@@ -79,8 +79,48 @@ static void compress_goto_ret(buffer<vm_instr> & code) {
     }
 }
 
+/* Return true if the code starting at pc is of the form
+   drop n_1; ...; drop n_k; ret
+   where the instructions may be connected by goto instructions. */
+static bool is_ret_sequence(buffer<vm_instr> const & code, unsigned pc) {
+    /* We use num_steps to make sure we do not loop when there is a cycle of goto instructions */
+    for (unsigned num_steps = 0; pc < code.size() && num_steps < code.size(); num_steps++) {
+        switch (code[pc].op()) {
+        case opcode::Ret:  return true;
+        case opcode::Drop: pc++; break;
+        case opcode::Goto: pc = code[pc].get_goto_pc(); break;
+        default:           return false;
+        }
+    }
+    return false;
+}
+
+/**
+   \brief Applies the following transformation
+
+   pc:   ginvoke fn
+   pc+1: drop n_1
+   ...
+         drop n_k
+         ret
+   ===>
+   pc:   tail_ginvoke fn
+   pc+1: drop n_1
+   ...
+         drop n_k
+         ret
+
+   The drop and ret instructions are only reachable by other branches after the transformation. */
+static void tail_calls(buffer<vm_instr> & code) {
+    for (unsigned i = 0; i + 1 < code.size(); i++) {
+        if (code[i].op() == opcode::InvokeGlobal && is_ret_sequence(code, i+1))
+            code[i] = mk_tail_invoke_global_instr(code[i].get_fn_idx());
+    }
+}
+
 void optimize(environment const &, buffer<vm_instr> & code) {
     compress_goto_ret(code);
     compress_drop_drop(code);
+    tail_calls(code);
 }
 }
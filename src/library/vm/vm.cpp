@@ -7,10 +7,18 @@ Author: Leonardo de Moura
 #include <string>
 #include <algorithm>
 #include <vector>
+#include <memory>
+#include <utility>
+#include <chrono>
+#include <iomanip>
+#include <unordered_map>
 #include "util/flet.h"
+#include "util/hash.h"
+#include "util/thread.h"
 #include "util/interrupt.h"
 #include "util/sstream.h"
 #include "util/parray.h"
+#include "util/profiler.h"
 #include "util/small_object_allocator.h"
 #include "library/constants.h"
 #include "library/kernel_serializer.h"
@@ -19,6 +27,24 @@ Author: Leonardo de Moura
 #include "library/vm/vm.h"
 #include "library/vm/vm_expr.h"
 
+/* Initial capacity of the VM data stack. */
+#ifndef LEAN_VM_INITIAL_STACK_SIZE
+#define LEAN_VM_INITIAL_STACK_SIZE 1024
+#endif
+
+/* Maximum number of frames in the VM call stack. Functions that do not recurse in tail position
+   fail with a stack_space_exception instead of consuming all memory. */
+#ifndef LEAN_VM_MAX_CALL_STACK_SIZE
+#define LEAN_VM_MAX_CALL_STACK_SIZE 1048576
+#endif
+
+/* Use direct threaded dispatch (labels as values extension) in release builds.
+   Each instruction jumps directly to the code of the next one. We use a switch
+   in debug mode because the VM execution is traced there. */
+#if defined(__GNUC__) && !defined(LEAN_DEBUG) && !defined(LEAN_EMSCRIPTEN) && !defined(LEAN_VM_SWITCH_DISPATCH)
+#define LEAN_VM_THREADED_DISPATCH
+#endif
+
 namespace lean {
 void vm_obj_cell::dec_ref(vm_obj & o, buffer<vm_obj_cell*> & todelete) {
     if (LEAN_VM_IS_PTR(o.m_data)) {
@@ -40,8 +66,15 @@ vm_composite::vm_composite(vm_obj_kind k, unsigned idx, unsigned sz, vm_obj cons
     std::uninitialized_copy(data, data + sz, fields);
 }
 
+static bool g_vm_profiler_enabled = false;
+
+/* Number of constructor and closure objects allocated by the current thread, it is used by the VM profiler,
+   and it is only updated when the profiler is enabled. */
+LEAN_THREAD_VALUE(size_t, g_vm_num_allocs, 0);
+
 static vm_obj mk_vm_composite(vm_obj_kind k, unsigned idx, unsigned sz, vm_obj const * data) {
     lean_assert(k == vm_obj_kind::Constructor || k == vm_obj_kind::Closure);
+    if (g_vm_profiler_enabled) g_vm_num_allocs++;
     return vm_obj(new (get_small_allocator().allocate(sizeof(vm_composite) + sz * sizeof(vm_obj))) vm_composite(k, idx, sz, data));
 }
 
@@ -191,6 +224,7 @@ void vm_instr::display(std::ostream & out,
                        std::function<optional<name>(unsigned)> const & cases_idx2name) const {
     switch (m_op) {
     case opcode::Push:          out << "push " << m_idx; break;
+    case opcode::Move:          out << "move " << m_idx; break;
     case opcode::Ret:           out << "ret"; break;
     case opcode::Drop:          out << "drop " << m_num; break;
     case opcode::Goto:          out << "goto " << m_pc[0]; break;
@@ -219,6 +253,10 @@ void vm_instr::display(std::ostream & out,
         out << "ginvoke ";
         display_fn(out, idx2name, m_fn_idx);
         break;
+    case opcode::TailInvokeGlobal:
+        out << "tail_ginvoke ";
+        display_fn(out, idx2name, m_fn_idx);
+        break;
     case opcode::InvokeBuiltin:
         out << "builtin ";
         display_fn(out, idx2name, m_fn_idx);
@@ -288,6 +326,12 @@ vm_instr mk_push_instr(unsigned idx) {
     return r;
 };
 
+vm_instr mk_move_instr(unsigned idx) {
+    vm_instr r(opcode::Move);
+    r.m_idx = idx;
+    return r;
+};
+
 vm_instr mk_drop_instr(unsigned n) {
     vm_instr r(opcode::Drop);
     r.m_num = n;
@@ -386,6 +430,12 @@ vm_instr mk_invoke_global_instr(unsigned fn_idx) {
     return r;
 }
 
+vm_instr mk_tail_invoke_global_instr(unsigned fn_idx) {
+    vm_instr r(opcode::TailInvokeGlobal);
+    r.m_fn_idx = fn_idx;
+    return r;
+}
+
 vm_instr mk_invoke_builtin_instr(unsigned fn_idx) {
     vm_instr r(opcode::InvokeBuiltin);
     r.m_fn_idx = fn_idx;
@@ -407,14 +457,15 @@ vm_instr mk_closure_instr(unsigned fn_idx, unsigned n) {
 
 void vm_instr::copy_args(vm_instr const & i) {
     switch (i.m_op) {
-    case opcode::InvokeGlobal: case opcode::InvokeBuiltin: case opcode::InvokeCFun:
+    case opcode::InvokeGlobal: case opcode::TailInvokeGlobal:
+    case opcode::InvokeBuiltin: case opcode::InvokeCFun:
         m_fn_idx = i.m_fn_idx;
         break;
     case opcode::Closure:
         m_fn_idx = i.m_fn_idx;
         m_nargs  = i.m_nargs;
         break;
-    case opcode::Push: case opcode::Proj:
+    case opcode::Push: case opcode::Move: case opcode::Proj:
         m_idx  = i.m_idx;
         break;
     case opcode::Drop:
@@ -520,13 +571,14 @@ vm_instr & vm_instr::operator=(vm_instr && s) {
 void vm_instr::serialize(serializer & s, std::function<name(unsigned)> const & idx2name) const {
     s << static_cast<char>(m_op);
     switch (m_op) {
-    case opcode::InvokeGlobal: case opcode::InvokeBuiltin: case opcode::InvokeCFun:
+    case opcode::InvokeGlobal: case opcode::TailInvokeGlobal:
+    case opcode::InvokeBuiltin: case opcode::InvokeCFun:
         s << idx2name(m_fn_idx);
         break;
     case opcode::Closure:
         s << idx2name(m_fn_idx) << m_nargs;
         break;
-    case opcode::Push: case opcode::Proj:
+    case opcode::Push: case opcode::Move: case opcode::Proj:
         s << m_idx;
         break;
     case opcode::Drop:
@@ -565,13 +617,13 @@ void vm_instr::serialize(serializer & s, std::function<name(unsigned)> const & i
     }
 }
 
-static unsigned read_fn_idx(deserializer & d, name_map<unsigned> const & name2idx) {
+/* Function references are decoded as positions in \c fns, they are resolved by #resolve_fn_idx
+   when the code is added to an environment. */
+static unsigned read_fn_idx(deserializer & d, buffer<name> & fns) {
     name n;
     d >> n;
-    if (auto r = name2idx.find(n))
-        return *r;
-    else
-        throw corrupted_stream_exception();
+    fns.push_back(n);
+    return fns.size() - 1;
 }
 
 static void read_cases_pcs(deserializer & d, buffer<unsigned> & pcs) {
@@ -580,21 +632,25 @@ static void read_cases_pcs(deserializer & d, buffer<unsigned> & pcs) {
         pcs.push_back(d.read_unsigned());
 }
 
-static vm_instr read_vm_instr(deserializer & d, name_map<unsigned> const & name2idx) {
+static vm_instr read_vm_instr(deserializer & d, buffer<name> & fns) {
     opcode op = static_cast<opcode>(d.read_char());
     unsigned pc, idx;
     switch (op) {
     case opcode::InvokeGlobal:
-        return mk_invoke_global_instr(read_fn_idx(d, name2idx));
+        return mk_invoke_global_instr(read_fn_idx(d, fns));
+    case opcode::TailInvokeGlobal:
+        return mk_tail_invoke_global_instr(read_fn_idx(d, fns));
     case opcode::InvokeBuiltin:
-        return mk_invoke_builtin_instr(read_fn_idx(d, name2idx));
+        return mk_invoke_builtin_instr(read_fn_idx(d, fns));
     case opcode::InvokeCFun:
-        return mk_invoke_cfun_instr(read_fn_idx(d, name2idx));
+        return mk_invoke_cfun_instr(read_fn_idx(d, fns));
     case opcode::Closure:
-        idx = read_fn_idx(d, name2idx);
+        idx = read_fn_idx(d, fns);
         return mk_closure_instr(idx, d.read_unsigned());
     case opcode::Push:
         return mk_push_instr(d.read_unsigned());
+    case opcode::Move:
+        return mk_move_instr(d.read_unsigned());
     case opcode::Proj:
         return mk_proj_instr(d.read_unsigned());
     case opcode::Drop:
@@ -639,15 +695,40 @@ static vm_instr read_vm_instr(deserializer & d, name_map<unsigned> const & name2
     lean_unreachable();
 }
 
+/* Replace the function reference of \c i (a position in \c fns, see #read_fn_idx) with its index in \c name2idx. */
+static vm_instr resolve_fn_idx(vm_instr const & i, buffer<name> const & fns, name_hamt_map<unsigned> const & name2idx) {
+    auto get_idx = [&](unsigned pos) {
+        if (auto r = name2idx.find(fns[pos]))
+            return *r;
+        else
+            throw corrupted_stream_exception();
+    };
+    switch (i.op()) {
+    case opcode::InvokeGlobal:
+        return mk_invoke_global_instr(get_idx(i.get_fn_idx()));
+    case opcode::TailInvokeGlobal:
+        return mk_tail_invoke_global_instr(get_idx(i.get_fn_idx()));
+    case opcode::InvokeBuiltin:
+        return mk_invoke_builtin_instr(get_idx(i.get_fn_idx()));
+    case opcode::InvokeCFun:
+        return mk_invoke_cfun_instr(get_idx(i.get_fn_idx()));
+    case opcode::Closure:
+        return mk_closure_instr(get_idx(i.get_fn_idx()), i.get_nargs());
+    default:
+        return i;
+    }
+}
+
 vm_decl_cell::vm_decl_cell(name const & n, unsigned idx, unsigned arity, vm_function fn):
     m_rc(0), m_kind(vm_decl_kind::Builtin), m_name(n), m_idx(idx), m_arity(arity), m_fn(fn) {}
 
 vm_decl_cell::vm_decl_cell(name const & n, unsigned idx, unsigned arity, vm_cfunction fn):
     m_rc(0), m_kind(vm_decl_kind::CFun), m_name(n), m_idx(idx), m_arity(arity), m_cfn(fn) {}
 
-vm_decl_cell::vm_decl_cell(name const & n, unsigned idx, expr const & e, unsigned code_sz, vm_instr const * code):
+vm_decl_cell::vm_decl_cell(name const & n, unsigned idx, expr const & e, unsigned code_sz, vm_instr const * code,
+                           unsigned stack_sz):
     m_rc(0), m_kind(vm_decl_kind::Bytecode), m_name(n), m_idx(idx), m_expr(e), m_arity(0),
-    m_code_size(code_sz) {
+    m_code_size(code_sz), m_stack_size(stack_sz) {
     expr it = e;
     while (is_lambda(it)) {
         m_arity++;
@@ -739,13 +820,17 @@ void declare_vm_cases_builtin(name const & n, char const * i, vm_cases_function
 
 /** \brief VM function/constant declarations are stored in an environment extension. */
 struct vm_decls : public environment_extension {
-    name_map<unsigned>        m_name2idx;
+    name_hamt_map<unsigned>   m_name2idx;
     parray<vm_decl>           m_decls;
 
-    name_map<unsigned>        m_cases2idx;
+    name_hamt_map<unsigned>   m_cases2idx;
     parray<vm_cases_function> m_cases;
     parray<name>              m_cases_names;
 
+    /* Indices of the VM functions referenced by each native library installed in this environment,
+       see install_vm_natives. The entry of a library that has not been installed is nullptr. */
+    std::vector<std::shared_ptr<std::vector<unsigned> const>> m_native_fn_idxs;
+
     vm_decls() {
         g_vm_builtins->for_each([&](name const & n, std::tuple<unsigned, char const *, vm_function> const & p) {
                 add(vm_decl(n, m_decls.size(), std::get<0>(p), std::get<2>(p)));
@@ -777,15 +862,15 @@ struct vm_decls : public environment_extension {
             throw exception(sstream() << "VM already contains code for '" << n << "'");
         unsigned idx = m_decls.size();
         m_name2idx.insert(n, idx);
-        m_decls.push_back(vm_decl(n, idx, e, 0, nullptr));
+        m_decls.push_back(vm_decl(n, idx, e, 0, nullptr, 0));
         return idx;
     }
 
-    void update(name const & n, unsigned code_sz, vm_instr const * code) {
+    void update(name const & n, unsigned code_sz, vm_instr const * code, unsigned stack_sz) {
         lean_assert(m_name2idx.contains(n));
         unsigned idx = *m_name2idx.find(n);
         vm_decl d    = m_decls[idx];
-        m_decls.set(idx, vm_decl(n, idx, d.get_expr(), code_sz, code));
+        m_decls.set(idx, vm_decl(n, idx, d.get_expr(), code_sz, code, stack_sz));
     }
 };
 
@@ -858,6 +943,117 @@ environment add_native(environment const & env, name const & n, unsigned arity,
     return add_native(env, n, arity, reinterpret_cast<vm_cfunction>(fn));
 }
 
+/** \brief Function compiled into a native library, see register_vm_native. */
+struct vm_native_fn {
+    name         m_name;
+    unsigned     m_arity;
+    unsigned     m_code_hash;
+    vm_cfunction m_fn;
+};
+
+/** \brief Native library, see register_vm_native_library. */
+struct vm_native_library {
+    std::vector<name>         m_fn_refs;
+    std::vector<vm_native_fn> m_fns;
+};
+
+/* Native libraries are registered at startup, before any environment is created.
+   After that, the vector is only read. */
+static std::vector<vm_native_library> * g_vm_native_libs = nullptr;
+
+unsigned register_vm_native_library(buffer<name> const & fn_refs) {
+    unsigned id = g_vm_native_libs->size();
+    g_vm_native_libs->emplace_back();
+    g_vm_native_libs->back().m_fn_refs.assign(fn_refs.begin(), fn_refs.end());
+    return id;
+}
+
+void register_vm_native(unsigned lib_id, name const & n, unsigned arity, unsigned code_hash, vm_cfunction fn) {
+    lean_assert(lib_id < g_vm_native_libs->size());
+    (*g_vm_native_libs)[lib_id].m_fns.push_back(vm_native_fn{n, arity, code_hash, fn});
+}
+
+unsigned get_vm_code_hash(environment const & env, vm_decl const & d) {
+    lean_assert(d.is_bytecode());
+    /* Function references are hashed by name since indices depend on the environment. */
+    serializer s;
+    s << d.get_arity() << d.get_code_size();
+    for (unsigned i = 0; i < d.get_code_size(); i++)
+        d.get_code()[i].serialize(s, [&](unsigned idx) { return get_vm_decl_name(env, idx); });
+    return hash_str(s.size(), s.data(), 17);
+}
+
+unsigned const * get_vm_native_fn_idxs(unsigned lib_id) {
+    vm_decls const & ext = get_extension(get_vm_state().env());
+    lean_assert(lib_id < ext.m_native_fn_idxs.size() && ext.m_native_fn_idxs[lib_id]);
+    return ext.m_native_fn_idxs[lib_id]->data();
+}
+
+/* Return the indices of the functions referenced by \c lib in \c ext, or nullptr if the library
+   cannot be installed because \c ext does not contain all functions it was compiled from. */
+static std::shared_ptr<std::vector<unsigned> const>
+resolve_native_library(environment const & env, vm_decls const & ext, vm_native_library const & lib) {
+    for (vm_native_fn const & fn : lib.m_fns) {
+        auto idx = ext.m_name2idx.find(fn.m_name);
+        if (!idx)
+            return nullptr;
+        vm_decl d = ext.m_decls[*idx];
+        if (!d.is_bytecode() || d.get_arity() != fn.m_arity)
+            return nullptr;
+        if (get_vm_code_hash(env, d) != fn.m_code_hash)
+            throw exception(sstream() << "failed to install native code, the native code for '" << fn.m_name
+                            << "' is out of date, it must be regenerated");
+    }
+    auto idxs = std::make_shared<std::vector<unsigned>>();
+    for (name const & n : lib.m_fn_refs) {
+        auto idx = ext.m_name2idx.find(n);
+        if (!idx)
+            return nullptr;
+        idxs->push_back(*idx);
+    }
+    return idxs;
+}
+
+environment install_vm_natives(environment const & env) {
+    if (g_vm_native_libs->empty())
+        return env;
+    vm_decls ext = get_extension(env);
+    if (ext.m_native_fn_idxs.size() == g_vm_native_libs->size())
+        return env;
+    /* All libraries are checked against the bytecode in \c env before any function is replaced. */
+    for (unsigned i = 0; i < g_vm_native_libs->size(); i++)
+        ext.m_native_fn_idxs.push_back(resolve_native_library(env, ext, (*g_vm_native_libs)[i]));
+    for (unsigned i = 0; i < g_vm_native_libs->size(); i++) {
+        if (!ext.m_native_fn_idxs[i])
+            continue;
+        for (vm_native_fn const & fn : (*g_vm_native_libs)[i].m_fns) {
+            if (!fn.m_fn)
+                continue;
+            unsigned idx = *ext.m_name2idx.find(fn.m_name);
+            ext.m_decls.set(idx, vm_decl(fn.m_name, idx, fn.m_arity, fn.m_fn));
+        }
+    }
+    return update(env, ext);
+}
+
+void for_each_vm_decl(environment const & env, std::function<void(vm_decl const &)> const & fn) {
+    vm_decls const & ext = get_extension(env);
+    for (unsigned i = 0; i < ext.m_decls.size(); i++)
+        fn(ext.m_decls[i]);
+}
+
+name get_vm_decl_name(environment const & env, unsigned fn_idx) {
+    vm_decls const & ext = get_extension(env);
+    lean_assert(fn_idx < ext.m_decls.size());
+    return ext.m_decls[fn_idx].get_name();
+}
+
+name get_vm_builtin_cases_name(environment const & env, unsigned cases_idx) {
+    vm_decls const & ext = get_extension(env);
+    lean_assert(cases_idx < ext.m_cases_names.size());
+    return ext.m_cases_names[cases_idx];
+}
+
 bool is_vm_function(environment const & env, name const & fn) {
     auto const & ext = get_extension(env);
     return ext.m_name2idx.contains(fn) || g_vm_builtins->contains(fn);
@@ -896,7 +1092,7 @@ static void reserve_reader(deserializer & d, shared_environment & senv,
                            std::function<void(delayed_update_fn const &)> &) {
     name fn; expr e;
     d >> fn >> e;
-    senv.update([&](environment const & env) -> environment {
+    senv.update([=](environment const & env) -> environment {
             vm_decls ext = get_extension(env);
             ext.reserve(fn, e);
             return update(env, ext);
@@ -905,7 +1101,7 @@ static void reserve_reader(deserializer & d, shared_environment & senv,
 
 void serialize_code(serializer & s, unsigned fidx, parray<vm_decl> const & decls) {
     vm_decl const & d = decls[fidx];
-    s << d.get_name() << d.get_code_size();
+    s << d.get_name() << d.get_code_size() << d.get_stack_size();
     vm_instr const * code = d.get_code();
     auto fn = [&](unsigned idx) { return decls[idx].get_name(); };
     for (unsigned i = 0; i < d.get_code_size(); i++) {
@@ -916,23 +1112,33 @@ void serialize_code(serializer & s, unsigned fidx, parray<vm_decl> const & decls
 static void code_reader(deserializer & d, shared_environment & senv,
                         std::function<void(asynch_update_fn const &)> &,
                         std::function<void(delayed_update_fn const &)> &) {
-    senv.update([&](environment const & env) -> environment {
-            name fn; unsigned code_sz;
-            d >> fn;
-            d >> code_sz;
+    name fn; unsigned code_sz, stack_sz;
+    d >> fn;
+    d >> code_sz >> stack_sz;
+    /* The instructions are decoded without accessing the environment, since modules are decoded in parallel
+       (see import_modules_fn). Function references are resolved when the update is applied.
+       Remark: all functions referenced by the code have already been reserved (by this module or by one
+       of its dependencies) at that point. */
+    auto fns  = std::make_shared<buffer<name>>();
+    auto code = std::make_shared<buffer<vm_instr>>();
+    for (unsigned i = 0; i < code_sz; i++) {
+        code->push_back(read_vm_instr(d, *fns));
+    }
+    senv.update([=](environment const & env) -> environment {
             vm_decls ext = get_extension(env);
-            buffer<vm_instr> code;
-            for (unsigned i = 0; i < code_sz; i++) {
-                code.push_back(read_vm_instr(d, ext.m_name2idx));
-            }
-            ext.update(fn, code_sz, code.data());
+            name_hamt_map<unsigned> const & name2idx = ext.m_name2idx;
+            buffer<vm_instr> new_code;
+            for (vm_instr const & i : *code)
+                new_code.push_back(resolve_fn_idx(i, *fns, name2idx));
+            ext.update(fn, code_sz, new_code.data(), stack_sz);
             return update(env, ext);
         });
 }
 
-environment update_vm_code(environment const & env, name const & fn, unsigned code_sz, vm_instr const * code) {
+environment update_vm_code(environment const & env, name const & fn, unsigned code_sz, vm_instr const * code,
+                           unsigned stack_sz) {
     vm_decls ext = get_extension(env);
-    ext.update(fn, code_sz, code);
+    ext.update(fn, code_sz, code, stack_sz);
     environment new_env = update(env, ext);
     unsigned fidx       = *ext.m_name2idx.find(fn);
     return module::add(new_env, *g_vm_code_key, [=](environment const & env, serializer & s) {
@@ -940,9 +1146,10 @@ environment update_vm_code(environment const & env, name const & fn, unsigned co
         });
 }
 
-environment add_vm_code(environment const & env, name const & fn, expr const & e, unsigned code_sz, vm_instr const * code) {
+environment add_vm_code(environment const & env, name const & fn, expr const & e, unsigned code_sz, vm_instr const * code,
+                        unsigned stack_sz) {
     environment new_env = reserve_vm_index(env, fn, e);
-    return update_vm_code(new_env, fn, code_sz, code);
+    return update_vm_code(new_env, fn, code_sz, code, stack_sz);
 }
 
 environment optimize_vm_decls(environment const & env) {
@@ -971,6 +1178,100 @@ optional<unsigned> get_vm_builtin_cases_idx(environment const & env, name const
         return optional<unsigned>();
 }
 
+void vm_decl_stats::merge(vm_decl_stats const & s) {
+    m_calls       += s.m_calls;
+    m_time        += s.m_time;
+    m_self        += s.m_self;
+    m_allocs      += s.m_allocs;
+    m_self_allocs += s.m_self_allocs;
+    for (unsigned i = 0; i < num_opcodes; i++)
+        m_opcodes[i] += s.m_opcodes[i];
+}
+
+typedef std::unordered_map<name, vm_decl_stats, name_hash> vm_profile;
+
+static mutex *      g_vm_profile_mutex    = nullptr;
+static vm_profile * g_vm_profile          = nullptr; /* statistics of the vm_state objects that have been destroyed */
+
+void enable_vm_profiler(bool flag) {
+    g_vm_profiler_enabled = flag;
+}
+
+bool is_vm_profiler_enabled() {
+    return g_vm_profiler_enabled;
+}
+
+/* Remark: the code executed using vm_state::execute is recorded in the last entry of m_stats. */
+struct vm_state::profiler {
+    typedef std::chrono::steady_clock clock;
+    struct frame {
+        unsigned          m_idx;
+        clock::time_point m_start;
+        size_t            m_start_allocs;
+        double            m_callees_time;
+        size_t            m_callees_allocs;
+        frame(unsigned idx):
+            m_idx(idx), m_start(clock::now()), m_start_allocs(g_vm_num_allocs),
+            m_callees_time(0.0), m_callees_allocs(0) {}
+    };
+    std::vector<vm_decl_stats> m_stats;
+    /* Number of frames for each function in m_frames, it is used to avoid counting recursive calls twice. */
+    std::vector<unsigned>      m_active;
+    std::vector<frame>         m_frames;
+
+    profiler(unsigned num_decls):m_stats(num_decls + 1), m_active(num_decls + 1, 0) {}
+
+    unsigned get_idx(unsigned fn_idx) const {
+        return std::min(fn_idx, static_cast<unsigned>(m_stats.size() - 1));
+    }
+
+    void count(unsigned fn_idx, opcode op) {
+        m_stats[get_idx(fn_idx)].m_opcodes[static_cast<unsigned>(op)]++;
+    }
+
+    void enter(unsigned fn_idx) {
+        unsigned idx = get_idx(fn_idx);
+        m_stats[idx].m_calls++;
+        m_active[idx]++;
+        m_frames.emplace_back(idx);
+    }
+
+    void exit() {
+        lean_assert(!m_frames.empty());
+        frame const & fr = m_frames.back();
+        double time      = std::chrono::duration<double>(clock::now() - fr.m_start).count();
+        size_t allocs    = g_vm_num_allocs - fr.m_start_allocs;
+        vm_decl_stats & s = m_stats[fr.m_idx];
+        s.m_self        += time - fr.m_callees_time;
+        s.m_self_allocs += allocs - fr.m_callees_allocs;
+        m_active[fr.m_idx]--;
+        if (m_active[fr.m_idx] == 0) {
+            s.m_time   += time;
+            s.m_allocs += allocs;
+        }
+        m_frames.pop_back();
+        if (!m_frames.empty()) {
+            m_frames.back().m_callees_time   += time;
+            m_frames.back().m_callees_allocs += allocs;
+        }
+    }
+
+    /* Close the frames that were left open by an exception. */
+    void unwind(unsigned num_frames) {
+        while (m_frames.size() > num_frames)
+            exit();
+    }
+
+    void merge(vm_profile & p, vm_state const & s) const {
+        for (unsigned i = 0; i < m_stats.size(); i++) {
+            if (m_stats[i].m_calls > 0) {
+                name n = i < s.m_decls.size() ? s.m_decls[i].get_name() : name("[execute]");
+                p[n].merge(m_stats[i]);
+            }
+        }
+    }
+};
+
 vm_state::vm_state(environment const & env):
     m_env(optimize_vm_decls(env)),
     m_decls(get_extension(m_env).m_decls.as_vector_if_compressed()),
@@ -980,6 +1281,17 @@ vm_state::vm_state(environment const & env):
     m_code(nullptr),
     m_fn_idx(0),
     m_bp(0) {
+    m_stack.reserve(LEAN_VM_INITIAL_STACK_SIZE);
+    if (g_vm_profiler_enabled)
+        m_profiler.reset(new profiler(m_decls.size()));
+}
+
+vm_state::~vm_state() {
+    if (m_profiler) {
+        m_profiler->unwind(0);
+        lock_guard<mutex> lock(*g_vm_profile_mutex);
+        m_profiler->merge(*g_vm_profile, *this);
+    }
 }
 
 void vm_state::push_fields(vm_obj const & obj) {
@@ -993,10 +1305,12 @@ void vm_state::push_fields(vm_obj const & obj) {
 }
 
 void vm_state::invoke_builtin(vm_decl const & d) {
+    if (m_profiler) m_profiler->enter(d.get_idx());
     unsigned saved_bp = m_bp;
     unsigned sz = m_stack.size();
     m_bp = sz;
     d.get_fn()(*this);
+    if (m_profiler) m_profiler->exit();
     lean_assert(m_stack.size() == sz + 1);
     m_bp = saved_bp;
     sz = m_stack.size();
@@ -1018,6 +1332,7 @@ scope_vm_state::~scope_vm_state() {
 
 void vm_state::invoke_cfun(vm_decl const & d) {
     flet<vm_state *> Set(g_vm_state, this);
+    if (m_profiler) m_profiler->enter(d.get_idx());
     auto & S       = m_stack;
     unsigned sz    = S.size();
     unsigned arity = d.get_arity();
@@ -1082,6 +1397,7 @@ void vm_state::invoke_cfun(vm_decl const & d) {
         r = reinterpret_cast<vm_cfunction_N>(d.get_cfn())(args.size(), args.data());
         break;
     }}
+    if (m_profiler) m_profiler->exit();
     m_stack.resize(sz - arity);
     m_stack.push_back(r);
     m_pc++;
@@ -1135,6 +1451,7 @@ static void to_cbuffer(vm_obj const & fn, buffer<vm_obj> & args) {
 vm_obj vm_state::invoke(unsigned fn_idx, unsigned nargs, vm_obj const * as) {
     lean_assert(fn_idx < m_decls.size());
     vm_decl const & d = m_decls[fn_idx];
+    profile_scope scope("vm", d.get_name());
     lean_assert(d.get_arity() <= nargs);
     std::copy(as, as + nargs, std::back_inserter(m_stack));
     invoke_fn(fn_idx);
@@ -1145,6 +1462,20 @@ vm_obj vm_state::invoke(unsigned fn_idx, unsigned nargs, vm_obj const * as) {
     return r;
 }
 
+vm_obj vm_state::invoke_move(unsigned fn_idx, unsigned nargs, vm_obj * as) {
+    lean_assert(fn_idx < m_decls.size());
+    vm_decl const & d = m_decls[fn_idx];
+    profile_scope scope("vm", d.get_name());
+    lean_assert(d.get_arity() <= nargs);
+    std::move(as, as + nargs, std::back_inserter(m_stack));
+    invoke_fn(fn_idx);
+    if (d.get_arity() < nargs)
+        apply(nargs - d.get_arity());
+    vm_obj r = m_stack.back();
+    m_stack.pop_back();
+    return r;
+}
+
 vm_obj vm_state::invoke(name const & fn, unsigned nargs, vm_obj const * as) {
     if (auto r = m_fn_name2idx.find(fn)) {
         return invoke(*r, nargs, as);
@@ -1656,13 +1987,31 @@ vm_obj invoke(unsigned fn_idx, vm_obj const & arg) {
     return invoke(fn_idx, 1, &arg);
 }
 
+vm_obj invoke_global(unsigned fn, unsigned nargs, vm_obj * args) {
+    lean_assert(g_vm_state);
+    return g_vm_state->invoke_move(fn, nargs, args);
+}
+
 vm_state const & get_vm_state() {
     lean_assert(g_vm_state);
     return *g_vm_state;
 }
 
+/* Make sure the data stack can store \c sz values without being reallocated.
+
+   Remark: the stack slots used by a function are reserved when it is invoked (see vm_decl::get_stack_size).
+   So, the instructions that push values never reallocate the data stack. */
+void vm_state::reserve_stack(unsigned sz) {
+    if (sz > m_stack.capacity())
+        m_stack.reserve(std::max(static_cast<size_t>(sz), 2 * m_stack.capacity()));
+}
+
 void vm_state::invoke_global(vm_decl const & d) {
+    if (m_call_stack.size() >= LEAN_VM_MAX_CALL_STACK_SIZE)
+        throw stack_space_exception("vm");
+    reserve_stack(m_stack.size() - d.get_arity() + d.get_stack_size());
     m_call_stack.emplace_back(m_code, m_fn_idx, d.get_arity(), m_pc+1, m_bp);
+    if (m_profiler) m_profiler->enter(d.get_idx());
     m_code            = d.get_code();
     m_fn_idx          = d.get_idx();
     m_pc              = 0;
@@ -1697,26 +2046,59 @@ void vm_state::run() {
     lean_assert(m_code);
     unsigned init_call_stack_sz = m_call_stack.size();
     m_pc = 0;
+#if defined(LEAN_VM_THREADED_DISPATCH)
+    /* The order must match the declaration of opcode */
+    static void * const dispatch_table[] = {
+        &&op_Push, &&op_Ret, &&op_Drop, &&op_Goto,
+        &&op_SConstructor, &&op_Constructor, &&op_Num,
+        &&op_Destruct, &&op_Cases2, &&op_CasesN, &&op_NatCases, &&op_BuiltinCases, &&op_Proj,
+        &&op_Apply, &&op_InvokeGlobal, &&op_InvokeBuiltin, &&op_InvokeCFun,
+        &&op_Closure, &&op_Unreachable, &&op_Pexpr, &&op_TailInvokeGlobal, &&op_Move
+    };
+    static_assert(sizeof(dispatch_table)/sizeof(dispatch_table[0]) == num_opcodes,
+                  "VM dispatch table does not match opcode declaration");
+    /* When the profiler is enabled, every instruction is dispatched to op_Profile, which counts it
+       and then jumps to its implementation. So, there is no overhead when the profiler is disabled. */
+    void * profile_dispatch_table[num_opcodes];
+    void * const * table = dispatch_table;
+    if (m_profiler) {
+        std::fill_n(profile_dispatch_table, num_opcodes, &&op_Profile);
+        table = profile_dispatch_table;
+    }
+#define VM_CASE(op) case opcode::op: op_##op
+#define VM_DISPATCH() do { instr = m_code + m_pc; goto *table[static_cast<unsigned>(instr->op())]; } while (0)
+#else
+#define VM_CASE(op) case opcode::op
+#define VM_DISPATCH() goto main_loop
+#endif
+    vm_instr const * instr;
     while (true) {
+#if !defined(LEAN_VM_THREADED_DISPATCH)
       main_loop:
-        vm_instr const & instr = m_code[m_pc];
+#endif
+        instr = m_code + m_pc;
         DEBUG_CODE({
                 /* We only trace VM in debug mode */
                 lean_trace(name({"vm", "run"}),
                            tout() << m_pc << ": ";
-                           instr.display(tout().get_stream(),
-                                         [&](unsigned idx) {
-                                             return optional<name>(m_decls[idx].get_name());
-                                         },
-                                         [&](unsigned idx) {
-                                             return optional<name>(m_builtin_cases_names[idx]);
-                                         });
+                           instr->display(tout().get_stream(),
+                                          [&](unsigned idx) {
+                                              return optional<name>(m_decls[idx].get_name());
+                                          },
+                                          [&](unsigned idx) {
+                                              return optional<name>(m_builtin_cases_names[idx]);
+                                          });
                            tout() << "\n";
                            display_stack(tout().get_stream());
                            tout() << "\n";)
                     });
-        switch (instr.op()) {
-        case opcode::Push:
+        /* The stack slots used by the current function were reserved when it was invoked */
+        lean_assert(m_fn_idx >= m_decls.size() ||
+                    (m_stack.size() <= m_bp + m_decls[m_fn_idx].get_stack_size() &&
+                     m_bp + m_decls[m_fn_idx].get_stack_size() <= m_stack.capacity()));
+        if (m_profiler) m_profiler->count(m_fn_idx, instr->op());
+        switch (instr->op()) {
+        VM_CASE(Push):
             /* Instruction: push i
 
                stack before,      after
@@ -1728,10 +2110,29 @@ void vm_state::run() {
                v                  v
                a_i
             */
-            m_stack.push_back(m_stack[m_bp + instr.get_idx()]);
+            m_stack.push_back(m_stack[m_bp + instr->get_idx()]);
+            m_pc++;
+            VM_DISPATCH();
+        VM_CASE(Move):
+            /* Instruction: move i
+
+               Similar to push i, but the stack slot i is cleared. The compiler uses it for the
+               last use of a local, then the stack does not keep an extra reference to a_i.
+               Builtins, such as array.write, can then update a_i in place.
+
+               stack before,      after
+               ...                ...
+               bp :  a_0          bp :  a_0
+               ...                ...
+               a_i  ==>           #0
+               ...                ...
+               v                  v
+                                  a_i
+            */
+            m_stack.push_back(std::move(m_stack[m_bp + instr->get_idx()]));
             m_pc++;
-            goto main_loop;
-        case opcode::Drop: {
+            VM_DISPATCH();
+        VM_CASE(Drop): {
             /* Instruction: drop n
 
                stack before,      after
@@ -1742,22 +2143,22 @@ void vm_state::run() {
                a_n
                v
             */
-            unsigned num = instr.get_num();
+            unsigned num = instr->get_num();
             unsigned sz  = m_stack.size();
             lean_assert(sz > num);
             swap(m_stack[sz - num - 1], m_stack[sz - 1]);
             m_stack.resize(sz - num);
             m_pc++;
-            goto main_loop;
+            VM_DISPATCH();
         }
-        case opcode::Goto:
+        VM_CASE(Goto):
             /* Instruction: goto pc
 
                m_pc := pc
             */
-            m_pc = instr.get_goto_pc();
-            goto main_loop;
-        case opcode::SConstructor:
+            m_pc = instr->get_goto_pc();
+            VM_DISPATCH();
+        VM_CASE(SConstructor):
             /** Instruction: scnstr i
 
                 stack before,      after
@@ -1765,10 +2166,10 @@ void vm_state::run() {
                 v    ==>           v
                 #i
             */
-            m_stack.push_back(mk_vm_simple(instr.get_cidx()));
+            m_stack.push_back(mk_vm_simple(instr->get_cidx()));
             m_pc++;
-            goto main_loop;
-        case opcode::Constructor: {
+            VM_DISPATCH();
+        VM_CASE(Constructor): {
             /** Instruction: cnstr i n
 
                 stack before,      after
@@ -1778,15 +2179,15 @@ void vm_state::run() {
                 ...
                 a_n
             */
-            unsigned nfields = instr.get_nfields();
+            unsigned nfields = instr->get_nfields();
             unsigned sz      = m_stack.size();
-            vm_obj new_value = mk_vm_constructor(instr.get_cidx(), nfields, m_stack.data() + sz - nfields);
+            vm_obj new_value = mk_vm_constructor(instr->get_cidx(), nfields, m_stack.data() + sz - nfields);
             m_stack.resize(sz - nfields + 1);
             swap(m_stack.back(), new_value);
             m_pc++;
-            goto main_loop;
+            VM_DISPATCH();
         }
-        case opcode::Closure: {
+        VM_CASE(Closure): {
             /** Instruction: closure fn n
 
                 stack before,      after
@@ -1796,15 +2197,15 @@ void vm_state::run() {
                 ...
                 a_1
             */
-            unsigned nargs     = instr.get_nargs();
+            unsigned nargs     = instr->get_nargs();
             unsigned sz        = m_stack.size();
-            vm_obj new_value   = mk_vm_closure(instr.get_fn_idx(), nargs, m_stack.data() + sz - nargs);
+            vm_obj new_value   = mk_vm_closure(instr->get_fn_idx(), nargs, m_stack.data() + sz - nargs);
             m_stack.resize(sz - nargs + 1);
             swap(m_stack.back(), new_value);
             m_pc++;
-            goto main_loop;
+            VM_DISPATCH();
         }
-        case opcode::Num:
+        VM_CASE(Num):
             /** Instruction: num n
 
                 stack before,      after
@@ -1812,10 +2213,10 @@ void vm_state::run() {
                 v    ==>           v
                                    n
             */
-            m_stack.push_back(mk_vm_mpz(instr.get_mpz()));
+            m_stack.push_back(mk_vm_mpz(instr->get_mpz()));
             m_pc++;
-            goto main_loop;
-        case opcode::Pexpr:
+            VM_DISPATCH();
+        VM_CASE(Pexpr):
             /** Instruction: pexpr e
 
                 stack before,      after
@@ -1823,10 +2224,10 @@ void vm_state::run() {
                 v    ==>           v
                                    e
             */
-            m_stack.push_back(to_obj(instr.get_expr()));
+            m_stack.push_back(to_obj(instr->get_expr()));
             m_pc++;
-            goto main_loop;
-        case opcode::Destruct: {
+            VM_DISPATCH();
+        VM_CASE(Destruct): {
             /** Instruction: destruct
 
                 stack before,              after
@@ -1840,9 +2241,9 @@ void vm_state::run() {
             m_stack.pop_back();
             push_fields(top);
             m_pc++;
-            goto main_loop;
+            VM_DISPATCH();
         }
-        case opcode::Cases2: {
+        VM_CASE(Cases2): {
             /** Instruction: cases2 pc1 pc2
 
                 stack before,              after
@@ -1858,10 +2259,10 @@ void vm_state::run() {
             vm_obj top = m_stack.back();
             m_stack.pop_back();
             push_fields(top);
-            m_pc = instr.get_cases2_pc(cidx(top));
-            goto main_loop;
+            m_pc = instr->get_cases2_pc(cidx(top));
+            VM_DISPATCH();
         }
-        case opcode::NatCases: {
+        VM_CASE(NatCases): {
             /** Instruction: natcases pc1 pc2
 
                 stack before,              after (if n = 0)    after (if n > 0)
@@ -1878,28 +2279,28 @@ void vm_state::run() {
                 if (val == 0) {
                     m_stack.pop_back();
                     m_pc++;
-                    goto main_loop;
+                    VM_DISPATCH();
                 } else {
                     vm_obj new_value = mk_vm_simple(val - 1);
                     swap(top, new_value);
-                    m_pc = instr.get_cases2_pc(1);
-                    goto main_loop;
+                    m_pc = instr->get_cases2_pc(1);
+                    VM_DISPATCH();
                 }
             } else {
                 mpz const & val = to_mpz(top);
                 if (val == 0) {
                     m_stack.pop_back();
                     m_pc++;
-                    goto main_loop;
+                    VM_DISPATCH();
                 } else {
                     vm_obj new_value = mk_vm_mpz(val - 1);
                     swap(top, new_value);
-                    m_pc = instr.get_cases2_pc(1);
-                    goto main_loop;
+                    m_pc = instr->get_cases2_pc(1);
+                    VM_DISPATCH();
                 }
             }
         }
-        case opcode::CasesN: {
+        VM_CASE(CasesN): {
             /** Instruction: casesn pc_0 ... pc_[n-1]
 
                 stack before,              after
@@ -1914,23 +2315,23 @@ void vm_state::run() {
             vm_obj top = m_stack.back();
             m_stack.pop_back();
             push_fields(top);
-            m_pc = instr.get_casesn_pc(cidx(top));
-            goto main_loop;
+            m_pc = instr->get_casesn_pc(cidx(top));
+            VM_DISPATCH();
         }
-        case opcode::BuiltinCases: {
+        VM_CASE(BuiltinCases): {
             /** Instruction: builtin_cases
                 It is similar to CasesN, but uses the vm_cases_function to extract the data.
             */
             vm_obj top = m_stack.back();
             m_stack.pop_back();
-            vm_cases_function fn = m_builtin_cases[instr.get_cases_idx()];
+            vm_cases_function fn = m_builtin_cases[instr->get_cases_idx()];
             buffer<vm_obj> data;
             unsigned cidx = fn(top, data);
             std::copy(data.begin(), data.end(), std::back_inserter(m_stack));
-            m_pc = instr.get_casesn_pc(cidx);
-            goto main_loop;
+            m_pc = instr->get_casesn_pc(cidx);
+            VM_DISPATCH();
         }
-        case opcode::Proj: {
+        VM_CASE(Proj): {
             /** Instruction: proj i
 
                stack before,              after
@@ -1940,13 +2341,13 @@ void vm_state::run() {
 
             */
             vm_obj & top = m_stack.back();
-            top = cfield(top, instr.get_idx());
+            top = cfield(top, instr->get_idx());
             m_pc++;
-            goto main_loop;
+            VM_DISPATCH();
         }
-        case opcode::Unreachable:
+        VM_CASE(Unreachable):
             throw exception("VM unreachable instruction has been reached");
-        case opcode::Ret: {
+        VM_CASE(Ret): {
             /**
                Instruction: ret
 
@@ -1977,15 +2378,16 @@ void vm_state::run() {
             m_fn_idx = fr.m_fn_idx;
             m_pc     = fr.m_pc;
             m_bp     = fr.m_bp;
+            if (m_profiler) m_profiler->exit();
             if (m_call_stack.size() == init_call_stack_sz) {
                 m_call_stack.pop_back();
                 return;
             } else {
                 m_call_stack.pop_back();
-                goto main_loop;
+                VM_DISPATCH();
             }
         }
-        case opcode::Apply: {
+        VM_CASE(Apply): {
             /**
                Instruction: apply
 
@@ -2030,6 +2432,7 @@ void vm_state::run() {
                 m_pc++;
             }
             /* Copy closure data to the top of the stack */
+            reserve_stack(m_stack.size() + csz);
             std::copy(cfields(closure), cfields(closure) + csz, std::back_inserter(m_stack));
             if (nargs < arity) {
                 /* Case 1) We don't have sufficient arguments. So, we create a new closure */
@@ -2038,15 +2441,15 @@ void vm_state::run() {
                 m_stack.resize(sz - nargs + 1);
                 swap(m_stack.back(), new_value);
                 m_pc++;
-                goto main_loop;
+                VM_DISPATCH();
             } else {
                 lean_assert(nargs == arity);
                 /* Case 2 */
                 invoke(d);
-                goto main_loop;
+                VM_DISPATCH();
             }
         }
-        case opcode::InvokeGlobal:
+        VM_CASE(InvokeGlobal):
             check_interrupted();
             check_memory("vm");
             /**
@@ -2067,10 +2470,96 @@ void vm_state::run() {
                a_1                     a_1
 
                where n is fn.arity
+
+               Remark: fn may have been replaced with native code (see install_vm_natives)
+               after the current function was compiled.
             */
-            invoke_global(m_decls[instr.get_fn_idx()]);
-            goto main_loop;
-        case opcode::InvokeBuiltin:
+            {
+                vm_decl const & d = m_decls[instr->get_fn_idx()];
+                if (d.is_bytecode())
+                    invoke_global(d);
+                else
+                    invoke(d);
+            }
+            VM_DISPATCH();
+        VM_CASE(TailInvokeGlobal): {
+            check_interrupted();
+            check_memory("vm");
+            /**
+               Instruction: tail_ginvoke fn
+
+               It is only used when the result of fn is also the result of the current function.
+               That is, the instruction is followed by drop instructions and ret.
+               We reuse the current frame instead of creating a new one. Moreover, m_code and m_fn_idx
+               are not modified when fn is the current function, i.e., self tail calls are jumps.
+
+               call stack before                  after
+
+               ...                                ...
+               (code, fn_idx, num, pc, bp)  ==>   (code, fn_idx, n, pc, bp)
+
+               stack before            after
+               ...                     ...
+               v                       v
+               b_m              m_bp : a_n
+               ...                     ...
+               b_1       ==>           a_1
+               c_k
+               ...
+               c_1
+               a_n
+               ...
+               a_1
+
+               where n is fn.arity, b_m ... b_1 are the arguments of the current function, and
+               c_k ... c_1 are its local values.
+            */
+            vm_decl const & d = m_decls[instr->get_fn_idx()];
+            if (!d.is_bytecode()) {
+                /* fn has been replaced with native code (see install_vm_natives).
+                   We invoke it, and return its result r as the ret instruction does:
+
+                   stack before        after
+                   ...                 ...
+                   r                   r
+                   ...       ==>
+                   m_bp : b_1
+                */
+                invoke(d);
+                frame const & fr = m_call_stack.back();
+                swap(m_stack[m_bp], m_stack.back());
+                m_stack.resize(m_bp + 1);
+                m_code   = fr.m_code;
+                m_fn_idx = fr.m_fn_idx;
+                m_pc     = fr.m_pc;
+                m_bp     = fr.m_bp;
+                if (m_profiler) m_profiler->exit();
+                m_call_stack.pop_back();
+                if (m_call_stack.size() < init_call_stack_sz)
+                    return;
+                VM_DISPATCH();
+            }
+            unsigned arity    = d.get_arity();
+            unsigned sz       = m_stack.size();
+            lean_assert(sz >= m_bp + arity);
+            if (m_bp + arity < sz) {
+                std::move(m_stack.begin() + (sz - arity), m_stack.end(), m_stack.begin() + m_bp);
+                m_stack.resize(m_bp + arity);
+            }
+            m_call_stack.back().m_num = arity;
+            reserve_stack(m_bp + d.get_stack_size());
+            if (m_profiler) {
+                m_profiler->exit();
+                m_profiler->enter(d.get_idx());
+            }
+            if (m_fn_idx != d.get_idx()) {
+                m_code   = d.get_code();
+                m_fn_idx = d.get_idx();
+            }
+            m_pc = 0;
+            VM_DISPATCH();
+        }
+        VM_CASE(InvokeBuiltin):
             check_interrupted();
             check_memory("vm");
             /**
@@ -2087,9 +2576,9 @@ void vm_state::run() {
 
                Remark: note that the arguments are in reverse order.
             */
-            invoke_builtin(m_decls[instr.get_fn_idx()]);
-            goto main_loop;
-        case opcode::InvokeCFun:
+            invoke_builtin(m_decls[instr->get_fn_idx()]);
+            VM_DISPATCH();
+        VM_CASE(InvokeCFun):
             check_interrupted();
             check_memory("vm");
             /**
@@ -2097,11 +2586,18 @@ void vm_state::run() {
 
                Similar to InvokeBuiltin
             */
-            invoke_cfun(m_decls[instr.get_fn_idx()]);
-            goto main_loop;
+            invoke_cfun(m_decls[instr->get_fn_idx()]);
+            VM_DISPATCH();
         }
+#if defined(LEAN_VM_THREADED_DISPATCH)
+      op_Profile:
+        m_profiler->count(m_fn_idx, instr->op());
+        goto *dispatch_table[static_cast<unsigned>(instr->op())];
+#endif
     }
 }
+#undef VM_CASE
+#undef VM_DISPATCH
 
 void vm_state::invoke_fn(name const & fn) {
     if (auto r = m_fn_name2idx.find(fn)) {
@@ -2117,17 +2613,35 @@ void vm_state::invoke_fn(unsigned fn_idx) {
     unsigned arity    = d.get_arity();
     if (arity > m_stack.size())
         throw exception("invalid VM function call, data stack does not have enough values");
-    invoke(d);
-    run();
+    /* Remark: this method may be invoked by C++ code invoked by the VM (e.g., code produced
+       by the C++ code generator), so we must preserve the program counter. */
+    unsigned saved_pc = m_pc;
+    unsigned num_frames = m_profiler ? m_profiler->m_frames.size() : 0;
+    try {
+        invoke(d);
+        if (d.is_bytecode())
+            run();
+    } catch (...) {
+        if (m_profiler) m_profiler->unwind(num_frames);
+        throw;
+    }
+    m_pc = saved_pc;
 }
 
 void vm_state::execute(vm_instr const * code) {
+    unsigned num_frames = m_profiler ? m_profiler->m_frames.size() : 0;
     m_call_stack.emplace_back(m_code, m_fn_idx, 0, m_pc, m_bp);
     m_code            = code;
     m_fn_idx          = -1;
     m_pc              = 0;
     m_bp              = m_stack.size();
-    run();
+    if (m_profiler) m_profiler->enter(m_fn_idx);
+    try {
+        run();
+    } catch (...) {
+        if (m_profiler) m_profiler->unwind(num_frames);
+        throw;
+    }
 }
 
 void vm_state::apply(unsigned n) {
@@ -2200,10 +2714,90 @@ unsigned get_vm_builtin_arity(name const & fn) {
     lean_unreachable();
 }
 
+vm_cfunction get_vm_builtin_cfun(name const & fn) {
+    if (auto p = g_vm_cbuiltins->find(fn))
+        return std::get<2>(*p);
+    lean_unreachable();
+}
+
+vm_cases_function get_vm_builtin_cases(name const & fn) {
+    if (auto p = g_vm_cases_builtins->find(fn))
+        return std::get<1>(*p);
+    lean_unreachable();
+}
+
+static char const * get_opcode_name(unsigned op) {
+    switch (static_cast<opcode>(op)) {
+    case opcode::Push:             return "push";
+    case opcode::Ret:              return "ret";
+    case opcode::Drop:             return "drop";
+    case opcode::Goto:             return "goto";
+    case opcode::SConstructor:     return "scnstr";
+    case opcode::Constructor:      return "cnstr";
+    case opcode::Num:              return "num";
+    case opcode::Destruct:         return "destruct";
+    case opcode::Cases2:           return "cases2";
+    case opcode::CasesN:           return "cases";
+    case opcode::NatCases:         return "nat_cases";
+    case opcode::BuiltinCases:     return "builtin_cases";
+    case opcode::Proj:             return "proj";
+    case opcode::Apply:            return "apply";
+    case opcode::InvokeGlobal:     return "ginvoke";
+    case opcode::InvokeBuiltin:    return "builtin";
+    case opcode::InvokeCFun:       return "cfun";
+    case opcode::Closure:          return "closure";
+    case opcode::Unreachable:      return "unreachable";
+    case opcode::Pexpr:            return "pexpr";
+    case opcode::TailInvokeGlobal: return "tail_ginvoke";
+    case opcode::Move:             return "move";
+    }
+    lean_unreachable();
+}
+
+void display_vm_profile(std::ostream & out) {
+    vm_profile p;
+    {
+        lock_guard<mutex> lock(*g_vm_profile_mutex);
+        p = *g_vm_profile;
+    }
+    if (g_vm_state && g_vm_state->m_profiler)
+        g_vm_state->m_profiler->merge(p, *g_vm_state);
+    std::vector<std::pair<name, vm_decl_stats>> entries(p.begin(), p.end());
+    std::sort(entries.begin(), entries.end(), [](std::pair<name, vm_decl_stats> const & e1,
+                                                 std::pair<name, vm_decl_stats> const & e2) {
+                  if (e1.second.m_self != e2.second.m_self)
+                      return e1.second.m_self > e2.second.m_self;
+                  return quick_cmp(e1.first, e2.first) < 0;
+              });
+    std::ios_base::fmtflags flags = out.flags();
+    out << "vm profile\n";
+    out << std::setw(12) << "self" << std::setw(12) << "time" << std::setw(12) << "calls"
+        << std::setw(12) << "self allocs" << std::setw(12) << "allocs" << "  function\n";
+    out << std::fixed << std::setprecision(5);
+    for (auto const & e : entries) {
+        vm_decl_stats const & s = e.second;
+        out << std::setw(12) << s.m_self << std::setw(12) << s.m_time << std::setw(12) << s.m_calls
+            << std::setw(12) << s.m_self_allocs << std::setw(12) << s.m_allocs << "  " << e.first << "\n";
+        bool first = true;
+        for (unsigned op = 0; op < num_opcodes; op++) {
+            if (s.m_opcodes[op] == 0)
+                continue;
+            out << (first ? std::string(14, ' ') : std::string(", ")) << get_opcode_name(op) << " " << s.m_opcodes[op];
+            first = false;
+        }
+        if (!first)
+            out << "\n";
+    }
+    out.flags(flags);
+}
+
 void initialize_vm_core() {
     g_vm_builtins = new name_map<std::tuple<unsigned, char const *, vm_function>>();
     g_vm_cbuiltins = new name_map<std::tuple<unsigned, char const *, vm_cfunction>>();
     g_vm_cases_builtins = new name_map<std::tuple<char const *, vm_cases_function>>();
+    g_vm_native_libs = new std::vector<vm_native_library>();
+    g_vm_profile_mutex = new mutex();
+    g_vm_profile = new vm_profile();
     g_may_update_vm_builtins = true;
     DEBUG_CODE({
             /* We only trace VM in debug mode because it produces a 10% performance penalty */
@@ -2216,6 +2810,9 @@ void finalize_vm_core() {
     delete g_vm_builtins;
     delete g_vm_cbuiltins;
     delete g_vm_cases_builtins;
+    delete g_vm_native_libs;
+    delete g_vm_profile_mutex;
+    delete g_vm_profile;
 }
 
 void initialize_vm() {
@@ -8,6 +8,7 @@ Author: Leonardo de Moura
 #include <memory>
 #include <algorithm>
 #include <vector>
+#include <functional>
 #include "util/debug.h"
 #include "util/rc.h"
 #include "util/small_object_allocator.h"
@@ -229,18 +230,20 @@ enum class opcode {
     SConstructor, Constructor, Num,
     Destruct, Cases2, CasesN, NatCases, BuiltinCases, Proj,
     Apply, InvokeGlobal, InvokeBuiltin, InvokeCFun,
-    Closure, Unreachable, Pexpr
+    Closure, Unreachable, Pexpr, TailInvokeGlobal, Move
 };
 
+const unsigned num_opcodes = static_cast<unsigned>(opcode::Move) + 1;
+
 /** \brief VM instructions */
 class vm_instr {
     opcode m_op;
     union {
         struct {
-            unsigned m_fn_idx;  /* InvokeGlobal, InvokeBuiltin, InvokeCFun and Closure. */
+            unsigned m_fn_idx;  /* InvokeGlobal, TailInvokeGlobal, InvokeBuiltin, InvokeCFun and Closure. */
             unsigned m_nargs;   /* Closure */
         };
-        /* Push, Proj */
+        /* Push, Move, Proj */
         unsigned m_idx;
         /* Drop */
         unsigned m_num;
@@ -265,6 +268,7 @@ class vm_instr {
     };
     /* Apply, Ret, Destruct and Unreachable do not have arguments */
     friend vm_instr mk_push_instr(unsigned idx);
+    friend vm_instr mk_move_instr(unsigned idx);
     friend vm_instr mk_drop_instr(unsigned n);
     friend vm_instr mk_proj_instr(unsigned n);
     friend vm_instr mk_goto_instr(unsigned pc);
@@ -280,6 +284,7 @@ class vm_instr {
     friend vm_instr mk_builtin_cases_instr(unsigned cases_idx, unsigned num_pc, unsigned const * pcs);
     friend vm_instr mk_apply_instr();
     friend vm_instr mk_invoke_global_instr(unsigned fn_idx);
+    friend vm_instr mk_tail_invoke_global_instr(unsigned fn_idx);
     friend vm_instr mk_invoke_cfun_instr(unsigned fn_idx);
     friend vm_instr mk_invoke_builtin_instr(unsigned fn_idx);
     friend vm_instr mk_closure_instr(unsigned fn_idx, unsigned n);
@@ -299,8 +304,8 @@ public:
     opcode op() const { return m_op; }
 
     unsigned get_fn_idx() const {
-        lean_assert(m_op == opcode::InvokeGlobal || m_op == opcode::InvokeBuiltin ||
-                    m_op == opcode::InvokeCFun || m_op == opcode::Closure);
+        lean_assert(m_op == opcode::InvokeGlobal || m_op == opcode::TailInvokeGlobal ||
+                    m_op == opcode::InvokeBuiltin || m_op == opcode::InvokeCFun || m_op == opcode::Closure);
         return m_fn_idx;
     }
 
@@ -310,7 +315,7 @@ public:
     }
 
     unsigned get_idx() const {
-        lean_assert(m_op == opcode::Push || m_op == opcode::Proj);
+        lean_assert(m_op == opcode::Push || m_op == opcode::Move || m_op == opcode::Proj);
         return m_idx;
     }
 
@@ -396,6 +401,7 @@ public:
 };
 
 vm_instr mk_push_instr(unsigned idx);
+vm_instr mk_move_instr(unsigned idx);
 vm_instr mk_drop_instr(unsigned n);
 vm_instr mk_proj_instr(unsigned n);
 vm_instr mk_goto_instr(unsigned pc);
@@ -411,6 +417,7 @@ vm_instr mk_casesn_instr(unsigned num_pc, unsigned const * pcs);
 vm_instr mk_builtin_cases_instr(unsigned cases_idx, unsigned num_pc, unsigned const * pcs);
 vm_instr mk_apply_instr();
 vm_instr mk_invoke_global_instr(unsigned fn_idx);
+vm_instr mk_tail_invoke_global_instr(unsigned fn_idx);
 vm_instr mk_invoke_cfun_instr(unsigned fn_idx);
 vm_instr mk_invoke_builtin_instr(unsigned fn_idx);
 vm_instr mk_closure_instr(unsigned fn_idx, unsigned n);
@@ -432,6 +439,8 @@ struct vm_decl_cell {
     union {
         struct {
             unsigned   m_code_size;
+            /* Maximum number of data stack slots used by the code, starting at the arguments. */
+            unsigned   m_stack_size;
             vm_instr * m_code;
         };
         vm_function   m_fn;
@@ -439,7 +448,8 @@ struct vm_decl_cell {
     };
     vm_decl_cell(name const & n, unsigned idx, unsigned arity, vm_function fn);
     vm_decl_cell(name const & n, unsigned idx, unsigned arity, vm_cfunction fn);
-    vm_decl_cell(name const & n, unsigned idx, expr const & e, unsigned code_sz, vm_instr const * code);
+    vm_decl_cell(name const & n, unsigned idx, expr const & e, unsigned code_sz, vm_instr const * code,
+                 unsigned stack_sz);
     ~vm_decl_cell();
     void dealloc();
 };
@@ -454,8 +464,9 @@ public:
         vm_decl(new vm_decl_cell(n, idx, arity, fn)) {}
     vm_decl(name const & n, unsigned idx, unsigned arity, vm_cfunction fn):
         vm_decl(new vm_decl_cell(n, idx, arity, fn)) {}
-    vm_decl(name const & n, unsigned idx, expr const & e, unsigned code_sz, vm_instr const * code):
-        vm_decl(new vm_decl_cell(n, idx, e, code_sz, code)) {}
+    vm_decl(name const & n, unsigned idx, expr const & e, unsigned code_sz, vm_instr const * code,
+            unsigned stack_sz):
+        vm_decl(new vm_decl_cell(n, idx, e, code_sz, code, stack_sz)) {}
     vm_decl(vm_decl const & s):m_ptr(s.m_ptr) { if (m_ptr) m_ptr->inc_ref(); }
     vm_decl(vm_decl && s):m_ptr(s.m_ptr) { s.m_ptr = nullptr; }
     ~vm_decl() { if (m_ptr) m_ptr->dec_ref(); }
@@ -474,11 +485,23 @@ public:
     unsigned get_arity() const { lean_assert(m_ptr); return m_ptr->m_arity; }
     unsigned get_code_size() const { lean_assert(is_bytecode()); return m_ptr->m_code_size; }
     vm_instr const * get_code() const { lean_assert(is_bytecode()); return m_ptr->m_code; }
+    unsigned get_stack_size() const { lean_assert(is_bytecode()); return m_ptr->m_stack_size; }
     vm_function get_fn() const { lean_assert(is_builtin()); return m_ptr->m_fn; }
     vm_cfunction get_cfn() const { lean_assert(is_cfun()); return m_ptr->m_cfn; }
     expr const & get_expr() const { lean_assert(is_bytecode()); return m_ptr->m_expr; }
 };
 
+/** \brief Statistics collected by the VM profiler for a VM function. */
+struct vm_decl_stats {
+    unsigned long long m_calls       = 0;
+    double             m_time        = 0.0; // wall-clock time in seconds, including callees
+    double             m_self        = 0.0; // wall-clock time in seconds, excluding callees
+    unsigned long long m_allocs      = 0;   // number of constructor and closure objects allocated, including callees
+    unsigned long long m_self_allocs = 0;
+    unsigned long long m_opcodes[num_opcodes] = {}; // number of instructions executed for each opcode
+    void merge(vm_decl_stats const & s);
+};
+
 /** \brief Virtual machine for executing VM bytecode. */
 class vm_state {
     typedef std::vector<vm_decl> decls;
@@ -488,7 +511,7 @@ class vm_state {
     decls const &               m_decls;
     builtin_cases const &       m_builtin_cases;
     builtin_cases_names const & m_builtin_cases_names;
-    name_map<unsigned>          m_fn_name2idx;
+    name_hamt_map<unsigned>     m_fn_name2idx;
     vm_instr const *            m_code;   /* code of the current function being executed */
     unsigned                    m_fn_idx; /* function idx being executed */
     unsigned                    m_pc;     /* program counter */
@@ -504,7 +527,10 @@ class vm_state {
     };
     std::vector<vm_obj>         m_stack;
     std::vector<frame>          m_call_stack;
+    struct profiler;
+    std::unique_ptr<profiler>   m_profiler; /* nullptr if the VM profiler is disabled */
 
+    void reserve_stack(unsigned sz);
     void push_fields(vm_obj const & obj);
     void invoke_builtin(vm_decl const & d);
     void invoke_cfun(vm_decl const & d);
@@ -514,8 +540,10 @@ class vm_state {
     void execute(vm_instr const * code);
     vm_obj invoke_closure(vm_obj const & fn, unsigned nargs);
 
+    friend void display_vm_profile(std::ostream & out);
 public:
     vm_state(environment const & env);
+    ~vm_state();
 
     environment const & env() const { return m_env; }
 
@@ -573,6 +601,9 @@ public:
     vm_obj invoke(unsigned fn_idx, vm_obj const & a) {
         return invoke(fn_idx, 1, &a);
     }
+    /** \brief Similar to invoke(fn_idx, nargs, as), but the arguments are moved to the VM stack.
+        So, the callee may update them in place if they are not shared. */
+    vm_obj invoke_move(unsigned fn_idx, unsigned nargs, vm_obj * as);
 
     vm_obj invoke(name const & fn, unsigned nargs, vm_obj const * as);
     vm_obj invoke(name const & fn, std::initializer_list<vm_obj> const & as) {
@@ -594,6 +625,16 @@ public:
 /** \brief Return reference to thread local VM state object. */
 vm_state const & get_vm_state();
 
+/** \brief Enable/disable the VM profiler. It only affects vm_state objects created afterwards.
+    When it is enabled, each vm_state object records the number of calls, the time spent, the number of
+    constructor and closure objects allocated, and the number of instructions executed by each opcode
+    for each VM function. The statistics are accumulated when the vm_state object is destroyed. */
+void enable_vm_profiler(bool flag);
+bool is_vm_profiler_enabled();
+/** \brief Display the statistics collected by the VM profiler, including the ones collected by the
+    thread local VM state object. The functions are sorted by the time spent in them excluding callees. */
+void display_vm_profile(std::ostream & out);
+
 /** \brief Add builtin implementation for the function named \c n.
     All environment objects will contain this builtin.
     \pre These procedures can only be invoked at initialization time. */
@@ -633,17 +674,50 @@ environment add_native(environment const & env, name const & n, vm_cfunction_7 f
 environment add_native(environment const & env, name const & n, vm_cfunction_8 fn);
 environment add_native(environment const & env, name const & n, unsigned arity, vm_cfunction_N fn);
 
+/** \brief Register a native library whose code references the VM functions \c fn_refs, and return its id.
+    The native code obtains the indices of these functions in the environment being executed
+    using get_vm_native_fn_idxs. Native libraries must be registered before environments are created. */
+unsigned register_vm_native_library(buffer<name> const & fn_refs);
+
+/** \brief Register \c fn as the native implementation of the VM function \c n in the library \c lib_id.
+    \c code_hash is the get_vm_code_hash of the bytecode \c fn was produced from. \c fn may be nullptr
+    for functions that are only invoked by other functions of the library.
+    The registered implementations are installed by install_vm_natives, and they are usually
+    produced by the C++ code generator (see library/compiler/cpp_compiler.h).
+    \remark \c fn must have type vm_cfunction_N if arity > 8. */
+void register_vm_native(unsigned lib_id, name const & n, unsigned arity, unsigned code_hash, vm_cfunction fn);
+
+/** \brief Return a hash code for the bytecode of \c d. It does not depend on the function indices of \c env. */
+unsigned get_vm_code_hash(environment const & env, vm_decl const & d);
+
+/** \brief Return the indices of the VM functions referenced by the native library \c lib_id
+    in the environment of the current vm_state. */
+unsigned const * get_vm_native_fn_idxs(unsigned lib_id);
+
+/** \brief Replace the bytecode of the functions in \c env with the native implementations of every
+    registered library that can be installed in \c env. A library is installed only if \c env contains
+    all VM functions it references, and all functions it was compiled from have the same arity.
+    The bindings are stored in \c env, so different environments may install different libraries.
+    \remark Throws an exception if the bytecode of a function does not match the code hash of its
+    native implementation. The frontend invokes it after modules are imported. */
+environment install_vm_natives(environment const & env);
+
 /** \brief Reserve an index for the given function in the VM, the expression
     \c e is the value of \c fn after preprocessing.
     See library/compiler/pre_proprocess_rec.cpp for details. */
 environment reserve_vm_index(environment const & env, name const & fn, expr const & e);
 
 /** \brief Add bytcode for the function named \c fn in \c env.
+    \c stack_sz is the maximum number of data stack slots used by \c code, including the
+    arguments of \c fn. The VM reserves them when \c fn is invoked, so the data stack is
+    never reallocated while \c code is executed.
     \remark The index for \c fn must have been reserved using reserve_vm_index. */
-environment update_vm_code(environment const & env, name const & fn, unsigned code_sz, vm_instr const * code);
+environment update_vm_code(environment const & env, name const & fn, unsigned code_sz, vm_instr const * code,
+                           unsigned stack_sz);
 
 /** \brief Combines reserve_vm_index and update_vm_code */
-environment add_vm_code(environment const & env, name const & fn, expr const & e, unsigned code_sz, vm_instr const * code);
+environment add_vm_code(environment const & env, name const & fn, expr const & e, unsigned code_sz, vm_instr const * code,
+                        unsigned stack_sz);
 
 /** \brief Return the internal idx for the given constant. Return none
     if the constant is not builtin nor it has code associated with it. */
@@ -696,6 +770,26 @@ vm_obj invoke(vm_obj const & fn, unsigned nargs, vm_obj const * args);
 vm_obj invoke(unsigned fn_idx, unsigned nargs, vm_obj const * args);
 vm_obj invoke(unsigned fn_idx, vm_obj const & arg);
 
+/** \brief The following procedures are used by the code produced by the C++ code generator.
+    They use the thread local VM state object.
+
+    Invoke the VM function \c fn_idx with \c nargs arguments. The arguments are in the order they are
+    stored in the VM stack, i.e., args[nargs-1] is the first argument. They are moved to the VM stack. */
+vm_obj invoke_global(unsigned fn_idx, unsigned nargs, vm_obj * args);
+/** \brief Return the C++ function that implements the builtin \c fn.
+    \pre is_vm_builtin_function(fn) && get_vm_builtin_kind(fn) == vm_builtin_kind::CFun */
+vm_cfunction get_vm_builtin_cfun(name const & fn);
+/** \brief Return the C++ function that implements the builtin cases_on \c fn.
+    \pre is_vm_builtin_function(fn) && get_vm_builtin_kind(fn) == vm_builtin_kind::Cases */
+vm_cases_function get_vm_builtin_cases(name const & fn);
+
+/** \brief Invoke \c fn for each function in the VM. */
+void for_each_vm_decl(environment const & env, std::function<void(vm_decl const &)> const & fn);
+/** \brief Return the name of the function with index \c fn_idx. */
+name get_vm_decl_name(environment const & env, unsigned fn_idx);
+/** \brief Return the name of the builtin cases_on with index \c cases_idx. */
+name get_vm_builtin_cases_name(environment const & env, unsigned cases_idx);
+
 void display_vm_code(std::ostream & out, environment const & env, unsigned code_sz, vm_instr const * code);
 
 void initialize_vm_core();
@@ -0,0 +1,137 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#include <limits>
+#include "util/sstream.h"
+#include "library/trace.h"
+#include "library/vm/vm.h"
+#include "library/vm/vm_nat.h"
+#include "library/vm/vm_array.h"
+
+namespace lean {
+struct vm_array : public vm_external {
+    parray<vm_obj> m_array;
+    vm_array(parray<vm_obj> const & a):m_array(a) {}
+    virtual void dealloc() override { this->~vm_array(); get_vm_allocator().deallocate(sizeof(vm_array), this); }
+};
+
+static vm_array * to_vm_array(vm_obj const & o) {
+    lean_assert(is_external(o));
+    lean_assert(dynamic_cast<vm_array*>(to_external(o)));
+    return static_cast<vm_array*>(to_external(o));
+}
+
+parray<vm_obj> const & to_array(vm_obj const & o) {
+    return to_vm_array(o)->m_array;
+}
+
+vm_obj to_obj(parray<vm_obj> const & a) {
+    return mk_vm_external(new (get_vm_allocator().allocate(sizeof(vm_array))) vm_array(a));
+}
+
+static unsigned to_array_idx(parray<vm_obj> const & a, vm_obj const & i) {
+    unsigned idx = force_to_unsigned(i, std::numeric_limits<unsigned>::max());
+    if (idx >= a.size())
+        throw exception(sstream() << "array index out of bounds, index: " << idx << ", size: " << a.size());
+    return idx;
+}
+
+/* Apply \c fn to the array stored in \c a, and push the result into the VM stack.
+   If \c a is not shared, then the array is updated in place. Remark: \c a is a reference to the VM stack,
+   and the array is not shared when the stack holds the only reference to it. This is the case when
+   the array argument is the result of another function call or the last use of a local
+   (see move instruction). */
+template<typename F>
+static void update_array(vm_state & s, vm_obj const & a, F && fn) {
+    if (a.raw()->get_rc() == 1) {
+        lean_trace(name({"vm", "array"}), tout() << "update in place\n";);
+        fn(to_vm_array(a)->m_array);
+        s.push(a);
+    } else {
+        lean_trace(name({"vm", "array"}), tout() << "update shared array\n";);
+        parray<vm_obj> new_a = to_array(a);
+        fn(new_a);
+        s.push(to_obj(new_a));
+    }
+}
+
+vm_obj array_mk_empty(vm_obj const &) {
+    return to_obj(parray<vm_obj>());
+}
+
+vm_obj array_mk(vm_obj const &, vm_obj const & n, vm_obj const & v) {
+    if (!is_simple(n))
+        throw exception("array is too big");
+    parray<vm_obj> a;
+    unsigned sz = cidx(n);
+    for (unsigned i = 0; i < sz; i++)
+        a.push_back(v);
+    return to_obj(a);
+}
+
+vm_obj array_size(vm_obj const &, vm_obj const & a) {
+    return mk_vm_nat(to_array(a).size());
+}
+
+vm_obj array_read(vm_obj const &, vm_obj const & a, vm_obj const & i) {
+    parray<vm_obj> const & arr = to_array(a);
+    return arr[to_array_idx(arr, i)];
+}
+
+vm_obj array_to_list(vm_obj const &, vm_obj const & a) {
+    parray<vm_obj> const & arr = to_array(a);
+    vm_obj r = mk_vm_simple(0);
+    unsigned i = arr.size();
+    while (i > 0) {
+        --i;
+        r = mk_vm_constructor(1, arr[i], r);
+    }
+    return r;
+}
+
+/* The following builtins use the VM stack API instead of the C function API,
+   since the latter copies the arguments and, consequently, the arrays would always be shared.
+
+   The arguments are stored at the top of the stack: s.get(-1) is the type,
+   s.get(-2) is the array, and so on. */
+
+/* array.write {A : Type} : array A → nat → A → array A */
+static void array_write(vm_state & s) {
+    vm_obj const & a = s.get(-2);
+    unsigned idx     = to_array_idx(to_array(a), s.get(-3));
+    vm_obj const & v = s.get(-4);
+    update_array(s, a, [&](parray<vm_obj> & arr) { arr.set(idx, v); });
+}
+
+/* array.push_back {A : Type} : array A → A → array A */
+static void array_push_back(vm_state & s) {
+    vm_obj const & v = s.get(-3);
+    update_array(s, s.get(-2), [&](parray<vm_obj> & arr) { arr.push_back(v); });
+}
+
+/* array.pop_back {A : Type} : array A → array A */
+static void array_pop_back(vm_state & s) {
+    vm_obj const & a = s.get(-2);
+    if (to_array(a).empty())
+        throw exception("array.pop_back failed, array is empty");
+    update_array(s, a, [&](parray<vm_obj> & arr) { arr.pop_back(); });
+}
+
+void initialize_vm_array() {
+    DECLARE_VM_BUILTIN(name({"array", "mk_empty"}),  array_mk_empty);
+    DECLARE_VM_BUILTIN(name({"array", "mk"}),        array_mk);
+    DECLARE_VM_BUILTIN(name({"array", "size"}),      array_size);
+    DECLARE_VM_BUILTIN(name({"array", "read"}),      array_read);
+    DECLARE_VM_BUILTIN(name({"array", "to_list"}),   array_to_list);
+    declare_vm_builtin(name({"array", "write"}),     "array_write",     4, array_write);
+    declare_vm_builtin(name({"array", "push_back"}), "array_push_back", 3, array_push_back);
+    declare_vm_builtin(name({"array", "pop_back"}),  "array_pop_back",  2, array_pop_back);
+    register_trace_class({"vm", "array"});
+}
+
+void finalize_vm_array() {
+}
+}
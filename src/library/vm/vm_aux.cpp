@@ -5,6 +5,7 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Author: Leonardo de Moura
 */
 #include <string>
+#include <sstream>
 #include <iostream>
 #include "util/timeit.h"
 #include "library/trace.h"
@@ -23,9 +24,18 @@ vm_obj vm_trace(vm_obj const &, vm_obj const & s, vm_obj const & fn) {
     return invoke(fn, mk_vm_unit());
 }
 
+vm_obj vm_profile_report(vm_obj const &) {
+    if (!is_vm_profiler_enabled())
+        return to_obj(std::string());
+    std::ostringstream out;
+    display_vm_profile(out);
+    return to_obj(out.str());
+}
+
 void initialize_vm_aux() {
     DECLARE_VM_BUILTIN("timeit", vm_timeit);
     DECLARE_VM_BUILTIN("trace",  vm_trace);
+    DECLARE_VM_BUILTIN("vm_profile_report", vm_profile_report);
 }
 
 void finalize_vm_aux() {
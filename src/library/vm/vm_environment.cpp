@@ -149,7 +149,7 @@ vm_obj environment_inductive_dep_elim(vm_obj const & env, vm_obj const & n) {
 
 vm_obj environment_fold(vm_obj const &, vm_obj const & env, vm_obj const & a, vm_obj const & fn) {
     vm_obj r = a;
-    to_env(env).for_each_declaration([&](declaration const & d) {
+    to_env(env).for_each_declaration_by_name([&](declaration const & d) {
             r = invoke(fn, to_obj(d), r);
         });
     return r;
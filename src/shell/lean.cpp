@@ -8,8 +8,11 @@ Author: Leonardo de Moura
 #include <fstream>
 #include <signal.h>
 #include <cstdlib>
+#include <cstdio>
 #include <getopt.h>
 #include <string>
+#include <vector>
+#include <memory>
 #include "util/stackinfo.h"
 #include "util/macros.h"
 #include "util/debug.h"
@@ -19,6 +22,7 @@ Author: Leonardo de Moura
 #include "util/thread.h"
 #include "util/lean_path.h"
 #include "util/file_lock.h"
+#include "util/profiler.h"
 #include "util/sexpr/options.h"
 #include "util/sexpr/option_declarations.h"
 #include "kernel/environment.h"
@@ -32,12 +36,17 @@ Author: Leonardo de Moura
 #include "library/type_context.h"
 #include "library/io_state_stream.h"
 #include "library/definition_cache.h"
+#include "library/cache_helper.h"
 #include "library/export.h"
+#include "library/vm/vm.h"
 #include "library/error_handling.h"
+#include "library/compiler/cpp_compiler.h"
 #include "frontends/lean/parser.h"
 #include "frontends/lean/pp.h"
 #include "frontends/lean/dependencies.h"
 #include "frontends/lean/opt_cmd.h"
+#include "frontends/lean/server.h"
+#include "frontends/lean/make.h"
 #include "frontends/smt2/parser.h"
 #include "init/init.h"
 #include "shell/emscripten.h"
@@ -61,7 +70,6 @@ using lean::options;
 using lean::keep_theorem_mode;
 using lean::module_name;
 using lean::simple_pos_info_provider;
-using lean::shared_file_lock;
 using lean::exclusive_file_lock;
 using lean::type_context;
 using lean::type_checker;
@@ -109,9 +117,16 @@ static void display_help(std::ostream & out) {
     std::cout << "  --threads=num -j  number of threads used to process lean files\n";
 #endif
     std::cout << "  --deps            just print dependencies of a Lean input\n";
+    std::cout << "  --make -m         produce the .olean files of the given Lean files and of the Lean files\n"
+              << "                    they import, only out of date files are processed (in parallel if -j is used)\n";
     std::cout << "  --flycheck        print structured error message for flycheck\n";
-    std::cout << "  --cache=file -c   load/save cached definitions from/to the given file\n";
-    std::cout << "  --profile         display elaboration/type checking time for each definition/theorem\n";
+    std::cout << "  --cache=dir -c    load/save cached definitions from/to the given directory\n";
+    std::cout << "  --profile         display elaboration/type checking time for each definition/theorem,\n"
+              << "                    the time spent in each phase (e.g., parsing, elaboration), and cache statistics\n";
+    std::cout << "  --profile-folded=file  save the profile in the folded stack format used by flame graph tools\n";
+    std::cout << "  --profile-json=file    save the time spent in each phase and declaration in JSON format\n";
+    std::cout << "  --profile-vm      display the number of calls, time, allocations and executed instructions\n"
+              << "                    of each VM function (e.g., tactics) at exit\n";
 #if defined(LEAN_USE_BOOST)
     std::cout << "  --tstack=num -s   thread stack size in Kb\n";
 #endif
@@ -126,9 +141,14 @@ static void display_help(std::ostream & out) {
     std::cout << "  --goal            display goal at close to given position\n";
     std::cout << "  --hole            display type of the \"hole\" in the given posivition\n";
     std::cout << "  --info            display information about identifier or token in the given posivition\n";
+    std::cout << "  --server          start a server that reads commands (e.g., VISIT, SYNC, CHECK, INFO) from\n"
+              << "                    the standard input, and keeps snapshots for incremental processing\n";
     std::cout << "Exporting data:\n";
     std::cout << "  --export=file -E  export final environment as textual low-level file\n";
     std::cout << "  --export-all=file -A  export final environment (and all dependencies) as textual low-level file\n";
+    std::cout << "  --cpp=file        generate C++ code for the VM functions defined in the input file\n";
+    std::cout << "  --native=file     load native code for VM functions from the given shared object,\n";
+    std::cout << "                    the shared object is produced by compiling the code generated by --cpp\n";
 }
 
 static char const * get_file_extension(char const * fname) {
@@ -145,6 +165,22 @@ static char const * get_file_extension(char const * fname) {
     }
 }
 
+static void display_profile(io_state const & ios, optional<std::string> const & folded_file,
+                            optional<std::string> const & json_file) {
+    if (ios.get_options().get_bool("profile", false))
+        lean::display_profile_summary(ios.get_regular_stream());
+    if (folded_file) {
+        std::ofstream out(*folded_file);
+        lean::display_profile_folded(out);
+    }
+    if (json_file) {
+        std::ofstream out(*json_file);
+        lean::display_profile_json(out);
+    }
+    if (lean::is_vm_profiler_enabled())
+        lean::display_vm_profile(ios.get_regular_stream());
+}
+
 static struct option g_long_options[] = {
     {"version",      no_argument,       0, 'v'},
     {"help",         no_argument,       0, 'h'},
@@ -161,12 +197,16 @@ static struct option g_long_options[] = {
     {"discard",      no_argument,       0, 'r'},
     {"to_axiom",     no_argument,       0, 'X'},
     {"profile",      no_argument,       0, 'P'},
+    {"profile-folded", required_argument, 0, 'W'},
+    {"profile-json", required_argument, 0, 'U'},
+    {"profile-vm",   no_argument,       0, 'V'},
 #if defined(LEAN_MULTI_THREAD)
     {"threads",      required_argument, 0, 'j'},
 #endif
     {"quiet",        no_argument,       0, 'q'},
     {"cache",        required_argument, 0, 'c'},
     {"deps",         no_argument,       0, 'd'},
+    {"make",         no_argument,       0, 'm'},
     {"flycheck",     no_argument,       0, 'F'},
 #if defined(LEAN_USE_BOOST)
     {"tstack",       required_argument, 0, 's'},
@@ -176,7 +216,10 @@ static struct option g_long_options[] = {
     {"goal",         no_argument,       0, 'G'},
     {"hole",         no_argument,       0, 'Z'},
     {"info",         no_argument,       0, 'I'},
+    {"server",       no_argument,       0, 'S'},
     {"dir",          required_argument, 0, 'T'},
+    {"cpp",          required_argument, 0, 'C'},
+    {"native",       required_argument, 0, 'N'},
 #ifdef LEAN_DEBUG
     {"debug",        required_argument, 0, 'B'},
 #endif
@@ -184,7 +227,7 @@ static struct option g_long_options[] = {
     {0, 0, 0, 0}
 };
 
-#define OPT_STR "PHXFdD:qrlupgvhk:012t:012o:E:c:L:012O:012GZAIT:B:"
+#define OPT_STR "PHXFdmD:qrlupgvhk:012t:012o:E:c:L:012O:012GZAIST:B:C:N:"
 
 #if defined(LEAN_TRACK_MEMORY)
 #define OPT_STR2 OPT_STR "M:012"
@@ -245,10 +288,13 @@ int main() { return 0; }
 #else
 int main(int argc, char ** argv) {
     lean::initializer init;
+    /* All threads that manipulate expressions are created using interruptible_thread. */
+    lean::thread_confined_rc_scope confined_rc;
     bool export_objects     = false;
     unsigned trust_lvl      = LEAN_BELIEVER_TRUST_LEVEL+1;
     bool smt2               = false;
     bool only_deps          = false;
+    bool make_mode          = false;
     unsigned num_threads    = 1;
     bool read_cache         = false;
     bool save_cache         = false;
@@ -261,9 +307,14 @@ int main(int argc, char ** argv) {
     optional<std::string> export_txt;
     optional<std::string> export_all_txt;
     optional<std::string> base_dir;
+    optional<std::string> cpp_output;
+    optional<std::string> profile_folded;
+    optional<std::string> profile_json;
+    std::vector<std::string> native_libs;
     bool show_goal = false;
     bool show_hole = false;
     bool show_info = false;
+    bool run_server = false;
     input_kind default_k = input_kind::Unspecified;
     while (true) {
         int c = getopt_long(argc, argv, g_opt_str, g_long_options, NULL);
@@ -330,6 +381,9 @@ int main(int argc, char ** argv) {
         case 'd':
             only_deps = true;
             break;
+        case 'm':
+            make_mode = true;
+            break;
         case 'D':
             try {
                 opts = set_config_option(opts, optarg);
@@ -344,6 +398,15 @@ int main(int argc, char ** argv) {
         case 'P':
             opts = opts.update("profile", true);
             break;
+        case 'W':
+            profile_folded = std::string(optarg);
+            break;
+        case 'U':
+            profile_json = std::string(optarg);
+            break;
+        case 'V':
+            lean::enable_vm_profiler(true);
+            break;
         case 'L':
             line = atoi(optarg);
             break;
@@ -359,6 +422,9 @@ int main(int argc, char ** argv) {
         case 'I':
             show_info = true;
             break;
+        case 'S':
+            run_server = true;
+            break;
         case 'E':
             export_txt = std::string(optarg);
             break;
@@ -373,6 +439,12 @@ int main(int argc, char ** argv) {
         case 'T':
             base_dir = std::string(optarg);
             break;
+        case 'C':
+            cpp_output = std::string(optarg);
+            break;
+        case 'N':
+            native_libs.push_back(optarg);
+            break;
         default:
             std::cerr << "Unknown command line option\n";
             display_help(std::cerr);
@@ -398,6 +470,17 @@ int main(int argc, char ** argv) {
     lean_assert(num_threads == 1);
     #endif
 
+    if (opts.get_bool("profile", false) || profile_folded || profile_json)
+        lean::enable_profiler(true);
+
+    try {
+        for (std::string const & lib : native_libs)
+            lean::load_native_library(lib);
+    } catch (lean::exception & ex) {
+        std::cerr << ex.what() << "\n";
+        return 1;
+    }
+
     if (smt2) {
         // Note: the smt2 flag may override other flags
         environment env = mk_environment(trust_lvl);
@@ -447,17 +530,16 @@ int main(int argc, char ** argv) {
 
     environment env = has_hlean ? mk_hott_environment(trust_lvl) : mk_environment(trust_lvl);
     io_state ios(opts, lean::mk_pretty_formatter_factory());
-    definition_cache   cache;
-    definition_cache * cache_ptr = nullptr;
+    if (run_server) {
+        lean::server s(env, ios, base_dir);
+        s(std::cin);
+        return 0;
+    }
+    std::unique_ptr<definition_cache> cache;
     if (read_cache) {
         try {
-            cache_ptr = &cache;
-            shared_file_lock cache_lock(cache_name);
-            std::ifstream in(cache_name, std::ifstream::binary);
-            if (!in.bad() && !in.fail())
-                cache.load(in);
+            cache.reset(new definition_cache(cache_name));
         } catch (lean::throwable & ex) {
-            cache_ptr = nullptr;
             // I'm using flycheck_error instead off flycheck_warning because
             // the :error-patterns at lean-flycheck.el do not work after
             // I add a rule for FLYCHECK_WARNING.
@@ -466,11 +548,18 @@ int main(int argc, char ** argv) {
             if (optind < argc)
                 display_error_pos(ios.get_regular_stream(), ios.get_options(), argv[optind], 1, 0);
             ios.get_regular_stream()
-                << "failed to load cache file '" << cache_name << "', "
+                << "failed to open cache directory '" << cache_name << "', "
                 << ex.what() << ". cache is going to be ignored\n";
         }
     }
     try {
+        if (make_mode) {
+            bool ok = lean::make(env, ios, argc - optind, argv + optind, num_threads, cache.get(), tmode);
+            display_profile(ios, profile_folded, profile_json);
+            if (save_cache && cache)
+                cache->save();
+            return ok ? 0 : 1;
+        }
         bool ok = true;
         for (int i = optind; i < argc; i++) {
             try {
@@ -490,7 +579,7 @@ int main(int argc, char ** argv) {
                         if (!display_deps(env, std::cout, std::cerr, argv[i]))
                             ok = false;
                     } else if (!parse_commands(env, ios, argv[i], base_dir, false, num_threads,
-                                               cache_ptr, tmode)) {
+                                               cache.get(), tmode)) {
                         ok = false;
                     }
                     break;
@@ -506,16 +595,16 @@ int main(int argc, char ** argv) {
                 lean::display_error(out, &pp, ex);
             }
         }
-        if (save_cache) {
-            exclusive_file_lock cache_lock(cache_name);
-            std::ofstream out(cache_name, std::ofstream::binary);
-            cache.save(out);
-        }
-        if (export_objects && ok) {
-            exclusive_file_lock output_lock(output);
-            std::ofstream out(output, std::ofstream::binary);
-            export_module(out, env);
+        if (ios.get_options().get_bool("profile", false)) {
+            std::ostream & out = ios.get_regular_stream();
+            out << "cache statistics\n";
+            lean::display_cache_stats(out);
         }
+        display_profile(ios, profile_folded, profile_json);
+        if (save_cache && cache)
+            cache->save();
+        if (export_objects && ok)
+            export_module(output, env);
         if (export_txt) {
             exclusive_file_lock expor_lock(*export_txt);
             std::ofstream out(*export_txt);
@@ -526,6 +615,10 @@ int main(int argc, char ** argv) {
             std::ofstream out(*export_all_txt);
             export_all_as_lowtext(out, env);
         }
+        if (cpp_output && ok) {
+            std::ofstream out(*cpp_output);
+            lean::emit_cpp_module(out, env);
+        }
         return ok ? 0 : 1;
     } catch (lean::throwable & ex) {
         type_context tc(env, ios.get_options());
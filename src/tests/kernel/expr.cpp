@@ -9,7 +9,9 @@ Author: Leonardo de Moura
 #include <utility>
 #include <vector>
 #include <limits>
+#include <memory>
 #include "util/test.h"
+#include "util/thread.h"
 #include "util/init_module.h"
 #include "util/sexpr/init_module.h"
 #include "kernel/expr.h"
@@ -376,6 +378,92 @@ static void tst18() {
     lean_assert(!has_local(mk_app(f, a0, a0, a0, a0)));
 }
 
+static void tst19() {
+    expr f  = Const("f");
+    expr a  = Const("a");
+    expr b  = Const("b");
+    expr t1 = mk_app(f, a);
+    expr t2;
+    /* The hash-consing table is shared by all threads */
+    thread th([&]() {
+            t2 = mk_app(Const("f"), Const("a"));
+            run_thread_finalizers();
+        });
+    th.join();
+    lean_assert(is_eqp(t1, t2));
+    /* The hash-consing table does not keep expressions alive */
+    {
+        expr t3 = mk_app(f, b);
+        lean_assert(is_cached(t3));
+    }
+    scoped_expr_caching set(false);
+    lean_assert(!is_cached(mk_app(f, b)));
+    lean_assert(is_cached(mk_app(f, a)));
+}
+
+static void tst20() {
+    /* The same terms are created over and over, as the elaborator does. They are shared when hash-consing is enabled. */
+    expr f = Const("f");
+    std::vector<expr> as;
+    for (unsigned i = 0; i < 100; i++)
+        as.push_back(Const(name("a", i)));
+    for (bool caching : {false, true}) {
+        scoped_expr_caching set(caching);
+        std::vector<expr> ts;
+        for (unsigned i = 0; i < as.size(); i++)
+            ts.push_back(mk_app(f, as[i], as[(i+1) % as.size()], as[(i+2) % as.size()]));
+        for (unsigned k = 0; k < 100; k++) {
+            for (unsigned i = 0; i < as.size(); i++) {
+                expr t = mk_app(f, as[i], as[(i+1) % as.size()], as[(i+2) % as.size()]);
+                lean_assert(t == ts[i]);
+                lean_assert(is_eqp(t, ts[i]) == caching);
+            }
+        }
+    }
+}
+
+static void tst21() {
+    /* Equal terms created concurrently by several threads are shared, and the hash-consing table
+       does not keep them alive: each one is removed from its shard when it is released. */
+    expr f = Const("f");
+    std::vector<expr> as;
+    for (unsigned i = 0; i < 100; i++)
+        as.push_back(Const(name("a", i)));
+    unsigned num_threads = 4;
+    unsigned num_terms   = 1000;
+    unsigned old_size    = get_hash_cons_table_size();
+    std::vector<std::vector<expr>> ts(num_threads);
+    std::vector<std::unique_ptr<thread>> threads;
+    for (unsigned t = 0; t < num_threads; t++) {
+        threads.emplace_back(new thread([&, t]() {
+                    for (unsigned k = 0; k < num_terms; k++) {
+                        /* each thread creates the terms in a different order */
+                        unsigned i = (k + t * num_terms / num_threads) % num_terms;
+                        expr e = mk_app(f, as[i % as.size()], as[(i / as.size()) % as.size()]);
+                        if (k % 2 == 0)
+                            ts[t].push_back(e);
+                    }
+                    run_thread_finalizers();
+                }));
+    }
+    for (auto & th : threads)
+        th->join();
+    for (unsigned t = 0; t < num_threads; t++) {
+        lean_assert(ts[t].size() == num_terms / 2);
+        for (unsigned k = 0; k < ts[t].size(); k++) {
+            expr const & e = ts[t][k];
+            lean_assert(is_cached(e));
+            for (unsigned t2 = 0; t2 < num_threads; t2++) {
+                auto it = std::find(ts[t2].begin(), ts[t2].end(), e);
+                lean_assert(it == ts[t2].end() || is_eqp(*it, e));
+            }
+        }
+    }
+    lean_assert(get_hash_cons_table_size() > old_size);
+    ts.clear();
+    lean_assert(get_hash_cons_table_size() == old_size);
+}
+
 int main() {
     save_stack_info();
     initialize_util_module();
@@ -403,6 +491,9 @@ int main() {
     tst16();
     tst17();
     tst18();
+    tst19();
+    tst20();
+    tst21();
     std::cout << "sizeof(expr):            " << sizeof(expr) << "\n";
     std::cout << "sizeof(expr_cell):       " << sizeof(expr_cell) << "\n";
     std::cout << "sizeof(expr_app):        " << sizeof(expr_app) << "\n";
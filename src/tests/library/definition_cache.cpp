@@ -0,0 +1,153 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#include <cstdio>
+#include <string>
+#include "util/test.h"
+#include "util/lean_path.h"
+#include "util/init_module.h"
+#include "util/sexpr/init_module.h"
+#include "util/sexpr/options.h"
+#include "kernel/type_checker.h"
+#include "kernel/init_module.h"
+#include "library/init_module.h"
+#include "library/fingerprint.h"
+#include "library/reducible.h"
+#include "library/definition_cache.h"
+using namespace lean;
+
+static char const * g_dir = "definition_cache_tst.tmp";
+
+/* Remove the cache directory: saving a cache with capacity 0 evicts all entries. */
+static void remove_cache() {
+    if (!is_directory(g_dir))
+        return;
+    definition_cache(g_dir, 0).save();
+    std::remove(path_append(g_dir, "index").c_str());
+    std::remove(g_dir);
+}
+
+static environment add(environment const & env, declaration const & d) {
+    return env.add(check(env, d));
+}
+
+static environment mk_env(expr const & f_type) {
+    environment env;
+    expr A = mk_constant("A");
+    env = add(env, mk_constant_assumption("A", level_param_names(), mk_Type()));
+    env = add(env, mk_constant_assumption("a", level_param_names(), A));
+    env = add(env, mk_constant_assumption("f", level_param_names(), f_type));
+    env = add(env, mk_definition(env, "g", level_param_names(), A, mk_constant("a")));
+    return env;
+}
+
+static bool find(definition_cache & c, environment const & env, name const & n, expr const & pre_type,
+                 expr const & pre_value, options const & opts = options()) {
+    return static_cast<bool>(c.find(env, opts, n, pre_type, pre_value, true));
+}
+
+static void tst1() {
+    remove_cache();
+    expr A     = mk_constant("A");
+    expr a     = mk_constant("a");
+    expr f     = mk_constant("f");
+    environment env = mk_env(mk_arrow(A, A));
+    expr val   = mk_app(f, a);
+    {
+        definition_cache c(g_dir);
+        lean_assert(!find(c, env, "d", A, val));
+        c.add(env, options(), "d", A, val, level_param_names(), A, val, true);
+        lean_assert(find(c, env, "d", A, val));
+        /* auxiliary declarations of d are not available to other declarations */
+        c.add(env, options(), "e", A, a, level_param_names(), A, mk_constant(name("e", "_main")), true);
+        c.save();
+    }
+    {
+        /* A different process processing a different file: imports do not matter */
+        environment env2 = update_fingerprint(env, 42);
+        definition_cache c(g_dir);
+        auto r = c.find(env2, options(), "d", A, val, true);
+        lean_assert(r && std::get<1>(*r) == A && std::get<2>(*r) == val);
+        /* the entry can be reused by a definition with a different name */
+        lean_assert(find(c, env2, "d2", A, val));
+        lean_assert(find(c, env2, "e", A, a));
+        lean_assert(!find(c, env2, "e2", A, a));
+        /* different pre-terms */
+        lean_assert(!find(c, env2, "d", A, mk_app(f, val)));
+        /* the type of a dependency of the pre-terms changed */
+        environment env3 = mk_env(mk_arrow(A, mk_arrow(A, A)));
+        lean_assert(!find(c, env3, "d", A, val));
+        /* the reducibility attributes changed */
+        environment env4 = set_reducible(env2, "g", reducible_status::Reducible, true);
+        lean_assert(!find(c, env4, "d", A, val));
+        /* the options changed */
+        options opts = options().update(name{"class", "instance_max_depth"}, 64u);
+        lean_assert(!find(c, env2, "d", A, val, opts));
+    }
+    remove_cache();
+}
+
+static void tst2() {
+    /* least recently used entries are evicted */
+    remove_cache();
+    expr A = mk_constant("A");
+    expr a = mk_constant("a");
+    expr f = mk_constant("f");
+    environment env = mk_env(mk_arrow(A, A));
+    expr v1 = a;
+    expr v2 = mk_app(f, a);
+    expr v3 = mk_app(f, v2);
+    {
+        definition_cache c(g_dir, 2);
+        c.add(env, options(), "d1", A, v1, level_param_names(), A, v1, true);
+        c.save();
+        c.add(env, options(), "d2", A, v2, level_param_names(), A, v2, true);
+        c.save();
+        c.add(env, options(), "d3", A, v3, level_param_names(), A, v3, true);
+        c.save();
+    }
+    {
+        definition_cache c(g_dir, 2);
+        lean_assert(!find(c, env, "d1", A, v1));
+        lean_assert(find(c, env, "d2", A, v2));
+        lean_assert(find(c, env, "d3", A, v3));
+    }
+    {
+        /* using d2 makes d3 the least recently used entry */
+        definition_cache c(g_dir, 2);
+        lean_assert(find(c, env, "d2", A, v2));
+        c.save();
+    }
+    {
+        definition_cache c(g_dir, 2);
+        c.add(env, options(), "d1", A, v1, level_param_names(), A, v1, true);
+        c.save();
+    }
+    {
+        definition_cache c(g_dir, 2);
+        lean_assert(find(c, env, "d1", A, v1));
+        lean_assert(find(c, env, "d2", A, v2));
+        lean_assert(!find(c, env, "d3", A, v3));
+    }
+    remove_cache();
+}
+
+int main() {
+    save_stack_info();
+    initialize_util_module();
+    initialize_sexpr_module();
+    initialize_kernel_module();
+    initialize_library_core_module();
+    initialize_library_module();
+    tst1();
+    tst2();
+    finalize_library_module();
+    finalize_library_core_module();
+    finalize_kernel_module();
+    finalize_sexpr_module();
+    finalize_util_module();
+    return has_violations() ? 1 : 0;
+}
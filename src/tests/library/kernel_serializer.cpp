@@ -0,0 +1,97 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#include "util/test.h"
+#include "util/init_module.h"
+#include "util/sexpr/init_module.h"
+#include "kernel/abstract.h"
+#include "kernel/init_module.h"
+#include "library/init_module.h"
+#include "library/kernel_serializer.h"
+using namespace lean;
+
+static declaration_table_ptr write_read(serializer & s1, serializer & s0) {
+    write_declaration_table(s0, s1);
+    s0.write(s1.data(), s1.size());
+    deserializer d(s0.data(), s0.size());
+    return read_declaration_table(d, std::shared_ptr<mapped_file>());
+}
+
+static void tst1() {
+    expr A  = Const("A");
+    expr f  = Const("f");
+    expr a  = Const("a");
+    expr x  = Local("x", A);
+    expr big = a;
+    for (unsigned i = 0; i < 100; i++)
+        big = mk_app(f, big, x);
+    expr T1 = Pi(x, mk_app(f, big, x));
+    expr T2 = Pi(x, mk_app(f, x, big));
+    expr v  = Fun(x, big);
+    declaration d1 = mk_theorem("t1", level_param_names(), T1, v);
+    declaration d2 = mk_definition("d2", level_param_names(), T2, v, reducibility_hints::mk_regular(3));
+    declaration d3 = mk_axiom("ax", level_param_names(), T1);
+    serializer s1, s0;
+    write_lazy_declaration(s1, d1);
+    write_lazy_declaration(s1, d2);
+    write_lazy_declaration(s1, d3);
+    declaration_table_ptr t = write_read(s1, s0);
+    deserializer d(s1.data(), s1.size());
+    declaration e1 = read_lazy_declaration(d, t);
+    declaration e2 = read_lazy_declaration(d, t);
+    declaration e3 = read_lazy_declaration(d, t);
+    lean_assert(e1.is_theorem() && e2.is_definition() && !e2.is_theorem() && e3.is_axiom());
+    lean_assert(e1.get_name() == "t1" && e2.get_name() == "d2" && e3.get_name() == "ax");
+    lean_assert(e2.get_hints().get_height() == 3);
+    lean_assert(e1.get_type() == T1);
+    lean_assert(e2.get_type() == T2);
+    lean_assert(e3.get_type() == T1);
+    lean_assert(e1.get_value() == v);
+    lean_assert(e2.get_value() == v);
+    // subterms are shared between declarations
+    lean_assert(is_eqp(binding_body(e1.get_value()), binding_body(e2.get_value())));
+    lean_assert(is_eqp(app_arg(app_fn(binding_body(e1.get_type()))), binding_body(e2.get_value())));
+    // the table is indexed by name
+    lean_assert(find_declaration(t, "d2"));
+    lean_assert(!find_declaration(t, "d4"));
+    // big is stored only once
+    serializer sb;
+    sb << big;
+    lean_assert(s0.size() < 2 * sb.size());
+}
+
+static void tst2() {
+    // deep expressions are decoded without recursion
+    expr f   = Const("f");
+    expr a   = Const("a");
+    expr A   = Const("A");
+    expr big = a;
+    for (unsigned i = 0; i < 10000; i++)
+        big = mk_app(f, big, mk_constant(name("c").append_after(i)));
+    declaration d1 = mk_definition("d", level_param_names(), A, big, reducibility_hints::mk_opaque());
+    serializer s1, s0;
+    write_lazy_declaration(s1, d1);
+    declaration_table_ptr t = write_read(s1, s0);
+    declaration e1 = *find_declaration(t, "d");
+    lean_assert(e1.get_value() == big);
+}
+
+int main() {
+    save_stack_info();
+    initialize_util_module();
+    initialize_sexpr_module();
+    initialize_kernel_module();
+    initialize_library_core_module();
+    initialize_library_module();
+    tst1();
+    tst2();
+    finalize_library_module();
+    finalize_library_core_module();
+    finalize_kernel_module();
+    finalize_sexpr_module();
+    finalize_util_module();
+    return has_violations() ? 1 : 0;
+}
@@ -27,7 +27,16 @@ static void tst1() {
     lean_assert(log2(4294967295u) == 31);
 }
 
+static void tst2() {
+    lean_assert(popcount(0) == 0);
+    lean_assert(popcount(1) == 1);
+    lean_assert(popcount(255) == 8);
+    lean_assert(popcount(0x80000001u) == 2);
+    lean_assert(popcount(4294967295u) == 32);
+}
+
 int main() {
     tst1();
+    tst2();
     return has_violations() ? 1 : 0;
 }
@@ -0,0 +1,150 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "util/test.h"
+#include "util/hamt_map.h"
+#include "util/rb_map.h"
+#include "util/name_map.h"
+#include "util/timeit.h"
+#include "util/init_module.h"
+using namespace lean;
+
+struct int_hash { unsigned operator()(int i) const { return static_cast<unsigned>(i) * 2654435761u; } };
+/* Bad hash function for testing collision nodes */
+struct int_bad_hash { unsigned operator()(int i) const { return static_cast<unsigned>(i) % 3; } };
+struct int_eq { bool operator()(int i1, int i2) const { return i1 == i2; } };
+typedef hamt_map<int, int, int_hash, int_eq>     int2int;
+typedef hamt_map<int, int, int_bad_hash, int_eq> bad_int2int;
+typedef rb_map<int, int, int_cmp>                int2int_ref;
+
+template<typename M>
+static void check(M const & m, int2int_ref const & r) {
+    lean_assert_eq(m.size(), r.size());
+    r.for_each([&](int k, int v) {
+            lean_assert(m.contains(k));
+            lean_assert_eq(*m.find(k), v);
+        });
+    unsigned n = 0;
+    m.for_each([&](int k, int v) {
+            lean_assert(r.contains(k));
+            lean_assert_eq(*r.find(k), v);
+            n++;
+        });
+    lean_assert_eq(n, m.size());
+}
+
+static void tst1() {
+    int2int m;
+    lean_assert(m.empty());
+    m.insert(10, 1);
+    m.insert(20, 2);
+    int2int m2 = m;
+    m2.insert(10, 3);
+    m2.insert(30, 4);
+    lean_assert_eq(*m.find(10), 1);
+    lean_assert_eq(*m2.find(10), 3);
+    lean_assert(!m.contains(30));
+    lean_assert(m2.contains(30));
+    lean_assert_eq(m.size(), 2u);
+    lean_assert_eq(m2.size(), 3u);
+    m2.erase(20);
+    m2.erase(100);
+    lean_assert(m.contains(20));
+    lean_assert(!m2.contains(20));
+    lean_assert_eq(m2.size(), 2u);
+    lean_assert(is_eqp(m, int2int(m)));
+    lean_assert(!is_eqp(m, m2));
+    lean_assert(*m2.find_if([](int k, int) { return k > 20; }) == 4);
+}
+
+template<typename M>
+static void tst_random(unsigned n, unsigned range) {
+    std::mt19937 rng;
+    M           m;
+    int2int_ref r;
+    std::vector<M>           ms;
+    std::vector<int2int_ref> rs;
+    for (unsigned i = 0; i < n; i++) {
+        int k = rng() % range;
+        if (rng() % 3 == 0) {
+            m.erase(k);
+            r.erase(k);
+        } else {
+            m.insert(k, i);
+            r.insert(k, i);
+        }
+        if (i % 100 == 0) {
+            ms.push_back(m);
+            rs.push_back(r);
+        }
+    }
+    check(m, r);
+    /* Older versions must not be affected by updates */
+    for (unsigned i = 0; i < ms.size(); i++)
+        check(ms[i], rs[i]);
+    r.for_each([&](int k, int) { m.erase(k); });
+    lean_assert(m.empty());
+}
+
+static void tst2() {
+    tst_random<int2int>(10000, 100);
+    tst_random<int2int>(10000, 100000);
+    tst_random<bad_int2int>(2000, 100);
+}
+
+/* Compare lookup performance with rb_map on hierarchical names similar to the ones in the standard library. */
+static void tst3() {
+    std::vector<name> ns;
+    for (unsigned i = 0; i < 400; i++) {
+        name ns_name = name(name("namespace"), ("n" + std::to_string(i)).c_str());
+        for (unsigned j = 0; j < 50; j++)
+            ns.push_back(name(ns_name, ("decl_" + std::to_string(j)).c_str()));
+    }
+    name_map<unsigned>      m1;
+    name_hamt_map<unsigned> m2;
+    {
+        timeit timer(std::cout, "rb_map insert");
+        for (unsigned i = 0; i < ns.size(); i++)
+            m1 = insert(m1, ns[i], i);
+    }
+    {
+        timeit timer(std::cout, "hamt_map insert");
+        for (unsigned i = 0; i < ns.size(); i++)
+            m2 = insert(m2, ns[i], i);
+    }
+    /* Use new name objects to make sure we are not using pointer equality */
+    std::vector<name> queries;
+    for (name const & n : ns)
+        queries.push_back(name(name(n.get_prefix().get_prefix(), n.get_prefix().get_string()), n.get_string()));
+    unsigned r1 = 0, r2 = 0;
+    {
+        timeit timer(std::cout, "rb_map find");
+        for (unsigned k = 0; k < 10; k++)
+            for (name const & n : queries)
+                r1 += *m1.find(n);
+    }
+    {
+        timeit timer(std::cout, "hamt_map find");
+        for (unsigned k = 0; k < 10; k++)
+            for (name const & n : queries)
+                r2 += *m2.find(n);
+    }
+    lean_assert_eq(r1, r2);
+}
+
+int main() {
+    save_stack_info();
+    initialize_util_module();
+    tst1();
+    tst2();
+    tst3();
+    finalize_util_module();
+    return has_violations() ? 1 : 0;
+}
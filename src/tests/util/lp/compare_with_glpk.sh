@@ -41,7 +41,12 @@ filename="${filename%.*}"
 #testpath="${mps_input_file%/*}"
 testpath="/tmp"
 glpsol_output="${testpath}""/""${filename}"$prefix".out"
-lp_tst_output="${testpath}""/""${filename}"$prefix".lp_tst.out""$mpq_option"
+# the pricing of lp_tst can be set by the environment variable LP_TST_PRICING
+pricing_option=""
+if [ -n "$LP_TST_PRICING" ]; then
+    pricing_option="--pricing $LP_TST_PRICING"
+fi
+lp_tst_output="${testpath}""/""${filename}"$prefix".lp_tst.out""$mpq_option""$LP_TST_PRICING"
 lp_tst=$HOME"/projects/lean/build/release/tests/util/lp/lp_tst"
 cost_compare=$HOME"/projects/lean/build/release/tests/util/lp/double_compare"
 
@@ -87,9 +92,9 @@ get_cost_from_glpout glp_cost
 # fi
 
 if [ $# -eq 2 ] ; then
-    $lp_tst --file $mps_input_file --time_limit 60 $minmax_option > $lp_tst_output
+    $lp_tst --file $mps_input_file --time_limit 60 $minmax_option $pricing_option > $lp_tst_output
 else 
-    $lp_tst --file $mps_input_file --time_limit 12000 $minmax_option "--mpq" > $lp_tst_output
+    $lp_tst --file $mps_input_file --time_limit 12000 $minmax_option "--mpq" $pricing_option > $lp_tst_output
 fi
 status=$?
 if [ $status -ne 0 ]; then
@@ -1029,6 +1029,15 @@ void update_settings(argument_parser & args_parser, lp_settings& settings) {
     }
     if (get_int_from_args_parser("--maxng", args_parser, n))
         settings.max_number_of_iterations_with_no_improvements = n;
+    if (args_parser.option_is_used("--no_presolve"))
+        settings.presolve = false;
+    std::string pricing = args_parser.get_option_value("--pricing");
+    if (pricing.size() > 0) {
+        if (pricing_strategy_from_string(pricing, settings.pricing))
+            cout << "setting pricing to " << pricing << std::endl;
+        else
+            cout << "unknown pricing " << pricing << ", using " << pricing_strategy_to_string(settings.pricing) << std::endl;
+    }
     double d;
     if (get_double_from_args_parser("--harris_toler", args_parser, d)) {
         cout << "setting harris_feasibility_tolerance to " << d << std::endl;
@@ -1809,8 +1818,12 @@ void setup_args_parser(argument_parser & parser) {
     parser.add_option_with_help_string("--compare_with_glpk", "compares the results by running glpsol");
     parser.add_option_with_after_string_with_help("--out_dir", "setting the output directory for tests, if not set /tmp is used");
     parser.add_option_with_help_string("--dual", "using the dual simplex solver");
+    parser.add_option_with_after_string_with_help("--pricing", "the pricing of the simplex solvers: dantzig, devex or steepest_edge");
     parser.add_option_with_help_string("--compare_with_primal", "using the primal simplex solver for comparison");
     parser.add_option_with_help_string("--lar", "test lar_solver");
+    parser.add_option_with_help_string("--lar_push_pop", "test and benchmark push() and pop() of lar_solver");
+    parser.add_option_with_help_string("--presolve", "test the presolve of lp_solver");
+    parser.add_option_with_help_string("--no_presolve", "solve without the presolve");
     parser.add_option_with_after_string_with_help("--maxng", "max iterations without progress");
     parser.add_option_with_help_string("-tbq", "test binary queue");
 }
@@ -2288,6 +2301,221 @@ void test_lar_solver(argument_parser & args_parser) {
     }
 }
 
+struct lar_push_pop_problem {
+    unsigned m_vars;
+    std::vector<buffer<std::pair<mpq, var_index>>> m_rows;
+    std::vector<std::pair<lconstraint_kind, mpq>> m_bounds; // the bounds of the rows
+    std::vector<int> m_row_vals; // the values of the rows at a feasible point
+
+    lar_push_pop_problem(unsigned vars, unsigned rows): m_vars(vars) {
+        std::vector<int> x;
+        for (unsigned j = 0; j < vars; j++)
+            x.push_back(static_cast<int>(my_random() % 21) - 10);
+        for (unsigned i = 0; i < rows; i++)
+            add_row(x, 3);
+        for (unsigned i = 0; i < rows; i++) {
+            m_bounds.push_back(std::make_pair(GE, mpq(m_row_vals[i] - 5)));
+            m_bounds.push_back(std::make_pair(LE, mpq(m_row_vals[i] + 5)));
+        }
+    }
+
+    void add_row(const std::vector<int> & x, unsigned length) {
+        buffer<std::pair<mpq, var_index>> row;
+        std::set<unsigned> used;
+        int val = 0;
+        while (used.size() < length) {
+            unsigned j = my_random() % m_vars;
+            if (used.find(j) != used.end()) continue;
+            used.insert(j);
+            int a = static_cast<int>(my_random() % 9) - 4;
+            if (a == 0) a = 1;
+            row.push_back(std::make_pair(mpq(a), j));
+            val += a * x[j];
+        }
+        m_rows.push_back(row);
+        m_row_vals.push_back(val);
+    }
+
+    void add_vars(lar_solver & solver) const {
+        for (unsigned j = 0; j < m_vars; j++)
+            solver.add_var(std::string("x") + T_to_string(j));
+    }
+
+    void fill(lar_solver & solver) const {
+        add_vars(solver);
+        for (unsigned k = 0; k < m_bounds.size(); k++)
+            solver.add_constraint(m_rows[k / 2], m_bounds[k].first, m_bounds[k].second);
+    }
+};
+
+struct lar_tightening {
+    unsigned m_row;
+    lconstraint_kind m_kind;
+    mpq m_right_side;
+};
+
+lar_tightening random_tightening(const lar_push_pop_problem & p) {
+    lar_tightening t;
+    t.m_row = my_random() % p.m_rows.size();
+    t.m_kind = my_random() % 2 ? GE : LE;
+    // most of the tightenings keep the problem feasible, some do not
+    int shift = static_cast<int>(my_random() % 15) - 7;
+    t.m_right_side = mpq(p.m_row_vals[t.m_row] + shift);
+    return t;
+}
+
+void check_lar_status_and_evidence(lar_solver & solver, lp_status status) {
+    lean_assert(status == OPTIMAL || status == INFEASIBLE);
+    if (status == OPTIMAL) {
+        lean_assert(solver.all_constraints_hold());
+    } else {
+        buffer<std::pair<mpq, constraint_index>> evidence;
+        solver.get_infeasibility_evidence(evidence);
+        lean_assert(evidence.size() > 0);
+    }
+}
+
+// Solves a sequence of problems that differ from a base problem by a couple
+// of tightened bounds, once with push()/pop() on one solver and once by
+// building every problem from scratch, and compares the results and the time.
+void test_lar_push_pop(unsigned vars, unsigned rows, unsigned steps) {
+    lar_push_pop_problem p(vars, rows);
+    std::vector<std::vector<lar_tightening>> sequence;
+    for (unsigned k = 0; k < steps; k++) {
+        std::vector<lar_tightening> ts;
+        ts.push_back(random_tightening(p));
+        if (k % 2)
+            ts.push_back(random_tightening(p));
+        sequence.push_back(ts);
+    }
+    std::vector<lp_status> incremental_statuses;
+    unsigned incremental_iterations = 0;
+    int begin = get_millisecond_count();
+    lar_solver solver;
+    p.fill(solver);
+    lp_status status = solver.check();
+    lean_assert(status == OPTIMAL);
+    for (auto & ts : sequence) {
+        solver.push();
+        for (auto & t : ts)
+            solver.add_constraint(p.m_rows[t.m_row], t.m_kind, t.m_right_side);
+        status = solver.check();
+        incremental_iterations += solver.get_total_iterations();
+        check_lar_status_and_evidence(solver, status);
+        incremental_statuses.push_back(status);
+        solver.pop();
+        lean_assert(solver.get_scope_level() == 0);
+    }
+    int incremental_time = get_millisecond_span(begin);
+
+    unsigned scratch_iterations = 0;
+    begin = get_millisecond_count();
+    for (unsigned k = 0; k < sequence.size(); k++) {
+        lar_solver scratch;
+        p.fill(scratch);
+        for (auto & t : sequence[k])
+            scratch.add_constraint(p.m_rows[t.m_row], t.m_kind, t.m_right_side);
+        status = scratch.check();
+        scratch_iterations += scratch.get_total_iterations();
+        lean_assert(status == incremental_statuses[k]);
+    }
+    int scratch_time = get_millisecond_span(begin);
+    std::cout << "lar push/pop on " << steps << " problems: " << incremental_time << " ms and "
+              << incremental_iterations << " iterations incrementally, " << scratch_time << " ms and "
+              << scratch_iterations << " iterations from scratch" << std::endl;
+
+    // nested scopes adding new left sides and variables
+    solver.push();
+    var_index y = solver.add_var("y");
+    buffer<std::pair<mpq, var_index>> row = p.m_rows[0];
+    row.push_back(std::make_pair(mpq(1), y));
+    solver.add_constraint(row, EQ, mpq(p.m_row_vals[0]));
+    check_lar_status_and_evidence(solver, solver.check());
+    solver.push();
+    buffer<std::pair<mpq, var_index>> y_row;
+    y_row.push_back(std::make_pair(mpq(1), y));
+    solver.add_constraint(y_row, GE, mpq(100));
+    status = solver.check();
+    lean_assert(status == INFEASIBLE);
+    check_lar_status_and_evidence(solver, status);
+    solver.pop(2);
+    lean_assert(solver.get_scope_level() == 0);
+    status = solver.check();
+    check_lar_status_and_evidence(solver, status);
+    lean_assert(status == OPTIMAL);
+
+    solver.clear();
+    p.fill(solver);
+    status = solver.check();
+    lean_assert(status == OPTIMAL);
+}
+
+// maximize x0 + x1 + 2x2 - x3 subject to x0 + x1 <= 4, 2x0 <= 6, x0 + x1 + x2 <= 100, -x2 >= -1, -2x0 - 2x1 >= -10:
+// the second and the fourth rows are singletons, the third one is dominated, the fifth one is parallel to the first
+// and looser, and x3, x4 are not in any row
+lp_solver<double, double> * create_presolve_problem(bool dual, bool presolve, double x0_low_bound, bool add_unbounded_column) {
+    lp_solver<double, double> * solver = dual? static_cast<lp_solver<double, double>*>(new lp_dual_simplex<double, double>()) : new lp_primal_simplex<double, double>();
+    solver->settings().presolve = presolve;
+    double costs[] = {1, 1, 2, -1, 0};
+    for (unsigned j = 0; j < 5; j++) {
+        solver->set_cost_for_column(j, costs[j]);
+        solver->set_low_bound(j, 0);
+    }
+    solver->set_low_bound(0, x0_low_bound);
+    solver->set_upper_bound(1, 10);
+    solver->set_low_bound(4, 2);
+    solver->set_upper_bound(4, 5);
+    if (add_unbounded_column) {
+        solver->set_cost_for_column(5, 1);
+        solver->set_low_bound(5, 0);
+    }
+    solver->set_row_column_coefficient(0, 0, 1);
+    solver->set_row_column_coefficient(0, 1, 1);
+    solver->add_constraint(Less_or_equal, 4, 0);
+    solver->set_row_column_coefficient(1, 0, 2);
+    solver->add_constraint(Less_or_equal, 6, 1);
+    solver->set_row_column_coefficient(2, 0, 1);
+    solver->set_row_column_coefficient(2, 1, 1);
+    solver->set_row_column_coefficient(2, 2, 1);
+    solver->add_constraint(Less_or_equal, 100, 2);
+    solver->set_row_column_coefficient(3, 2, -1);
+    solver->add_constraint(Greater_or_equal, -1, 3);
+    solver->set_row_column_coefficient(4, 0, -2);
+    solver->set_row_column_coefficient(4, 1, -2);
+    solver->add_constraint(Greater_or_equal, -10, 4);
+    return solver;
+}
+
+void test_presolve() {
+    for (int dual = 0; dual < 2; dual++) {
+        for (int presolve = 0; presolve < 2; presolve++) {
+            lp_solver<double, double> * solver = create_presolve_problem(dual, presolve, 0, false);
+            solver->find_maximal_solution();
+            lean_assert(solver->get_status() == OPTIMAL);
+            lean_assert(fabs(solver->get_current_cost() - 6) < 1e-8);
+            lean_assert(fabs(solver->get_column_value(2) - 1) < 1e-8);
+            lean_assert(solver->get_column_value(0) <= 3 + 1e-8);
+            lean_assert(fabs(solver->get_column_value(3)) < 1e-8);
+            if (presolve) {
+                lean_assert(fabs(solver->get_column_value(4) - 2) < 1e-8);
+            }
+            std::cout << "presolve test: dual = " << dual << ", presolve = " << presolve << ", status " << lp_status_to_string(solver->get_status())
+                      << ", cost " << solver->get_current_cost() << std::endl;
+            delete solver;
+        }
+        // x0 >= 5 contradicts the singleton row 2x0 <= 6
+        lp_solver<double, double> * solver = create_presolve_problem(dual, true, 5, false);
+        solver->find_maximal_solution();
+        lean_assert(solver->get_status() == INFEASIBLE);
+        delete solver;
+        // x5 has a positive cost and no upper bound, and it is not in any row
+        solver = create_presolve_problem(dual, true, 0, true);
+        solver->find_maximal_solution();
+        lean_assert(solver->get_status() == UNBOUNDED);
+        delete solver;
+    }
+}
+
 void test_numeric_pair() {
     numeric_pair<mpq> a;
     numeric_pair<mpq> b(2, mpq(6, 2));
@@ -2484,6 +2712,15 @@ int main(int argn, char * const * argv) {
         test_files_from_directory(args_parser.get_option_value("--test_file_directory"), args_parser);
         return finalize(0);
     }
+    if (args_parser.option_is_used("--lar_push_pop")) {
+        test_lar_push_pop(10, 8, 20);
+        test_lar_push_pop(60, 40, 100);
+        return finalize(lean::has_violations() ? 1 : 0);
+    }
+    if (args_parser.option_is_used("--presolve")) {
+        test_presolve();
+        return finalize(lean::has_violations() ? 1 : 0);
+    }
     if (args_parser.option_is_used("--lar")){
         std::cout <<"calling test_lar_solver" << std::endl;
         test_lar_solver(args_parser);
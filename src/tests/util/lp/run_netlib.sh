@@ -3,19 +3,27 @@ failures=0
 successes=0
 inconclusive=0
 total=0
-if [ $# -eq 1 ]; then
-    mpq_option=$1
-    if [ $mpq_option != "--mpq" ]; then
-        echo "Usage: run_netlib.sh [--mpq]"
-        exit 1
-    fi
-else
-    mpq_option="none"
-    if [ $# -ne 0 ] ; then
-       echo "Too many arguments. Usage: run_netlib.sh [--mpq]"
-       exit 1
-    fi
-fi
+mpq_option="none"
+pricings="steepest_edge"
+while [ $# -ne 0 ]; do
+    case $1 in
+        --mpq)
+            mpq_option=$1
+            ;;
+        --pricing)
+            shift
+            pricings=$1
+            ;;
+        --all_pricings)
+            pricings="dantzig devex steepest_edge"
+            ;;
+        *)
+            echo "Usage: run_netlib.sh [--mpq] [--pricing dantzig|devex|steepest_edge | --all_pricings]"
+            exit 1
+            ;;
+    esac
+    shift
+done
 
 date
 
@@ -35,23 +43,48 @@ function analyze_run_result() {
     fi
 }
 
-for f in test_files/netlib/*.SIF ; do
-    let "total += 2"
-    echo "processing "$f" for minimum"
-    ./compare_with_glpk.sh --min $f
-    analyze_run_result
+# sums the iterations and the seconds reported by lp_tst in the given outputs
+function sum_iterations_and_time() {
+    cat "$@" 2>/dev/null | grep "processed in" | awk '{ time += $3; iterations += $7 } END { printf "%d %.3f", iterations, time }'
+}
 
-    echo "processing "$f" for maximum"
-    ./compare_with_glpk.sh --max $f
-    analyze_run_result
+declare -A iterations_of
+declare -A time_of
+for pricing in $pricings ; do
+    export LP_TST_PRICING=$pricing
+    echo "pricing is "$pricing
+    outputs=()
+    for f in test_files/netlib/*.SIF ; do
+        let "total += 2"
+        echo "processing "$f" for minimum"
+        ./compare_with_glpk.sh --min $f
+        analyze_run_result
 
-    if [ $mpq_option == "--mpq" ]; then
-        let "total += 1"
-        echo "processing "$f" for rationals for minimum"
-        ./compare_with_glpk.sh --min --mpq $f
+        echo "processing "$f" for maximum"
+        ./compare_with_glpk.sh --max $f
         analyze_run_result
-    fi
+
+        filename=$(basename "$f")
+        filename="${filename%.*}"
+        outputs+=("/tmp/"$filename"_min.lp_tst.out"$pricing "/tmp/"$filename"_max.lp_tst.out"$pricing)
+
+        if [ $mpq_option == "--mpq" ]; then
+            let "total += 1"
+            echo "processing "$f" for rationals for minimum"
+            ./compare_with_glpk.sh --min --mpq $f
+            analyze_run_result
+        fi
+    done
+    read iterations_of[$pricing] time_of[$pricing] <<< $(sum_iterations_and_time "${outputs[@]}")
 done
 
 echo "Total runs="$total", failures="$failures", successes="$successes", inconclusive="$inconclusive
+for pricing in $pricings ; do
+    line="pricing "$pricing": iterations="${iterations_of[$pricing]}", seconds="${time_of[$pricing]}
+    if [ -n "${iterations_of[dantzig]}" ] && [ "${iterations_of[dantzig]}" != 0 ] && [ $pricing != dantzig ]; then
+        line=$line$(awk -v i=${iterations_of[$pricing]} -v t=${time_of[$pricing]} -v i0=${iterations_of[dantzig]} -v t0=${time_of[dantzig]} \
+            'BEGIN { printf ", iterations reduced by %.1f%%", 100 * (i0 - i) / i0; if (t0 > 0) printf ", time reduced by %.1f%%", 100 * (t0 - t) / t0 }')
+    fi
+    echo $line
+done
 date
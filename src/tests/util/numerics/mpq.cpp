@@ -4,8 +4,12 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
+#include <climits>
 #include <iostream>
+#include <random>
 #include <sstream>
+#include <string>
+#include <vector>
 #include "util/test.h"
 #include "util/serializer.h"
 #include "util/numerics/mpq.h"
@@ -195,6 +199,95 @@ static void tst7() {
     lean_assert(n5 == m5);
 }
 
+static std::string to_str(mpq_t const & a) {
+    std::vector<char> buffer(mpz_sizeinbase(mpq_numref(a), 10) + mpz_sizeinbase(mpq_denref(a), 10) + 3);
+    mpq_get_str(buffer.data(), 10, a);
+    return std::string(buffer.data());
+}
+
+static void check(mpq const & a, mpq_t const & b) {
+    std::ostringstream out;
+    out << a;
+    lean_assert_eq(out.str(), to_str(b));
+    lean_assert_eq(a.get_double(), mpq_get_d(b));
+}
+
+static void tst8() {
+    // cross-check the inline representation against GMP around the long boundaries
+    std::vector<std::string> vals;
+    long nums[] = {0, 1, -1, 2, -3, 1l << 32, LONG_MAX, LONG_MAX - 1, LONG_MIN, LONG_MIN + 1};
+    long dens[] = {1, 2, 3, 6, 1l << 31, LONG_MAX};
+    for (long n : nums)
+        for (long d : dens)
+            vals.push_back(std::to_string(n) + "/" + std::to_string(d));
+    vals.push_back("9223372036854775808");
+    vals.push_back("-9223372036854775809/9223372036854775808");
+    vals.push_back("1/18446744073709551616");
+    std::mt19937 rng;
+    std::uniform_int_distribution<long> long_dist(LONG_MIN, LONG_MAX);
+    std::uniform_int_distribution<long> small_dist(1, 1000);
+    for (unsigned i = 0; i < 20; i++) {
+        vals.push_back(std::to_string(long_dist(rng)) + "/" + std::to_string(small_dist(rng)));
+        vals.push_back(std::to_string(small_dist(rng) - 500) + "/" + std::to_string(small_dist(rng)));
+    }
+    mpq_t a1, b1, r1;
+    mpq_init(a1); mpq_init(b1); mpq_init(r1);
+    for (std::string const & sa : vals) {
+        mpq_set_str(a1, sa.c_str(), 10);
+        mpq_canonicalize(a1);
+        mpq a(sa.c_str());
+        check(a, a1);
+        for (std::string const & sb : vals) {
+            mpq_set_str(b1, sb.c_str(), 10);
+            mpq_canonicalize(b1);
+            mpq b(sb.c_str());
+            lean_assert((cmp(a, b) < 0) == (mpq_cmp(a1, b1) < 0));
+            lean_assert((a == b) == (mpq_equal(a1, b1) != 0));
+            mpq_add(r1, a1, b1); check(a + b, r1);
+            mpq_sub(r1, a1, b1); check(a - b, r1);
+            mpq_mul(r1, a1, b1); check(a * b, r1);
+            if (!b.is_zero()) {
+                mpq_div(r1, a1, b1); check(a / b, r1);
+            }
+            if (b.is_integer()) {
+                mpz z = b.get_numerator();
+                lean_assert((cmp(a, z) < 0) == (mpq_cmp(a1, b1) < 0));
+                mpq_add(r1, a1, b1); check(a + z, r1);
+                mpq_sub(r1, a1, b1); check(a - z, r1);
+                mpq_mul(r1, a1, b1); check(a * z, r1);
+                if (!z.is_zero()) {
+                    mpq_div(r1, a1, b1); check(a / z, r1);
+                }
+            }
+        }
+        for (int k : {1, -1, 3, -7, INT_MAX, INT_MIN}) {
+            mpq_set_si(b1, k, 1);
+            mpq_add(r1, a1, b1); check(a + k, r1);
+            mpq_sub(r1, a1, b1); check(a - k, r1);
+            mpq_mul(r1, a1, b1); check(a * k, r1);
+            mpq_div(r1, a1, b1); check(a / k, r1);
+            lean_assert((cmp(a, k) < 0) == (mpq_cmp(a1, b1) < 0));
+        }
+        for (unsigned k : {3u, UINT_MAX}) {
+            mpq_set_ui(b1, k, 1);
+            mpq_add(r1, a1, b1); check(a + k, r1);
+            mpq_sub(r1, a1, b1); check(a - k, r1);
+            mpq_mul(r1, a1, b1); check(a * k, r1);
+            mpq_div(r1, a1, b1); check(a / k, r1);
+        }
+        mpq_neg(r1, a1); check(neg(a), r1);
+        mpq_abs(r1, a1); check(abs(a), r1);
+        if (!a.is_zero()) {
+            mpq_inv(r1, a1); check(inv(a), r1);
+        }
+        mpq_mul(r1, a1, a1); mpq_mul(r1, r1, a1); check(pow(a, 3), r1);
+        mpz f = floor(a), c = ceil(a);
+        lean_assert(f <= a && a < f + 1);
+        lean_assert(c - 1 < a && a <= c);
+    }
+    mpq_clear(a1); mpq_clear(b1); mpq_clear(r1);
+}
+
 int main() {
     tst0();
     tst1();
@@ -204,5 +297,6 @@ int main() {
     tst5();
     tst6();
     tst7();
+    tst8();
     return has_violations() ? 1 : 0;
 }
@@ -4,9 +4,13 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
+#include <climits>
 #include <iostream>
+#include <memory>
+#include <random>
 #include <sstream>
 #include <string>
+#include <vector>
 #include "util/test.h"
 #include "util/serializer.h"
 #include "util/numerics/mpz.h"
@@ -63,8 +67,108 @@ static void tst2() {
     lean_assert(n4 == m4);
 }
 
+static std::string to_str(mpz const & a) {
+    std::ostringstream out;
+    out << a;
+    return out.str();
+}
+
+static std::string to_str(mpz_t const & a) {
+    std::unique_ptr<char[]> buffer(new char[mpz_sizeinbase(a, 10) + 2]);
+    mpz_get_str(buffer.get(), 10, a);
+    return std::string(buffer.get());
+}
+
+static void check(mpz const & a, mpz_t const & b) {
+    lean_assert_eq(to_str(a), to_str(b));
+    lean_assert(a.is_long_int() == (mpz_fits_slong_p(b) != 0));
+    lean_assert_eq(cmp(a, mpz(to_str(b).c_str())), 0);
+}
+
+static void tst3() {
+    // cross-check the inline representation against GMP around the long boundaries
+    std::vector<std::string> vals;
+    long small[] = {0, 1, -1, 2, -2, 3, 7, -7, 64, 1l << 31, -(1l << 31), 1l << 32, -(1l << 32),
+                    LONG_MAX, LONG_MAX - 1, LONG_MAX / 2, LONG_MIN, LONG_MIN + 1, LONG_MIN / 2};
+    for (long v : small)
+        vals.push_back(std::to_string(v));
+    vals.push_back("9223372036854775808");   // LONG_MAX + 1
+    vals.push_back("-9223372036854775809");  // LONG_MIN - 1
+    vals.push_back("18446744073709551616");  // 2^64
+    vals.push_back("-340282366920938463463374607431768211456");
+    std::mt19937 rng;
+    std::uniform_int_distribution<long> long_dist(LONG_MIN, LONG_MAX);
+    std::uniform_int_distribution<long> small_dist(-1000, 1000);
+    for (unsigned i = 0; i < 20; i++) {
+        vals.push_back(std::to_string(long_dist(rng)));
+        vals.push_back(std::to_string(small_dist(rng)));
+    }
+    mpz_t a1, b1, r1;
+    mpz_init(a1); mpz_init(b1); mpz_init(r1);
+    for (std::string const & sa : vals) {
+        for (std::string const & sb : vals) {
+            mpz a(sa.c_str()), b(sb.c_str());
+            mpz_set_str(a1, sa.c_str(), 10);
+            mpz_set_str(b1, sb.c_str(), 10);
+            lean_assert((cmp(a, b) < 0) == (mpz_cmp(a1, b1) < 0));
+            lean_assert((a == b) == (mpz_cmp(a1, b1) == 0));
+            mpz_add(r1, a1, b1); check(a + b, r1);
+            mpz_sub(r1, a1, b1); check(a - b, r1);
+            mpz_mul(r1, a1, b1); check(a * b, r1);
+            mpz_and(r1, a1, b1); check(a & b, r1);
+            mpz_ior(r1, a1, b1); check(a | b, r1);
+            mpz_xor(r1, a1, b1); check(a ^ b, r1);
+            mpz_gcd(r1, a1, b1); check(gcd(a, b), r1);
+            mpz c(a);
+            c.addmul(a, b);
+            mpz_set(r1, a1); mpz_addmul(r1, a1, b1); check(c, r1);
+            c = b;
+            c.submul(a, b);
+            mpz_set(r1, b1); mpz_submul(r1, a1, b1); check(c, r1);
+            if (!b.is_zero()) {
+                mpz_tdiv_q(r1, a1, b1); check(a / b, r1);
+                mpz_tdiv_r(r1, a1, b1); check(rem(a, b), r1);
+            }
+        }
+        mpz a(sa.c_str());
+        mpz_set_str(a1, sa.c_str(), 10);
+        mpz_neg(r1, a1); check(neg(a), r1);
+        mpz_abs(r1, a1); check(abs(a), r1);
+        mpz_com(r1, a1); check(~a, r1);
+        mpz_add_ui(r1, a1, 1); check(a + 1, r1);
+        mpz_sub_ui(r1, a1, 1); check(a - 1, r1);
+        mpz_mul_si(r1, a1, -3); check(a * -3, r1);
+        mpz_tdiv_q_ui(r1, a1, 3); check(a / 3u, r1);
+        for (unsigned u : {3u, UINT_MAX}) {
+            mpz_add_ui(r1, a1, u); check(a + u, r1);
+            mpz_sub_ui(r1, a1, u); check(a - u, r1);
+            mpz_mul_ui(r1, a1, u); check(a * u, r1);
+            mpz_tdiv_q_ui(r1, a1, u); check(a / u, r1);
+        }
+        for (int i : {-3, INT_MAX, INT_MIN}) {
+            mpz_set_si(b1, i);
+            mpz_add(r1, a1, b1); check(a + i, r1);
+            mpz_sub(r1, a1, b1); check(a - i, r1);
+            mpz_mul(r1, a1, b1); check(a * i, r1);
+        }
+        for (unsigned k : {0u, 1u, 31u, 62u, 63u, 64u, 100u}) {
+            mpz c;
+            mul2k(c, a, k);
+            mpz_mul_2exp(r1, a1, k); check(c, r1);
+            div2k(c, a, k);
+            mpz_tdiv_q_2exp(r1, a1, k); check(c, r1);
+        }
+        if (a.is_pos())
+            lean_assert_eq(a.log2(), mpz_sizeinbase(a1, 2) - 1);
+        if (a.is_neg())
+            lean_assert_eq(a.mlog2(), mpz_sizeinbase(a1, 2) - 1);
+    }
+    mpz_clear(a1); mpz_clear(b1); mpz_clear(r1);
+}
+
 int main() {
     tst1();
     tst2();
+    tst3();
     return has_violations() ? 1 : 0;
 }
@@ -0,0 +1,92 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#include <sstream>
+#include <string>
+#include <vector>
+#include "util/test.h"
+#include "util/thread.h"
+#include "util/profiler.h"
+#include "util/init_module.h"
+using namespace lean;
+
+static void busy_wait() {
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(2)) {}
+}
+
+static bool contains(std::string const & s, std::string const & sub) {
+    return s.find(sub) != std::string::npos;
+}
+
+static void tst1() {
+    {
+        profile_scope s1("file", name("a.lean"));
+        {
+            profile_scope s2("declaration", name{"nat", "foo"});
+            for (unsigned i = 0; i < 3; i++) {
+                profile_scope s3("elaboration");
+                profile_scope s4("type class resolution");
+                {
+                    /* nested scopes of the same phase are not counted twice */
+                    profile_scope s5("type class resolution");
+                    busy_wait();
+                }
+            }
+            profile_scope s6("type checking");
+            busy_wait();
+        }
+    }
+    std::ostringstream folded;
+    display_profile_folded(folded);
+    std::cout << folded.str();
+    lean_assert(contains(folded.str(), "file a.lean;declaration nat.foo;elaboration;type class resolution;"
+                         "type class resolution "));
+    lean_assert(contains(folded.str(), "file a.lean;declaration nat.foo;type checking "));
+    std::ostringstream json;
+    display_profile_json(json);
+    std::cout << json.str();
+    lean_assert(contains(json.str(), "{\"phase\": \"type class resolution\""));
+    lean_assert(contains(json.str(), "\"count\": 6}"));
+    lean_assert(contains(json.str(), "{\"name\": \"nat.foo\""));
+    display_profile_summary(std::cout);
+}
+
+static void tst2() {
+#if defined(LEAN_MULTI_THREAD)
+    profile_context ctx;
+    {
+        profile_scope s1("file", name("b.lean"));
+        profile_scope s2("declaration", name("bar"));
+        ctx = get_profile_context();
+    }
+    lean_assert(ctx.size() == 2);
+    std::vector<thread> threads;
+    for (unsigned i = 0; i < 4; i++) {
+        threads.push_back(thread([&]() {
+                    profile_context_scope scope(ctx);
+                    profile_scope s("elaboration");
+                    busy_wait();
+                }));
+    }
+    for (auto & th : threads)
+        th.join();
+    std::ostringstream folded;
+    display_profile_folded(folded);
+    std::cout << folded.str();
+    lean_assert(contains(folded.str(), "file b.lean;declaration bar;elaboration "));
+#endif
+}
+
+int main() {
+    save_stack_info();
+    initialize_util_module();
+    enable_profiler(true);
+    tst1();
+    tst2();
+    finalize_util_module();
+    return has_violations() ? 1 : 0;
+}
@@ -6,6 +6,8 @@ Author: Leonardo de Moura
 */
 #include <iostream>
 #include <sstream>
+#include <fstream>
+#include <cstdio>
 #include <string>
 #include <cstring>
 #include <vector>
@@ -16,6 +18,7 @@ Author: Leonardo de Moura
 #include "util/debug.h"
 #include "util/list.h"
 #include "util/name.h"
+#include "util/mapped_file.h"
 #include "util/init_module.h"
 using namespace lean;
 
@@ -171,6 +174,90 @@ static void tst4() {
     lean_assert_eq(d5, o5);
 }
 
+static void tst5() {
+    char const * fname = "serializer_tst5.tmp";
+    name n1{"foo", "bla"};
+    name n2(n1, 10);
+    {
+        std::ofstream out(fname, std::ofstream::binary);
+        serializer s(out);
+        s << n1 << 300u << n2 << "hello" << n1;
+    }
+    {
+        mapped_file f(fname);
+        memory_istream in(f.data(), f.size());
+        deserializer d(in);
+        name m1, m2, m3; unsigned u; std::string str;
+        d >> m1 >> u >> m2 >> str >> m3;
+        lean_assert(n1 == m1);
+        lean_assert(u == 300);
+        lean_assert(n2 == m2);
+        lean_assert(str == "hello");
+        lean_assert(n1 == m3);
+        lean_assert(in.pos() == f.size());
+    }
+    std::remove(fname);
+}
+
+static void tst6() {
+    // LEB128 boundaries, using the buffer based serializer and the memory based deserializer
+    unsigned us[] = {0, 1, 127, 128, 255, 300, 16383, 16384, 1u << 21, (1u << 28) - 1, 1u << 28, 0xffffffffu};
+    uint64 ls[]   = {0, 127, 128, 0xffffffffull, 1ull << 35, 1ull << 63, 0xffffffffffffffffull};
+    name n1{"foo", "bla"};
+    serializer s;
+    for (unsigned u : us)
+        s << u;
+    for (uint64 l : ls)
+        s << l;
+    s << -20 << n1 << std::string(1000, 'a') << n1 << true;
+    std::ostringstream out;
+    serializer s2(out);
+    s2.write(s.data(), s.size());
+    lean_assert(out.str() == std::string(s.data(), s.size()));
+    deserializer d(s.data(), s.size());
+    for (unsigned u : us)
+        lean_assert_eq(d.read_unsigned(), u);
+    for (uint64 l : ls)
+        lean_assert_eq(d.read_uint64(), l);
+    name m1, m2; std::string str;
+    lean_assert_eq(d.read_int(), -20);
+    d >> m1 >> str >> m2;
+    lean_assert(n1 == m1);
+    lean_assert(n1 == m2);
+    lean_assert(str == std::string(1000, 'a'));
+    lean_assert(d.read_bool());
+    lean_assert_eq(d.pos(), s.size());
+    try {
+        d.read_unsigned();
+        lean_unreachable();
+    } catch (corrupted_stream_exception &) {}
+    try {
+        char const abc[3] = {'a', 'b', 'c'};
+        deserializer d2(abc, 3);
+        d2.read_string();
+        lean_unreachable();
+    } catch (corrupted_stream_exception &) {}
+}
+
+static void tst7() {
+    // a 5th LEB128 byte carrying bits beyond 32 must be rejected instead of silently truncated
+    char const overlong[5] = {'\xff', '\xff', '\xff', '\xff', '\x1f'};
+    try {
+        deserializer d(overlong, 5);
+        d.read_unsigned();
+        lean_unreachable();
+    } catch (corrupted_stream_exception &) {}
+    char const max[5] = {'\xff', '\xff', '\xff', '\xff', '\x0f'};
+    deserializer d(max, 5);
+    lean_assert(d.read_unsigned() == 0xffffffffu);
+    // writes that the stream buffer rejects must be reported by the stream
+    std::ofstream out;
+    lean_assert(out.good());
+    serializer s(out);
+    s << 1000u << "hello";
+    lean_assert(!out);
+}
+
 int main() {
     save_stack_info();
     initialize_util_module();
@@ -179,6 +266,9 @@ int main() {
     tst2();
     tst3();
     tst4();
+    tst5();
+    tst6();
+    tst7();
     finalize_util_module();
     return has_violations() ? 1 : 0;
 }
@@ -12,6 +12,7 @@ Author: Leonardo de Moura
 #include "util/shared_mutex.h"
 #include "util/interrupt.h"
 #include "util/init_module.h"
+#include "util/rc.h"
 using namespace lean;
 
 #if defined(LEAN_MULTI_THREAD) && !defined(__APPLE__)
@@ -183,6 +184,41 @@ static void tst6() {
     t1.join();
 }
 
+struct rc_cell {
+    MK_LEAN_RC();
+    void dealloc() { delete this; }
+    rc_cell():m_rc(0) {}
+};
+
+static void tst7() {
+    lean_assert(!is_rc_thread_confined());
+    thread_confined_rc_scope confined;
+    lean_assert(is_rc_thread_confined());
+    rc_cell * c = new rc_cell();
+    for (unsigned i = 0; i < 1000; i++)
+        c->inc_ref();
+    lean_assert_eq(c->get_rc(), 1000u);
+    {
+        interruptible_thread t1([&]() {
+                for (unsigned i = 0; i < 100000; i++) {
+                    c->inc_ref();
+                    c->dec_ref();
+                }
+            });
+        /* Objects may be shared with t1 until it is joined */
+        lean_assert(!is_rc_thread_confined());
+        for (unsigned i = 0; i < 100000; i++) {
+            c->inc_ref();
+            c->dec_ref();
+        }
+        t1.join();
+    }
+    lean_assert(is_rc_thread_confined());
+    lean_assert_eq(c->get_rc(), 1000u);
+    for (unsigned i = 0; i < 1000; i++)
+        c->dec_ref();
+}
+
 int main() {
     save_stack_info();
     initialize_util_module();
@@ -192,6 +228,7 @@ int main() {
     tst4();
     tst5();
     tst6();
+    tst7();
     run_thread_finalizers();
     finalize_util_module();
     run_post_thread_finalizers();
@@ -0,0 +1,283 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#pragma once
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "util/rc.h"
+#include "util/debug.h"
+#include "util/pair.h"
+#include "util/optional.h"
+#include "util/bit_tricks.h"
+
+namespace lean {
+/**
+   \brief Persistent hash array mapped trie.
+
+   It uses a O(1) copy operation. Different maps can share nodes, and the sharing is thread-safe.
+   Updates copy the (at most 8) nodes in the path to the updated key, or update them in place if they are not shared.
+
+   Each node has 32 slots indexed by 5 bits of the hash code. A slot is empty, contains an entry, or
+   contains a child node. Two bitmaps (one for entries and one for children) are used to store only the
+   non-empty slots. Keys with the same hash code are stored in a collision node at the bottom of the trie.
+
+   \c Hash must return the hash code of a key, and \c Eq must be an equality test for keys.
+   The iteration order is not specified.
+*/
+template<typename K, typename T, typename Hash, typename Eq>
+class hamt_map : private Hash, private Eq {
+public:
+    typedef pair<K, T> entry;
+private:
+    static constexpr unsigned num_bits      = 5;
+    static constexpr unsigned slot_mask     = (1u << num_bits) - 1;
+    static constexpr unsigned max_shift     = 32;
+
+    struct node_cell;
+    struct node {
+        node_cell * m_ptr;
+        node():m_ptr(nullptr) {}
+        node(node_cell * ptr):m_ptr(ptr) { if (m_ptr) ptr->inc_ref(); }
+        node(node const & s):m_ptr(s.m_ptr) { if (m_ptr) m_ptr->inc_ref(); }
+        node(node && s):m_ptr(s.m_ptr) { s.m_ptr = nullptr; }
+        ~node() { if (m_ptr) m_ptr->dec_ref(); }
+        node & operator=(node const & n) { LEAN_COPY_REF(n); }
+        node & operator=(node&& n) { LEAN_MOVE_REF(n); }
+        operator bool() const { return m_ptr != nullptr; }
+        bool is_shared() const { return m_ptr && m_ptr->get_rc() > 1; }
+        node_cell * operator->() const { lean_assert(m_ptr); return m_ptr; }
+        friend bool is_eqp(node const & n1, node const & n2) { return n1.m_ptr == n2.m_ptr; }
+        friend void swap(node & n1, node & n2) { std::swap(n1.m_ptr, n2.m_ptr); }
+        node steal() { node r; swap(r, *this); return r; }
+    };
+
+    struct leaf {
+        unsigned m_hash;
+        entry    m_entry;
+        leaf(unsigned h, entry const & e):m_hash(h), m_entry(e) {}
+    };
+
+    struct node_cell {
+        unsigned          m_leaf_bitmap;
+        unsigned          m_child_bitmap;
+        /* Remark: in collision nodes, the bitmaps are not used, and m_leaves is an unordered list of entries. */
+        std::vector<leaf> m_leaves;
+        std::vector<node> m_children;
+        MK_LEAN_RC();
+        void dealloc() { delete this; }
+        node_cell():m_leaf_bitmap(0), m_child_bitmap(0), m_rc(0) {}
+        node_cell(node_cell const & s):
+            m_leaf_bitmap(s.m_leaf_bitmap), m_child_bitmap(s.m_child_bitmap),
+            m_leaves(s.m_leaves), m_children(s.m_children), m_rc(0) {}
+    };
+
+    node     m_root;
+    unsigned m_size;
+
+    unsigned hash(K const & k) const { return Hash::operator()(k); }
+    bool eq(K const & k1, K const & k2) const { return Eq::operator()(k1, k2); }
+
+    static unsigned get_bit(unsigned h, unsigned shift) { return 1u << ((h >> shift) & slot_mask); }
+    /* Position of the slot \c bit in the compact array associated with \c bitmap */
+    static unsigned get_idx(unsigned bitmap, unsigned bit) { return popcount(bitmap & (bit - 1)); }
+
+    static node ensure_unshared(node && n) {
+        if (n.is_shared()) {
+            return node(new node_cell(*n.m_ptr));
+        } else {
+            return n;
+        }
+    }
+
+    /* Insert \c l in the trie \c n at depth \c shift. Return true if \c l.m_entry.first was not already in the map. */
+    bool insert(node & n, unsigned shift, leaf const & l) {
+        if (n)
+            n = ensure_unshared(n.steal());
+        else
+            n = node(new node_cell());
+        node_cell * c = n.m_ptr;
+        if (shift >= max_shift) {
+            for (leaf & old : c->m_leaves) {
+                if (eq(old.m_entry.first, l.m_entry.first)) {
+                    old.m_entry = l.m_entry;
+                    return false;
+                }
+            }
+            c->m_leaves.push_back(l);
+            return true;
+        }
+        unsigned bit = get_bit(l.m_hash, shift);
+        if (c->m_child_bitmap & bit) {
+            return insert(c->m_children[get_idx(c->m_child_bitmap, bit)], shift + num_bits, l);
+        } else if (c->m_leaf_bitmap & bit) {
+            unsigned i = get_idx(c->m_leaf_bitmap, bit);
+            leaf & old = c->m_leaves[i];
+            if (old.m_hash == l.m_hash && eq(old.m_entry.first, l.m_entry.first)) {
+                old.m_entry = l.m_entry;
+                return false;
+            }
+            /* Slot conflict: move the existing entry and the new one into a new child node. */
+            node child;
+            insert(child, shift + num_bits, old);
+            insert(child, shift + num_bits, l);
+            c->m_leaves.erase(c->m_leaves.begin() + i);
+            c->m_leaf_bitmap &= ~bit;
+            c->m_children.insert(c->m_children.begin() + get_idx(c->m_child_bitmap, bit), child);
+            c->m_child_bitmap |= bit;
+            return true;
+        } else {
+            c->m_leaves.insert(c->m_leaves.begin() + get_idx(c->m_leaf_bitmap, bit), l);
+            c->m_leaf_bitmap |= bit;
+            return true;
+        }
+    }
+
+    /* Remove \c k from the trie \c n at depth \c shift.
+       \pre \c k is in the trie. */
+    void erase(node & n, unsigned shift, unsigned h, K const & k) {
+        n = ensure_unshared(n.steal());
+        node_cell * c = n.m_ptr;
+        if (shift >= max_shift) {
+            for (unsigned i = 0; i < c->m_leaves.size(); i++) {
+                if (eq(c->m_leaves[i].m_entry.first, k)) {
+                    c->m_leaves.erase(c->m_leaves.begin() + i);
+                    break;
+                }
+            }
+        } else {
+            unsigned bit = get_bit(h, shift);
+            if (c->m_leaf_bitmap & bit) {
+                c->m_leaves.erase(c->m_leaves.begin() + get_idx(c->m_leaf_bitmap, bit));
+                c->m_leaf_bitmap &= ~bit;
+            } else {
+                lean_assert(c->m_child_bitmap & bit);
+                unsigned i = get_idx(c->m_child_bitmap, bit);
+                erase(c->m_children[i], shift + num_bits, h, k);
+                node_cell * child = c->m_children[i].m_ptr;
+                if (!child || (child->m_children.empty() && child->m_leaves.size() == 1)) {
+                    /* Remove the child, and move its remaining entry (if any) to this node. */
+                    if (child) {
+                        leaf l = child->m_leaves[0];
+                        c->m_leaves.insert(c->m_leaves.begin() + get_idx(c->m_leaf_bitmap, bit), l);
+                        c->m_leaf_bitmap |= bit;
+                    }
+                    c->m_children.erase(c->m_children.begin() + i);
+                    c->m_child_bitmap &= ~bit;
+                }
+            }
+        }
+        if (c->m_leaves.empty() && c->m_children.empty())
+            n = node();
+    }
+
+    template<typename F>
+    static void for_each(node_cell const * c, F && f) {
+        for (leaf const & l : c->m_leaves)
+            f(l.m_entry.first, l.m_entry.second);
+        for (node const & child : c->m_children)
+            for_each(child.m_ptr, f);
+    }
+
+    template<typename F>
+    static optional<T> find_if(node_cell const * c, F && f) {
+        for (leaf const & l : c->m_leaves) {
+            if (f(l.m_entry.first, l.m_entry.second))
+                return optional<T>(l.m_entry.second);
+        }
+        for (node const & child : c->m_children) {
+            if (auto r = find_if(child.m_ptr, f))
+                return r;
+        }
+        return optional<T>();
+    }
+
+public:
+    hamt_map(Hash const & h = Hash(), Eq const & e = Eq()):Hash(h), Eq(e), m_size(0) {}
+    hamt_map(hamt_map const & s):Hash(s), Eq(s), m_root(s.m_root), m_size(s.m_size) {}
+    hamt_map(hamt_map && s):Hash(s), Eq(s), m_root(s.m_root.steal()), m_size(s.m_size) {}
+    hamt_map & operator=(hamt_map const & s) { m_root = s.m_root; m_size = s.m_size; return *this; }
+    hamt_map & operator=(hamt_map && s) { m_root = s.m_root.steal(); m_size = s.m_size; return *this; }
+
+    friend void swap(hamt_map & a, hamt_map & b) { swap(a.m_root, b.m_root); std::swap(a.m_size, b.m_size); }
+    friend bool is_eqp(hamt_map const & m1, hamt_map const & m2) { return is_eqp(m1.m_root, m2.m_root); }
+
+    bool empty() const { return m_size == 0; }
+    unsigned size() const { return m_size; }
+    void clear() { m_root = node(); m_size = 0; }
+
+    T const * find(K const & k) const {
+        unsigned h = hash(k);
+        node_cell const * c = m_root.m_ptr;
+        unsigned shift = 0;
+        while (c) {
+            if (shift >= max_shift) {
+                for (leaf const & l : c->m_leaves) {
+                    if (eq(l.m_entry.first, k))
+                        return &l.m_entry.second;
+                }
+                return nullptr;
+            }
+            unsigned bit = get_bit(h, shift);
+            if (c->m_leaf_bitmap & bit) {
+                leaf const & l = c->m_leaves[get_idx(c->m_leaf_bitmap, bit)];
+                if (l.m_hash == h && eq(l.m_entry.first, k))
+                    return &l.m_entry.second;
+                return nullptr;
+            } else if (c->m_child_bitmap & bit) {
+                c      = c->m_children[get_idx(c->m_child_bitmap, bit)].m_ptr;
+                shift += num_bits;
+            } else {
+                return nullptr;
+            }
+        }
+        return nullptr;
+    }
+
+    bool contains(K const & k) const { return find(k) != nullptr; }
+
+    void insert(K const & k, T const & v) {
+        if (insert(m_root, 0, leaf(hash(k), mk_pair(k, v))))
+            m_size++;
+    }
+
+    void erase(K const & k) {
+        if (!contains(k))
+            return;
+        erase(m_root, 0, hash(k), k);
+        m_size--;
+    }
+
+    template<typename F>
+    void for_each(F && f) const {
+        if (m_root)
+            for_each(m_root.m_ptr, f);
+    }
+
+    template<typename F>
+    optional<T> find_if(F && f) const {
+        if (m_root)
+            return find_if(m_root.m_ptr, f);
+        return optional<T>();
+    }
+};
+template<typename K, typename T, typename H, typename E>
+hamt_map<K, T, H, E> insert(hamt_map<K, T, H, E> const & m, K const & k, T const & v) {
+    auto r = m;
+    r.insert(k, v);
+    return r;
+}
+template<typename K, typename T, typename H, typename E>
+hamt_map<K, T, H, E> erase(hamt_map<K, T, H, E> const & m, K const & k) {
+    auto r = m;
+    r.erase(k);
+    return r;
+}
+template<typename K, typename T, typename H, typename E, typename F>
+void for_each(hamt_map<K, T, H, E> const & m, F && f) {
+    return m.for_each(f);
+}
+}
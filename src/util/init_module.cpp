@@ -12,6 +12,7 @@ Author: Leonardo de Moura
 #include "util/thread.h"
 #include "util/memory_pool.h"
 #include "util/fresh_name.h"
+#include "util/profiler.h"
 
 namespace lean {
 void initialize_util_module() {
@@ -22,8 +23,10 @@ void initialize_util_module() {
     initialize_name();
     initialize_lean_path();
     initialize_fresh_name();
+    initialize_profiler();
 }
 void finalize_util_module() {
+    finalize_profiler();
     finalize_fresh_name();
     finalize_lean_path();
     finalize_name();
@@ -76,6 +76,7 @@ void interruptible_thread::request_interrupt(unsigned try_ms) {
 
 void interruptible_thread::join() {
     m_thread.join();
+    m_rc_sharing.release();
 }
 
 bool interruptible_thread::joinable() {
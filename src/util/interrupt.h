@@ -116,6 +116,8 @@ private:
       thread.
     */
     atomic_bool           m_dummy_addr;
+    /* Reference counted objects are not thread-confined until this thread is joined. */
+    rc_sharing_scope      m_rc_sharing;
     thread                m_thread;
     static atomic_bool *  get_flag_addr();
 };
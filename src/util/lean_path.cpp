@@ -40,6 +40,17 @@ bool is_directory(char const * pathname) {
     return info.st_mode & S_IFDIR;
 }
 
+bool create_directory(char const * pathname) {
+#if defined(LEAN_WINDOWS) && !defined(LEAN_CYGWIN)
+    if (CreateDirectoryA(pathname, NULL))
+        return true;
+#else
+    if (mkdir(pathname, 0777) == 0)
+        return true;
+#endif
+    return is_directory(pathname); // it may have been created by another process
+}
+
 #if defined(LEAN_WINDOWS) && !defined(LEAN_CYGWIN)
 // Windows version
 static char g_path_sep     = ';';
@@ -38,6 +38,8 @@ std::string find_file(std::string const & base, optional<unsigned> const & k, na
 
 /** \brief Return true iff fname ends with ".lean" */
 bool is_lean_file(std::string const & fname);
+/** \brief Return true iff fname ends with ".hlean" */
+bool is_hlean_file(std::string const & fname);
 /** \brief Return true iff fname ends with ".olean" */
 bool is_olean_file(std::string const & fname);
 
@@ -50,6 +52,12 @@ std::string name_to_file(name const & fname);
 */
 void display_path(std::ostream & out, std::string const & fname);
 
+/** \brief Return true iff \c pathname is an existing directory */
+bool is_directory(char const * pathname);
+/** \brief Create the directory \c pathname (its parent must exist). Return true if the directory exists
+    after the call. */
+bool create_directory(char const * pathname);
+
 std::string dirname(char const * fname);
 std::string path_append(char const * path1, char const * path2);
 
@@ -769,6 +769,33 @@ template <typename T, typename X>    void lar_core_solver<T, X>::advance_on_infe
 
 template <typename T, typename X>    void lar_core_solver<T, X>::solve() {
     prefix();
+    solve_on_current_basis();
+}
+
+template <typename T, typename X>    bool lar_core_solver<T, X>::factorization_can_be_reused() const {
+    return this->m_factorization != nullptr &&
+        this->m_factorization->get_status() == LU_status::OK &&
+        this->m_m == this->m_A.row_count() &&
+        this->m_n == this->m_A.column_count() &&
+        this->m_basis_heading.size() == this->m_n;
+}
+
+template <typename T, typename X>    void lar_core_solver<T, X>::warm_solve() {
+    if (!factorization_can_be_reused()) {
+        solve();
+        return;
+    }
+    // the matrix and the basis have not changed since the last call, only the bounds could
+    init_local();
+    solve_on_current_basis();
+}
+
+template <typename T, typename X>    void lar_core_solver<T, X>::solve_on_current_basis() {
+    this->m_status = FEASIBLE;
+    this->m_total_iterations = 0;
+    this->m_iters_with_no_cost_growing = 0;
+    m_infeasible_row.clear();
+    m_infeasible_row_sign = 0;
     if (is_empty()) {
         this->m_status = OPTIMAL;
         return;
@@ -121,6 +121,8 @@ public:
 
     void prefix();
 
+    bool factorization_can_be_reused() const;
+
     bool is_tiny() const { return this->m_m < 10 && this->m_n < 20; }
 
     bool is_empty() const { return this->m_m == 0 || this->m_n == 0; }
@@ -171,6 +173,12 @@ public:
 
     void solve();
 
+    // solves again after the bounds have changed, starting from the current
+    // basis and reusing its factorization when m_A has not changed
+    void warm_solve();
+
+    void solve_on_current_basis();
+
     bool low_bounds_are_set() const { return true; }
 
     void print_column_info(unsigned j, std::ostream & out);
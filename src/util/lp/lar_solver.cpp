@@ -36,10 +36,12 @@ canonic_left_side * lar_solver::create_or_fetch_existing_left_side(const buffer<
     auto it = m_set_of_canonic_left_sides.find(left_side);
     if (it == m_set_of_canonic_left_sides.end()) {
         m_set_of_canonic_left_sides.insert(left_side);
-        lean_assert(m_map_from_var_index_to_column_info_with_cls.find(m_available_var_index) == m_map_from_var_index_to_column_info_with_cls.end());
+        left_side->m_row_index = static_cast<unsigned>(m_canonic_left_sides.size());
+        m_canonic_left_sides.push_back(left_side);
         unsigned vj = m_available_var_index;
-        m_map_from_var_index_to_column_info_with_cls[vj] = column_info_with_cls(left_side);
-        m_map_from_var_index_to_column_info_with_cls[vj].m_column_info.set_name("_s" + T_to_string(vj));
+        column_info_with_cls ci_with_cls(left_side);
+        ci_with_cls.m_column_info.set_name("_s" + T_to_string(vj));
+        register_column(vj, ci_with_cls);
         left_side->m_additional_var_index = vj;
         m_available_var_index++;
     } else {
@@ -59,26 +61,27 @@ mpq lar_solver::find_ratio_of_original_constraint_to_normalized(canonic_left_sid
     return it->second;
 }
 
-void lar_solver::map_left_side_to_A_of_core_solver(canonic_left_side*  left_side, unsigned  j) {
-    var_index additional_var = left_side->m_additional_var_index;
-    lean_assert(valid_index(additional_var));
-    auto it = m_map_from_var_index_to_column_info_with_cls.find(additional_var);
-    lean_assert(it != m_map_from_var_index_to_column_info_with_cls.end());
-    column_info<mpq> & ci = it->second.m_column_info;
-    lean_assert(!is_valid(ci.get_column_index()));
-    lean_assert(left_side->size() > 0); // if size is zero we have an empty row
-    left_side->m_row_index = m_lar_core_solver_params.m_basis.size();
-    m_lar_core_solver_params.m_basis.push_back(j); // j will be a basis column, so we put it into the basis as well
-    lean_assert(m_map_from_column_indices_to_var_index.find(j) == m_map_from_column_indices_to_var_index.end());
-    ci.set_column_index(j);
-    m_map_from_column_indices_to_var_index[j] = additional_var;
+// the column of a variable in A is its index, so the variables surviving pop() keep their columns
+void lar_solver::register_column(var_index vi, const column_info_with_cls & ci_with_cls) {
+    lean_assert(m_map_from_var_index_to_column_info_with_cls.find(vi) == m_map_from_var_index_to_column_info_with_cls.end());
+    lean_assert(m_map_from_column_indices_to_var_index.find(vi) == m_map_from_column_indices_to_var_index.end());
+    column_info_with_cls & t = m_map_from_var_index_to_column_info_with_cls[vi] = ci_with_cls;
+    t.m_column_info.set_column_index(vi);
+    m_map_from_column_indices_to_var_index[vi] = vi;
+    m_A_is_stale = true;
 }
 
-
-void lar_solver::map_left_sides_to_A_of_core_solver() {
-    unsigned j = m_map_from_column_indices_to_var_index.size();
-    for (auto it : m_set_of_canonic_left_sides)
-        map_left_side_to_A_of_core_solver(it, j++);
+// The basis of the previous solve stays valid when rows are appended to A:
+// the additional column of a new row has -1 in this row only, so making
+// these columns basic keeps the basis matrix non-singular.
+void lar_solver::extend_basis_with_new_rows() {
+    std::vector<unsigned> & basis = m_lar_core_solver_params.m_basis;
+    lean_assert(basis.size() <= m_canonic_left_sides.size());
+    for (unsigned i = static_cast<unsigned>(basis.size()); i < m_canonic_left_sides.size(); i++) {
+        canonic_left_side * ls = m_canonic_left_sides[i];
+        lean_assert(ls->size() > 0); // if size is zero we have an empty row
+        basis.push_back(get_column_index_from_var_index(ls->m_additional_var_index));
+    }
 }
 
 // this adds a row to A
@@ -95,23 +98,15 @@ void lar_solver::fill_row_of_A(static_matrix<U, V> & A, unsigned i, canonic_left
     A.set(i, additional_column, - one_of_type<U>());
 }
 
-void lar_solver::fill_set_of_active_var_indices() {
-    for (auto & t : m_set_of_canonic_left_sides)
-        for (auto & a : t->m_coeffs)
-            m_set_of_active_var_indices.insert(a.second);
-}
-
 template <typename U, typename V>
 void lar_solver::create_matrix_A(static_matrix<U, V> & A) {
-    unsigned m = m_set_of_canonic_left_sides.size();
-    fill_set_of_active_var_indices();
-    unsigned n = m_set_of_active_var_indices.size() + m;
+    unsigned m = static_cast<unsigned>(m_canonic_left_sides.size());
+    unsigned n = static_cast<unsigned>(m_map_from_var_index_to_column_info_with_cls.size());
+    A.clear();
     A.init_empty_matrix(m, n);
-    unsigned i = 0;
-    for (auto t : m_set_of_canonic_left_sides) {
+    for (auto t : m_canonic_left_sides) {
         lean_assert(t->size() > 0);
-        if (is_valid(t->m_row_index))
-            fill_row_of_A(A, i++, t);
+        fill_row_of_A(A, t->m_row_index, t);
     }
 }
 
@@ -173,6 +168,18 @@ void lar_solver::set_low_bound_for_column_info(lar_normalized_constraint * norm_
     try_to_set_fixed(ci);
 }
 
+void lar_solver::unset_bounds_of_left_sides() {
+    for (auto ls : m_canonic_left_sides) {
+        column_info<mpq> & ci = get_column_info_from_var_index(ls->m_additional_var_index);
+        ci.unset_low_bound();
+        ci.unset_upper_bound();
+        ci.set_low_bound_strict(false);
+        ci.set_upper_bound_strict(false);
+        ci.unset_fixed();
+        ls->m_low_bound_witness = ls->m_upper_bound_witness = nullptr;
+    }
+}
+
 void lar_solver::update_column_info_of_normalized_constraint(lar_normalized_constraint & norm_constr) {
     lean_assert(norm_constr.size() > 0);
     switch (norm_constr.m_kind) {
@@ -263,6 +270,16 @@ void lar_solver::resize_and_init_x_with_signature(std::vector<V> & x, std::vecto
     }
 }
 
+// The core solver snaps the non-basic values to the bounds and recalculates
+// the basic ones. A free column has nothing to snap to, so it starts from zero.
+void lar_solver::resize_x_and_reset_free_columns(unsigned n) {
+    auto & x = m_lar_core_solver_params.m_x;
+    x.resize(n, zero_of_type<numeric_pair<mpq>>());
+    for (unsigned j = 0; j < n; j++)
+        if (m_lar_core_solver_params.m_column_types[j] == free_column)
+            x[j] = zero_of_type<numeric_pair<mpq>>();
+}
+
 template <typename V> V lar_solver::get_column_val(std::vector<V> & low_bound, std::vector<V> & upper_bound, non_basic_column_value_position pos_type, unsigned j) {
     switch (pos_type) {
     case at_low_bound: return low_bound[j];
@@ -276,11 +293,80 @@ template <typename V> V lar_solver::get_column_val(std::vector<V> & low_bound, s
 }
 
 lar_solver::~lar_solver() {
-    std::vector<canonic_left_side*> to_delete;
-    for (auto it : m_set_of_canonic_left_sides)
-        to_delete.push_back(it);
-    for (auto t : to_delete)
+    for (auto t : m_canonic_left_sides)
+        delete t;
+}
+
+void lar_solver::clear() {
+    for (auto t : m_canonic_left_sides)
         delete t;
+    m_canonic_left_sides.clear();
+    m_set_of_canonic_left_sides.clear();
+    m_available_var_index = 0;
+    m_available_constr_index = 0;
+    m_status = UNKNOWN;
+    m_var_names_to_var_index.clear();
+    m_map_from_column_indices_to_var_index.clear();
+    m_normalized_constraints.clear();
+    m_map_from_var_index_to_column_info_with_cls.clear();
+    m_infeasible_canonic_left_side = nullptr;
+    m_scopes.clear();
+    m_lar_core_solver_params.m_basis.clear();
+    m_lar_core_solver_params.m_x.clear();
+    m_A_is_stale = true;
+}
+
+void lar_solver::push() {
+    scope s;
+    s.m_var_count = m_available_var_index;
+    s.m_constr_count = m_available_constr_index;
+    s.m_left_side_count = static_cast<unsigned>(m_canonic_left_sides.size());
+    s.m_basis = m_lar_core_solver_params.m_basis;
+    m_scopes.push_back(s);
+}
+
+void lar_solver::pop_constraints(unsigned constr_count) {
+    for (constraint_index i = constr_count; i < m_available_constr_index; i++)
+        m_normalized_constraints.erase(i);
+    m_available_constr_index = constr_count;
+}
+
+void lar_solver::pop_left_sides(unsigned left_side_count) {
+    while (m_canonic_left_sides.size() > left_side_count) {
+        canonic_left_side * ls = m_canonic_left_sides.back();
+        m_canonic_left_sides.pop_back();
+        m_set_of_canonic_left_sides.erase(ls);
+        delete ls;
+    }
+}
+
+void lar_solver::pop_vars(unsigned var_count) {
+    for (var_index vi = var_count; vi < m_available_var_index; vi++) {
+        auto it = m_map_from_var_index_to_column_info_with_cls.find(vi);
+        lean_assert(it != m_map_from_var_index_to_column_info_with_cls.end());
+        auto name_it = m_var_names_to_var_index.find(it->second.m_column_info.get_name());
+        if (name_it != m_var_names_to_var_index.end() && name_it->second == vi)
+            m_var_names_to_var_index.erase(name_it);
+        m_map_from_column_indices_to_var_index.erase(it->second.m_column_info.get_column_index());
+        m_map_from_var_index_to_column_info_with_cls.erase(it);
+    }
+    m_available_var_index = var_count;
+}
+
+void lar_solver::pop(unsigned k) {
+    lean_assert(k > 0 && k <= m_scopes.size());
+    scope & s = m_scopes[m_scopes.size() - k];
+    pop_constraints(s.m_constr_count);
+    pop_left_sides(s.m_left_side_count);
+    if (m_available_var_index > s.m_var_count) {
+        pop_vars(s.m_var_count);
+        // the current basis can refer to the removed columns, the one recorded by push() cannot
+        m_lar_core_solver_params.m_basis = s.m_basis;
+        m_A_is_stale = true;
+    }
+    m_scopes.resize(m_scopes.size() - k);
+    m_status = UNKNOWN;
+    m_infeasible_canonic_left_side = nullptr;
 }
 
 var_index lar_solver::add_var(std::string s) {
@@ -288,10 +374,9 @@ var_index lar_solver::add_var(std::string s) {
     if (it != m_var_names_to_var_index.end())
         return it->second;
     var_index i = m_available_var_index++;
-    lean_assert(m_map_from_var_index_to_column_info_with_cls.find(i) == m_map_from_var_index_to_column_info_with_cls.end());
     auto ci_with_cls = column_info_with_cls();
     ci_with_cls.m_column_info.set_name(s);
-    m_map_from_var_index_to_column_info_with_cls[i] = ci_with_cls;
+    register_column(i, ci_with_cls);
     m_var_names_to_var_index[s] = i;
     return i;
 }
@@ -423,6 +508,7 @@ bool lar_solver::the_evidence_is_correct() {
 }
 #endif
 void lar_solver::update_column_info_of_normalized_constraints() {
+    unset_bounds_of_left_sides();
     for (auto & it : m_normalized_constraints)
         update_column_info_of_normalized_constraint(it.second);
 }
@@ -437,22 +523,13 @@ mpq lar_solver::sum_of_right_sides_of_evidence(const buffer<std::pair<mpq, unsig
     }
     return ret;
 }
-// do not touch additional vars here
-void lar_solver::map_var_indices_to_columns_of_A() {
-    int i = 0;
-    for (auto & it : m_map_from_var_index_to_column_info_with_cls) {
-        if (it.second.m_canonic_left_side != nullptr) continue;
-        lean_assert(m_map_from_column_indices_to_var_index.find(i) == m_map_from_column_indices_to_var_index.end());
-        it.second.m_column_info.set_column_index(i);
-        m_map_from_column_indices_to_var_index[i] = it.first;
-        i++;
-    }
-}
 void lar_solver::prepare_independently_of_numeric_type() {
+    m_status = UNKNOWN;
+    m_infeasible_canonic_left_side = nullptr;
     update_column_info_of_normalized_constraints();
-    map_var_indices_to_columns_of_A();
-    map_left_sides_to_A_of_core_solver();
-    fill_column_names();
+    extend_basis_with_new_rows();
+    if (m_A_is_stale)
+        fill_column_names();
     fill_column_types();
 }
 
@@ -527,8 +604,40 @@ void lar_solver::solve_on_signature(const lar_solution_signature & signature) {
     solve_with_core_solver();
 }
 
+// After push()/pop() or new constraints the basis of the previous solve is
+// usually close to a feasible one: start the simplex from it, and when A has
+// not changed keep its LU factorization as well.
+void lar_solver::solve_on_previous_basis() {
+    auto & p = m_lar_core_solver_params;
+    if (m_A_is_stale) {
+        create_matrix_A(p.m_A);
+        fill_bounds_for_core_solver(p.m_low_bounds, p.m_upper_bounds);
+        resize_x_and_reset_free_columns(p.m_A.column_count());
+        m_A_is_stale = false;
+        m_mpq_lar_core_solver.solve();
+    } else {
+        fill_bounds_for_core_solver(p.m_low_bounds, p.m_upper_bounds);
+        resize_x_and_reset_free_columns(p.m_A.column_count());
+        m_mpq_lar_core_solver.warm_solve();
+    }
+    m_status = m_mpq_lar_core_solver.m_status;
+    lean_assert(m_status != OPTIMAL  || all_constraints_hold());
+#ifdef LEAN_DEBUG
+    lean_assert(!settings().row_feasibility || m_status != INFEASIBLE || the_evidence_is_correct());
+#endif
+}
+
 void lar_solver::solve() {
+    // the double solver only helps to find the first basis
+    bool has_previous_basis = !m_lar_core_solver_params.m_basis.empty();
     prepare_independently_of_numeric_type();
+    if (m_status == INFEASIBLE)
+        return; // the bounds of a left side contradict each other
+    if (has_previous_basis) {
+        solve_on_previous_basis();
+        return;
+    }
+    m_A_is_stale = false;
     if (m_lar_core_solver_params.m_settings.use_double_solver_for_lar) {
         lar_solution_signature solution_signature;
         find_solution_signature_with_doubles(solution_signature);
@@ -546,6 +655,10 @@ lp_status lar_solver::check() {
     return m_status;
 }
 void lar_solver::get_infeasibility_evidence(buffer<std::pair<mpq, constraint_index>> & evidence){
+    if (m_infeasible_canonic_left_side != nullptr) {
+        get_infeasibility_evidence_for_conflicting_bounds(evidence);
+        return;
+    }
     if (!m_mpq_lar_core_solver.get_infeasible_row_sign()) {
         return;
     }
@@ -556,6 +669,15 @@ void lar_solver::get_infeasibility_evidence(buffer<std::pair<mpq, constraint_ind
     get_infeasibility_evidence_for_inf_sign(evidence, inf_row, inf_sign);
 }
 
+// the upper bound of the left side is below its low bound: ls <= u minus ls >= l gives 0 <= u - l < 0
+void lar_solver::get_infeasibility_evidence_for_conflicting_bounds(buffer<std::pair<mpq, constraint_index>> & evidence) {
+    lar_normalized_constraint * upper = m_infeasible_canonic_left_side->m_upper_bound_witness;
+    lar_normalized_constraint * low = m_infeasible_canonic_left_side->m_low_bound_witness;
+    lean_assert(upper != nullptr && low != nullptr);
+    evidence.push_back(std::make_pair(one_of_type<mpq>() / upper->m_ratio_to_original, upper->m_index));
+    evidence.push_back(std::make_pair(- one_of_type<mpq>() / low->m_ratio_to_original, low->m_index));
+}
+
 void lar_solver::get_infeasibility_evidence_for_inf_sign(buffer<std::pair<mpq, constraint_index>> & evidence,
                                                          const std::vector<std::pair<mpq, unsigned>> & inf_row,
                                                          int inf_sign) {
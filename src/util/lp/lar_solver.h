@@ -48,27 +48,36 @@ struct conversion_helper <double> {
 };
 
 class lar_solver {
+    // the state recorded by push() and restored by pop()
+    struct scope {
+        unsigned m_var_count;
+        unsigned m_constr_count;
+        unsigned m_left_side_count;
+        std::vector<unsigned> m_basis;
+    };
     unsigned m_available_var_index = 0;
     unsigned m_available_constr_index = 0;
     lp_status m_status = UNKNOWN;
-    std::unordered_set<var_index> m_set_of_active_var_indices; // a variable is active if it is referenced in a left side
     std::unordered_map<std::string, var_index> m_var_names_to_var_index;
     std::unordered_set<canonic_left_side*, hash_and_equal_of_canonic_left_side_struct, hash_and_equal_of_canonic_left_side_struct> m_set_of_canonic_left_sides;
+    std::vector<canonic_left_side*> m_canonic_left_sides; // the i-th left side defines the i-th row of A
     std::unordered_map<unsigned, var_index> m_map_from_column_indices_to_var_index;
     std::unordered_map<constraint_index, lar_normalized_constraint> m_normalized_constraints;
     std::unordered_map<var_index, column_info_with_cls> m_map_from_var_index_to_column_info_with_cls;
     lar_core_solver_parameter_struct<mpq, numeric_pair<mpq>> m_lar_core_solver_params;
     lar_core_solver<mpq, numeric_pair<mpq>> m_mpq_lar_core_solver;
     canonic_left_side * m_infeasible_canonic_left_side = nullptr; // such can be found at the initialization step
+    std::vector<scope> m_scopes;
+    bool m_A_is_stale = true; // rows or columns were added or removed since A was built
     canonic_left_side * create_or_fetch_existing_left_side(const buffer<std::pair<mpq, var_index>>& left_side_par);
 
     mpq find_ratio_of_original_constraint_to_normalized(canonic_left_side * ls, const lar_constraint & constraint);
 
     void add_canonic_left_side_for_var(var_index i, std::string var_name);
 
-    void map_left_side_to_A_of_core_solver(canonic_left_side*  left_side, var_index vj);
+    void register_column(var_index vi, const column_info_with_cls & ci_with_cls);
 
-    void map_left_sides_to_A_of_core_solver();
+    void extend_basis_with_new_rows();
 
     bool valid_index(unsigned j) { return static_cast<int>(j) >= 0;}
 
@@ -101,6 +110,8 @@ class lar_solver {
 
     void update_column_info_of_normalized_constraint(lar_normalized_constraint & norm_constr);
 
+    void unset_bounds_of_left_sides();
+
     column_type get_column_type(column_info<mpq> & ci);
 
     void fill_column_names();
@@ -119,20 +130,31 @@ class lar_solver {
                                           std::vector<V> & upper_bound, const lar_solution_signature & signature);
 
     template <typename V> V get_column_val(std::vector<V> & low_bound, std::vector<V> & upper_bound, non_basic_column_value_position pos_type, unsigned j);
-    void map_var_indices_to_columns_of_A();
+
+    void resize_x_and_reset_free_columns(unsigned n);
+
+    void pop_constraints(unsigned constr_count);
+    void pop_left_sides(unsigned left_side_count);
+    void pop_vars(unsigned var_count);
 
     void register_in_map(std::unordered_map<var_index, mpq> & coeffs, lar_constraint & cn, const mpq & a);
     unsigned get_column_index_from_var_index(var_index vi) const;
     column_info<mpq> & get_column_info_from_var_index(var_index vi);
-    void fill_set_of_active_var_indices();
 
 public:
     ~lar_solver();
 
     lp_settings & settings() { return m_lar_core_solver_params.m_settings;}
 
-    void clear() {lean_assert(false); // not implemented
-    }
+    void clear();
+
+    // push() records the current set of variables and constraints, pop(k)
+    // retracts everything added since the k-th most recent push()
+    void push();
+
+    void pop(unsigned k = 1);
+
+    unsigned get_scope_level() const { return static_cast<unsigned>(m_scopes.size()); }
 
     lar_solver() : m_mpq_lar_core_solver(m_lar_core_solver_params.m_x,
                                      m_lar_core_solver_params.m_column_types,
@@ -187,11 +209,15 @@ public:
 
     void solve_on_signature(const lar_solution_signature & signature);
 
+    void solve_on_previous_basis();
+
     void solve();
 
     lp_status check();
     void get_infeasibility_evidence(buffer<std::pair<mpq, constraint_index>> & evidence);
 
+    void get_infeasibility_evidence_for_conflicting_bounds(buffer<std::pair<mpq, constraint_index>> & evidence);
+
     void get_infeasibility_evidence_for_inf_sign(buffer<std::pair<mpq, constraint_index>> & evidence,
                                                  const std::vector<std::pair<mpq, unsigned>> & inf_row,
                                                  int inf_sign);
@@ -34,7 +34,9 @@ lp_dual_core_solver<T, X>::lp_dual_core_solver(static_matrix<T, X> & A,
                               upper_bound_values),
     m_can_enter_basis(can_enter_basis),
     m_a_wave(this->m_m),
-    m_betas(this->m_m) {
+    m_betas(this->m_m),
+    m_pricing(settings.pricing),
+    m_degenerate_iterations(0) {
     m_harris_tolerance = numeric_traits<T>::precise()? numeric_traits<T>::zero() : T(this->m_settings.harris_feasibility_tolerance);
     this->solve_yB(this->m_y);
     init_basic_part_of_basis_heading(this->m_basis, this->m_m, this->m_basis_heading);
@@ -247,7 +249,8 @@ template <typename T, typename X> bool lp_dual_core_solver<T, X>::advance_on_kno
     if (!ratio_test()) {
         return true;
     }
-    calculate_beta_r_precisely();
+    if (m_pricing == steepest_edge_pricing)
+        calculate_beta_r_precisely();
     this->solve_Bd(m_q); // FTRAN
     int pivot_compare_result = this->pivots_in_column_and_row_are_different(m_q, m_p);
     if (!pivot_compare_result){;}
@@ -257,7 +260,8 @@ template <typename T, typename X> bool lp_dual_core_solver<T, X>::advance_on_kno
         lean_assert(pivot_compare_result == 1);
         this->init_lu();
     }
-    DSE_FTran();
+    if (m_pricing == steepest_edge_pricing)
+        DSE_FTran();
     return basis_change_and_update();
 }
 
@@ -343,7 +347,7 @@ template <typename T, typename X> T lp_dual_core_solver<T, X>::get_delta() {
         lean_unreachable();
     case upper_bound:
         if (this->x_above_upper_bound(m_p)) {
-            return get_edge_steepness_for_upper_bound(m_p);
+            return this->m_x[m_p] - this->m_upper_bound_values[m_p];
         }
         lean_unreachable();
     case fixed:
@@ -382,7 +386,52 @@ template <typename T, typename X> void lp_dual_core_solver<T, X>::xb_minus_delta
     }
 }
 
-template <typename T, typename X> void lp_dual_core_solver<T, X>::update_betas() { // page 194 of Progress ... todo - once in a while betas have to be reinitialized
+template <typename T, typename X> void lp_dual_core_solver<T, X>::update_betas() {
+    switch (m_pricing) {
+    case dantzig_pricing:
+        break; // the betas stay equal to one
+    case devex_pricing:
+        update_devex_betas();
+        break;
+    case steepest_edge_pricing:
+        update_steepest_edge_betas();
+        break;
+    default:
+        lean_unreachable();
+    }
+}
+
+// the dual devex reference weights, see page 196 of Progress ...
+// they need only the column of the entering variable which is already in m_ed
+template <typename T, typename X> void lp_dual_core_solver<T, X>::update_devex_betas() {
+    T one_over_arq = numeric_traits<T>::one() / this->m_pivot_row[m_q];
+    T beta_r = (m_betas[m_r] * one_over_arq) * one_over_arq;
+    if (beta_r > T(this->m_settings.devex_weight_reset_threshold)) { // the reference framework has gone stale
+        init_betas();
+        return;
+    }
+    unsigned i = this->m_m;
+    while (i--) {
+        if (static_cast<int>(i) == m_r) continue;
+        T a = this->m_ed[i];
+        if (is_zero(a)) continue;
+        T b = a * a * beta_r;
+        if (m_betas[i] < b)
+            m_betas[i] = b;
+    }
+    m_betas[m_r] = std::max(beta_r, numeric_traits<T>::one());
+}
+
+// Dantzig and devex weights do not guide the dual out of a long run of degenerate iterations.
+// On acc-tight5, where every iteration is degenerate, they never reduce the primal infeasibility.
+// So we fall back to the steepest edge weights, which we compute precisely from the current basis.
+template <typename T, typename X> void lp_dual_core_solver<T, X>::switch_to_steepest_edge_pricing() {
+    m_pricing = steepest_edge_pricing;
+    init_betas_precisely();
+    m_degenerate_iterations = 0;
+}
+
+template <typename T, typename X> void lp_dual_core_solver<T, X>::update_steepest_edge_betas() { // page 194 of Progress ... todo - once in a while betas have to be reinitialized
     T one_over_arq = numeric_traits<T>::one() / this->m_pivot_row[m_q];
     T beta_r = this->m_betas[m_r] = std::max(T(0.0001), (m_betas[m_r] * one_over_arq) *  one_over_arq);
     T k = -2 * one_over_arq;
@@ -450,6 +499,10 @@ template <typename T, typename X> void lp_dual_core_solver<T, X>::init_beta_prec
 }
 
 template <typename T, typename X> void lp_dual_core_solver<T, X>::init_betas_precisely() {
+    if (m_pricing != steepest_edge_pricing) {
+        init_betas(); // the reference framework is reset
+        return;
+    }
     unsigned i = this->m_m;
     while (i--) {
         init_beta_precisely(i);
@@ -484,6 +537,10 @@ template <typename T, typename X> bool lp_dual_core_solver<T, X>::basis_change_a
         return false;
     }
 
+    if (this->m_settings.abs_val_is_smaller_than_zero_tolerance(m_theta_D))
+        m_degenerate_iterations++;
+    else
+        m_degenerate_iterations = 0;
     lean_assert(d_is_correct());
     return true;
 }
@@ -763,6 +820,9 @@ template <typename T, typename X> void lp_dual_core_solver<T, X>::one_iteration(
     } else {
         this->m_status = FEASIBLE;
     }
+    if (m_pricing != steepest_edge_pricing &&
+        m_degenerate_iterations > this->m_settings.max_number_of_degenerate_dual_iterations_before_steepest_edge)
+        switch_to_steepest_edge_pricing();
     pricing_loop(number_of_rows_to_try, offset_in_rows);
     lean_assert(problem_is_dual_feasible());
 }
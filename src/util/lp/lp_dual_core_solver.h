@@ -33,6 +33,8 @@ public:
     std::vector<T> m_betas; // m_betas[i] is approximately a square of the norm of the i-th row of the reverse of B
     T m_harris_tolerance;
     std::set<unsigned> m_forbidden_rows;
+    pricing_strategy m_pricing; // starts as m_settings.pricing, and can fall back to steepest edge
+    unsigned m_degenerate_iterations; // the number of consecutive iterations that did not change the dual objective
     lp_dual_core_solver(static_matrix<T, X> & A,
                         std::vector<bool> & can_enter_basis,
                         std::vector<X> & b, // the right side std::vector
@@ -94,6 +96,12 @@ public:
 
     void update_betas();
 
+    void update_devex_betas();
+
+    void update_steepest_edge_betas();
+
+    void switch_to_steepest_edge_pricing();
+
     void apply_flips();
 
     void snap_xN_column_to_bounds(unsigned j);
@@ -332,12 +332,16 @@ template <typename T, typename X> void lp_dual_simplex<T, X>::find_maximal_solut
         return;
     }
 
-    this->flip_costs(); // do it for now, todo ( remove the flipping)
-
-    this->cleanup();
+    this->cleanup(); // before the flipping, since the presolve relies on maximizing the costs
     if (this->m_status == INFEASIBLE) {
         return;
     }
+    this->flip_costs(); // do it for now, todo ( remove the flipping)
+    if (this->problem_is_empty()) { // the presolve has removed all rows
+        this->m_status = OPTIMAL;
+        this->postsolve();
+        return;
+    }
     this->fill_matrix_A_and_init_right_side();
     this->fill_m_b();
     this->scale();
@@ -349,6 +353,7 @@ template <typename T, typename X> void lp_dual_simplex<T, X>::find_maximal_solut
     if (this->m_status == FEASIBLE) {
         stage2();
     }
+    this->postsolve();
 }
 
 
@@ -478,7 +478,8 @@ template <typename T, typename X>void lp_primal_core_solver<T, X>::advance_on_en
         lean_assert(pivot_compare_result == 1);
         this->init_lu();
     }
-    calc_working_vector_beta_for_column_norms();
+    if (this->m_settings.pricing == steepest_edge_pricing)
+        calc_working_vector_beta_for_column_norms();
     if (!this->update_basis_and_x(entering, leaving, t * m_sign_of_entering_delta)) {
         if (this->m_status == FLOATING_POINT_ERROR)
             return;
@@ -658,13 +659,37 @@ template <typename T, typename X>    T lp_primal_core_solver<T, X>::calculate_co
 }
 
 template <typename T, typename X>    void lp_primal_core_solver<T, X>::update_or_init_column_norms(unsigned entering, unsigned leaving) {
+    if (this->m_settings.pricing == dantzig_pricing)
+        return; // all norms stay equal to one
     if (++m_column_norm_update_counter == this->m_settings.column_norms_update_frequency) {
         init_column_norms();
+    } else if (this->m_settings.pricing == devex_pricing) {
+        update_devex_weights(entering, leaving);
     } else {
         update_column_norms(entering, leaving);
     }
 }
 
+// the devex reference weights of Forrest and Goldfarb, see Achim Koberstein dissertation, section 8.1.
+// Unlike update_column_norms() it needs only the pivot row, and no additional solve with B
+template <typename T, typename X>    void lp_primal_core_solver<T, X>::update_devex_weights(unsigned entering, unsigned leaving) {
+    T pivot = this->m_pivot_row[entering];
+    T w_ent = this->m_column_norms[entering] / pivot / pivot;
+    if (w_ent > T(this->m_settings.devex_weight_reset_threshold)) { // the reference framework has gone stale
+        init_column_norms();
+        return;
+    }
+    for (unsigned j : this->m_pivot_row_index) {
+        if (j == leaving || j == entering)
+            continue;
+        const T & t = this->m_pivot_row[j];
+        T w = t * t * w_ent;
+        if (this->m_column_norms[j] < w)
+            this->m_column_norms[j] = w;
+    }
+    this->m_column_norms[leaving] = std::max(w_ent, numeric_traits<T>::one());
+}
+
 // following Swietanowski - A new steepest ...
 template <typename T, typename X>    void lp_primal_core_solver<T, X>::update_column_norms(unsigned entering, unsigned leaving) {
     T pivot = this->m_pivot_row[entering];
@@ -184,6 +184,8 @@ public:
     // following Swietanowski - A new steepest ...
     void update_column_norms(unsigned entering, unsigned leaving);
 
+    void update_devex_weights(unsigned entering, unsigned leaving);
+
     T calculate_norm_of_entering_exactly();
 
     // calling it stage1 is too cryptic
@@ -170,10 +170,10 @@ template <typename T, typename X> void lp_primal_simplex<T, X>::find_maximal_sol
     }
 
     this->cleanup();
-    this->fill_matrix_A_and_init_right_side();
     if (this->m_status == lp_status::INFEASIBLE) {
         return;
     }
+    this->fill_matrix_A_and_init_right_side();
     this->m_x.resize(this->m_A->column_count());
     this->fill_m_b();
     this->scale();
@@ -182,6 +182,7 @@ template <typename T, typename X> void lp_primal_simplex<T, X>::find_maximal_sol
     set_core_solver_bounds();
     update_time_limit_from_starting_time(preprocessing_start_time);
     solve_with_total_inf();
+    this->postsolve();
 }
 
 template <typename T, typename X> void lp_primal_simplex<T, X>::fill_A_x_and_basis_for_stage_one_total_inf() {
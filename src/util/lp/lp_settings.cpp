@@ -60,6 +60,24 @@ lp_status lp_status_from_string(std::string status) {
     lean_unreachable();
     return lp_status::UNKNOWN; // it is unreachable
 }
+std::string pricing_strategy_to_string(pricing_strategy p) {
+    switch (p) {
+    case dantzig_pricing: return "dantzig";
+    case devex_pricing: return "devex";
+    case steepest_edge_pricing: return "steepest_edge";
+    default:
+        lean_unreachable();
+    }
+    return "unknown"; // it is unreachable
+}
+
+bool pricing_strategy_from_string(std::string const & s, pricing_strategy & p) {
+    if (s == "dantzig") { p = dantzig_pricing; return true; }
+    if (s == "devex") { p = devex_pricing; return true; }
+    if (s == "steepest_edge") { p = steepest_edge_pricing; return true; }
+    return false;
+}
+
 int get_millisecond_count() {
     timeb tb;
     ftime(&tb);
@@ -45,6 +45,17 @@ const char* lp_status_to_string(lp_status status);
 
 lp_status lp_status_from_string(std::string status);
 
+// the rule for choosing the entering column in the primal simplex and the leaving row in the dual one
+enum pricing_strategy {
+    dantzig_pricing,       // the largest reduced cost or infeasibility
+    devex_pricing,         // scaled by the devex reference weights of Forrest and Goldfarb
+    steepest_edge_pricing  // scaled by the updated norms of the edges
+};
+
+std::string pricing_strategy_to_string(pricing_strategy p);
+
+bool pricing_strategy_from_string(std::string const & s, pricing_strategy & p);
+
 enum non_basic_column_value_position { at_low_bound, at_upper_bound, at_fixed, free_of_bounds };
 
 template <typename X> bool is_epsilon_small(const X & v, const double& eps);    // forward definition
@@ -72,6 +83,7 @@ struct lp_settings {
 
     unsigned percent_of_entering_to_check = 5; // we try to find a profitable column in a percentage of the columns
     bool use_scaling = true;
+    bool presolve = true; // turns singleton rows into bounds, drops dominated rows and pins the columns that are left without rows
     double scaling_maximum = 1;
     double scaling_minimum = 0.5;
     double harris_feasibility_tolerance = 1e-7; // page 179 of Istvan Maros
@@ -146,6 +158,10 @@ struct lp_settings {
     int report_frequency = 1000;
     bool print_statistics = false;
     unsigned column_norms_update_frequency = 1000;
+    pricing_strategy pricing = steepest_edge_pricing;
+    double devex_weight_reset_threshold = 1e6; // the devex reference framework is restarted when a weight grows above it
+    // the dual core solver switches from dantzig or devex pricing to steepest edge after this many consecutive degenerate iterations
+    unsigned max_number_of_degenerate_dual_iterations_before_steepest_edge = 1000;
     bool scale_with_ratio = true;
     double density_threshold = 0.7; // need to tune it up, todo
 #ifdef LEAN_DEBUG
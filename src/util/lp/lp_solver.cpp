@@ -7,6 +7,9 @@
 #include <string>
 #include <algorithm>
 #include <vector>
+#include <map>
+#include <utility>
+#include <unordered_set>
 #include "util/lp/lp_solver.h"
 namespace lean {
 template <typename T, typename X> column_info<T> * lp_solver<T, X>::get_or_create_column_info(unsigned column) {
@@ -248,7 +251,7 @@ template <typename T, typename X>    bool lp_solver<T, X>::row_e_is_obsolete(std
         }
     }
 
-    return false;
+    return row_is_singleton(row, row_index);
 }
 
 template <typename T, typename X>  bool lp_solver<T, X>::row_ge_is_obsolete(std::unordered_map<unsigned, T> & row, unsigned row_index) {
@@ -273,7 +276,12 @@ template <typename T, typename X>  bool lp_solver<T, X>::row_ge_is_obsolete(std:
         }
     }
 
-    return false;
+    T low_bound;
+    if (m_settings.presolve && get_minimal_row_value(row, low_bound) && val_is_smaller_than_eps(rs - low_bound, m_settings.refactor_tolerance)) {
+        return true; // the row is dominated by the bounds of its columns
+    }
+
+    return row_is_singleton(row, row_index);
 }
 
 template <typename T, typename X> bool lp_solver<T, X>::row_le_is_obsolete(std::unordered_map<unsigned, T> & row, unsigned row_index) {
@@ -298,7 +306,60 @@ template <typename T, typename X> bool lp_solver<T, X>::row_le_is_obsolete(std::
         }
     }
 
-    return false;
+    T upper_bound;
+    if (m_settings.presolve && get_maximal_row_value(row, upper_bound) && val_is_smaller_than_eps(upper_bound - rs, m_settings.refactor_tolerance)) {
+        return true; // the row is dominated by the bounds of its columns
+    }
+
+    return row_is_singleton(row, row_index);
+}
+
+template <typename T, typename X> bool lp_solver<T, X>::row_is_singleton(std::unordered_map<unsigned, T> & row, unsigned row_index) {
+    if (!m_settings.presolve || row.size() != 1)
+        return false;
+    unsigned j = row.begin()->first;
+    T a = row.begin()->second;
+    column_info<T> * ci = m_columns[j];
+    if (ci->is_fixed())
+        return false; // remove_fixed_or_zero_columns() takes care of it
+    auto & constraint = m_constraints[row_index];
+    T bound = constraint.m_rs / a;
+    switch (constraint.m_relation) {
+    case Equal:
+        if ((ci->low_bound_is_set() && !val_is_smaller_than_eps(ci->get_low_bound() - bound, m_settings.refactor_tolerance)) ||
+            (ci->upper_bound_is_set() && !val_is_smaller_than_eps(bound - ci->get_upper_bound(), m_settings.refactor_tolerance))) {
+            m_status = INFEASIBLE;
+            return true;
+        }
+        ci->set_fixed_value(bound);
+        return true;
+    case Greater_or_equal:
+    case Less_or_equal:
+        if ((a > numeric_traits<T>::zero()) == (constraint.m_relation == Less_or_equal)) {
+            if (!ci->upper_bound_is_set() || bound < ci->get_upper_bound())
+                ci->set_upper_bound(bound);
+        } else {
+            if (!ci->low_bound_is_set() || bound > ci->get_low_bound())
+                ci->set_low_bound(bound);
+        }
+        if (!column_bounds_are_consistent(ci))
+            m_status = INFEASIBLE;
+        return true;
+    }
+    lean_unreachable();
+    return false; // it is unreachable
+}
+
+// fixes the column if its bounds meet
+template <typename T, typename X> bool lp_solver<T, X>::column_bounds_are_consistent(column_info<T> * ci) {
+    if (!ci->low_bound_is_set() || !ci->upper_bound_is_set())
+        return true;
+    T diff = ci->get_low_bound() - ci->get_upper_bound();
+    if (!val_is_smaller_than_eps(diff, m_settings.refactor_tolerance))
+        return false;
+    if (val_is_smaller_than_eps(-diff, m_settings.refactor_tolerance))
+        ci->set_fixed_value(ci->get_low_bound());
+    return true;
 }
 
 // analyse possible max and min values that are derived from var boundaries
@@ -372,16 +433,113 @@ template <typename T, typename X> unsigned lp_solver<T, X>::try_to_remove_some_r
     return static_cast<unsigned>(rows_to_delete.size());
 }
 
+template <typename T, typename X> int lp_solver<T, X>::choose_parallel_row_to_remove(unsigned k, T const & lead_k, unsigned i, T const & lead_i) {
+    lp_relation rel_k = relation_after_division(m_constraints[k].m_relation, lead_k);
+    lp_relation rel_i = relation_after_division(m_constraints[i].m_relation, lead_i);
+    T rs_k = m_constraints[k].m_rs / lead_k;
+    T rs_i = m_constraints[i].m_rs / lead_i;
+    if (rel_k == Equal || rel_i == Equal) {
+        // the equality implies the other row, or they contradict each other
+        bool k_is_equality = rel_k == Equal;
+        T const & eq_rs = k_is_equality? rs_k : rs_i;
+        T const & rs = k_is_equality? rs_i : rs_k;
+        lp_relation rel = k_is_equality? rel_i : rel_k;
+        bool holds = (rel == Greater_or_equal || val_is_smaller_than_eps(eq_rs - rs, m_settings.refactor_tolerance)) &&
+            (rel == Less_or_equal || val_is_smaller_than_eps(rs - eq_rs, m_settings.refactor_tolerance));
+        if (!holds) {
+            m_status = INFEASIBLE;
+            return -1;
+        }
+        return k_is_equality? i : k;
+    }
+    if (rel_k != rel_i)
+        return -1; // the rows bound the same expression from the opposite sides
+    bool k_is_tighter = rel_k == Less_or_equal? rs_k <= rs_i : rs_k >= rs_i;
+    return k_is_tighter? i : k;
+}
+
+// finds the rows that are multiples of each other, the rows are compared after normalizing
+// the coefficient of the smallest column to one
+template <typename T, typename X> unsigned lp_solver<T, X>::remove_parallel_rows() {
+    std::map<std::vector<std::pair<unsigned, T>>, std::pair<unsigned, T>> normalized_rows;
+    std::vector<unsigned> rows_to_delete;
+    for (auto & t : m_A_values) {
+        if (t.second.size() < 2)
+            continue; // the singleton rows become bounds
+        std::vector<std::pair<unsigned, T>> key(t.second.begin(), t.second.end());
+        std::sort(key.begin(), key.end(), [](std::pair<unsigned, T> const & a, std::pair<unsigned, T> const & b) { return a.first < b.first; });
+        T lead = key[0].second;
+        for (auto & p : key)
+            p.second /= lead;
+        auto it = normalized_rows.find(key);
+        if (it == normalized_rows.end()) {
+            normalized_rows[key] = std::make_pair(t.first, lead);
+            continue;
+        }
+        int r = choose_parallel_row_to_remove(it->second.first, it->second.second, t.first, lead);
+        if (m_status == INFEASIBLE)
+            return 0;
+        if (r < 0)
+            continue;
+        rows_to_delete.push_back(r);
+        if (static_cast<unsigned>(r) == it->second.first)
+            it->second = std::make_pair(t.first, lead);
+    }
+    for (unsigned i : rows_to_delete)
+        m_A_values.erase(i);
+    return static_cast<unsigned>(rows_to_delete.size());
+}
+
+// we are maximizing, so a column that does not appear in any row is moved to the bound that increases the cost
+template <typename T, typename X> void lp_solver<T, X>::pin_column_to_best_bound(column_info<T> * ci) {
+    T const & c = ci->get_cost();
+    if (c > numeric_traits<T>::zero()) {
+        if (ci->upper_bound_is_set()) {
+            ci->set_fixed_value(ci->get_upper_bound());
+            return;
+        }
+        m_presolve_found_unbounded_column = true;
+    } else if (c < numeric_traits<T>::zero()) {
+        if (ci->low_bound_is_set()) {
+            ci->set_fixed_value(ci->get_low_bound());
+            return;
+        }
+        m_presolve_found_unbounded_column = true;
+    }
+    if (ci->low_bound_is_set())
+        ci->set_fixed_value(ci->get_low_bound());
+    else if (ci->upper_bound_is_set())
+        ci->set_fixed_value(ci->get_upper_bound());
+    else
+        ci->set_fixed_value(numeric_traits<T>::zero());
+}
+
+template <typename T, typename X> unsigned lp_solver<T, X>::pin_columns_without_rows() {
+    std::unordered_set<unsigned> columns_in_rows;
+    for (auto & row : m_A_values)
+        for (auto & t : row.second)
+            columns_in_rows.insert(t.first);
+    unsigned pinned = 0;
+    for (auto & t : m_columns) {
+        if (t.second->is_fixed() || columns_in_rows.find(t.first) != columns_in_rows.end())
+            continue;
+        pin_column_to_best_bound(t.second);
+        pinned++;
+    }
+    return pinned;
+}
+
 template <typename T, typename X> void lp_solver<T, X>::cleanup() {
-    int n = 0; // number of deleted rows
-    int d;
-    while ((d = try_to_remove_some_rows() > 0))
-        n += d;
-
-    // if (n == 1)
-    //     std::cout << "deleted one row" << std::endl;
-    // else if (n)
-    //     std::cout << "deleted " << n << " rows" << std::endl;
+    unsigned rows = static_cast<unsigned>(m_A_values.size());
+    remove_fixed_or_zero_columns();
+    if (m_settings.presolve)
+        remove_parallel_rows();
+    while (m_status != INFEASIBLE && try_to_remove_some_rows() > 0) {}
+    if (m_status == INFEASIBLE || !m_settings.presolve)
+        return;
+    unsigned pinned = pin_columns_without_rows();
+    if (m_settings.print_statistics)
+        std::cout << "presolve removed " << rows - m_A_values.size() << " rows and pinned " << pinned << " columns" << std::endl;
 }
 
 template <typename T, typename X> void lp_solver<T, X>::map_external_rows_to_core_solver_rows() {
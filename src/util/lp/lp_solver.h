@@ -58,6 +58,7 @@ public:
     std::vector<T> m_x;
     std::vector<T> m_upper_bounds;
     std::vector<unsigned> m_basis;
+    bool m_presolve_found_unbounded_column = false;
 
     lp_status m_status = lp_status::UNKNOWN;
 
@@ -174,6 +175,11 @@ protected:
 
     bool row_le_is_obsolete(std::unordered_map<unsigned, T> & row, unsigned row_index);
 
+    // a row with a single column is replaced by a bound on the column
+    bool row_is_singleton(std::unordered_map<unsigned, T> & row, unsigned row_index);
+
+    bool column_bounds_are_consistent(column_info<T> * ci);
+
     // analyse possible max and min values that are derived from var boundaries
     // Let us say that the we have a "ge" constraint, and the min value is equal to the rs.
     // Then we know what values of the variables are. For each positive coeff of the row it has to be
@@ -188,8 +194,31 @@ protected:
 
     unsigned try_to_remove_some_rows();
 
+    // the relation of the row divided by lead
+    static lp_relation relation_after_division(lp_relation relation, T const & lead) {
+        if (relation == Equal || lead > numeric_traits<T>::zero())
+            return relation;
+        return relation == Less_or_equal? Greater_or_equal : Less_or_equal;
+    }
+
+    // rows k and i are parallel: row i is row k multiplied by lead_i / lead_k.
+    // Returns the row that is implied by the other one, or -1 if both rows are needed.
+    int choose_parallel_row_to_remove(unsigned k, T const & lead_k, unsigned i, T const & lead_i);
+
+    unsigned remove_parallel_rows();
+
+    void pin_column_to_best_bound(column_info<T> * ci);
+
+    unsigned pin_columns_without_rows();
+
     void cleanup();
 
+    // maps the status of the presolved problem back to the original problem
+    void postsolve() {
+        if (m_presolve_found_unbounded_column && m_status == OPTIMAL)
+            m_status = UNBOUNDED;
+    }
+
     void map_external_rows_to_core_solver_rows();
 
     void map_external_columns_to_core_solver_columns();
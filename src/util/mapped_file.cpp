@@ -0,0 +1,62 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#include <string>
+#include <fstream>
+#include "util/exception.h"
+#include "util/sstream.h"
+#include "util/mapped_file.h"
+
+#if !defined(LEAN_WINDOWS)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace lean {
+#if defined(LEAN_WINDOWS)
+mapped_file::mapped_file(std::string const & fname):
+    m_data(nullptr), m_size(0), m_mapped(false) {
+    std::ifstream in(fname, std::ifstream::binary);
+    if (!in.good())
+        throw exception(sstream() << "failed to open file '" << fname << "'");
+    m_buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+}
+
+mapped_file::~mapped_file() {}
+#else
+mapped_file::mapped_file(std::string const & fname):
+    m_data(nullptr), m_size(0), m_mapped(false) {
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd == -1)
+        throw exception(sstream() << "failed to open file '" << fname << "'");
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw exception(sstream() << "failed to access stats of file '" << fname << "'");
+    }
+    m_size = st.st_size;
+    if (m_size > 0) {
+        void * p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            throw exception(sstream() << "failed to map file '" << fname << "'");
+        }
+        m_data   = static_cast<char const *>(p);
+        m_mapped = true;
+    }
+    close(fd);
+}
+
+mapped_file::~mapped_file() {
+    if (m_mapped)
+        munmap(const_cast<char *>(m_data), m_size);
+}
+#endif
+}
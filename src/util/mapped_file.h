@@ -0,0 +1,50 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#pragma once
+#include <string>
+#include <vector>
+#include <iostream>
+
+namespace lean {
+/** \brief Read-only view of the contents of a file.
+    On POSIX systems the file is mapped into memory, and pages are only loaded
+    when they are accessed. On other platforms, the whole file is read into a buffer. */
+class mapped_file {
+    char const *      m_data;
+    size_t            m_size;
+    std::vector<char> m_buffer; // used only when mmap is not available
+    bool              m_mapped;
+public:
+    /** \brief Map the given file. Throws an exception if the file cannot be opened. */
+    mapped_file(std::string const & fname);
+    mapped_file(mapped_file const &) = delete;
+    mapped_file & operator=(mapped_file const &) = delete;
+    ~mapped_file();
+    char const * data() const { return m_data; }
+    size_t size() const { return m_size; }
+};
+
+/** \brief Read-only stream buffer for a contiguous block of memory.
+    It does not copy the data, and the memory block must outlive it. */
+class memory_streambuf : public std::streambuf {
+public:
+    memory_streambuf(char const * data, size_t size) {
+        char * b = const_cast<char *>(data);
+        setg(b, b, b + size);
+    }
+    /** \brief Return the number of bytes consumed so far. */
+    size_t pos() const { return gptr() - eback(); }
+};
+
+/** \brief Input stream for a contiguous block of memory. */
+class memory_istream : public std::istream {
+    memory_streambuf m_buf;
+public:
+    memory_istream(char const * data, size_t size):std::istream(nullptr), m_buf(data, size) { rdbuf(&m_buf); }
+    size_t pos() const { return m_buf.pos(); }
+};
+}
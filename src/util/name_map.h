@@ -6,9 +6,13 @@ Author: Leonardo de Moura
 */
 #pragma once
 #include "util/rb_map.h"
+#include "util/hamt_map.h"
 #include "util/name.h"
 namespace lean {
 template<typename T> using name_map = rb_map<name, T, name_quick_cmp>;
+/** \brief Maps from names implemented using hash array mapped tries.
+    They provide faster lookups than name_map, but the iteration order is not specified. */
+template<typename T> using name_hamt_map = hamt_map<name, T, name_hash, name_eq>;
 
 class rename_map : public name_map<name> {
 public:
@@ -24,10 +24,8 @@ class mpfp {
     friend numeric_traits<mpfp>;
     mpfr_t m_val;
 
-    static mpz_t const & zval(mpz const & v) { return v.m_val; }
-    static mpz_t & zval(mpz & v) { return v.m_val; }
-    static mpq_t const & qval(mpq const & v) { return v.m_val; }
-    static mpq_t & qval(mpq & v) { return v.m_val; }
+    typedef mpz::gmp_view zval;
+    typedef mpq::gmp_view qval;
 
 public:
     friend void swap(mpfp & a, mpfp & b) { mpfr_swap(a.m_val, b.m_val); }
@@ -61,13 +59,13 @@ public:
         mpfr_set_f(m_val, v, rnd); return *this;
     }
     mpfp & set(mpz   const & v, mpfr_rnd_t rnd = MPFR_RNDN) {
-        mpfr_set_z(m_val, v.m_val, rnd); return *this;
+        mpfr_set_z(m_val, zval(v), rnd); return *this;
     }
     mpfp & set(mpq   const & v, mpfr_rnd_t rnd = MPFR_RNDN) {
-        mpfr_set_q(m_val, v.m_val, rnd); return *this;
+        mpfr_set_q(m_val, qval(v), rnd); return *this;
     }
     mpfp & set(mpbq  const & v, mpfr_rnd_t rnd = MPFR_RNDN) {
-        mpfr_set_z(m_val, v.m_num.m_val, rnd);   // this = m_num
+        mpfr_set_z(m_val, zval(v.m_num), rnd);   // this = m_num
         mpfr_div_2ui(m_val, m_val, v.m_k, rnd);  // this = m_num / (2^k)
         return *this;
     }
@@ -323,8 +321,8 @@ public:
     mpfp & add(double const o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_add_d(m_val, m_val, o, rnd); return *this; }
     mpfp & add(mpz_t const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_add_z(m_val, m_val, o, rnd); return *this; }
     mpfp & add(mpq_t const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_add_q(m_val, m_val, o, rnd); return *this; }
-    mpfp & add(mpz const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_add_z(m_val, m_val, o.m_val, rnd); return *this; }
-    mpfp & add(mpq const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_add_q(m_val, m_val, o.m_val, rnd); return *this; }
+    mpfp & add(mpz const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_add_z(m_val, m_val, zval(o), rnd); return *this; }
+    mpfp & add(mpq const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_add_q(m_val, m_val, qval(o), rnd); return *this; }
     mpfp & operator+=(mpfp const & o) { return add(o); }
     mpfp & operator+=(unsigned long int o) { return add(o); }
     mpfp & operator+=(long int const o) { return add(o); }
@@ -348,13 +346,13 @@ public:
     mpfp & sub(double const o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_sub_d(m_val, m_val, o, rnd); return *this; }
     mpfp & sub(mpz_t const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_sub_z(m_val, m_val, o, rnd); return *this; }
     mpfp & sub(mpq_t const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_sub_q(m_val, m_val, o, rnd); return *this; }
-    mpfp & sub(mpz const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_sub_z(m_val, m_val, o.m_val, rnd); return *this; }
-    mpfp & sub(mpq const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_sub_q(m_val, m_val, o.m_val, rnd); return *this; }
+    mpfp & sub(mpz const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_sub_z(m_val, m_val, zval(o), rnd); return *this; }
+    mpfp & sub(mpq const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_sub_q(m_val, m_val, qval(o), rnd); return *this; }
     mpfp & rsub(unsigned long int const o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_ui_sub(m_val, o, m_val, rnd); return *this; }
     mpfp & rsub(long int const o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_si_sub(m_val, o, m_val, rnd); return *this; }
     mpfp & rsub(double const o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_d_sub(m_val, o, m_val, rnd); return *this; }
     mpfp & rsub(mpz_t const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_z_sub(m_val, o, m_val, rnd); return *this; }
-    mpfp & rsub(mpz const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_z_sub(m_val, o.m_val, m_val, rnd); return *this; }
+    mpfp & rsub(mpz const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_z_sub(m_val, zval(o), m_val, rnd); return *this; }
     mpfp & operator-=(mpfp const & o) { return sub(o); }
     mpfp & operator-=(unsigned long int o) { return sub(o); }
     mpfp & operator-=(long int const o) { return sub(o); }
@@ -385,8 +383,8 @@ public:
     mpfp & mul(double const o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_mul_d(m_val, m_val, o, rnd); return *this; }
     mpfp & mul(mpz_t const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_mul_z(m_val, m_val, o, rnd); return *this; }
     mpfp & mul(mpq_t const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_mul_q(m_val, m_val, o, rnd); return *this; }
-    mpfp & mul(mpz const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_mul_z(m_val, m_val, o.m_val, rnd); return *this; }
-    mpfp & mul(mpq const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_mul_q(m_val, m_val, o.m_val, rnd); return *this; }
+    mpfp & mul(mpz const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_mul_z(m_val, m_val, zval(o), rnd); return *this; }
+    mpfp & mul(mpq const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_mul_q(m_val, m_val, qval(o), rnd); return *this; }
     mpfp & operator*=(mpfp const & o) { return mul(o); }
     mpfp & operator*=(unsigned long int o) { return mul(o); }
     mpfp & operator*=(long int const o) { return mul(o); }
@@ -410,8 +408,8 @@ public:
     mpfp & div(double const o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_div_d(m_val, m_val, o, rnd); return *this; }
     mpfp & div(mpz_t const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_div_z(m_val, m_val, o, rnd); return *this; }
     mpfp & div(mpq_t const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_div_q(m_val, m_val, o, rnd); return *this; }
-    mpfp & div(mpz const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_div_z(m_val, m_val, o.m_val, rnd); return *this; }
-    mpfp & div(mpq const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_div_q(m_val, m_val, o.m_val, rnd); return *this; }
+    mpfp & div(mpz const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_div_z(m_val, m_val, zval(o), rnd); return *this; }
+    mpfp & div(mpq const & o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_div_q(m_val, m_val, qval(o), rnd); return *this; }
     mpfp & rdiv(unsigned long int const o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_ui_div(m_val, o, m_val, rnd); return *this; }
     mpfp & rdiv(long int const o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_si_div(m_val, o, m_val, rnd); return *this; }
     mpfp & rdiv(double const o, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_d_div(m_val, o, m_val, rnd); return *this; }
@@ -480,7 +478,7 @@ public:
     void power(unsigned long int b, mpfr_rnd_t rnd = get_mpfp_rnd()) { mpfr_pow_ui(m_val, m_val, b, rnd); }
     void power(long int b, mpfr_rnd_t rnd = get_mpfp_rnd())          { mpfr_pow_si(m_val, m_val, b, rnd); }
     void power(mpz_t const & b, mpfr_rnd_t rnd = get_mpfp_rnd())     { mpfr_pow_z(m_val, m_val, b, rnd); }
-    void power(mpz const & b, mpfr_rnd_t rnd = get_mpfp_rnd())       { mpfr_pow_z(m_val, m_val, b.m_val, rnd); }
+    void power(mpz const & b, mpfr_rnd_t rnd = get_mpfp_rnd())       { mpfr_pow_z(m_val, m_val, zval(b), rnd); }
 
     friend mpfp pow(mpfp a, mpfp const & b, mpfr_rnd_t rnd = get_mpfp_rnd())      { a.power(b, rnd); return a; }
     friend mpfp pow(mpfp a, unsigned long int b, mpfr_rnd_t rnd = get_mpfp_rnd()) { a.power(b, rnd); return a; }
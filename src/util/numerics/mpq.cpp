@@ -26,6 +26,106 @@ void numeric_traits<mpq>::finalize() {
     delete pi_u;
 }
 
+mpq::gmp_view::gmp_view(mpq const & v) {
+    if (v.is_small()) {
+        m_limbs[0] = mpz::uabs(v.m_num);
+        m_limbs[1] = v.m_den;
+        mpz_roinit_n(mpq_numref(&m_tmp), &m_limbs[0], v.m_num < 0 ? -1 : (v.m_num > 0 ? 1 : 0));
+        mpz_roinit_n(mpq_denref(&m_tmp), &m_limbs[1], 1);
+        m_ptr = &m_tmp;
+    } else {
+        m_ptr = v.m_ptr;
+    }
+}
+
+void mpq::to_big() {
+    if (m_ptr)
+        return;
+    m_ptr = new __mpq_struct;
+    mpq_init(m_ptr);
+    mpz_set_si(mpq_numref(m_ptr), m_num);
+    mpz_set_si(mpq_denref(m_ptr), m_den);
+}
+
+void mpq::normalize() {
+    if (m_ptr && mpz_fits_slong_p(mpq_numref(m_ptr)) && mpz_fits_slong_p(mpq_denref(m_ptr))) {
+        long n = mpz_get_si(mpq_numref(m_ptr));
+        long d = mpz_get_si(mpq_denref(m_ptr));
+        release();
+        m_num = n;
+        m_den = d;
+    }
+}
+
+void mpq::set_big(mpq_srcptr v) {
+    if (m_ptr) {
+        mpq_set(m_ptr, v);
+    } else {
+        m_ptr = new __mpq_struct;
+        mpq_init(m_ptr);
+        mpq_set(m_ptr, v);
+    }
+    normalize();
+}
+
+void mpq::release() {
+    mpq_clear(m_ptr);
+    delete m_ptr;
+    m_ptr = nullptr;
+}
+
+void mpq::set_canonical(long n, long d) {
+    if (d != 0 && n != LONG_MIN && d != LONG_MIN) {
+        if (d < 0) {
+            n = -n;
+            d = -d;
+        }
+        long g = mpz::small_gcd(mpz::uabs(n), d);
+        set_small(n / g, d / g);
+        return;
+    }
+    to_big();
+    mpq_set_si(m_ptr, n, d);
+    mpq_canonicalize(m_ptr);
+    normalize();
+}
+
+mpq::mpq(unsigned long int n, unsigned long int d):mpq() {
+    if (n <= static_cast<unsigned long>(LONG_MAX) && d <= static_cast<unsigned long>(LONG_MAX)) {
+        set_canonical(n, d);
+    } else {
+        to_big();
+        mpq_set_ui(m_ptr, n, d);
+        mpq_canonicalize(m_ptr);
+        normalize();
+    }
+}
+
+mpq & mpq::operator=(mpz const & v) {
+    if (v.is_small()) {
+        set_small(v.m_val, 1);
+    } else {
+        to_big();
+        mpq_set_z(m_ptr, v.m_ptr);
+    }
+    return *this;
+}
+
+mpq & mpq::operator=(char const * v) {
+    to_big();
+    mpq_set_str(m_ptr, v, 10);
+    mpq_canonicalize(m_ptr);
+    normalize();
+    return *this;
+}
+
+mpq & mpq::operator=(double v) {
+    to_big();
+    mpq_set_d(m_ptr, v);
+    normalize();
+    return *this;
+}
+
 mpq & mpq::operator=(mpbq const & b) {
     *this = 2;
     power(*this, *this, b.get_k());
@@ -34,72 +134,282 @@ mpq & mpq::operator=(mpbq const & b) {
     return *this;
 }
 
+void swap_numerator(mpq & a, mpz & b) {
+    mpz n = a.get_numerator();
+    mpq r(b);
+    r /= a.get_denominator();
+    swap(a, r);
+    swap(b, n);
+}
+
+void swap_denominator(mpq & a, mpz & b) {
+    mpz d = a.get_denominator();
+    mpq r(a.get_numerator());
+    r /= b;
+    swap(a, r);
+    swap(b, d);
+}
+
+void mpq::inv() {
+    if (is_small() && m_num != 0 && m_num != LONG_MIN) {
+        long n = m_num < 0 ? -m_den : m_den;
+        m_den  = m_num < 0 ? -m_num : m_num;
+        m_num  = n;
+        return;
+    }
+    to_big();
+    mpq_inv(m_ptr, m_ptr);
+    normalize();
+}
+
+/**
+   \brief this <- this + n/d, where n/d is in canonical form.
+   The denominators are combined using the method from Knuth (TAOCP 4.5.1) to keep intermediate values small.
+*/
+bool mpq::add_small(long n, long d) {
+    long r_n, r_d;
+    if (m_den == d) {
+        if (__builtin_add_overflow(m_num, n, &r_n))
+            return false;
+        if (d == 1) {
+            m_num = r_n;
+            return true;
+        }
+        long g = mpz::small_gcd(mpz::uabs(r_n), d);
+        m_num = r_n / g;
+        m_den = d / g;
+        return true;
+    }
+    long g = mpz::small_gcd(m_den, d);
+    long t1, t2;
+    if (g == 1) {
+        if (__builtin_mul_overflow(m_num, d, &t1) || __builtin_mul_overflow(n, m_den, &t2) ||
+            __builtin_add_overflow(t1, t2, &r_n) || __builtin_mul_overflow(m_den, d, &r_d))
+            return false;
+        m_num = r_n;
+        m_den = r_d;
+        return true;
+    }
+    long t;
+    if (__builtin_mul_overflow(m_num, d / g, &t1) || __builtin_mul_overflow(n, m_den / g, &t2) ||
+        __builtin_add_overflow(t1, t2, &t))
+        return false;
+    if (t == 0) {
+        m_num = 0;
+        m_den = 1;
+        return true;
+    }
+    long g2 = mpz::small_gcd(mpz::uabs(t), g);
+    if (__builtin_mul_overflow(m_den / g, d / g2, &r_d))
+        return false;
+    m_num = t / g2;
+    m_den = r_d;
+    return true;
+}
+
+/** \brief this <- this * (n/d), where n/d is in canonical form. */
+bool mpq::mul_small(long n, long d) {
+    if (m_num == 0 || n == 0) {
+        m_num = 0;
+        m_den = 1;
+        return true;
+    }
+    long g1 = mpz::small_gcd(mpz::uabs(m_num), d);
+    long g2 = mpz::small_gcd(mpz::uabs(n), m_den);
+    long r_n, r_d;
+    if (__builtin_mul_overflow(m_num / g1, n / g2, &r_n) || __builtin_mul_overflow(m_den / g2, d / g1, &r_d))
+        return false;
+    m_num = r_n;
+    m_den = r_d;
+    return true;
+}
+
+bool mpq::add_int_small(long k) {
+    // gcd(m_num + k*m_den, m_den) == gcd(m_num, m_den) == 1
+    long t, r;
+    if (__builtin_mul_overflow(k, m_den, &t) || __builtin_add_overflow(m_num, t, &r))
+        return false;
+    m_num = r;
+    return true;
+}
+
+bool mpq::mul_int_small(long k) {
+    if (k == 0 || m_num == 0) {
+        m_num = 0;
+        m_den = 1;
+        return true;
+    }
+    long g = mpz::small_gcd(mpz::uabs(k), m_den);
+    long r;
+    if (__builtin_mul_overflow(m_num, k / g, &r))
+        return false;
+    m_num = r;
+    m_den /= g;
+    return true;
+}
+
+bool mpq::div_int_small(long k) {
+    if (k == 0)
+        return false;
+    unsigned long g = mpz::small_gcd(mpz::uabs(m_num), mpz::uabs(k));
+    unsigned long q = mpz::uabs(k) / g;
+    if (g > static_cast<unsigned long>(LONG_MAX) || q > static_cast<unsigned long>(LONG_MAX))
+        return false;
+    long n = m_num / static_cast<long>(g);
+    long r_d;
+    if ((k < 0 && n == LONG_MIN) || __builtin_mul_overflow(m_den, static_cast<long>(q), &r_d))
+        return false;
+    m_num = k < 0 ? -n : n;
+    m_den = r_d;
+    return true;
+}
+
+mpq & mpq::add_big(mpq const & o, bool sub) {
+    gmp_view v(o);
+    to_big();
+    if (sub)
+        mpq_sub(m_ptr, m_ptr, v);
+    else
+        mpq_add(m_ptr, m_ptr, v);
+    normalize();
+    return *this;
+}
+
+mpq & mpq::mul_big(mpq const & o, bool div) {
+    gmp_view v(o);
+    to_big();
+    if (div)
+        mpq_div(m_ptr, m_ptr, v);
+    else
+        mpq_mul(m_ptr, m_ptr, v);
+    normalize();
+    return *this;
+}
+
+mpq & mpq::add_int_big(long k) {
+    to_big();
+    if (k >= 0)
+        mpz_addmul_ui(mpq_numref(m_ptr), mpq_denref(m_ptr), k);
+    else
+        mpz_submul_ui(mpq_numref(m_ptr), mpq_denref(m_ptr), mpz::uabs(k));
+    normalize();
+    return *this;
+}
+
+mpq & mpq::mul_int_big(long k) {
+    to_big();
+    mpz_mul_si(mpq_numref(m_ptr), mpq_numref(m_ptr), k);
+    mpq_canonicalize(m_ptr);
+    normalize();
+    return *this;
+}
+
+mpq & mpq::div_int_big(long k) {
+    to_big();
+    mpz_mul_si(mpq_denref(m_ptr), mpq_denref(m_ptr), k);
+    mpq_canonicalize(m_ptr);
+    normalize();
+    return *this;
+}
+
+int mpq::cmp_big(mpq const & o) const {
+    return mpq_cmp(gmp_view(*this), gmp_view(o));
+}
+
 MK_THREAD_LOCAL_GET_DEF(mpz, get_tlocal1);
 int cmp(mpq const & a, mpz const & b) {
     if (a.is_integer()) {
-        return mpz_cmp(mpq_numref(a.m_val), mpq::zval(b));
+        return cmp(a.get_numerator(), b);
     } else {
         mpz & tmp = get_tlocal1();
-        mpz_mul(mpq::zval(tmp), mpq_denref(a.m_val), mpq::zval(b));
-        return mpz_cmp(mpq_numref(a.m_val), mpq::zval(tmp));
+        denominator(tmp, a);
+        tmp *= b;
+        return cmp(a.get_numerator(), tmp);
     }
 }
 
+void mpq::numerator_core(mpz & r) const {
+    if (is_small())
+        r = m_num;
+    else
+        r.set_big(mpq_numref(m_ptr));
+}
+
+void mpq::denominator_core(mpz & r) const {
+    if (is_small())
+        r = m_den;
+    else
+        r.set_big(mpq_denref(m_ptr));
+}
+
 void mpq::floor() {
     if (is_integer())
         return;
+    if (is_small()) {
+        // m_den > 1, so the quotient and the adjustment cannot overflow
+        m_num = m_num / m_den - (m_num < 0 ? 1 : 0);
+        m_den = 1;
+        return;
+    }
     bool neg = is_neg();
-    mpz_tdiv_q(mpq_numref(m_val), mpq_numref(m_val), mpq_denref(m_val));
-    mpz_set_ui(mpq_denref(m_val), 1);
+    mpz_tdiv_q(mpq_numref(m_ptr), mpq_numref(m_ptr), mpq_denref(m_ptr));
+    mpz_set_ui(mpq_denref(m_ptr), 1);
     if (neg)
-        mpz_sub_ui(mpq_numref(m_val), mpq_numref(m_val), 1);
+        mpz_sub_ui(mpq_numref(m_ptr), mpq_numref(m_ptr), 1);
+    normalize();
 }
 
 void mpq::ceil() {
     if (is_integer())
         return;
+    if (is_small()) {
+        m_num = m_num / m_den + (m_num > 0 ? 1 : 0);
+        m_den = 1;
+        return;
+    }
     bool pos = is_pos();
-    mpz_tdiv_q(mpq_numref(m_val), mpq_numref(m_val), mpq_denref(m_val));
-    mpz_set_ui(mpq_denref(m_val), 1);
+    mpz_tdiv_q(mpq_numref(m_ptr), mpq_numref(m_ptr), mpq_denref(m_ptr));
+    mpz_set_ui(mpq_denref(m_ptr), 1);
     if (pos)
-        mpz_add_ui(mpq_numref(m_val), mpq_numref(m_val), 1);
+        mpz_add_ui(mpq_numref(m_ptr), mpq_numref(m_ptr), 1);
+    normalize();
 }
 
 mpz floor(mpq const & a) {
-    if (a.is_integer())
-        return a.get_numerator();
-    mpz r;
-    mpz_tdiv_q(mpq::zval(r), mpq_numref(a.m_val), mpq_denref(a.m_val));
-    if (a.is_neg())
-        --r;
-    return r;
+    mpq r(a);
+    r.floor();
+    return r.get_numerator();
 }
 
 mpz ceil(mpq const & a) {
-    if (a.is_integer())
-        return a.get_numerator();
-    mpz r;
-    mpz_tdiv_q(mpq::zval(r), mpq_numref(a.m_val), mpq_denref(a.m_val));
-    if (a.is_pos())
-        ++r;
-    return r;
+    mpq r(a);
+    r.ceil();
+    return r.get_numerator();
 }
 
 void power(mpq & a, mpq const & b, unsigned k) {
-    mpz_pow_ui(mpq_numref(a.m_val), mpq_numref(b.m_val), k);
-    mpz_pow_ui(mpq_denref(a.m_val), mpq_denref(b.m_val), k);
-    mpq_canonicalize(a.m_val);
+    mpq::gmp_view v(b);
+    mpq_srcptr vb = v;
+    a.to_big();
+    mpz_pow_ui(mpq_numref(a.m_ptr), mpq_numref(vb), k);
+    mpz_pow_ui(mpq_denref(a.m_ptr), mpq_denref(vb), k);
+    mpq_canonicalize(a.m_ptr);
+    a.normalize();
 }
 
 extern void display(std::ostream & out, __mpz_struct const * v);
 
 std::ostream & operator<<(std::ostream & out, mpq const & v) {
-    if (v.is_integer()) {
-        display(out, mpq_numref(v.m_val));
+    if (v.is_small()) {
+        out << v.m_num;
+        if (v.m_den != 1)
+            out << "/" << v.m_den;
+    } else if (v.is_integer()) {
+        display(out, mpq_numref(v.m_ptr));
     } else {
-        display(out, mpq_numref(v.m_val));
+        display(out, mpq_numref(v.m_ptr));
         out << "/";
-        display(out, mpq_denref(v.m_val));
+        display(out, mpq_denref(v.m_ptr));
     }
     return out;
 }
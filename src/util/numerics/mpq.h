@@ -5,6 +5,7 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Author: Leonardo de Moura
 */
 #pragma once
+#include <algorithm>
 #include "util/numerics/mpz.h"
 
 namespace lean {
@@ -12,41 +13,94 @@ class mpbq;
 
 /**
    \brief Wrapper for GMP rationals
+
+   As for mpz, numerators and denominators that fit in a long are stored inline in canonical form
+   (m_den > 0 and gcd(m_num, m_den) == 1), and GMP is only used when an operation overflows.
 */
 class mpq {
     friend class mpfp;
-    mpq_t m_val;
-    static mpz_t const & zval(mpz const & v) { return v.m_val; }
-    static mpz_t & zval(mpz & v) { return v.m_val; }
-public:
-    friend void swap(mpq & a, mpq & b) { mpq_swap(a.m_val, b.m_val); }
-    friend void swap_numerator(mpq & a, mpz & b) { mpz_swap(mpq_numref(a.m_val), zval(b)); mpq_canonicalize(a.m_val); }
-    friend void swap_denominator(mpq & a, mpz & b) { mpz_swap(mpq_denref(a.m_val), zval(b)); mpq_canonicalize(a.m_val); }
+    long           m_num; // the value is m_num/m_den when m_ptr == nullptr
+    long           m_den;
+    __mpq_struct * m_ptr;
+
+    /** \brief Read-only GMP view of an mpq, it does not allocate memory for small values. */
+    class gmp_view {
+        mp_limb_t    m_limbs[2];
+        __mpq_struct m_tmp;
+        mpq_srcptr   m_ptr;
+    public:
+        explicit gmp_view(mpq const & v);
+        gmp_view(gmp_view const &) = delete;
+        operator mpq_srcptr() const { return m_ptr; }
+    };
+
+    bool is_small() const { return m_ptr == nullptr; }
+    void set_small(long n, long d) { if (m_ptr) release(); m_num = n; m_den = d; }
+    /** \brief Move the value to GMP, the representation is not canonical until normalize() is invoked. */
+    void to_big();
+    /** \brief Move the value back inline if the numerator and denominator fit in a long. */
+    void normalize();
+    void set_big(mpq_srcptr v);
+    void release();
+    void set_canonical(long n, long d);
+
+    // Fast paths, they return false if the result does not fit in the inline representation.
+    bool add_small(long n, long d);
+    bool mul_small(long n, long d);
+    bool add_int_small(long k);
+    bool mul_int_small(long k);
+    bool div_int_small(long k);
+
+    mpq & add_big(mpq const & o, bool sub);
+    mpq & mul_big(mpq const & o, bool div);
+    mpq & add_int_big(long k);
+    mpq & mul_int_big(long k);
+    mpq & div_int_big(long k);
+    mpq & add_int(long k) { if (is_small() && add_int_small(k)) return *this; return add_int_big(k); }
+    mpq & mul_int(long k) { if (is_small() && mul_int_small(k)) return *this; return mul_int_big(k); }
+    mpq & div_int(long k) { if (is_small() && div_int_small(k)) return *this; return div_int_big(k); }
+    int cmp_big(mpq const & o) const;
+    void numerator_core(mpz & r) const;
+    void denominator_core(mpz & r) const;
 
-    mpq & operator=(mpz const & v) { mpq_set_z(m_val, v.m_val); return *this; }
-    mpq & operator=(mpq const & v) { mpq_set(m_val, v.m_val); return *this; }
+public:
+    friend void swap(mpq & a, mpq & b) {
+        std::swap(a.m_num, b.m_num); std::swap(a.m_den, b.m_den); std::swap(a.m_ptr, b.m_ptr);
+    }
+    friend void swap_numerator(mpq & a, mpz & b);
+    friend void swap_denominator(mpq & a, mpz & b);
+
+    mpq & operator=(mpz const & v);
+    mpq & operator=(mpq const & v) {
+        if (this == &v) return *this;
+        if (v.is_small()) set_small(v.m_num, v.m_den); else set_big(v.m_ptr);
+        return *this;
+    }
     mpq & operator=(mpq && v) { swap(*this, v); return *this; }
     mpq & operator=(mpbq const & b);
-    mpq & operator=(char const * v) { mpq_set_str(m_val, v, 10); return *this; }
-    mpq & operator=(unsigned long int v) { mpq_set_ui(m_val, v, 1u); return *this; }
-    mpq & operator=(long int v) { mpq_set_si(m_val, v, 1); return *this; }
+    mpq & operator=(char const * v);
+    mpq & operator=(unsigned long int v) {
+        if (v <= static_cast<unsigned long>(LONG_MAX)) { set_small(static_cast<long>(v), 1); return *this; }
+        to_big(); mpq_set_ui(m_ptr, v, 1u); return *this;
+    }
+    mpq & operator=(long int v) { set_small(v, 1); return *this; }
     mpq & operator=(unsigned int v) { return operator=(static_cast<unsigned long int>(v)); }
     mpq & operator=(int v) { return operator=(static_cast<long int>(v)); }
-    mpq & operator=(double v) { mpq_set_d(m_val, v); return *this; }
+    mpq & operator=(double v);
 
-    mpq() { mpq_init(m_val); }
+    mpq():m_num(0), m_den(1), m_ptr(nullptr) {}
     mpq(mpq const & v):mpq() { operator=(v); }
-    mpq(mpq && s):mpq() { mpq_swap(m_val, s.m_val); }
+    mpq(mpq && s):m_num(s.m_num), m_den(s.m_den), m_ptr(s.m_ptr) { s.m_ptr = nullptr; }
     template<typename T> explicit mpq(T const & v):mpq() { operator=(v); }
-    mpq(unsigned long int n, unsigned long int d):mpq() { mpq_set_ui(m_val, n, d); mpq_canonicalize(m_val); }
-    mpq(long int n, long int d):mpq() { mpq_set_si(m_val, n, d); mpq_canonicalize(m_val); }
-    mpq(unsigned int n, unsigned int d):mpq() { mpq_set_ui(m_val, n, d); mpq_canonicalize(m_val); }
-    mpq(int n, int d):mpq() { mpq_set_si(m_val, n, d); mpq_canonicalize(m_val); }
-    ~mpq() { mpq_clear(m_val); }
+    mpq(unsigned long int n, unsigned long int d);
+    mpq(long int n, long int d):mpq() { set_canonical(n, d); }
+    mpq(unsigned int n, unsigned int d):mpq() { set_canonical(n, d); }
+    mpq(int n, int d):mpq() { set_canonical(n, d); }
+    ~mpq() { if (m_ptr) release(); }
 
-    unsigned hash() const { return static_cast<unsigned>(mpz_get_si(mpq_numref(m_val))); }
+    unsigned hash() const { return static_cast<unsigned>(is_small() ? m_num : mpz_get_si(mpq_numref(m_ptr))); }
 
-    int sgn() const { return mpq_sgn(m_val); }
+    int sgn() const { return is_small() ? (m_num > 0) - (m_num < 0) : mpq_sgn(m_ptr); }
     friend int sgn(mpq const & a) { return a.sgn(); }
     bool is_pos() const { return sgn() > 0; }
     bool is_neg() const { return sgn() < 0; }
@@ -54,23 +108,35 @@ public:
     bool is_nonpos() const { return !is_pos(); }
     bool is_nonneg() const { return !is_neg(); }
 
-    void neg() { mpq_neg(m_val, m_val); }
+    void neg() {
+        if (is_small() && m_num != LONG_MIN) { m_num = -m_num; return; }
+        to_big(); mpq_neg(m_ptr, m_ptr); normalize();
+    }
     friend mpq neg(mpq a) { a.neg(); return a; }
 
-    void abs() { mpq_abs(m_val, m_val); }
+    void abs() { if (is_neg()) neg(); }
     friend mpq abs(mpq a) { a.abs(); return a; }
 
-    void inv() { mpq_inv(m_val, m_val); }
+    void inv();
     friend mpq inv(mpq a) { a.inv(); return a; }
 
-    double get_double() const { return mpq_get_d(m_val); }
+    double get_double() const { return mpq_get_d(gmp_view(*this)); }
 
-    bool is_integer() const { return mpz_cmp_ui(mpq_denref(m_val), 1u) == 0; }
+    bool is_integer() const { return is_small() ? m_den == 1 : mpz_cmp_ui(mpq_denref(m_ptr), 1u) == 0; }
 
-    friend int cmp(mpq const & a, mpq const & b) { return mpq_cmp(a.m_val, b.m_val); }
+    friend int cmp(mpq const & a, mpq const & b) {
+        if (a.is_small() && b.is_small()) {
+            long l, r;
+            if (a.m_den == b.m_den)
+                return (a.m_num > b.m_num) - (a.m_num < b.m_num);
+            if (!__builtin_mul_overflow(a.m_num, b.m_den, &l) && !__builtin_mul_overflow(b.m_num, a.m_den, &r))
+                return (l > r) - (l < r);
+        }
+        return a.cmp_big(b);
+    }
     friend int cmp(mpq const & a, mpz const & b);
-    friend int cmp(mpq const & a, unsigned b) { return mpq_cmp_ui(a.m_val, b, 1); }
-    friend int cmp(mpq const & a, int b) { return mpq_cmp_si(a.m_val, b, 1); }
+    friend int cmp(mpq const & a, unsigned b) { return a.is_small() && a.m_den == 1 ? cmp(mpz(a.m_num), b) : mpq_cmp_ui(static_cast<mpq_srcptr>(gmp_view(a)), b, 1); }
+    friend int cmp(mpq const & a, int b) { return a.is_small() && a.m_den == 1 ? (a.m_num > b) - (a.m_num < b) : mpq_cmp_si(static_cast<mpq_srcptr>(gmp_view(a)), b, 1); }
     friend int cmp(mpq const & a, double b) { return a.get_double() - b; }
 
     friend bool operator<(mpq const & a, mpq const & b) { return cmp(a, b) < 0; }
@@ -113,10 +179,15 @@ public:
     friend bool operator>=(int a, mpq const & b) { return cmp(b, a) <= 0; }
     friend bool operator>=(double a, mpq const & b) { return cmp(b, a) <= 0; }
 
-    friend bool operator==(mpq const & a, mpq const & b) { return mpq_equal(a.m_val, b.m_val) != 0; }
-    friend bool operator==(mpq const & a, mpz const & b) { return a.is_integer() && mpz_cmp(mpq_numref(a.m_val), zval(b)) == 0; }
-    friend bool operator==(mpq const & a, unsigned int b) { return a.is_integer() && mpz_cmp_ui(mpq_numref(a.m_val), b) == 0; }
-    friend bool operator==(mpq const & a, int b) { return a.is_integer() && mpz_cmp_si(mpq_numref(a.m_val), b) == 0; }
+    // both representations are canonical, so a small value is never equal to a big one
+    friend bool operator==(mpq const & a, mpq const & b) {
+        if (a.is_small() || b.is_small())
+            return a.is_small() && b.is_small() && a.m_num == b.m_num && a.m_den == b.m_den;
+        return mpq_equal(a.m_ptr, b.m_ptr) != 0;
+    }
+    friend bool operator==(mpq const & a, mpz const & b) { return a.is_integer() && cmp(a, b) == 0; }
+    friend bool operator==(mpq const & a, unsigned int b) { return a.is_integer() && cmp(a, b) == 0; }
+    friend bool operator==(mpq const & a, int b) { return a.is_integer() && cmp(a, b) == 0; }
     friend bool operator==(mpz const & a, mpq const & b) { return operator==(b, a); }
     friend bool operator==(unsigned int a, mpq const & b) { return operator==(b, a); }
     friend bool operator==(int a, mpq const & b) { return operator==(b, a); }
@@ -129,25 +200,51 @@ public:
     friend bool operator!=(unsigned int a, mpq const & b) { return !operator==(a, b); }
     friend bool operator!=(int a, mpq const & b) { return !operator==(a, b); }
 
-    mpq & operator+=(mpq const & o) { mpq_add(m_val, m_val, o.m_val); return *this; }
-    mpq & operator+=(mpz const & o) { mpz_addmul(mpq_numref(m_val), mpq_denref(m_val), o.m_val); mpq_canonicalize(m_val); return *this; }
-    mpq & operator+=(unsigned int k) { mpz_addmul_ui(mpq_numref(m_val), mpq_denref(m_val), k); mpq_canonicalize(m_val); return *this; }
-    mpq & operator+=(int k) { if (k >= 0) return operator+=(static_cast<unsigned int>(k)); else return operator-=(static_cast<unsigned int>(-k)); }
-
-    mpq & operator-=(mpq const & o) { mpq_sub(m_val, m_val, o.m_val); return *this; }
-    mpq & operator-=(mpz const & o) { mpz_submul(mpq_numref(m_val), mpq_denref(m_val), o.m_val); mpq_canonicalize(m_val); return *this; }
-    mpq & operator-=(unsigned int k) { mpz_submul_ui(mpq_numref(m_val), mpq_denref(m_val), k); mpq_canonicalize(m_val); return *this; }
-    mpq & operator-=(int k) { if (k >= 0) return operator-=(static_cast<unsigned int>(k)); else return operator+=(static_cast<unsigned int>(-k)); }
-
-    mpq & operator*=(mpq const & o) { mpq_mul(m_val, m_val, o.m_val); return *this; }
-    mpq & operator*=(mpz const & o) { mpz_mul(mpq_numref(m_val), mpq_numref(m_val), o.m_val); mpq_canonicalize(m_val); return *this; }
-    mpq & operator*=(unsigned int k) { mpz_mul_ui(mpq_numref(m_val), mpq_numref(m_val), k); mpq_canonicalize(m_val); return *this; }
-    mpq & operator*=(int k) { mpz_mul_si(mpq_numref(m_val), mpq_numref(m_val), k); mpq_canonicalize(m_val); return *this; }
-
-    mpq & operator/=(mpq const & o) { mpq_div(m_val, m_val, o.m_val); return *this; }
-    mpq & operator/=(mpz const & o) { mpz_mul(mpq_denref(m_val), mpq_denref(m_val), o.m_val); mpq_canonicalize(m_val); return *this; }
-    mpq & operator/=(unsigned int k) { mpz_mul_ui(mpq_denref(m_val), mpq_denref(m_val), k); mpq_canonicalize(m_val); return *this; }
-    mpq & operator/=(int k) { mpz_mul_si(mpq_denref(m_val), mpq_denref(m_val), k); mpq_canonicalize(m_val); return *this; }
+    mpq & operator+=(mpq const & o) {
+        if (is_small() && o.is_small() && add_small(o.m_num, o.m_den)) return *this;
+        return add_big(o, false);
+    }
+    mpq & operator+=(mpz const & o) {
+        if (o.is_small()) return add_int(o.m_val);
+        return add_big(mpq(o), false);
+    }
+    mpq & operator+=(unsigned int k) { return *this += mpz(k); }
+    mpq & operator+=(int k) { return add_int(k); }
+
+    mpq & operator-=(mpq const & o) {
+        if (is_small() && o.is_small() && o.m_num != LONG_MIN && add_small(-o.m_num, o.m_den)) return *this;
+        return add_big(o, true);
+    }
+    mpq & operator-=(mpz const & o) {
+        if (o.is_small() && o.m_val != LONG_MIN) return add_int(-o.m_val);
+        return add_big(mpq(o), true);
+    }
+    mpq & operator-=(unsigned int k) { return *this -= mpz(k); }
+    mpq & operator-=(int k) { return *this -= mpz(k); }
+
+    mpq & operator*=(mpq const & o) {
+        if (is_small() && o.is_small() && mul_small(o.m_num, o.m_den)) return *this;
+        return mul_big(o, false);
+    }
+    mpq & operator*=(mpz const & o) {
+        if (o.is_small()) return mul_int(o.m_val);
+        return mul_big(mpq(o), false);
+    }
+    mpq & operator*=(unsigned int k) { return *this *= mpz(k); }
+    mpq & operator*=(int k) { return mul_int(k); }
+
+    mpq & operator/=(mpq const & o) {
+        if (is_small() && o.is_small() && o.m_num != 0 && o.m_num != LONG_MIN &&
+            mul_small(o.m_num < 0 ? -o.m_den : o.m_den, o.m_num < 0 ? -o.m_num : o.m_num))
+            return *this;
+        return mul_big(o, true);
+    }
+    mpq & operator/=(mpz const & o) {
+        if (o.is_small()) return div_int(o.m_val);
+        return mul_big(mpq(o), true);
+    }
+    mpq & operator/=(unsigned int k) { return *this /= mpz(k); }
+    mpq & operator/=(int k) { return div_int(k); }
 
     friend mpq operator+(mpq a, mpq const & b) { return a += b; }
     friend mpq operator+(mpq a, mpz const & b) { return a += b; }
@@ -190,9 +287,9 @@ public:
     mpq operator-() const { mpq t = *this; t.neg(); return t; }
 
     // a <- numerator(b)
-    friend void numerator(mpz & a, mpq const & b) { mpz_set(zval(a), mpq_numref(b.m_val)); }
+    friend void numerator(mpz & a, mpq const & b) { b.numerator_core(a); }
     // a <- denominator(b)
-    friend void denominator(mpz & a, mpq const & b) { mpz_set(zval(a), mpq_denref(b.m_val)); }
+    friend void denominator(mpz & a, mpq const & b) { b.denominator_core(a); }
 
     mpz get_numerator() const { mpz r; numerator(r, *this); return r; }
     mpz get_denominator() const { mpz r; denominator(r, *this); return r; }
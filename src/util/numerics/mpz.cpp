@@ -10,11 +10,197 @@ Author: Leonardo de Moura
 #include "util/numerics/mpz.h"
 
 namespace lean {
+static_assert(sizeof(long) <= sizeof(mp_limb_t), "small mpz values must fit in a single GMP limb");
+
+mpz::gmp_view::gmp_view(mpz const & v) {
+    if (v.is_small()) {
+        m_limb = uabs(v.m_val);
+        m_ptr  = mpz_roinit_n(&m_tmp, &m_limb, v.m_val < 0 ? -1 : (v.m_val > 0 ? 1 : 0));
+    } else {
+        m_ptr  = v.m_ptr;
+    }
+}
+
+void mpz::to_big() {
+    if (m_ptr)
+        return;
+    m_ptr = new __mpz_struct;
+    mpz_init_set_si(m_ptr, m_val);
+}
+
+void mpz::normalize() {
+    if (m_ptr && mpz_fits_slong_p(m_ptr)) {
+        long v = mpz_get_si(m_ptr);
+        release();
+        m_val = v;
+    }
+}
+
+void mpz::set_big(mpz_srcptr v) {
+    if (m_ptr) {
+        mpz_set(m_ptr, v);
+    } else {
+        m_ptr = new __mpz_struct;
+        mpz_init_set(m_ptr, v);
+    }
+    normalize();
+}
+
+void mpz::release() {
+    mpz_clear(m_ptr);
+    delete m_ptr;
+    m_ptr = nullptr;
+}
+
+mpz & mpz::operator=(char const * v) {
+    to_big();
+    mpz_set_str(m_ptr, v, 10);
+    normalize();
+    return *this;
+}
+
+mpz & mpz::add_big(mpz const & o) {
+    to_big();
+    mpz_add(m_ptr, m_ptr, gmp_view(o));
+    normalize();
+    return *this;
+}
+
+mpz & mpz::sub_big(mpz const & o) {
+    to_big();
+    mpz_sub(m_ptr, m_ptr, gmp_view(o));
+    normalize();
+    return *this;
+}
+
+mpz & mpz::mul_big(mpz const & o) {
+    to_big();
+    mpz_mul(m_ptr, m_ptr, gmp_view(o));
+    normalize();
+    return *this;
+}
+
+mpz & mpz::div_big(mpz const & o) {
+    to_big();
+    mpz_tdiv_q(m_ptr, m_ptr, gmp_view(o));
+    normalize();
+    return *this;
+}
+
+mpz & mpz::add_big(long o) {
+    to_big();
+    if (o >= 0)
+        mpz_add_ui(m_ptr, m_ptr, o);
+    else
+        mpz_sub_ui(m_ptr, m_ptr, uabs(o));
+    normalize();
+    return *this;
+}
+
+mpz & mpz::mul_big(long o) {
+    to_big();
+    mpz_mul_si(m_ptr, m_ptr, o);
+    normalize();
+    return *this;
+}
+
+void mpz::addmul_big(mpz const & a, mpz const & b, bool sub) {
+    gmp_view va(a), vb(b);
+    to_big();
+    if (sub)
+        mpz_submul(m_ptr, va, vb);
+    else
+        mpz_addmul(m_ptr, va, vb);
+    normalize();
+}
+
+int mpz::cmp_big(mpz const & o) const {
+    // big values are outside of the range of long
+    if (is_small())
+        return -mpz_sgn(o.m_ptr);
+    if (o.is_small())
+        return mpz_sgn(m_ptr);
+    return mpz_cmp(m_ptr, o.m_ptr);
+}
+
+mpz rem(mpz const & a, mpz const & b) {
+    if (a.is_small() && b.is_small() && b.m_val != 0) {
+        if (b.m_val == -1)
+            return mpz();
+        return mpz(a.m_val % b.m_val);
+    }
+    mpz r;
+    r.to_big();
+    mpz_tdiv_r(r.m_ptr, mpz::gmp_view(a), mpz::gmp_view(b));
+    r.normalize();
+    return r;
+}
+
+mpz & mpz::operator&=(mpz const & o) {
+    if (is_small() && o.is_small()) {
+        m_val &= o.m_val;
+        return *this;
+    }
+    to_big();
+    mpz_and(m_ptr, m_ptr, gmp_view(o));
+    normalize();
+    return *this;
+}
+
+mpz & mpz::operator|=(mpz const & o) {
+    if (is_small() && o.is_small()) {
+        m_val |= o.m_val;
+        return *this;
+    }
+    to_big();
+    mpz_ior(m_ptr, m_ptr, gmp_view(o));
+    normalize();
+    return *this;
+}
+
+mpz & mpz::operator^=(mpz const & o) {
+    if (is_small() && o.is_small()) {
+        m_val ^= o.m_val;
+        return *this;
+    }
+    to_big();
+    mpz_xor(m_ptr, m_ptr, gmp_view(o));
+    normalize();
+    return *this;
+}
+
+static const unsigned g_long_bits = sizeof(long) * 8;
+
+void mul2k(mpz & a, mpz const & b, unsigned k) {
+    long r;
+    if (b.is_small() && k < g_long_bits - 1 && !__builtin_mul_overflow(b.m_val, 1l << k, &r)) {
+        a = r;
+        return;
+    }
+    mpz::gmp_view vb(b);
+    a.to_big();
+    mpz_mul_2exp(a.m_ptr, vb, k);
+    a.normalize();
+}
+
+void div2k(mpz & a, mpz const & b, unsigned k) {
+    if (b.is_small() && k < g_long_bits - 1) {
+        // division rounds toward zero like mpz_tdiv_q_2exp
+        a = b.m_val / (1l << k);
+        return;
+    }
+    mpz::gmp_view vb(b);
+    a.to_big();
+    mpz_tdiv_q_2exp(a.m_ptr, vb, k);
+    a.normalize();
+}
 
 unsigned mpz::log2() const {
     if (is_nonpos())
         return 0;
-    unsigned r = mpz_sizeinbase(m_val, 2);
+    if (is_small())
+        return g_long_bits - 1 - __builtin_clzl(m_val);
+    unsigned r = mpz_sizeinbase(m_ptr, 2);
     lean_assert(r > 0);
     return r - 1;
 }
@@ -22,19 +208,18 @@ unsigned mpz::log2() const {
 unsigned mpz::mlog2() const {
     if (is_nonneg())
         return 0;
-    mpz * _this = const_cast<mpz*>(this);
-    _this->neg();
-    lean_assert(is_pos());
-    unsigned r = mpz_sizeinbase(m_val, 2);
-    _this->neg();
-    lean_assert(is_neg());
+    if (is_small())
+        return g_long_bits - 1 - __builtin_clzl(uabs(m_val));
+    // mpz_sizeinbase ignores the sign
+    unsigned r = mpz_sizeinbase(m_ptr, 2);
+    lean_assert(r > 0);
     return r - 1;
 }
 
 bool mpz::is_power_of_two(unsigned & shift) const {
     if (is_nonpos())
         return false;
-    if (mpz_popcount(m_val) == 1) {
+    if (mpz_popcount(gmp_view(*this)) == 1) {
         shift = log2();
         return true;
     } else {
@@ -53,12 +238,54 @@ mpz operator%(mpz const & a, mpz const & b) {
     return r;
 }
 
+void power(mpz & a, mpz const & b, unsigned k) {
+    mpz::gmp_view vb(b);
+    a.to_big();
+    mpz_pow_ui(a.m_ptr, vb, k);
+    a.normalize();
+}
+
+void rootrem(mpz & root, mpz & rem, mpz const & a, unsigned k) {
+    mpz::gmp_view va(a);
+    root.to_big();
+    rem.to_big();
+    mpz_rootrem(root.m_ptr, rem.m_ptr, va, k);
+    root.normalize();
+    rem.normalize();
+}
+
 bool root(mpz & root, mpz const & a, unsigned k) {
     mpz rem;
-    mpz_rootrem(root.m_val, rem.m_val, a.m_val, k);
+    rootrem(root, rem, a, k);
     return rem.is_zero();
 }
 
+void gcd(mpz & g, mpz const & a, mpz const & b) {
+    if (a.is_small() && b.is_small()) {
+        // the result may be 2^63 when both arguments are LONG_MIN or zero
+        g = mpz::small_gcd(mpz::uabs(a.m_val), mpz::uabs(b.m_val));
+        return;
+    }
+    mpz::gmp_view va(a), vb(b);
+    g.to_big();
+    mpz_gcd(g.m_ptr, va, vb);
+    g.normalize();
+}
+
+void gcdext(mpz & g, mpz & s, mpz & t, mpz const & a, mpz const & b) {
+    mpz::gmp_view va(a), vb(b);
+    g.to_big(); s.to_big(); t.to_big();
+    mpz_gcdext(g.m_ptr, s.m_ptr, t.m_ptr, va, vb);
+    g.normalize(); s.normalize(); t.normalize();
+}
+
+void lcm(mpz & l, mpz const & a, mpz const & b) {
+    mpz::gmp_view va(a), vb(b);
+    l.to_big();
+    mpz_lcm(l.m_ptr, va, vb);
+    l.normalize();
+}
+
 void display(std::ostream & out, __mpz_struct const * v) {
     size_t sz = mpz_sizeinbase(v, 10) + 2;
     if (sz < 1024) {
@@ -73,7 +300,10 @@ void display(std::ostream & out, __mpz_struct const * v) {
 }
 
 std::ostream & operator<<(std::ostream & out, mpz const & v) {
-    display(out, v.m_val);
+    if (v.is_small())
+        out << v.m_val;
+    else
+        display(out, v.m_ptr);
     return out;
 }
 
@@ -5,7 +5,9 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Author: Leonardo de Moura
 */
 #pragma once
+#include <algorithm>
 #include <cstddef>
+#include <climits>
 #include <gmp.h>
 #include <iostream>
 #include "util/debug.h"
@@ -16,29 +18,69 @@ namespace lean {
 class mpq;
 
 /**
-   \brief Wrapper for GMP integers
+   \brief Wrapper for GMP integers.
+
+   Values that fit in a long are stored inline, and GMP is only used when an operation overflows.
+   The representation is canonical: m_ptr is not nullptr iff the value does not fit in a long.
 */
 class mpz {
     friend class mpq;
     friend class mpfp;
-    mpz_t m_val;
-    mpz(__mpz_struct const * v) { mpz_init_set(m_val, v); }
+    long           m_val; // the value when m_ptr == nullptr
+    __mpz_struct * m_ptr;
+
+    /** \brief Read-only GMP view of an mpz, it does not allocate memory for small values. */
+    class gmp_view {
+        __mpz_struct m_tmp;
+        mp_limb_t    m_limb;
+        mpz_srcptr   m_ptr;
+    public:
+        explicit gmp_view(mpz const & v);
+        gmp_view(gmp_view const &) = delete;
+        operator mpz_srcptr() const { return m_ptr; }
+    };
+
+    static unsigned long uabs(long v) { return v < 0 ? 0ul - static_cast<unsigned long>(v) : static_cast<unsigned long>(v); }
+    static unsigned long small_gcd(unsigned long a, unsigned long b) {
+        while (b != 0) { unsigned long r = a % b; a = b; b = r; }
+        return a;
+    }
+
+    bool is_small() const { return m_ptr == nullptr; }
+    /** \brief Move the value to GMP, the representation is not canonical until normalize() is invoked. */
+    void to_big();
+    /** \brief Move the value back inline if it fits in a long. */
+    void normalize();
+    void set_big(mpz_srcptr v);
+    void set_small(long v) { if (m_ptr) release(); m_val = v; }
+    void release();
+
+    mpz & add_big(mpz const & o);
+    mpz & sub_big(mpz const & o);
+    mpz & mul_big(mpz const & o);
+    mpz & div_big(mpz const & o);
+    mpz & add_big(long o);
+    mpz & mul_big(long o);
+    void addmul_big(mpz const & a, mpz const & b, bool sub);
+    int cmp_big(mpz const & o) const;
+
+    mpz(__mpz_struct const * v):m_val(0), m_ptr(nullptr) { set_big(v); }
 public:
-    mpz() { mpz_init(m_val); }
-    explicit mpz(char const * v) { mpz_init_set_str(m_val, const_cast<char*>(v), 10); }
-    explicit mpz(unsigned long int v) { mpz_init_set_ui(m_val, v); }
-    explicit mpz(long int v) { mpz_init_set_si(m_val, v); }
-    explicit mpz(unsigned int v) { mpz_init_set_ui(m_val, v); }
-    explicit mpz(int v) { mpz_init_set_si(m_val, v); }
-    mpz(mpz const & s) { mpz_init_set(m_val, s.m_val); }
-    mpz(mpz && s):mpz() { mpz_swap(m_val, s.m_val); }
-    ~mpz() { mpz_clear(m_val); }
+    mpz():m_val(0), m_ptr(nullptr) {}
+    explicit mpz(char const * v):mpz() { operator=(v); }
+    explicit mpz(unsigned long int v):mpz() { operator=(v); }
+    explicit mpz(long int v):m_val(v), m_ptr(nullptr) {}
+    explicit mpz(unsigned int v):mpz() { operator=(v); }
+    explicit mpz(int v):m_val(v), m_ptr(nullptr) {}
+    mpz(mpz const & s):m_val(s.m_val), m_ptr(nullptr) { if (s.m_ptr) set_big(s.m_ptr); }
+    mpz(mpz && s):m_val(s.m_val), m_ptr(s.m_ptr) { s.m_ptr = nullptr; }
+    ~mpz() { if (m_ptr) release(); }
 
-    friend void swap(mpz & a, mpz & b) { mpz_swap(a.m_val, b.m_val); }
+    friend void swap(mpz & a, mpz & b) { std::swap(a.m_val, b.m_val); std::swap(a.m_ptr, b.m_ptr); }
 
-    unsigned hash() const { return static_cast<unsigned>(mpz_get_si(m_val)); }
+    unsigned hash() const { return static_cast<unsigned>(is_small() ? m_val : mpz_get_si(m_ptr)); }
 
-    int sgn() const { return mpz_sgn(m_val); }
+    int sgn() const { return is_small() ? (m_val > 0) - (m_val < 0) : mpz_sgn(m_ptr); }
     friend int sgn(mpz const & a) { return a.sgn(); }
     bool is_pos() const { return sgn() > 0; }
     bool is_neg() const { return sgn() < 0; }
@@ -46,36 +88,60 @@ public:
     bool is_nonpos() const { return !is_pos(); }
     bool is_nonneg() const { return !is_neg(); }
 
-    void neg() { mpz_neg(m_val, m_val); }
+    void neg() {
+        if (is_small() && m_val != LONG_MIN) { m_val = -m_val; return; }
+        to_big(); mpz_neg(m_ptr, m_ptr); normalize();
+    }
     friend mpz neg(mpz a) { a.neg(); return a; }
 
-    void abs() { mpz_abs(m_val, m_val); }
+    void abs() { if (is_neg()) neg(); }
     friend mpz abs(mpz a) { a.abs(); return a; }
 
-    bool even() const { return mpz_even_p(m_val) != 0; }
+    bool even() const { return is_small() ? (m_val & 1) == 0 : mpz_even_p(m_ptr) != 0; }
     bool odd() const { return !even(); }
 
-    bool is_int() const { return mpz_fits_sint_p(m_val) != 0; }
-    bool is_unsigned_int() const { return mpz_fits_uint_p(m_val) != 0; }
-    bool is_long_int() const { return mpz_fits_slong_p(m_val) != 0; }
-    bool is_unsigned_long_int() const { return mpz_fits_ulong_p(m_val) != 0; }
+    bool is_int() const { return is_small() && INT_MIN <= m_val && m_val <= INT_MAX; }
+    bool is_unsigned_int() const { return is_small() ? 0 <= m_val && static_cast<unsigned long>(m_val) <= UINT_MAX : mpz_fits_uint_p(m_ptr) != 0; }
+    bool is_long_int() const { return is_small(); }
+    bool is_unsigned_long_int() const { return is_small() ? m_val >= 0 : mpz_fits_ulong_p(m_ptr) != 0; }
 
-    long int get_long_int() const { lean_assert(is_long_int()); return mpz_get_si(m_val); }
+    long int get_long_int() const { lean_assert(is_long_int()); return m_val; }
     int get_int() const { lean_assert(is_int()); return static_cast<int>(get_long_int()); }
-    unsigned long int get_unsigned_long_int() const { lean_assert(is_unsigned_long_int()); return mpz_get_ui(m_val); }
+    unsigned long int get_unsigned_long_int() const {
+        lean_assert(is_unsigned_long_int());
+        return is_small() ? static_cast<unsigned long>(m_val) : mpz_get_ui(m_ptr);
+    }
     unsigned int get_unsigned_int() const { lean_assert(is_unsigned_int()); return static_cast<unsigned>(get_unsigned_long_int()); }
 
-    mpz & operator=(mpz const & v) { mpz_set(m_val, v.m_val); return *this; }
+    mpz & operator=(mpz const & v) {
+        if (this == &v) return *this;
+        if (v.is_small()) set_small(v.m_val); else set_big(v.m_ptr);
+        return *this;
+    }
     mpz & operator=(mpz && v) { swap(*this, v); return *this; }
-    mpz & operator=(char const * v) { mpz_set_str(m_val, v, 10); return *this; }
-    mpz & operator=(unsigned long int v) { mpz_set_ui(m_val, v); return *this; }
-    mpz & operator=(long int v) { mpz_set_si(m_val, v); return *this; }
+    mpz & operator=(char const * v);
+    mpz & operator=(unsigned long int v) {
+        if (v <= static_cast<unsigned long>(LONG_MAX)) { set_small(static_cast<long>(v)); return *this; }
+        to_big(); mpz_set_ui(m_ptr, v); return *this;
+    }
+    mpz & operator=(long int v) { set_small(v); return *this; }
     mpz & operator=(unsigned int v) { return operator=(static_cast<unsigned long int>(v)); }
     mpz & operator=(int v) { return operator=(static_cast<long int>(v)); }
 
-    friend int cmp(mpz const & a, mpz const & b) { return mpz_cmp(a.m_val, b.m_val); }
-    friend int cmp(mpz const & a, unsigned b) { return mpz_cmp_ui(a.m_val, b); }
-    friend int cmp(mpz const & a, int b) { return mpz_cmp_si(a.m_val, b); }
+    friend int cmp(mpz const & a, mpz const & b) {
+        if (a.is_small() && b.is_small()) return (a.m_val > b.m_val) - (a.m_val < b.m_val);
+        return a.cmp_big(b);
+    }
+    friend int cmp(mpz const & a, unsigned b) {
+        if (!a.is_small()) return mpz_cmp_ui(a.m_ptr, b);
+        if (a.m_val < 0) return -1;
+        unsigned long v = static_cast<unsigned long>(a.m_val);
+        return (v > b) - (v < b);
+    }
+    friend int cmp(mpz const & a, int b) {
+        if (!a.is_small()) return mpz_cmp_si(a.m_ptr, b);
+        return (a.m_val > b) - (a.m_val < b);
+    }
 
     friend bool operator<(mpz const & a, mpz const & b) { return cmp(a, b) < 0; }
     friend bool operator<(mpz const & a, unsigned b) { return cmp(a, b) < 0; }
@@ -113,23 +179,66 @@ public:
     friend bool operator!=(unsigned a, mpz const & b) { return cmp(b, a) != 0; }
     friend bool operator!=(int a, mpz const & b) { return cmp(b, a) != 0; }
 
-    mpz & operator+=(mpz const & o) { mpz_add(m_val, m_val, o.m_val); return *this; }
-    mpz & operator+=(unsigned u) { mpz_add_ui(m_val, m_val, u); return *this; }
-    mpz & operator+=(int u) { if (u >= 0) mpz_add_ui(m_val, m_val, u); else mpz_sub_ui(m_val, m_val, -u); return *this; }
-
-    mpz & operator-=(mpz const & o) { mpz_sub(m_val, m_val, o.m_val); return *this; }
-    mpz & operator-=(unsigned u) { mpz_sub_ui(m_val, m_val, u); return *this; }
-    mpz & operator-=(int u) { if (u >= 0) mpz_sub_ui(m_val, m_val, u); else mpz_add_ui(m_val, m_val, -u); return *this; }
-
-    mpz & operator*=(mpz const & o) { mpz_mul(m_val, m_val, o.m_val); return *this; }
-    mpz & operator*=(unsigned u) { mpz_mul_ui(m_val, m_val, u); return *this; }
-    mpz & operator*=(int u) { mpz_mul_si(m_val, m_val, u); return *this; }
-
-    mpz & operator/=(mpz const & o) { mpz_tdiv_q(m_val, m_val, o.m_val); return *this; }
-    mpz & operator/=(unsigned u) { mpz_tdiv_q_ui(m_val, m_val, u); return *this; }
-
-    friend mpz rem(mpz const & a, mpz const & b) { mpz r; mpz_tdiv_r(r.m_val, a.m_val, b.m_val); return r; }
-    mpz & operator%=(mpz const & o) { mpz r(*this % o); mpz_swap(m_val, r.m_val); return *this; }
+    mpz & operator+=(mpz const & o) {
+        long r;
+        if (is_small() && o.is_small() && !__builtin_add_overflow(m_val, o.m_val, &r)) { m_val = r; return *this; }
+        return add_big(o);
+    }
+    mpz & operator+=(unsigned u) {
+        long r;
+        if (is_small() && !__builtin_add_overflow(m_val, u, &r)) { m_val = r; return *this; }
+        return add_big(mpz(u));
+    }
+    mpz & operator+=(int u) {
+        long r;
+        if (is_small() && !__builtin_add_overflow(m_val, u, &r)) { m_val = r; return *this; }
+        return add_big(static_cast<long>(u));
+    }
+
+    mpz & operator-=(mpz const & o) {
+        long r;
+        if (is_small() && o.is_small() && !__builtin_sub_overflow(m_val, o.m_val, &r)) { m_val = r; return *this; }
+        return sub_big(o);
+    }
+    mpz & operator-=(unsigned u) {
+        long r;
+        if (is_small() && !__builtin_sub_overflow(m_val, u, &r)) { m_val = r; return *this; }
+        return sub_big(mpz(u));
+    }
+    mpz & operator-=(int u) {
+        long r;
+        if (is_small() && !__builtin_sub_overflow(m_val, u, &r)) { m_val = r; return *this; }
+        return sub_big(mpz(u));
+    }
+
+    mpz & operator*=(mpz const & o) {
+        long r;
+        if (is_small() && o.is_small() && !__builtin_mul_overflow(m_val, o.m_val, &r)) { m_val = r; return *this; }
+        return mul_big(o);
+    }
+    mpz & operator*=(unsigned u) {
+        long r;
+        if (is_small() && !__builtin_mul_overflow(m_val, u, &r)) { m_val = r; return *this; }
+        return mul_big(mpz(u));
+    }
+    mpz & operator*=(int u) {
+        long r;
+        if (is_small() && !__builtin_mul_overflow(m_val, u, &r)) { m_val = r; return *this; }
+        return mul_big(static_cast<long>(u));
+    }
+
+    mpz & operator/=(mpz const & o) {
+        if (is_small() && o.is_small() && o.m_val != 0 && !(m_val == LONG_MIN && o.m_val == -1)) { m_val /= o.m_val; return *this; }
+        return div_big(o);
+    }
+    mpz & operator/=(unsigned u) {
+        /* When unsigned is narrower than long, every u fits in a long. Otherwise (e.g., LLP64), use the slow path. */
+        if (sizeof(unsigned) < sizeof(long) && is_small() && u != 0) { m_val /= static_cast<long>(u); return *this; }
+        return div_big(mpz(u));
+    }
+
+    friend mpz rem(mpz const & a, mpz const & b);
+    mpz & operator%=(mpz const & o) { mpz r(*this % o); swap(*this, r); return *this; }
 
     friend mpz operator+(mpz a, mpz const & b) { return a += b; }
     friend mpz operator+(mpz a, unsigned b)  { return a += b; }
@@ -163,10 +272,13 @@ public:
     mpz & operator--() { return operator-=(1); }
     mpz operator--(int) { mpz r(*this); --(*this); return r; }
 
-    mpz & operator&=(mpz const & o) { mpz_and(m_val, m_val, o.m_val); return *this; }
-    mpz & operator|=(mpz const & o) { mpz_ior(m_val, m_val, o.m_val); return *this; }
-    mpz & operator^=(mpz const & o) { mpz_xor(m_val, m_val, o.m_val); return *this; }
-    void comp() { mpz_com(m_val, m_val); }
+    mpz & operator&=(mpz const & o);
+    mpz & operator|=(mpz const & o);
+    mpz & operator^=(mpz const & o);
+    void comp() {
+        if (is_small()) { m_val = ~m_val; return; }
+        mpz_com(m_ptr, m_ptr); normalize();
+    }
 
     friend mpz operator&(mpz a, mpz const & b) { return a &= b; }
     friend mpz operator|(mpz a, mpz const & b) { return a |= b; }
@@ -174,14 +286,24 @@ public:
     friend mpz operator~(mpz a) { a.comp(); return a; }
 
     // this <- this + a*b
-    void addmul(mpz const & a, mpz const & b) { mpz_addmul(m_val, a.m_val, b.m_val); }
+    void addmul(mpz const & a, mpz const & b) {
+        long p, r;
+        if (is_small() && a.is_small() && b.is_small() &&
+            !__builtin_mul_overflow(a.m_val, b.m_val, &p) && !__builtin_add_overflow(m_val, p, &r)) { m_val = r; return; }
+        addmul_big(a, b, false);
+    }
     // this <- this - a*b
-    void submul(mpz const & a, mpz const & b) { mpz_submul(m_val, a.m_val, b.m_val); }
+    void submul(mpz const & a, mpz const & b) {
+        long p, r;
+        if (is_small() && a.is_small() && b.is_small() &&
+            !__builtin_mul_overflow(a.m_val, b.m_val, &p) && !__builtin_sub_overflow(m_val, p, &r)) { m_val = r; return; }
+        addmul_big(a, b, true);
+    }
 
     // a <- b * 2^k
-    friend void mul2k(mpz & a, mpz const & b, unsigned k) { mpz_mul_2exp(a.m_val, b.m_val, k); }
+    friend void mul2k(mpz & a, mpz const & b, unsigned k);
     // a <- b / 2^k
-    friend void div2k(mpz & a, mpz const & b, unsigned k) { mpz_tdiv_q_2exp(a.m_val, b.m_val, k); }
+    friend void div2k(mpz & a, mpz const & b, unsigned k);
 
     /**
        \brief Return the position of the most significant bit.
@@ -195,28 +317,28 @@ public:
     */
     unsigned mlog2() const;
 
-    bool perfect_square() const { return mpz_perfect_square_p(m_val); }
+    bool perfect_square() const { return mpz_perfect_square_p(gmp_view(*this)); }
 
-    bool is_power_of_two() const { return is_pos() && mpz_popcount(m_val) == 1; }
+    bool is_power_of_two() const { return is_pos() && mpz_popcount(gmp_view(*this)) == 1; }
     bool is_power_of_two(unsigned & shift) const;
     /**
        \brief Return largest k s.t. n is a multiple of 2^k
     */
-    unsigned power_of_two_multiple() const { return mpz_scan1(m_val, 0); }
+    unsigned power_of_two_multiple() const { return mpz_scan1(gmp_view(*this), 0); }
 
-    friend void power(mpz & a, mpz const & b, unsigned k) { mpz_pow_ui(a.m_val, b.m_val, k); }
+    friend void power(mpz & a, mpz const & b, unsigned k);
     friend void _power(mpz & a, mpz const & b, unsigned k) { power(a, b, k); }
     friend mpz pow(mpz a, unsigned k) { power(a, a, k); return a; }
 
-    friend void rootrem(mpz & root, mpz & rem, mpz const & a, unsigned k) { mpz_rootrem(root.m_val, rem.m_val, a.m_val, k); }
+    friend void rootrem(mpz & root, mpz & rem, mpz const & a, unsigned k);
     // root <- a^{1/k}, return true iff the result is an integer
     friend bool root(mpz & root, mpz const & a, unsigned k);
     friend mpz root(mpz const & a, unsigned k) { mpz r; root(r, a, k); return r; }
 
-    friend void gcd(mpz & g, mpz const & a, mpz const & b) { mpz_gcd(g.m_val, a.m_val, b.m_val); }
+    friend void gcd(mpz & g, mpz const & a, mpz const & b);
     friend mpz gcd(mpz const & a, mpz const & b) { mpz r; gcd(r, a, b); return r; }
-    friend void gcdext(mpz & g, mpz & s, mpz & t, mpz const & a, mpz const & b) { mpz_gcdext(g.m_val, s.m_val, t.m_val, a.m_val, b.m_val); }
-    friend void lcm(mpz & l, mpz const & a, mpz const & b) { mpz_lcm(l.m_val, a.m_val, b.m_val); }
+    friend void gcdext(mpz & g, mpz & s, mpz & t, mpz const & a, mpz const & b);
+    friend void lcm(mpz & l, mpz const & a, mpz const & b);
     friend mpz lcm(mpz const & a, mpz const & b) { mpz l; lcm(l, a, b); return l; }
 
     friend std::ostream & operator<<(std::ostream & out, mpz const & v);
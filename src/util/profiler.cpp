@@ -0,0 +1,330 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <map>
+#include <utility>
+#include <unordered_map>
+#include <algorithm>
+#include <iomanip>
+#include "util/thread.h"
+#include "util/hash.h"
+#include "util/profiler.h"
+
+namespace lean {
+static bool same_phase(char const * p1, char const * p2) {
+    return p1 == p2 || strcmp(p1, p2) == 0;
+}
+
+static bool is_declaration_phase(char const * p) {
+    return strcmp(p, "declaration") == 0;
+}
+
+typedef std::pair<char const *, name> profile_key;
+
+struct profile_key_hash {
+    unsigned operator()(profile_key const & k) const {
+        /* Phases are compared using strcmp (see same_phase), so we hash their contents. */
+        return hash(hash_str(strlen(k.first), k.first, 31), k.second.hash());
+    }
+};
+
+struct profile_key_eq {
+    bool operator()(profile_key const & k1, profile_key const & k2) const {
+        return same_phase(k1.first, k2.first) && k1.second == k2.second;
+    }
+};
+
+struct profile_node {
+    char const *                               m_phase;
+    name                                       m_detail;
+    profile_node *                             m_parent;
+    std::vector<std::unique_ptr<profile_node>> m_children; // in creation order
+    /* Index for m_children. A node may have many children, e.g., vm_state::invoke opens a scope per function. */
+    std::unordered_map<profile_key, profile_node *, profile_key_hash, profile_key_eq> m_child_map;
+    double                                     m_time; // wall-clock time in seconds, including children
+    unsigned                                   m_count;
+    profile_node(char const * phase, name const & detail, profile_node * parent):
+        m_phase(phase), m_detail(detail), m_parent(parent), m_time(0.0), m_count(0) {}
+
+    profile_node * get_child(char const * phase, name const & detail) {
+        auto it = m_child_map.find(profile_key(phase, detail));
+        if (it != m_child_map.end())
+            return it->second;
+        m_children.emplace_back(new profile_node(phase, detail, this));
+        profile_node * c = m_children.back().get();
+        m_child_map.insert(std::make_pair(profile_key(phase, detail), c));
+        return c;
+    }
+
+    double self_time() const {
+        double r = m_time;
+        for (auto const & c : m_children)
+            r -= c->m_time;
+        /* Remark: it may be negative for scopes inherited using profile_context_scope */
+        return std::max(r, 0.0);
+    }
+};
+
+static bool                         g_profiler_enabled = false;
+static mutex *                      g_profile_mutex    = nullptr;
+static std::vector<profile_node*> * g_profile_roots    = nullptr; // one per thread
+LEAN_THREAD_PTR(profile_node, g_profile_current);
+
+void enable_profiler(bool flag) {
+    g_profiler_enabled = flag;
+}
+
+bool is_profiler_enabled() {
+    return g_profiler_enabled;
+}
+
+static profile_node * get_current_node() {
+    if (!g_profile_current) {
+        profile_node * root = new profile_node(nullptr, name(), nullptr);
+        lock_guard<mutex> lock(*g_profile_mutex);
+        g_profile_roots->push_back(root);
+        g_profile_current = root;
+    }
+    return g_profile_current;
+}
+
+profile_scope::profile_scope(char const * phase, name const & detail) {
+    if (!g_profiler_enabled) {
+        m_node = nullptr;
+        return;
+    }
+    m_node            = get_current_node()->get_child(phase, detail);
+    g_profile_current = m_node;
+    m_start           = std::chrono::steady_clock::now();
+}
+
+profile_scope::~profile_scope() {
+    if (m_node) {
+        auto end = std::chrono::steady_clock::now();
+        m_node->m_time += std::chrono::duration<double>(end - m_start).count();
+        m_node->m_count++;
+        g_profile_current = m_node->m_parent;
+    }
+}
+
+profile_context get_profile_context() {
+    profile_context r;
+    if (!g_profiler_enabled)
+        return r;
+    for (profile_node * it = get_current_node(); it->m_parent; it = it->m_parent)
+        r.emplace_back(it->m_phase, it->m_detail);
+    std::reverse(r.begin(), r.end());
+    return r;
+}
+
+profile_context_scope::profile_context_scope(profile_context const & ctx) {
+    if (!g_profiler_enabled) {
+        m_old_node = nullptr;
+        return;
+    }
+    m_old_node = get_current_node();
+    profile_node * node = m_old_node;
+    while (node->m_parent)
+        node = node->m_parent;
+    for (auto const & p : ctx)
+        node = node->get_child(p.first, p.second);
+    g_profile_current = node;
+}
+
+profile_context_scope::~profile_context_scope() {
+    if (m_old_node)
+        g_profile_current = m_old_node;
+}
+
+static void merge(profile_node & dst, profile_node const & src) {
+    dst.m_time  += src.m_time;
+    dst.m_count += src.m_count;
+    for (auto const & c : src.m_children)
+        merge(*dst.get_child(c->m_phase, c->m_detail), *c);
+}
+
+/* Remark: the result is only accurate if the profiled threads are not executing profile scopes. */
+static std::unique_ptr<profile_node> mk_merged_profile() {
+    std::unique_ptr<profile_node> r(new profile_node(nullptr, name(), nullptr));
+    lock_guard<mutex> lock(*g_profile_mutex);
+    for (profile_node const * root : *g_profile_roots)
+        merge(*r, *root);
+    for (auto const & c : r->m_children)
+        r->m_time += c->m_time;
+    return r;
+}
+
+static std::string get_frame(profile_node const & n) {
+    std::string r = n.m_phase;
+    if (!n.m_detail.is_anonymous())
+        r += " " + n.m_detail.to_string();
+    /* ';' separates frames in the folded stack format */
+    std::replace(r.begin(), r.end(), ';', ',');
+    std::replace(r.begin(), r.end(), '\n', ' ');
+    return r;
+}
+
+static void display_folded(std::ostream & out, profile_node const & n, std::string const & stack) {
+    for (auto const & c : n.m_children) {
+        std::string new_stack = stack.empty() ? get_frame(*c) : stack + ";" + get_frame(*c);
+        unsigned long long self = static_cast<unsigned long long>(c->self_time() * 1000000.0);
+        if (self > 0)
+            out << new_stack << " " << self << "\n";
+        display_folded(out, *c, new_stack);
+    }
+}
+
+void display_profile_folded(std::ostream & out) {
+    display_folded(out, *mk_merged_profile(), std::string());
+}
+
+struct phase_stats {
+    double   m_time  = 0.0;
+    double   m_self  = 0.0;
+    unsigned m_count = 0;
+};
+
+struct declaration_stats {
+    double                        m_time = 0.0;
+    std::map<std::string, double> m_phases; // exclusive time of each phase
+};
+
+struct profile_stats {
+    double                                                  m_total = 0.0;
+    std::map<std::string, phase_stats>                      m_phases;
+    std::unordered_map<name, declaration_stats, name_hash>  m_decls;
+
+    void collect(profile_node const & n, std::vector<char const *> & open_phases, declaration_stats * decl) {
+        for (auto const & c : n.m_children) {
+            bool nested = std::any_of(open_phases.begin(), open_phases.end(),
+                                      [&](char const * p) { return same_phase(p, c->m_phase); });
+            double self = c->self_time();
+            phase_stats & s = m_phases[c->m_phase];
+            if (!nested)
+                s.m_time += c->m_time;
+            s.m_self  += self;
+            s.m_count += c->m_count;
+            declaration_stats * c_decl = decl;
+            if (is_declaration_phase(c->m_phase)) {
+                c_decl = &m_decls[c->m_detail];
+                if (!nested)
+                    c_decl->m_time += c->m_time;
+            }
+            if (c_decl)
+                c_decl->m_phases[c->m_phase] += self;
+            open_phases.push_back(c->m_phase);
+            collect(*c, open_phases, c_decl);
+            open_phases.pop_back();
+        }
+    }
+
+    profile_stats() {
+        std::unique_ptr<profile_node> root = mk_merged_profile();
+        m_total = root->m_time;
+        std::vector<char const *> open_phases;
+        collect(*root, open_phases, nullptr);
+    }
+
+    /* Return the phases sorted by exclusive time */
+    std::vector<std::pair<std::string, phase_stats>> get_phases() const {
+        std::vector<std::pair<std::string, phase_stats>> r(m_phases.begin(), m_phases.end());
+        std::stable_sort(r.begin(), r.end(), [](std::pair<std::string, phase_stats> const & p1,
+                                                std::pair<std::string, phase_stats> const & p2) {
+                             return p1.second.m_self > p2.second.m_self;
+                         });
+        return r;
+    }
+
+    /* Return the declarations sorted by time */
+    std::vector<std::pair<name, declaration_stats>> get_decls() const {
+        std::vector<std::pair<name, declaration_stats>> r(m_decls.begin(), m_decls.end());
+        std::sort(r.begin(), r.end(), [](std::pair<name, declaration_stats> const & p1,
+                                         std::pair<name, declaration_stats> const & p2) {
+                      if (p1.second.m_time != p2.second.m_time)
+                          return p1.second.m_time > p2.second.m_time;
+                      return quick_cmp(p1.first, p2.first) < 0;
+                  });
+        return r;
+    }
+};
+
+static void display_json_string(std::ostream & out, std::string const & s) {
+    out << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<unsigned>(c)
+                << std::dec << std::setfill(' ');
+        else
+            out << c;
+    }
+    out << '"';
+}
+
+void display_profile_json(std::ostream & out) {
+    profile_stats stats;
+    out << std::fixed << std::setprecision(6);
+    out << "{\"total\": " << stats.m_total << ",\n \"phases\": [";
+    bool first = true;
+    for (auto const & p : stats.get_phases()) {
+        out << (first ? "\n  " : ",\n  ");
+        first = false;
+        out << "{\"phase\": ";
+        display_json_string(out, p.first);
+        out << ", \"time\": " << p.second.m_time << ", \"self\": " << p.second.m_self
+            << ", \"count\": " << p.second.m_count << "}";
+    }
+    out << "],\n \"declarations\": [";
+    first = true;
+    for (auto const & d : stats.get_decls()) {
+        out << (first ? "\n  " : ",\n  ");
+        first = false;
+        out << "{\"name\": ";
+        display_json_string(out, d.first.to_string());
+        out << ", \"time\": " << d.second.m_time << ", \"phases\": {";
+        bool first_phase = true;
+        for (auto const & p : d.second.m_phases) {
+            if (!first_phase)
+                out << ", ";
+            first_phase = false;
+            display_json_string(out, p.first);
+            out << ": " << p.second;
+        }
+        out << "}}";
+    }
+    out << "]}\n";
+}
+
+void display_profile_summary(std::ostream & out) {
+    profile_stats stats;
+    out << std::fixed << std::setprecision(5);
+    out << "total time " << stats.m_total << " secs\n";
+    out << std::left << std::setw(32) << "phase" << std::right << std::setw(12) << "time"
+        << std::setw(12) << "self" << std::setw(12) << "count" << "\n";
+    for (auto const & p : stats.get_phases()) {
+        out << std::left << std::setw(32) << p.first << std::right << std::setw(12) << p.second.m_time
+            << std::setw(12) << p.second.m_self << std::setw(12) << p.second.m_count << "\n";
+    }
+}
+
+void initialize_profiler() {
+    g_profile_mutex = new mutex();
+    g_profile_roots = new std::vector<profile_node*>();
+}
+
+void finalize_profiler() {
+    for (profile_node * root : *g_profile_roots)
+        delete root;
+    delete g_profile_roots;
+    delete g_profile_mutex;
+    g_profile_current = nullptr;
+}
+}
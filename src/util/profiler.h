@@ -0,0 +1,65 @@
+/*
+Copyright (c) 2016 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#pragma once
+#include <chrono>
+#include <vector>
+#include <utility>
+#include <iostream>
+#include "util/name.h"
+
+namespace lean {
+struct profile_node;
+
+/** \brief Hierarchical wall-clock profiler.
+
+    The code being profiled is delimited by (nested) \c profile_scope objects. Each scope has a phase
+    (e.g., "elaboration") and an optional detail (e.g., the name of the declaration being elaborated).
+    Each thread records the time spent in its scopes in its own tree, where a node is identified by
+    the phases and details of its ancestors. So, there is no synchronization when a scope is opened or closed.
+    The trees of all threads are merged when the profile is displayed.
+
+    When the profiler is disabled, a \c profile_scope only checks a flag. */
+void enable_profiler(bool flag);
+bool is_profiler_enabled();
+
+class profile_scope {
+    profile_node *                        m_node;
+    std::chrono::steady_clock::time_point m_start;
+public:
+    /** \remark \c phase must be a string literal. */
+    profile_scope(char const * phase, name const & detail = name());
+    ~profile_scope();
+};
+
+/** \brief The (phase, detail) pairs of the scopes opened by the current thread. */
+typedef std::vector<std::pair<char const *, name>> profile_context;
+profile_context get_profile_context();
+
+/** \brief Make the scopes in \c ctx the scopes of the current thread. It is used to attribute the work performed
+    by a task executed in a different thread to the scopes that were open when the task was created.
+    The time spent in these scopes is only accumulated by the thread that opened them. */
+class profile_context_scope {
+    profile_node * m_old_node;
+public:
+    profile_context_scope(profile_context const & ctx);
+    ~profile_context_scope();
+};
+
+/** \brief Display the profile in the folded stack format used by flame graph tools.
+    Each line has the form <tt>frame_1;...;frame_n time</tt> where \c time is the time in microseconds
+    spent in \c frame_n but not in its children. */
+void display_profile_folded(std::ostream & out);
+/** \brief Display a JSON object with the total and exclusive time (in seconds) and the number of scopes of each
+    phase, and the time spent in each phase by each declaration.
+    Remark: the total time of a phase does not count nested scopes of the same phase twice. */
+void display_profile_json(std::ostream & out);
+/** \brief Display the information produced by \c display_profile_json as a table. */
+void display_profile_summary(std::ostream & out);
+
+void initialize_profiler();
+void finalize_profiler();
+}
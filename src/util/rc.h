@@ -10,20 +10,40 @@ Author: Leonardo de Moura
 #include "util/thread.h"
 #include "util/debug.h"
 
+namespace lean {
+/** \brief Increment the reference counter \c rc.
+    Non-atomic operations are used if reference counted objects are thread-confined (see thread_confined_rc_scope). */
+inline void rc_inc(atomic<unsigned> & rc) {
+    if (is_rc_thread_confined())
+        rc.store(rc.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    else
+        atomic_fetch_add_explicit(&rc, 1u, memory_order_relaxed);
+}
+
+/** \brief Decrement the reference counter \c rc, and return true if it is now zero. */
+inline bool rc_dec(atomic<unsigned> & rc) {
+    if (is_rc_thread_confined()) {
+        unsigned r = rc.load(memory_order_relaxed) - 1;
+        rc.store(r, memory_order_relaxed);
+        return r == 0;
+    } else if (atomic_fetch_sub_explicit(&rc, 1u, memory_order_release) == 1u) {
+        atomic_thread_fence(memory_order_acquire);
+        return true;
+    } else {
+        return false;
+    }
+}
+}
+
 #define MK_LEAN_RC()                                                    \
 private:                                                                \
 atomic<unsigned> m_rc;                                                  \
 public:                                                                 \
 unsigned get_rc() const { return atomic_load(&m_rc); }                  \
-void inc_ref() { atomic_fetch_add_explicit(&m_rc, 1u, memory_order_relaxed); } \
+void inc_ref() { rc_inc(m_rc); }                                        \
 bool dec_ref_core() {                                                   \
     lean_assert(get_rc() > 0);                                          \
-    if (atomic_fetch_sub_explicit(&m_rc, 1u, memory_order_release) == 1u) { \
-        atomic_thread_fence(memory_order_acquire);                      \
-        return true;                                                    \
-    } else {                                                            \
-        return false;                                                   \
-    }                                                                   \
+    return rc_dec(m_rc);                                                \
 }                                                                       \
 void dec_ref() { if (dec_ref_core()) { dealloc(); } }
 
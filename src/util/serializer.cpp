@@ -23,23 +23,29 @@ void finalize_serializer() {
     serializer::finalize();
 }
 
-void serializer_core::write_unsigned(unsigned i) {
-    static_assert(sizeof(i) == 4, "unexpected unsigned size");
-    if (i < 255) {
-        m_out.put(i & 0xff);
-    } else {
-        m_out.put(0xff);
-        m_out.put((i >> 24) & 0xff);
-        m_out.put((i >> 16) & 0xff);
-        m_out.put((i >> 8) & 0xff);
-        m_out.put(i & 0xff);
+void serializer_core::write(char const * data, size_t sz) {
+    if (!m_out)
+        m_buffer.insert(m_buffer.end(), data, data + sz);
+    else if (m_out->rdbuf()->sputn(data, sz) != static_cast<std::streamsize>(sz))
+        m_out->setstate(std::ios_base::badbit);
+}
+
+void serializer_core::write_unsigned_ext(unsigned i) {
+    // LEB128: 7 bits per byte, least significant group first, the high bit marks continuation
+    while (i >= 0x80) {
+        put(static_cast<char>((i & 0x7f) | 0x80));
+        i >>= 7;
     }
+    put(static_cast<char>(i));
 }
 
 void serializer_core::write_uint64(uint64 i) {
     static_assert(sizeof(i) == 8, "unexpected uint64 size");
-    write_unsigned((i >> 32) & 0xffffffff);
-    write_unsigned(i & 0xffffffff);
+    while (i >= 0x80) {
+        put(static_cast<char>((i & 0x7f) | 0x80));
+        i >>= 7;
+    }
+    put(static_cast<char>(i));
 }
 
 void serializer_core::write_int(int i) {
@@ -64,34 +70,52 @@ void serializer_core::write_double(double d) {
 }
 
 std::string deserializer_core::read_string() {
+    if (!m_in) {
+        char const * e = static_cast<char const *>(memchr(m_curr, 0, m_end - m_curr));
+        if (!e)
+            throw corrupted_stream_exception();
+        std::string r(m_curr, e);
+        m_curr = e + 1;
+        return r;
+    }
     std::string r;
     while (true) {
-        char c = m_in.get();
+        int c = get();
         if (c == 0)
             break;
         if (c == EOF)
             throw corrupted_stream_exception();
-        r += c;
+        r += static_cast<char>(c);
     }
     return r;
 }
 
-unsigned deserializer_core::read_unsigned_ext() {
-    unsigned r;
+unsigned deserializer_core::read_unsigned_ext(int c) {
+    unsigned r = 0;
     static_assert(sizeof(r) == 4, "unexpected unsigned size");
-    r  = static_cast<unsigned>(m_in.get()) << 24;
-    r |= static_cast<unsigned>(m_in.get()) << 16;
-    r |= static_cast<unsigned>(m_in.get()) << 8;
-    r |= static_cast<unsigned>(m_in.get());
-    return r;
+    for (unsigned shift = 0; ; shift += 7) {
+        /* the 5th byte can only contribute the 4 most significant bits */
+        if (c == EOF || shift > 28 || (shift == 28 && (c & 0x7f) > 0xf))
+            throw corrupted_stream_exception();
+        r |= static_cast<unsigned>(c & 0x7f) << shift;
+        if (c < 0x80)
+            return r;
+        c = get();
+    }
 }
 
 uint64 deserializer_core::read_uint64() {
-    uint64 r;
+    uint64 r = 0;
     static_assert(sizeof(r) == 8, "unexpected uint64 size");
-    r  = static_cast<uint64>(read_unsigned()) << 32;
-    r |= static_cast<uint64>(read_unsigned());
-    return r;
+    for (unsigned shift = 0; ; shift += 7) {
+        int c = get();
+        /* the 10th byte can only contribute the most significant bit */
+        if (c == EOF || shift > 63 || (shift == 63 && (c & 0x7f) > 1))
+            throw corrupted_stream_exception();
+        r |= static_cast<uint64>(c & 0x7f) << shift;
+        if (c < 0x80)
+            return r;
+    }
 }
 
 double deserializer_core::read_double() {
@@ -103,7 +127,24 @@ double deserializer_core::read_double() {
 }
 
 void deserializer_core::read(std::vector<char> & data) {
-    unsigned sz = data.size();
-    m_in.read(data.data(), sz);
+    size_t sz = data.size();
+    if (m_in) {
+        if (m_in->rdbuf()->sgetn(data.data(), sz) != static_cast<std::streamsize>(sz))
+            throw corrupted_stream_exception();
+    } else {
+        if (static_cast<size_t>(m_end - m_curr) < sz)
+            throw corrupted_stream_exception();
+        memcpy(data.data(), m_curr, sz);
+        m_curr += sz;
+    }
+}
+
+char const * deserializer_core::read_block(size_t sz) {
+    lean_assert(!m_in);
+    if (static_cast<size_t>(m_end - m_curr) < sz)
+        throw corrupted_stream_exception();
+    char const * r = m_curr;
+    m_curr += sz;
+    return r;
 }
 }
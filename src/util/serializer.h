@@ -10,28 +10,50 @@ Author: Leonardo de Moura
 #include <string>
 #include <sstream>
 #include <cstring>
+#include <cstdio>
 #include "util/extensible_object.h"
 #include "util/list.h"
 #include "util/buffer.h"
 #include "util/int64.h"
 #include "util/optional.h"
+#include "util/debug.h"
 
 namespace lean {
 /**
    \brief Low-tech serializer.
    The actual functionality is implemented using extensions.
+
+   Bytes are written directly to the stream buffer of the given output stream, or, when no
+   stream is provided, appended to a growable contiguous buffer (see #data and #size).
+   Unsigned integers are encoded using LEB128.
 */
 class serializer_core {
-    std::ostream & m_out;
+    std::ostream *    m_out;
+    std::vector<char> m_buffer; // used only when m_out == nullptr
+    void put(char c) {
+        if (!m_out)
+            m_buffer.push_back(c);
+        else if (m_out->rdbuf()->sputc(c) == std::char_traits<char>::eof())
+            m_out->setstate(std::ios_base::badbit);
+    }
+    void write_unsigned_ext(unsigned i);
 public:
-    serializer_core(std::ostream & out):m_out(out) {}
-    void write_string(char const * str) { m_out.write(str, strlen(str) + 1); }
-    void write_string(std::string const & str) { m_out.write(str.c_str(), str.size() + 1); }
-    void write_unsigned(unsigned i);
+    serializer_core(std::ostream & out):m_out(&out) {}
+    serializer_core():m_out(nullptr) {}
+    /** \brief Contents written so far. \pre The serializer was created without an output stream. */
+    char const * data() const { lean_assert(!m_out); return m_buffer.data(); }
+    size_t size() const { lean_assert(!m_out); return m_buffer.size(); }
+    // write sz bytes stored at data
+    void write(char const * data, size_t sz);
+    void write_string(char const * str) { write(str, strlen(str) + 1); }
+    void write_string(std::string const & str) { write(str.c_str(), str.size() + 1); }
+    void write_unsigned(unsigned i) {
+        if (i < 0x80) put(static_cast<char>(i)); else write_unsigned_ext(i);
+    }
     void write_uint64(uint64 i);
     void write_int(int i);
-    void write_char(char c) { m_out.put(c); }
-    void write_bool(bool b) { m_out.put(b ? 1 : 0); }
+    void write_char(char c) { put(c); }
+    void write_bool(bool b) { put(b ? 1 : 0); }
     void write_double(double b);
 };
 
@@ -47,26 +69,40 @@ inline serializer & operator<<(serializer & s, bool b) { s.write_bool(b); return
 inline serializer & operator<<(serializer & s, double b) { s.write_double(b); return s; }
 
 /**
-   \brief Low-tech serializer.
+   \brief Low-tech deserializer.
    The actual functionality is implemented using extensions.
+
+   Bytes are read from a contiguous block of memory, or from the stream buffer of the given input stream.
 */
 class deserializer_core {
-    std::istream & m_in;
-    unsigned read_unsigned_ext();
+    std::istream * m_in;
+    char const *   m_begin;
+    char const *   m_curr;
+    char const *   m_end;
+    // Return the next byte, or EOF
+    int get() { return m_curr != m_end ? static_cast<unsigned char>(*(m_curr++)) : get_core(); }
+    int get_core() { return m_in ? m_in->rdbuf()->sbumpc() : EOF; }
+    unsigned read_unsigned_ext(int c);
 public:
-    deserializer_core(std::istream & in):m_in(in) {}
+    deserializer_core(std::istream & in):m_in(&in), m_begin(nullptr), m_curr(nullptr), m_end(nullptr) {}
+    /** \brief Read from the given block of memory, it must outlive the deserializer. */
+    deserializer_core(char const * data, size_t sz):m_in(nullptr), m_begin(data), m_curr(data), m_end(data + sz) {}
+    /** \brief Number of bytes consumed so far. \pre The deserializer was created for a block of memory. */
+    size_t pos() const { lean_assert(!m_in); return m_curr - m_begin; }
     std::string read_string();
     unsigned read_unsigned() {
-        unsigned r = static_cast<unsigned>(m_in.get());
-        return r < 255 ? r : read_unsigned_ext();
+        int c = get();
+        return 0 <= c && c < 0x80 ? static_cast<unsigned>(c) : read_unsigned_ext(c);
     }
     uint64 read_uint64();
     int read_int() { return read_unsigned(); }
-    char read_char() { return m_in.get(); }
-    bool read_bool() { return m_in.get() != 0; }
+    char read_char() { return get(); }
+    bool read_bool() { return get() != 0; }
     double read_double();
     // read data.size() bytes from input stream and store it at data
     void read(std::vector<char> & data);
+    /** \brief Skip the next \c sz bytes, and return a pointer to them. \pre The deserializer was created for a block of memory. */
+    char const * read_block(size_t sz);
 };
 
 typedef extensible_object<deserializer_core> deserializer;
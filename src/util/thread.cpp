@@ -8,6 +8,7 @@ Author: Leonardo de Moura
 #include <pthread.h>
 #include <vector>
 #include <iostream>
+#include "util/debug.h"
 #include "util/thread.h"
 
 namespace lean {
@@ -31,6 +32,35 @@ void initialize_thread() {}
 void finalize_thread() {}
 #endif
 
+#if defined(LEAN_MULTI_THREAD)
+atomic<unsigned> g_rc_sharing(1);
+
+thread_confined_rc_scope::thread_confined_rc_scope() {
+    lean_assert(g_rc_sharing > 0);
+    g_rc_sharing--;
+}
+
+thread_confined_rc_scope::~thread_confined_rc_scope() {
+    g_rc_sharing++;
+}
+
+rc_sharing_scope::rc_sharing_scope():m_active(true) {
+    g_rc_sharing++;
+}
+
+void rc_sharing_scope::release() {
+    if (m_active) {
+        m_active = false;
+        g_rc_sharing--;
+    }
+}
+#else
+thread_confined_rc_scope::thread_confined_rc_scope() {}
+thread_confined_rc_scope::~thread_confined_rc_scope() {}
+rc_sharing_scope::rc_sharing_scope():m_active(false) {}
+void rc_sharing_scope::release() {}
+#endif
+
 typedef std::vector<std::pair<thread_finalizer, void*>> thread_finalizers;
 
 void run_thread_finalizers_core(thread_finalizers & fns) {
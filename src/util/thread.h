@@ -98,9 +98,14 @@ public:
     atomic & operator=(atomic const & v) { m_value = v.m_value; return *this; }
     atomic & operator=(atomic && v) { m_value = std::forward<T>(v.m_value); return *this; }
     operator T() const { return m_value; }
-    void store(T const & v) { m_value = v; }
-    T load() const { return m_value; }
+    void store(T const & v, int = 0) { m_value = v; }
+    T load(int = 0) const { return m_value; }
     atomic & operator|=(T const & v) { m_value |= v; return *this; }
+    bool compare_exchange_weak(T & expected, T const & v, int = 0) {
+        if (m_value == expected) { m_value = v; return true; }
+        expected = m_value;
+        return false;
+    }
     atomic & operator+=(T const & v) { m_value += v; return *this; }
     atomic & operator-=(T const & v) { m_value -= v; return *this; }
     atomic & operator++() { ++m_value; return *this; }
@@ -208,4 +213,39 @@ void register_thread_finalizer(thread_finalizer fn, void * p);
 void run_thread_finalizers();
 void run_post_thread_finalizers();
 void delete_thread_finalizer_manager();
+
+/** \brief Reference counted objects (e.g., expr, level and name) are \em thread-confined when only one thread
+    manipulates them. In this mode, reference counters are updated using non-atomic operations (see util/rc.h).
+
+    Objects are not thread-confined by default since clients (e.g., the C API) may share them with
+    threads we do not control. A client that owns all threads that manipulate reference counted objects
+    (e.g., the lean executable) should use thread_confined_rc_scope. The mode is disabled while
+    there are interruptible_thread objects that have not been joined.
+
+    \remark g_rc_sharing is the number of reasons for not using thread-confined mode. */
+#if defined(LEAN_MULTI_THREAD)
+extern atomic<unsigned> g_rc_sharing;
+inline bool is_rc_thread_confined() { return g_rc_sharing.load(memory_order_relaxed) == 0; }
+#else
+inline bool is_rc_thread_confined() { return true; }
+#endif
+
+/** \brief Enable thread-confined reference counting in the scope of this object.
+    \pre There are no other threads manipulating reference counted objects. */
+class thread_confined_rc_scope {
+public:
+    thread_confined_rc_scope();
+    ~thread_confined_rc_scope();
+};
+
+/** \brief Disable thread-confined reference counting until \c release is invoked or this object is destroyed.
+    It must be created before starting a thread that may manipulate reference counted objects, and
+    released after the thread is joined. */
+class rc_sharing_scope {
+    bool m_active;
+public:
+    rc_sharing_scope();
+    ~rc_sharing_scope() { release(); }
+    void release();
+};
 }
@@ -5,26 +5,27 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Author: Leonardo de Moura
 */
 #pragma once
-#include <time.h>
+#include <chrono>
 #include <string>
 #include <iostream>
 #include <iomanip>
 
 namespace lean {
-/** \brief Low tech timer for used for testing. */
+/** \brief Low tech timer for used for testing.
+    We use wall clock time because clock() accumulates the time of all threads. */
 class timeit {
     std::ostream & m_out;
     std::string    m_msg;
     double         m_threshold; // we only display the result if time > m_threshold
-    clock_t        m_start;
+    std::chrono::steady_clock::time_point m_start;
 public:
     timeit(std::ostream & out, char const * msg, double threshold):m_out(out), m_msg(msg), m_threshold(threshold) {
-        m_start = clock();
+        m_start = std::chrono::steady_clock::now();
     }
     timeit(std::ostream & out, char const * msg):timeit(out, msg, -0.1) {}
     ~timeit() {
-        clock_t end = clock();
-        double result = ((static_cast<double>(end) - static_cast<double>(m_start)) / CLOCKS_PER_SEC);
+        auto end = std::chrono::steady_clock::now();
+        double result = std::chrono::duration<double>(end - m_start).count();
         if (result > m_threshold) {
             m_out << m_msg << " " << std::fixed << std::setprecision(5) << result << " secs\n";
         }
@@ -0,0 +1,21 @@
+definition f (n : nat) : nat := n + 1
+
+definition g {A : Type} [has_add A] (a : A) : A := a + a
+
+meta_definition h : nat → nat
+| 0     := 1
+| (n+1) := h n * 2
+
+definition k : nat → nat
+| 0     := 0
+| (n+1) := k n + 2
+
+example : f 1 = 2 := rfl
+
+lemma f_eq (n : nat) : f n = n + 1 := rfl
+
+definition bad : nat := tt
+
+#check g (f 2)
+vm_eval h 3
+vm_eval k 3
@@ -0,0 +1,40 @@
+#!/usr/bin/env bash
+if [ $# -ne 2 ]; then
+    echo "Usage: test_single.sh [lean-executable-path] [file]"
+    exit 1
+fi
+ulimit -s 8192
+LEAN=$1
+export LEAN_PATH=../../../library:.
+f=$2
+cache="$f.cache"
+copy="copy_$f"
+
+echo "-- testing $f"
+rm -rf "$cache"
+# The first run populates the cache, and the second one must produce the same messages using it.
+{
+    echo "-- first run"
+    "$LEAN" --cache="$cache" "$f"
+    echo "-- second run"
+    "$LEAN" --cache="$cache" "$f"
+    echo "-- number of cached definitions: $(ls "$cache" | grep -c '\.def$')"
+    # A different file with the same definitions reuses the entries instead of creating new ones.
+    cp "$f" "$copy"
+    echo "-- copy"
+    "$LEAN" --cache="$cache" "$copy" | sed "s/^$copy/$f/"
+    echo "-- number of cached definitions: $(ls "$cache" | grep -c '\.def$')"
+} &> "$f.produced.out"
+rm -rf "$cache" "$copy"
+if test -f "$f.expected.out"; then
+    if diff --ignore-all-space "$f.produced.out" "$f.expected.out"; then
+        echo "-- checked"
+        exit 0
+    else
+        echo "ERROR: file $f.produced.out does not match $f.expected.out"
+        exit 1
+    fi
+else
+    echo "ERROR: file $f.expected.out does not exist"
+    exit 1
+fi
@@ -0,0 +1,17 @@
+structure [class] foo (A : Type) := (val : A)
+structure [class] bar (A : Type) := (val : A)
+
+attribute [instance]
+definition foo_nat : foo nat := foo.mk 0
+attribute [instance]
+definition foo_bool : foo bool := foo.mk tt
+attribute [instance]
+definition foo_list (A : Type) [foo A] : foo (list A) := foo.mk [foo.val A]
+attribute [instance]
+definition foo_of_bar (A : Type) [bar A] : foo A := foo.mk (bar.val A)
+
+set_option trace.class_instances.discr_tree true
+
+check foo.val nat
+check foo.val (list bool)
+check λ A : Type, foo.val (list A)
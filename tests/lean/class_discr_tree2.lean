@@ -0,0 +1,22 @@
+structure [class] foo (A : Type) := (val : A)
+
+definition my_nat := nat
+
+attribute [instance]
+definition foo_my_nat : foo my_nat := foo.mk nat.zero
+attribute [instance]
+definition foo_bool : foo bool := foo.mk tt
+
+set_option trace.class_instances.discr_tree true
+
+-- my_nat is not reducible yet
+check foo.val nat
+
+-- the key of foo_my_nat must not depend on the reducibility of my_nat
+attribute [reducible] my_nat
+check foo.val nat
+
+section
+local attribute [irreducible] my_nat
+check foo.val my_nat
+end
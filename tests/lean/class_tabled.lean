@@ -0,0 +1,24 @@
+structure [class] foo (A : Type) := (val : A)
+structure [class] bar (A : Type) := (val : A)
+structure [class] baz (A : Type) := (val : A)
+
+attribute [instance]
+definition foo_of_bar (A : Type) [bar A] : foo A := foo.mk (bar.val A)
+attribute [instance]
+definition bar_of_foo (A : Type) [foo A] : bar A := bar.mk (foo.val A)
+
+-- The cycle foo nat -> bar nat -> foo nat is detected
+check foo.val nat
+
+attribute [instance]
+definition baz_nat : baz nat := baz.mk 0
+
+-- The cached failure is not affected by instances of baz
+check foo.val nat
+
+attribute [instance]
+definition bar_nat : bar nat := bar.mk 1
+
+-- but it is affected by the new instance of bar
+check foo.val nat
+check bar.val nat
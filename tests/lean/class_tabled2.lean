@@ -0,0 +1,17 @@
+structure [class] foo (A : Type) := (val : A)
+structure [class] bar (A : Type) (s : foo A) := (val : A)
+structure [class] baz (A : Type) := (val : A)
+
+attribute [instance]
+definition foo2 : foo nat := foo.mk 2
+attribute [instance]
+definition foo1 : foo nat := foo.mk 1
+attribute [instance]
+definition bar2 : bar nat foo2 := @bar.mk nat foo2 2
+attribute [instance]
+definition baz_of_bar (A : Type) [s : foo A] [bar A s] : baz A := baz.mk (foo.val A)
+
+-- The first answer for foo nat is foo1, but bar nat foo1 has no instance
+vm_eval baz.val nat
+-- The first answer is still used when it works
+vm_eval foo.val nat
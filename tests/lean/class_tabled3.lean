@@ -0,0 +1,30 @@
+-- Each level has two answers for d, and c only has an instance for the second one. Without answer reuse,
+-- every backtrack into the sub-goal d (box A) enumerates the answers of d A again, and the search is
+-- exponential in the number of levels.
+set_option class.instance_max_depth 256
+
+structure box (A : Type) := (val : A)
+
+structure [class] d (A : Type) := (val : nat)
+structure [class] c (A : Type) (x : d A) := (val : nat)
+
+attribute [instance]
+definition d_unit_2 : d unit := d.mk unit 2
+attribute [instance]
+definition d_unit_1 : d unit := d.mk unit 1
+attribute [instance]
+definition c_unit : c unit d_unit_2 := @c.mk unit d_unit_2 0
+
+attribute [instance]
+definition d_box_2 (A : Type) [x : d A] [c A x] : d (box A) := d.mk (box A) 2
+attribute [instance]
+definition d_box_1 (A : Type) [x : d A] [c A x] : d (box A) := d.mk (box A) 1
+attribute [instance]
+definition c_box (A : Type) (x : d A) (h : c A x) : c (box A) (@d_box_2 A x h) :=
+@c.mk (box A) (@d_box_2 A x h) 0
+
+structure [class] top (A : Type) := (val : nat)
+attribute [instance]
+definition top_of (A : Type) [x : d A] [c A x] : top A := top.mk A (@d.val A x)
+
+vm_eval top.val (box (box (box (box (box (box (box (box (box (box (box (box (box (box (box (box (box (box (box (box (box (box (box (box unit))))))))))))))))))))))))
@@ -0,0 +1,11 @@
+-- environment.fold visits the declarations in the order of their names, not in the order they were added
+meta_definition e := environment.mk_std 0
+
+definition hints := reducibility_hints.regular 10 tt
+
+vm_eval do
+   e₁ ← environment.add e (declaration.defn `c [] (expr.sort (level.succ level.zero)) (expr.sort level.zero) hints tt),
+   e₂ ← environment.add e₁ (declaration.defn `a.b [] (expr.sort (level.succ level.zero)) (expr.sort level.zero) hints tt),
+   e₃ ← environment.add e₂ (declaration.defn `b [] (expr.sort (level.succ level.zero)) (expr.sort level.zero) hints tt),
+   e₄ ← environment.add e₃ (declaration.defn `a [] (expr.sort (level.succ level.zero)) (expr.sort level.zero) hints tt),
+   exceptional.success (environment.fold e₄ ([] : list name) (λ d r, r ++ [declaration.to_name d]))
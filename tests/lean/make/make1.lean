@@ -0,0 +1,3 @@
+import .make1_src.d
+print "make1"
+vm_eval d
@@ -0,0 +1,2 @@
+print "a"
+definition a : nat := 1
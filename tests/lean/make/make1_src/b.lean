@@ -0,0 +1,3 @@
+import .a
+print "b"
+definition b : nat := a + 1
@@ -0,0 +1,3 @@
+import .a
+print "c"
+definition c : nat := a + 2
@@ -0,0 +1,3 @@
+import .b .c
+print "d"
+definition d : nat := b + c
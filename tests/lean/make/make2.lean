@@ -0,0 +1,2 @@
+import .make2_src.ok .make2_src.user
+print "make2"
@@ -0,0 +1,2 @@
+print "bad"
+definition bad : nat := tt
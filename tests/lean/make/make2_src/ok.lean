@@ -0,0 +1,2 @@
+print "ok"
+definition ok : nat := 1
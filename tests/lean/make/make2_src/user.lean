@@ -0,0 +1,3 @@
+import .bad
+print "user"
+definition user : nat := bad
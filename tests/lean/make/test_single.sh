@@ -0,0 +1,42 @@
+#!/usr/bin/env bash
+if [ $# -ne 2 ]; then
+    echo "Usage: test_single.sh [lean-executable-path] [file]"
+    exit 1
+fi
+ulimit -s 8192
+LEAN=$1
+export LEAN_PATH=../../../library:.
+f=$2
+src="${f%.lean}_src"
+
+echo "-- testing $f"
+rm -f "${f%.lean}.olean" "$src"/*.olean
+# The modules imported by $f are in the directory $src.
+# The second run must not process any module, and the third one must only process the last module in $src
+# and the modules that depend on it.
+{
+    echo "-- first run"
+    "$LEAN" --make "$f"
+    echo "-- exit code: $?"
+    echo "-- second run"
+    "$LEAN" --make "$f"
+    echo "-- exit code: $?"
+    last=$(ls "$src"/*.lean | sort | tail -n 1)
+    echo "-- removing the .olean file of $last"
+    rm -f "${last%.lean}.olean"
+    "$LEAN" --make "$f"
+    echo "-- exit code: $?"
+} 2>&1 | sed "s|$(pwd)/||g" > "$f.produced.out"
+rm -f "${f%.lean}.olean" "$src"/*.olean
+if test -f "$f.expected.out"; then
+    if diff --ignore-all-space "$f.produced.out" "$f.expected.out"; then
+        echo "-- checked"
+        exit 0
+    else
+        echo "ERROR: file $f.produced.out does not match $f.expected.out"
+        exit 1
+    fi
+else
+    echo "ERROR: file $f.expected.out does not exist"
+    exit 1
+fi
@@ -0,0 +1,4 @@
+meta_definition fib : nat → nat
+| 0     := 1
+| 1     := 1
+| (n+2) := fib n + fib (n+1)
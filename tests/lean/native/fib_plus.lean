@@ -0,0 +1,4 @@
+import .fib
+-- Bytecode from another module calling fib: a regular call, and a tail call
+meta_definition fib_plus (n : nat) : nat := fib n + 1
+meta_definition fib_tail (n : nat) : nat := fib n
@@ -0,0 +1,3 @@
+import .fib_plus
+vm_eval fib_plus 10
+vm_eval fib_tail 10
@@ -0,0 +1,2 @@
+import .fib
+vm_eval fib 25
@@ -0,0 +1,10 @@
+open array
+
+-- The recursive call is not a tail call, so the native count recurses on the C++ stack
+meta_definition count : nat → nat
+| 0     := 0
+| (n+1) := count n + 1
+
+meta_definition fill : nat → array nat → array nat
+| 0     a := a
+| (n+1) a := fill n (write a n (n * 2))
@@ -0,0 +1,6 @@
+import .rec
+vm_eval count 1000
+vm_eval count 10000000
+-- The VM keeps a reference to the arguments of the native fill, so only the first write copies the array
+set_option trace.vm.array true
+vm_eval array.to_list (fill 3 (array.mk 3 1))
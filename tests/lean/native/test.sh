@@ -0,0 +1,52 @@
+#!/usr/bin/env bash
+if [ $# -ne 2 ]; then
+    echo "Usage: test.sh [lean-executable-path] [c++-compiler-command]"
+    exit 1
+fi
+ulimit -s 8192
+LEAN=$1
+CXX=$2
+SRC=`pwd`
+export LEAN_PATH=$SRC/../../../library:.
+TMP=`mktemp -d`
+cp fib.lean fib_plus.lean fib_plus_main.lean main.lean rec.lean rec_main.lean "$TMP"
+cd "$TMP"
+
+# Round trip: generate C++ for fib.lean, compile it as a shared object, and load it when running
+# main.lean. The profiler reports a single call to the native fib since its recursive calls do not
+# go through the VM. Bytecode compiled in another module, before the native code was loaded, must
+# also call the native fib, both in regular and in tail position. Deep recursion in native code
+# must be reported as in the VM, and arguments passed to native code must not be shared needlessly.
+{
+    "$LEAN" --make fib.lean
+    "$LEAN" --cpp=fib.cpp fib.lean
+    $CXX -w -fPIC -shared fib.cpp -o fib.so || echo "-- failed to compile fib.cpp"
+    "$LEAN" --native=./fib.so main.lean
+    echo "-- exit code: $?"
+    echo "-- profile"
+    "$LEAN" --native=./fib.so --profile-vm main.lean | awk '$NF == "fib" { print "fib calls:", $3 }'
+    echo "-- called from another module"
+    "$LEAN" --make fib_plus.lean
+    "$LEAN" --native=./fib.so fib_plus_main.lean
+    echo "-- exit code: $?"
+    echo "-- deep recursion and arrays"
+    "$LEAN" --make rec.lean
+    "$LEAN" --cpp=rec.cpp rec.lean
+    $CXX -w -fPIC -shared rec.cpp -o rec.so || echo "-- failed to compile rec.cpp"
+    "$LEAN" --native=./rec.so rec_main.lean
+    echo "-- exit code: $?"
+    echo "-- out of date"
+    sed -i "s/fib n + fib (n+1)/fib (n+1) + fib n/" fib.lean
+    "$LEAN" --make fib.lean
+    "$LEAN" --native=./fib.so main.lean
+    echo "-- exit code: $?"
+} &> "$SRC/main.lean.produced.out"
+cd "$SRC"
+rm -rf "$TMP"
+if diff --ignore-all-space main.lean.produced.out main.lean.expected.out; then
+    echo "-- checked"
+    exit 0
+else
+    echo "ERROR: file main.lean.produced.out does not match main.lean.expected.out"
+    exit 1
+fi
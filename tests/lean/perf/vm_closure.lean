@@ -0,0 +1,12 @@
+-- VM micro-benchmark: partial applications and apply
+meta_definition add3 (a b c : nat) : nat :=
+a + b + c
+
+meta_definition f : nat → nat :=
+add3 1 2
+
+meta_definition iter : nat → nat → nat
+| 0     a := a
+| (n+1) a := iter n (f a)
+
+vm_eval timeit "vm_closure" (λ u, iter 3000000 0)
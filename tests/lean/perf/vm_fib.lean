@@ -0,0 +1,6 @@
+-- VM micro-benchmark: function calls and nat arithmetic
+meta_definition fib : nat → nat
+| 0     := 1
+| (n+1) := nat.cases_on n 1 (λ m, fib m + fib (m+1))
+
+vm_eval timeit "vm_fib" (λ u, fib 27)
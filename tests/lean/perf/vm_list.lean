@@ -0,0 +1,12 @@
+-- VM micro-benchmark: constructors, cases and closures
+open list
+
+meta_definition mk_list : nat → list nat → list nat
+| 0     l := l
+| (n+1) l := mk_list n (n :: l)
+
+meta_definition list_sum : list nat → nat → nat
+| []     s := s
+| (a::l) s := list_sum l (s + a)
+
+vm_eval timeit "vm_list" (λ u, list_sum (map (λ x, x + 1) (mk_list 1000000 [])) 0)
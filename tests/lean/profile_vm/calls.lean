@@ -0,0 +1,14 @@
+meta_definition loop : nat → nat → nat
+| 0     r := r
+| (n+1) r := loop n (r + 1)
+
+meta_definition even_odd : bool → nat → bool
+| b 0     := b
+| b (n+1) := even_odd (bool.bnot b) n
+
+meta_definition twice (f : nat → nat) (n : nat) : nat :=
+f (f n)
+
+vm_eval loop 1000 0
+vm_eval even_odd tt 1001
+vm_eval twice (λ n, loop n 0) 10
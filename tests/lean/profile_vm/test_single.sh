@@ -0,0 +1,43 @@
+#!/usr/bin/env bash
+if [ $# -ne 2 ]; then
+    echo "Usage: test_single.sh [lean-executable-path] [file]"
+    exit 1
+fi
+ulimit -s 8192
+LEAN=$1
+export LEAN_PATH=../../../library:.
+f=$2
+
+echo "-- testing $f"
+# The profiler output depends on the library and on timings. So, we only check its structure:
+# every function defined in $f must be listed, and its number of calls and executed
+# instructions must be nonzero.
+fns=`sed -n 's/^meta_definition \([^ ]*\) .*/\1/p' "$f"`
+"$LEAN" --profile-vm "$f" 2>&1 | awk -v fns="$fns" '
+    BEGIN                { n = split(fns, names) }
+    /^vm profile$/       { print; profile = 1; next }
+    !profile             { print; next }
+    $1 == "self"         { next }
+    $1 ~ /^[0-9.]+$/     { fn = $6; calls[fn] = $3; next }
+                         { for (i = 2; i <= NF; i += 2) instrs[fn] += $i }
+    END {
+        for (i = 1; i <= n; i++) {
+            fn = names[i]
+            if (!(fn in calls))
+                print fn ": missing"
+            else
+                print fn ": calls " (calls[fn] > 0 ? "ok" : "zero") ", instructions " (instrs[fn] > 0 ? "ok" : "zero")
+        }
+    }' > "$f.produced.out"
+if test -f "$f.expected.out"; then
+    if diff --ignore-all-space "$f.produced.out" "$f.expected.out"; then
+        echo "-- checked"
+        exit 0
+    else
+        echo "ERROR: file $f.produced.out does not match $f.expected.out"
+        exit 1
+    fi
+else
+    echo "ERROR: file $f.expected.out does not exist"
+    exit 1
+fi
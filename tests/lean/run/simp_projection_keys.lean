@@ -0,0 +1,14 @@
+open tactic
+
+structure point := (x : nat) (y : nat)
+
+constants (f g : nat → nat)
+-- The left-hand-side of Hf contains a projection of a constructor application
+constant Hf : ∀ a : nat, f (point.x (point.mk a 0)) = a
+-- The left-hand-side of Hg contains a recursor application
+constant Hg : ∀ a : nat, g (@nat.rec (λ n, nat) a (λ n r, r) nat.zero) = a
+attribute Hf Hg [simp]
+
+-- projections and recursors are reduced by the unifier, so they must not be used as keys
+example (a : nat) : f a = a := by simp
+example (a : nat) : g a = a := by simp
@@ -0,0 +1,12 @@
+-- The recursive calls are tail calls, so the VM call stack does not grow.
+-- Without tail calls, these functions exceed the maximum VM call stack size.
+meta_definition loop : nat → nat → nat
+| 0     r := r
+| (n+1) r := loop n (r + 1)
+
+meta_definition even_odd : bool → nat → bool
+| b 0     := b
+| b (n+1) := even_odd (bool.bnot b) n
+
+vm_eval loop 2000000 0
+vm_eval even_odd tt 2000001
@@ -0,0 +1,8 @@
+definition f (n : nat) : nat := n + 1
+
+check f
+
+definition g (n : nat) : nat := f n + 1
+
+check g 2
+check h
@@ -0,0 +1,6 @@
+namespace foo
+variable (A : Type)
+definition id (a : A) : A := a
+check id
+end foo
+check foo.id
@@ -0,0 +1,24 @@
+#!/usr/bin/env bash
+if [ $# -ne 2 ]; then
+    echo "Usage: test_single.sh [lean-executable-path] [file]"
+    exit 1
+fi
+ulimit -s 8192
+LEAN=$1
+export LEAN_PATH=../../../library:.
+f=$2
+
+echo "-- testing $f"
+"$LEAN" --server < "$f" &> "$f.produced.out"
+if test -f "$f.expected.out"; then
+    if diff --ignore-all-space "$f.produced.out" "$f.expected.out"; then
+        echo "-- checked"
+        exit 0
+    else
+        echo "ERROR: file $f.produced.out does not match $f.expected.out"
+        exit 1
+    fi
+else
+    echo "ERROR: file $f.expected.out does not exist"
+    exit 1
+fi
@@ -0,0 +1,18 @@
+open tactic
+
+constants (A : Type) (f g h : A → A) (a b c d : A)
+constants (Ha : f a = b) (Hb : f b = c) (Hc : f c = d)
+constants (Hgb : g b = c) (Hg : ∀ x, g x = d)
+attribute Ha Hb Hc Hgb Hg [simp]
+constants (Hh : ∀ x, h x = d) (Hhb : h b = c)
+attribute Hh Hhb [simp]
+
+set_option trace.simplifier.stats true
+
+-- the other lemmas for f are pruned by the discrimination tree
+example : f a = b := by simp
+
+-- the lemmas of different leaves are tried from the most recent to the oldest one
+example : g b = d := by simp
+example : h b = c := by simp
+example : g a = d := by simp
@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+if [ $# -ne 2 ]; then
+    echo "Usage: test_single.sh [lean-executable-path] [file]"
+    exit 1
+fi
+ulimit -s 8192
+LEAN=$1
+export LEAN_PATH=../../../library:.
+f=$2
+
+echo "-- testing $f"
+# The theorems are elaborated by auxiliary threads. The second run checks that the time spent by the
+# auxiliary threads is accounted by the profiler, it only keeps the number of times each phase was entered.
+{
+    "$LEAN" -j 4 "$f"
+    echo "-- exit code: $?"
+    echo "-- profile"
+    "$LEAN" -j 4 --profile "$f" | grep -E "^(elaboration|type checking) " | sed -E "s/[0-9]+\.[0-9]+//g" | sort
+} &> "$f.produced.out"
+if test -f "$f.expected.out"; then
+    if diff --ignore-all-space "$f.produced.out" "$f.expected.out"; then
+        echo "-- checked"
+        exit 0
+    else
+        echo "ERROR: file $f.produced.out does not match $f.expected.out"
+        exit 1
+    fi
+else
+    echo "ERROR: file $f.expected.out does not exist"
+    exit 1
+fi
@@ -0,0 +1,20 @@
+universe variable u
+variables {α : Type u} [has_add α]
+
+theorem foo1 (a b : α) (h : a = b) : a + b = b + a :=
+h ▸ rfl
+
+theorem foo2 (a : nat) : a = a :=
+rfl
+
+theorem foo3 (a b : nat) : a + 0 = b :=
+rfl
+
+theorem foo4 {β : Type u} (f : β → β) (x : β) (h : ∀ y, f y = y) : f (f x) = x :=
+eq.trans (h (f x)) (h x)
+
+reveal foo1
+print axioms foo1
+print axioms foo4
+check @foo1
+check @foo4
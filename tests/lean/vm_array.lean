@@ -0,0 +1,28 @@
+open array
+
+meta_definition fill : nat → array nat → array nat
+| 0     a := a
+| (n+1) a := fill n (write a n (n * 2))
+
+meta_definition sum_array (a : array nat) : nat → nat → nat
+| 0     r := r
+| (n+1) r := sum_array n (r + read a n)
+
+vm_eval size (fill 100 (mk 100 0))
+vm_eval sum_array (fill 100 (mk 100 0)) 100 0
+vm_eval to_list (pop_back (push_back (of_list [1, 2, 3]) 4))
+
+-- `a` is used after `write`, so `write` must not modify it
+meta_definition write_keep (a : array nat) : list nat × list nat :=
+(to_list (write a 0 10), to_list a)
+
+-- `a` is not used after `write`
+meta_definition write_last (a : array nat) : list nat × list nat :=
+(to_list a, to_list (write a 0 10))
+
+set_option trace.vm.array true
+
+-- the VM stack holds the only reference to the array, so it is updated in place
+vm_eval to_list (fill 3 (mk 3 1))
+vm_eval write_last (mk 3 1)
+vm_eval write_keep (mk 3 1)
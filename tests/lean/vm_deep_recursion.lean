@@ -0,0 +1,7 @@
+-- The recursive call is not a tail call
+meta_definition count : nat → nat
+| 0     := 0
+| (n+1) := count n + 1
+
+vm_eval count 2000000
+vm_eval count 1000